@@ -0,0 +1,345 @@
+/* bitround.c
+ *
+ * Lossy bit-rounding pre-filter for IEEE floating-point data. See
+ * bitround.h for what it does and the error bounds.
+ *
+ * Rounding is integer arithmetic on the bit patterns: add just under half of
+ * the dropped range (plus one if the lowest kept bit is set, for ties to
+ * even), then clear the dropped bits. A carry out of the mantissa bumps the
+ * exponent, which is exactly the right answer. The filter works in place
+ * and allocates nothing.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+/* The HDF5 external plugin header */
+#include <H5PLextern.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITROUND_X86
+#endif
+
+#include "bitround.h"
+
+
+/* Filter parameters */
+#define BITROUND_PARM_SIZE          1   /* "Local" parameter for element size */
+#define BITROUND_USER_NPARMS        1   /* Number of parameters that users can set */
+#define BITROUND_TOTAL_NPARMS       2   /* Total number of parameters for filter */
+
+/* IEEE layouts */
+#define FLOAT_MANT_BITS             23
+#define FLOAT_EXP_MASK              UINT32_C(0x7F800000)
+#define DOUBLE_MANT_BITS            52
+#define DOUBLE_EXP_MASK             UINT64_C(0x7FF0000000000000)
+
+/* Filter callback prototypes */
+static htri_t can_apply_bitround(hid_t dcpl_id, hid_t type_id, hid_t space_id);
+static herr_t set_local_bitround(hid_t dcpl_id, hid_t type_id, hid_t space_id);
+static size_t filter_bitround(unsigned int flags, size_t cd_nelmts,
+        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
+        void **buf);
+
+/* Kernel prototypes */
+static void round_floats(uint32_t *values, size_t n, unsigned drop);
+static void round_doubles(uint64_t *values, size_t n, unsigned drop);
+
+
+/* Information about this filter
+ * H5Z_class2_t is defined in H5Zpublic.h
+ */
+const H5Z_class2_t BITROUND_CLASS[1] = {{
+    H5Z_CLASS_T_VERS,                       /* Filter class version */
+    BITROUND_ID,                            /* Filter id number */
+    1,                                      /* encoder_present flag */
+    1,                                      /* decoder_present flag */
+    "bitround",                             /* Filter name for debugging */
+    can_apply_bitround,                     /* The "can apply" callback */
+    set_local_bitround,                     /* The "set local" callback */
+    (H5Z_func_t)filter_bitround,            /* The actual filter function */
+}};
+
+
+/* The plugin functions you must implement when you include H5PLextern.h */
+H5PL_type_t H5PLget_plugin_type(void) { return H5PL_TYPE_FILTER; }
+const void *H5PLget_plugin_info(void) { return BITROUND_CLASS; }
+
+
+/* Only little-endian IEEE float and double datasets */
+static htri_t
+can_apply_bitround(hid_t dcpl_id, hid_t type_id, hid_t space_id)
+{
+    size_t spos, epos, esize, mpos, msize;
+
+    (void)dcpl_id;
+    (void)space_id;
+
+    if (H5T_FLOAT != H5Tget_class(type_id))
+        return 0;
+    if (H5T_ORDER_LE != H5Tget_order(type_id))
+        return 0;
+    if (H5Tget_fields(type_id, &spos, &epos, &esize, &mpos, &msize) < 0)
+        return -1;
+
+    if (4 == H5Tget_size(type_id))
+        return 31 == spos && 8 == esize && 0 == mpos && FLOAT_MANT_BITS == msize;
+    if (8 == H5Tget_size(type_id))
+        return 63 == spos && 11 == esize && 0 == mpos && DOUBLE_MANT_BITS == msize;
+
+    return 0;
+} /* end can_apply_bitround() */
+
+
+static herr_t
+set_local_bitround(hid_t dcpl_id, hid_t type_id, hid_t space_id)
+{
+    unsigned flags;                             /* Filter flags */
+    size_t type_size;                           /* Datatype size */
+    size_t cd_nelmts = BITROUND_USER_NPARMS;    /* # of filter parameters */
+    unsigned cd_values[BITROUND_TOTAL_NPARMS];  /* Filter parameters */
+
+    (void)space_id;
+
+    /* Get the filter's current parameters */
+    if (H5Pget_filter_by_id(dcpl_id, BITROUND_ID, &flags, &cd_nelmts, cd_values, (size_t)0, NULL, NULL) < 0)
+        goto error;
+
+    /* The number of bits to keep is required */
+    if (cd_nelmts < BITROUND_USER_NPARMS)
+        goto error;
+
+    /* Get the type size */
+    if (0 == (type_size = H5Tget_size(type_id)))
+        goto error;
+    if (cd_values[BITROUND_PARM_KEEP_BITS] > (4 == type_size ? FLOAT_MANT_BITS : DOUBLE_MANT_BITS))
+        goto error;
+
+    /* Set "local" parameter for this dataset */
+    cd_values[BITROUND_PARM_SIZE] = (unsigned)type_size;
+
+    /* Modify the filter's parameters for this dataset */
+    if (H5Pmodify_filter(dcpl_id, BITROUND_ID, flags, (size_t)BITROUND_TOTAL_NPARMS, cd_values) < 0)
+        goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end set_local_bitround() */
+
+
+static size_t
+filter_bitround(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    unsigned keep_bits;
+    unsigned size;
+
+    (void)buf_size;
+
+    /* Check arguments */
+    if (cd_nelmts != BITROUND_TOTAL_NPARMS)
+        goto error;
+    keep_bits = cd_values[BITROUND_PARM_KEEP_BITS];
+    size = cd_values[BITROUND_PARM_SIZE];
+    if ((4 != size && 8 != size) || nbytes % size)
+        goto error;
+
+    /* Nothing to undo on read */
+    if (flags & H5Z_FLAG_REVERSE)
+        return nbytes;
+
+    if (4 == size) {
+        if (keep_bits > FLOAT_MANT_BITS)
+            goto error;
+        if (keep_bits < FLOAT_MANT_BITS)
+            round_floats((uint32_t *)*buf, nbytes / 4, FLOAT_MANT_BITS - keep_bits);
+    }
+    else {
+        if (keep_bits > DOUBLE_MANT_BITS)
+            goto error;
+        if (keep_bits < DOUBLE_MANT_BITS)
+            round_doubles((uint64_t *)*buf, nbytes / 8, DOUBLE_MANT_BITS - keep_bits);
+    }
+
+    return nbytes;
+
+error:
+    return 0;
+} /* end filter_bitround() */
+
+
+/**********/
+/* SCALAR */
+/**********/
+
+/* Rounds one value, dropping drop (>= 1) trailing mantissa bits. Values
+ * whose exponent is all ones (Inf/NaN) are left alone, and a value that
+ * would round up to infinity is truncated instead.
+ */
+#define ROUND_ONE(x, drop, one, exp_mask)                                   \
+    do {                                                                    \
+        if (((x) & (exp_mask)) != (exp_mask)) {                             \
+            __typeof__(x) _keep = ~(((one) << (drop)) - 1);                 \
+            __typeof__(x) _r = (x) + ((one) << ((drop) - 1)) - 1            \
+                + (((x) >> (drop)) & 1);                                    \
+                                                                            \
+            if ((_r & (exp_mask)) == (exp_mask))                            \
+                _r = (x);                                                   \
+            (x) = _r & _keep;                                               \
+        }                                                                   \
+    } while (0)
+
+static void
+round_floats_scalar(uint32_t *values, size_t n, unsigned drop)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        ROUND_ONE(values[i], drop, UINT32_C(1), FLOAT_EXP_MASK);
+} /* end round_floats_scalar() */
+
+static void
+round_doubles_scalar(uint64_t *values, size_t n, unsigned drop)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        ROUND_ONE(values[i], drop, UINT64_C(1), DOUBLE_EXP_MASK);
+} /* end round_doubles_scalar() */
+
+
+/********/
+/* AVX2 */
+/********/
+
+#ifdef BITROUND_X86
+
+/* The same arithmetic as ROUND_ONE, 8 floats or 4 doubles at a time */
+__attribute__((target("avx2")))
+static size_t
+round_floats_avx2(uint32_t *values, size_t n, unsigned drop)
+{
+    const __m256i exp_mask = _mm256_set1_epi32((int)FLOAT_EXP_MASK);
+    const __m256i keep = _mm256_set1_epi32((int)~((UINT32_C(1) << drop) - 1));
+    const __m256i half = _mm256_set1_epi32((int)((UINT32_C(1) << (drop - 1)) - 1));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m128i shift = _mm_cvtsi32_si128((int)drop);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(values + i));
+        __m256i odd = _mm256_and_si256(_mm256_srl_epi32(x, shift), one);
+        __m256i r = _mm256_add_epi32(_mm256_add_epi32(x, half), odd);
+
+        /* Rounded up into Inf/NaN: truncate. Already Inf/NaN: leave alone. */
+        __m256i overflow = _mm256_cmpeq_epi32(_mm256_and_si256(r, exp_mask), exp_mask);
+        __m256i special = _mm256_cmpeq_epi32(_mm256_and_si256(x, exp_mask), exp_mask);
+
+        r = _mm256_blendv_epi8(r, x, overflow);
+        r = _mm256_and_si256(r, keep);
+        r = _mm256_blendv_epi8(r, x, special);
+
+        _mm256_storeu_si256((__m256i *)(values + i), r);
+    }
+
+    return i;
+} /* end round_floats_avx2() */
+
+__attribute__((target("avx2")))
+static size_t
+round_doubles_avx2(uint64_t *values, size_t n, unsigned drop)
+{
+    const __m256i exp_mask = _mm256_set1_epi64x((long long)DOUBLE_EXP_MASK);
+    const __m256i keep = _mm256_set1_epi64x((long long)~((UINT64_C(1) << drop) - 1));
+    const __m256i half = _mm256_set1_epi64x((long long)((UINT64_C(1) << (drop - 1)) - 1));
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m128i shift = _mm_cvtsi32_si128((int)drop);
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(values + i));
+        __m256i odd = _mm256_and_si256(_mm256_srl_epi64(x, shift), one);
+        __m256i r = _mm256_add_epi64(_mm256_add_epi64(x, half), odd);
+        __m256i overflow = _mm256_cmpeq_epi64(_mm256_and_si256(r, exp_mask), exp_mask);
+        __m256i special = _mm256_cmpeq_epi64(_mm256_and_si256(x, exp_mask), exp_mask);
+
+        r = _mm256_blendv_epi8(r, x, overflow);
+        r = _mm256_and_si256(r, keep);
+        r = _mm256_blendv_epi8(r, x, special);
+
+        _mm256_storeu_si256((__m256i *)(values + i), r);
+    }
+
+    return i;
+} /* end round_doubles_avx2() */
+
+static int
+have_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+} /* end have_avx2() */
+
+#endif /* BITROUND_X86 */
+
+
+static void
+round_floats(uint32_t *values, size_t n, unsigned drop)
+{
+    size_t done = 0;
+
+#ifdef BITROUND_X86
+    if (have_avx2())
+        done = round_floats_avx2(values, n, drop);
+#endif
+
+    round_floats_scalar(values + done, n - done, drop);
+} /* end round_floats() */
+
+static void
+round_doubles(uint64_t *values, size_t n, unsigned drop)
+{
+    size_t done = 0;
+
+#ifdef BITROUND_X86
+    if (have_avx2())
+        done = round_doubles_avx2(values, n, drop);
+#endif
+
+    round_doubles_scalar(values + done, n - done, drop);
+} /* end round_doubles() */
@@ -0,0 +1,79 @@
+/* bitround.h
+ *
+ * Public header for the bit-rounding filter, a lossy pre-filter for IEEE
+ * floating-point data.
+ *
+ * The filter rounds every value to the nearest value (ties to even) that
+ * has only keep_bits explicit mantissa bits and zeroes the remaining
+ * trailing bits. Those bits are noise for many fields, yet they make up
+ * most of what shuffle + a compressor have to encode. Put the filter before
+ * the shuffle filter in the pipeline. Nothing happens on read; the dropped
+ * bits are gone.
+ *
+ * Error bounds, for keep_bits = k:
+ *
+ *  - Normal values: |x' - x| <= 2^-(k+1) * 2^floor(log2|x|), so the
+ *    relative error |x' - x| / |x| is at most 2^-(k+1) (half an ulp at the
+ *    reduced precision).
+ *
+ *  - Subnormal values: |x' - x| is at most 2^(m-k-1) times the smallest
+ *    subnormal, where m is 23 (float) or 52 (double).
+ *
+ *  - Values that would round up past the largest finite value are
+ *    truncated instead (relative error below 2^-k), so nothing finite
+ *    becomes infinite.
+ *
+ *  - Zeros, infinities, and NaNs are unchanged. Signs are never changed.
+ *
+ * k = 23 (float) or 52 (double) leaves the data untouched.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _BITROUND_H
+#define _BITROUND_H
+
+/* The filter ID number (NOTE: Has nothing to do with HDF5 hid_t IDs)
+ */
+#define BITROUND_ID                 ((H5Z_filter_t)321)
+
+/* Filter parameters (cd_values)
+ *
+ * Users pass one value, the number of explicit mantissa bits to keep:
+ * 0-23 for float datasets, 0-52 for double datasets. It is required; there
+ * is no default amount of precision to throw away.
+ *
+ *  H5Pset_filter(dcpl_id, BITROUND_ID, H5Z_FLAG_MANDATORY, 1, &keep_bits);
+ *
+ * The element size is added when the dataset is created.
+ */
+#define BITROUND_PARM_KEEP_BITS     0
+
+#endif /* _BITROUND_H */
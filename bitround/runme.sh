@@ -0,0 +1,11 @@
+#!/bin/sh
+#
+# This really isn't necessary, but it makes it obvious that you need to set
+# the plugin path in order to find your fancy new filter plugin.
+export HDF5_PLUGIN_PATH="."
+
+# Lossless, then progressively fewer mantissa bits, all with gzip
+for keep_bits in 23 16 12 8
+do
+    ./bitround_test_program $keep_bits 1
+done
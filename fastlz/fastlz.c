@@ -0,0 +1,159 @@
+/* fastlz.c
+ *
+ * HDF5 filter plugin for the fast LZ codec.
+ *
+ * Each compressed chunk is a 5-byte header followed by the payload:
+ *
+ *      bytes 0-3   uncompressed size (little-endian)
+ *      byte  4     method: 0 = stored as is, 1 = fastlz block
+ *
+ * Chunks that don't shrink are stored as is rather than failing the
+ * filter, so the filter works the same whether or not it is optional.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+/* The HDF5 external plugin header */
+#include <H5PLextern.h>
+
+#include "fastlz.h"
+#include "fastlz_codec.h"
+
+/* Chunk header */
+#define HEADER_SIZE         5
+#define METHOD_STORED       0
+#define METHOD_FASTLZ       1
+
+/* The data conversion function for this filter */
+static size_t filter_fastlz(unsigned int flags, size_t cd_nelmts,
+        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
+        void **buf);
+
+
+/* Information about this filter
+ * H5Z_class2_t is defined in H5Zpublic.h
+ */
+const H5Z_class2_t FASTLZ_CLASS[1] = {{
+    H5Z_CLASS_T_VERS,                       /* Filter class version */
+    FASTLZ_ID,                              /* Filter id number */
+    1,                                      /* encoder_present flag */
+    1,                                      /* decoder_present flag */
+    "fastlz",                               /* Filter name for debugging */
+    NULL,                                   /* The "can apply" callback */
+    NULL,                                   /* The "set local" callback */
+    (H5Z_func_t)filter_fastlz,              /* The actual filter function */
+}};
+
+
+/* The plugin functions you must implement when you include H5PLextern.h */
+H5PL_type_t H5PLget_plugin_type(void) { return H5PL_TYPE_FILTER; }
+const void *H5PLget_plugin_info(void) { return FASTLZ_CLASS; }
+
+
+static size_t
+filter_fastlz(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    const uint8_t *src = (const uint8_t *)*buf;
+    uint8_t *dest = NULL;
+    size_t dest_size;                       /* Valid bytes in dest */
+    size_t alloc_size;                      /* Size of the dest allocation */
+
+    if (flags & H5Z_FLAG_REVERSE) {
+        /* Decompress data */
+        if (nbytes < HEADER_SIZE)
+            goto error;
+
+        dest_size = (size_t)src[0] | ((size_t)src[1] << 8)
+            | ((size_t)src[2] << 16) | ((size_t)src[3] << 24);
+        alloc_size = dest_size ? dest_size : 1;
+        if (NULL == (dest = (uint8_t *)malloc(alloc_size)))
+            goto error;
+
+        if (METHOD_FASTLZ == src[4]) {
+            if (fastlz_decompress(src + HEADER_SIZE, nbytes - HEADER_SIZE, dest, dest_size) < 0)
+                goto error;
+        }
+        else if (METHOD_STORED == src[4] && nbytes - HEADER_SIZE == dest_size)
+            memcpy(dest, src + HEADER_SIZE, dest_size);
+        else
+            goto error;
+    }
+    else {
+        /* Compress data */
+        unsigned acceleration = FASTLZ_ACCELERATION_DEFAULT;
+        size_t compressed;
+
+        if (cd_nelmts > FASTLZ_PARM_ACCELERATION)
+            acceleration = cd_values[FASTLZ_PARM_ACCELERATION];
+        if (nbytes > UINT32_MAX)
+            goto error;
+
+        /* A stored chunk always fits, so that's all we ever need */
+        dest_size = alloc_size = HEADER_SIZE + nbytes;
+        if (NULL == (dest = (uint8_t *)malloc(alloc_size)))
+            goto error;
+
+        dest[0] = (uint8_t)(nbytes & 0xFF);
+        dest[1] = (uint8_t)((nbytes >> 8) & 0xFF);
+        dest[2] = (uint8_t)((nbytes >> 16) & 0xFF);
+        dest[3] = (uint8_t)((nbytes >> 24) & 0xFF);
+
+        /* Anything that doesn't beat storing the chunk is a miss */
+        compressed = fastlz_compress(src, nbytes, dest + HEADER_SIZE, nbytes, acceleration);
+        if (compressed) {
+            dest[4] = METHOD_FASTLZ;
+            dest_size = HEADER_SIZE + compressed;
+        }
+        else {
+            dest[4] = METHOD_STORED;
+            memcpy(dest + HEADER_SIZE, src, nbytes);
+        }
+    }
+
+    /* Swap in the new buffer */
+    free(*buf);
+    *buf = dest;
+    *buf_size = alloc_size;
+
+    return dest_size;
+
+error:
+    free(dest);
+
+    return 0;
+} /* end filter_fastlz() */
@@ -0,0 +1,57 @@
+/* fastlz.h
+ *
+ * Public header for the fast LZ compression filter.
+ *
+ * The filter compresses each chunk with the in-tree LZ4-style codec in
+ * fastlz_codec.c. It trades some ratio for much higher throughput than
+ * deflate, which makes it a good partner for the shuffle filter when the
+ * write rate matters more than the last few percent of storage.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FASTLZ_H
+#define _FASTLZ_H
+
+/* The filter ID number (NOTE: Has nothing to do with HDF5 hid_t IDs)
+ */
+#define FASTLZ_ID                   ((H5Z_filter_t)322)
+
+/* Filter parameters (cd_values)
+ *
+ * Users may pass one optional value, the acceleration (default 1). Larger
+ * values search for matches less thoroughly: faster, but a lower ratio.
+ * 0 means the default and values are capped at 65536.
+ *
+ *  H5Pset_filter(dcpl_id, FASTLZ_ID, H5Z_FLAG_OPTIONAL, 1, &acceleration);
+ */
+#define FASTLZ_PARM_ACCELERATION    0
+
+#endif /* _FASTLZ_H */
@@ -0,0 +1,375 @@
+/* fastlz_bench.c
+ *
+ * In-memory benchmark of shuffle + fastlz against shuffle + gzip.
+ *
+ * Generates a few typical kinds of scientific data, splits them into
+ * chunks, and runs each chunk through a byte shuffle and then either the
+ * fastlz codec (at several accelerations) or zlib's deflate (at several
+ * levels), the way the HDF5 filter pipeline would. Reports the compression
+ * ratio and the write (shuffle + compress) and read (decompress + unshuffle)
+ * throughput in MiB/s of uncompressed data, best of several repetitions.
+ *
+ * Everything stays in memory so only the filters are measured; the HDF5
+ * library and the storage are left out.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "fastlz_codec.h"
+
+/* Defaults */
+#define MIB                     ((size_t)1024 * 1024)
+#define DEFAULT_CHUNK_SIZE      MIB
+#define DEFAULT_TOTAL_SIZE      (64 * MIB)
+#define DEFAULT_REPS            3
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+/* Test data */
+typedef struct dataset_t {
+    const char *name;
+    unsigned elem_size;
+    void (*fill)(uint8_t *buf, size_t n_bytes);
+} dataset_t;
+
+/* Codecs */
+typedef enum codec_t {
+    CODEC_FASTLZ,
+    CODEC_GZIP
+} codec_t;
+
+typedef struct config_t {
+    codec_t codec;
+    int level;                  /* acceleration or gzip level */
+} config_t;
+
+static const config_t configs[] = {
+    {CODEC_FASTLZ, 1},
+    {CODEC_FASTLZ, 4},
+    {CODEC_FASTLZ, 16},
+    {CODEC_GZIP, 1},
+    {CODEC_GZIP, 6}
+};
+#define N_CONFIGS               (sizeof(configs) / sizeof(configs[0]))
+
+
+/**************/
+/* TEST DATA  */
+/**************/
+
+static uint32_t
+next_random(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state;
+} /* end next_random() */
+
+/* 32-bit counter, like an index or a timestamp */
+static void
+fill_ramp_i32(uint8_t *buf, size_t n_bytes)
+{
+    int32_t *p = (int32_t *)buf;
+    size_t i;
+
+    for (i = 0; i < n_bytes / sizeof(*p); i++)
+        p[i] = (int32_t)i;
+} /* end fill_ramp_i32() */
+
+/* Smooth float field with noise in the low mantissa bits */
+static void
+fill_smooth_f32(uint8_t *buf, size_t n_bytes)
+{
+    float *p = (float *)buf;
+    uint32_t state = 1;
+    size_t i;
+
+    for (i = 0; i < n_bytes / sizeof(*p); i++) {
+        float x = (float)(i % 10000) * 0.01f;
+
+        p[i] = 0.5f * x * x - 3.0f * x + 1.0f
+            + ((float)(next_random(&state) >> 8) / 16777216.0f - 0.5f) * 1.0e-3f;
+    }
+} /* end fill_smooth_f32() */
+
+/* 16-bit detector counts: a slow random walk */
+static void
+fill_walk_i16(uint8_t *buf, size_t n_bytes)
+{
+    int16_t *p = (int16_t *)buf;
+    uint32_t state = 2;
+    int16_t v = 1000;
+    size_t i;
+
+    for (i = 0; i < n_bytes / sizeof(*p); i++) {
+        v = (int16_t)(v + (int)(next_random(&state) >> 29) - 3);
+        p[i] = v;
+    }
+} /* end fill_walk_i16() */
+
+static const dataset_t datasets[] = {
+    {"ramp i32", 4, fill_ramp_i32},
+    {"smooth f32", 4, fill_smooth_f32},
+    {"walk i16", 2, fill_walk_i16}
+};
+#define N_DATASETS              (sizeof(datasets) / sizeof(datasets[0]))
+
+
+/***********/
+/* FILTERS */
+/***********/
+
+/* Plain byte shuffle, the same transform as the library's shuffle filter */
+static void
+shuffle(const uint8_t *src, uint8_t *dest, size_t n_bytes, unsigned elem_size)
+{
+    size_t n_elems = n_bytes / elem_size;
+    size_t i;
+    unsigned j;
+
+    for (j = 0; j < elem_size; j++)
+        for (i = 0; i < n_elems; i++)
+            dest[j * n_elems + i] = src[i * elem_size + j];
+} /* end shuffle() */
+
+static void
+unshuffle(const uint8_t *src, uint8_t *dest, size_t n_bytes, unsigned elem_size)
+{
+    size_t n_elems = n_bytes / elem_size;
+    size_t i;
+    unsigned j;
+
+    for (j = 0; j < elem_size; j++)
+        for (i = 0; i < n_elems; i++)
+            dest[i * elem_size + j] = src[j * n_elems + i];
+} /* end unshuffle() */
+
+/* Returns the compressed size, or 0 on failure */
+static size_t
+compress_chunk(const config_t *config, const uint8_t *src, size_t n_bytes,
+        uint8_t *dest, size_t dest_size)
+{
+    if (CODEC_FASTLZ == config->codec)
+        return fastlz_compress(src, n_bytes, dest, dest_size, (unsigned)config->level);
+    else {
+        uLongf z_size = (uLongf)dest_size;
+
+        if (Z_OK != compress2(dest, &z_size, src, (uLong)n_bytes, config->level))
+            return 0;
+        return (size_t)z_size;
+    }
+} /* end compress_chunk() */
+
+static int
+decompress_chunk(const config_t *config, const uint8_t *src, size_t n_bytes,
+        uint8_t *dest, size_t dest_size)
+{
+    if (CODEC_FASTLZ == config->codec)
+        return fastlz_decompress(src, n_bytes, dest, dest_size);
+    else {
+        uLongf z_size = (uLongf)dest_size;
+
+        if (Z_OK != uncompress(dest, &z_size, src, (uLong)n_bytes) || z_size != dest_size)
+            return -1;
+        return 0;
+    }
+} /* end decompress_chunk() */
+
+
+/*********/
+/* BENCH */
+/*********/
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+} /* end now() */
+
+/* Runs one dataset through one configuration */
+static int
+bench(const dataset_t *dset, const config_t *config, const uint8_t *data,
+        size_t total_size, size_t chunk_size, int reps, uint8_t *compressed,
+        size_t *compressed_sizes, uint8_t *scratch, uint8_t *out)
+{
+    size_t n_chunks = total_size / chunk_size;
+    size_t stride = FASTLZ_COMPRESS_BOUND(chunk_size) + 64;
+    size_t stored = 0;
+    double best_write = 0.0;
+    double best_read = 0.0;
+    size_t c;
+    int r;
+
+    for (r = 0; r < reps; r++) {
+        double t0, t1, t2;
+
+        t0 = now();
+        for (c = 0; c < n_chunks; c++) {
+            shuffle(data + c * chunk_size, scratch, chunk_size, dset->elem_size);
+            if (0 == (compressed_sizes[c] = compress_chunk(config, scratch, chunk_size, compressed + c * stride, stride)))
+                PROGRAM_ERROR("compression failed");
+        }
+        t1 = now();
+        for (c = 0; c < n_chunks; c++) {
+            if (decompress_chunk(config, compressed + c * stride, compressed_sizes[c], scratch, chunk_size) < 0)
+                PROGRAM_ERROR("decompression failed");
+            unshuffle(scratch, out + c * chunk_size, chunk_size, dset->elem_size);
+        }
+        t2 = now();
+
+        if (0 == r || t1 - t0 < best_write)
+            best_write = t1 - t0;
+        if (0 == r || t2 - t1 < best_read)
+            best_read = t2 - t1;
+    }
+
+    if (memcmp(data, out, n_chunks * chunk_size))
+        PROGRAM_ERROR("data did not survive the round trip");
+
+    for (c = 0; c < n_chunks; c++)
+        stored += compressed_sizes[c];
+
+    printf("%-12s %-8s %5d %8.2f %11.1f %11.1f\n", dset->name,
+            CODEC_FASTLZ == config->codec ? "fastlz" : "gzip", config->level,
+            (double)(n_chunks * chunk_size) / (double)stored,
+            (double)(n_chunks * chunk_size) / (double)MIB / best_write,
+            (double)(n_chunks * chunk_size) / (double)MIB / best_read);
+
+    return 0;
+
+error:
+    return -1;
+} /* end bench() */
+
+static void
+usage(FILE *stream)
+{
+    fprintf(stream, "Usage: fastlz_bench [-c chunk MiB] [-s total MiB] [-r reps]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "   -c  Chunk size in MiB (default 1)\n");
+    fprintf(stream, "   -s  Data per dataset in MiB (default 64)\n");
+    fprintf(stream, "   -r  Repetitions, best time is reported (default 3)\n");
+    fprintf(stream, "\n");
+} /* end usage() */
+
+int
+main(int argc, char *argv[])
+{
+    size_t chunk_size = DEFAULT_CHUNK_SIZE;
+    size_t total_size = DEFAULT_TOTAL_SIZE;
+    int reps = DEFAULT_REPS;
+    size_t n_chunks;
+    uint8_t *data = NULL;
+    uint8_t *compressed = NULL;
+    size_t *compressed_sizes = NULL;
+    uint8_t *scratch = NULL;
+    uint8_t *out = NULL;
+    size_t d, k;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "c:s:r:h"))) {
+        switch (opt) {
+            case 'c':
+                chunk_size = (size_t)atoi(optarg) * MIB;
+                break;
+            case 's':
+                total_size = (size_t)atoi(optarg) * MIB;
+                break;
+            case 'r':
+                reps = atoi(optarg);
+                break;
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                PROGRAM_ERROR("bad option");
+        }
+    }
+    if (0 == chunk_size || total_size < chunk_size || reps < 1) {
+        usage(stderr);
+        PROGRAM_ERROR("chunk size, total size, and reps must be positive and chunk <= total");
+    }
+    n_chunks = total_size / chunk_size;
+    total_size = n_chunks * chunk_size;
+
+    if (NULL == (data = (uint8_t *)malloc(total_size)))
+        PROGRAM_ERROR("memory allocation for data failed");
+    if (NULL == (out = (uint8_t *)malloc(total_size)))
+        PROGRAM_ERROR("memory allocation for out failed");
+    if (NULL == (scratch = (uint8_t *)malloc(chunk_size)))
+        PROGRAM_ERROR("memory allocation for scratch failed");
+    if (NULL == (compressed = (uint8_t *)malloc(n_chunks * (FASTLZ_COMPRESS_BOUND(chunk_size) + 64))))
+        PROGRAM_ERROR("memory allocation for compressed failed");
+    if (NULL == (compressed_sizes = (size_t *)calloc(n_chunks, sizeof(size_t))))
+        PROGRAM_ERROR("memory allocation for compressed_sizes failed");
+
+    printf("%zu MiB per dataset in %zu KiB chunks, best of %d\n\n",
+            total_size / MIB, chunk_size / 1024, reps);
+    printf("%-12s %-8s %5s %8s %11s %11s\n", "data", "codec", "level", "ratio", "write MiB/s", "read MiB/s");
+
+    for (d = 0; d < N_DATASETS; d++) {
+        datasets[d].fill(data, total_size);
+        for (k = 0; k < N_CONFIGS; k++)
+            if (bench(&datasets[d], &configs[k], data, total_size, chunk_size, reps,
+                    compressed, compressed_sizes, scratch, out) < 0)
+                PROGRAM_ERROR("benchmark failed");
+    }
+
+    free(data);
+    free(out);
+    free(scratch);
+    free(compressed);
+    free(compressed_sizes);
+
+    return EXIT_SUCCESS;
+
+error:
+    free(data);
+    free(out);
+    free(scratch);
+    free(compressed);
+    free(compressed_sizes);
+
+    return EXIT_FAILURE;
+} /* end main */
@@ -0,0 +1,309 @@
+/* fastlz_codec.c
+ *
+ * An LZ4-style block compressor and decompressor. See fastlz_codec.h.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "fastlz_codec.h"
+
+/* Block format constants (the same as LZ4's) */
+#define MIN_MATCH           4       /* Shortest encodable match */
+#define MAX_OFFSET          65535   /* Matches must be this close */
+#define LAST_LITERALS       5       /* The last 5 bytes are always literals */
+#define MF_LIMIT            12      /* No match may start in the last 12 bytes */
+#define RUN_MASK            15      /* 4-bit length fields */
+
+/* Hash table: 4096 entries of 32-bit positions (16 KiB, fits in L1) */
+#define HASH_LOG            12
+#define HASH_SIZE           (1 << HASH_LOG)
+
+/* After 2^SKIP_TRIGGER failed probes the search step grows by one */
+#define SKIP_TRIGGER        6
+
+static inline uint32_t
+read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+} /* end read32() */
+
+static inline uint64_t
+read64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+} /* end read64() */
+
+static inline uint32_t
+hash32(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+} /* end hash32() */
+
+/* Length of the match between a and b, stopping at limit */
+static inline size_t
+match_length(const uint8_t *a, const uint8_t *b, const uint8_t *limit)
+{
+    const uint8_t *start = a;
+
+    while (a + 8 <= limit && read64(a) == read64(b)) {
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        a++;
+        b++;
+    }
+
+    return (size_t)(a - start);
+} /* end match_length() */
+
+/* Writes the 255-byte continuation of a length field */
+static inline uint8_t *
+write_length(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t)len;
+
+    return op;
+} /* end write_length() */
+
+/* Bytes needed by a length field's continuation */
+#define EXTRA_LENGTH_BYTES(len)     ((len) >= RUN_MASK ? ((len) - RUN_MASK) / 255 + 1 : 0)
+
+/* Emits one sequence: a literal run, optionally followed by a match.
+ * Returns the new output position or NULL if it does not fit.
+ */
+static uint8_t *
+emit_sequence(uint8_t *op, const uint8_t *oend, const uint8_t *literals,
+        size_t n_literals, size_t offset, size_t match_len)
+{
+    size_t need = 1 + EXTRA_LENGTH_BYTES(n_literals) + n_literals;
+    uint8_t *token = op;
+
+    if (match_len)
+        need += 2 + EXTRA_LENGTH_BYTES(match_len - MIN_MATCH);
+    if (need > (size_t)(oend - op))
+        return NULL;
+
+    op++;
+    if (n_literals >= RUN_MASK) {
+        *token = RUN_MASK << 4;
+        op = write_length(op, n_literals - RUN_MASK);
+    }
+    else
+        *token = (uint8_t)(n_literals << 4);
+    memcpy(op, literals, n_literals);
+    op += n_literals;
+
+    if (match_len) {
+        size_t ml = match_len - MIN_MATCH;
+
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        if (ml >= RUN_MASK) {
+            *token |= RUN_MASK;
+            op = write_length(op, ml - RUN_MASK);
+        }
+        else
+            *token |= (uint8_t)ml;
+    }
+
+    return op;
+} /* end emit_sequence() */
+
+
+size_t
+fastlz_compress(const void *src, size_t src_size, void *dest, size_t dest_size,
+        unsigned acceleration)
+{
+    const uint8_t *base = (const uint8_t *)src;
+    const uint8_t *ip = base;
+    const uint8_t *anchor = base;
+    const uint8_t *iend = base + src_size;
+    const uint8_t *mflimit;
+    const uint8_t *matchlimit;
+    uint8_t *op = (uint8_t *)dest;
+    const uint8_t *oend = op + dest_size;
+    uint32_t table[HASH_SIZE];
+
+    if (0 == acceleration)
+        acceleration = FASTLZ_ACCELERATION_DEFAULT;
+    if (acceleration > FASTLZ_ACCELERATION_MAX)
+        acceleration = FASTLZ_ACCELERATION_MAX;
+
+    /* Too short to hold a match */
+    if (src_size < MF_LIMIT + 1)
+        goto last_literals;
+
+    /* Positions are 32-bit; HDF5 chunks are smaller than 4 GiB anyway */
+    if (src_size > UINT32_MAX)
+        return 0;
+
+    mflimit = iend - MF_LIMIT;
+    matchlimit = iend - LAST_LITERALS;
+    memset(table, 0, sizeof(table));
+    ip++;
+
+    for (;;) {
+        const uint8_t *ref;
+        size_t probes = (size_t)acceleration << SKIP_TRIGGER;
+        size_t len;
+
+        /* Find a match, skipping ahead faster the longer we miss */
+        for (;;) {
+            uint32_t h;
+            size_t step = probes++ >> SKIP_TRIGGER;
+
+            if (ip > mflimit)
+                goto last_literals;
+
+            h = hash32(read32(ip));
+            ref = base + table[h];
+            table[h] = (uint32_t)(ip - base);
+            if (ref < ip && ip - ref <= MAX_OFFSET && read32(ref) == read32(ip))
+                break;
+            ip += step;
+        }
+
+        /* Extend the match backwards over pending literals */
+        while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+
+        len = MIN_MATCH + match_length(ip + MIN_MATCH, ref + MIN_MATCH, matchlimit);
+
+        if (NULL == (op = emit_sequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), len)))
+            return 0;
+
+        ip += len;
+        anchor = ip;
+        if (ip > mflimit)
+            break;
+
+        /* Seed the table from inside the match so runs chain together */
+        table[hash32(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+    }
+
+last_literals:
+    if (NULL == (op = emit_sequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0)))
+        return 0;
+
+    return (size_t)(op - (uint8_t *)dest);
+} /* end fastlz_compress() */
+
+
+int
+fastlz_decompress(const void *src, size_t src_size, void *dest, size_t dest_size)
+{
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *iend = ip + src_size;
+    uint8_t *base = (uint8_t *)dest;
+    uint8_t *op = base;
+    uint8_t *oend = base + dest_size;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t n_literals = token >> 4;
+        size_t offset;
+        size_t len;
+        const uint8_t *ref;
+
+        /* Literal run */
+        if (RUN_MASK == n_literals) {
+            unsigned b;
+
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                n_literals += b;
+            } while (255 == b);
+        }
+        if (n_literals > (size_t)(iend - ip) || n_literals > (size_t)(oend - op))
+            return -1;
+        memcpy(op, ip, n_literals);
+        ip += n_literals;
+        op += n_literals;
+
+        /* The last sequence has no match */
+        if (ip == iend)
+            break;
+
+        /* Match */
+        if (iend - ip < 2)
+            return -1;
+        offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (0 == offset || offset > (size_t)(op - base))
+            return -1;
+
+        len = token & RUN_MASK;
+        if (RUN_MASK == len) {
+            unsigned b;
+
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (255 == b);
+        }
+        len += MIN_MATCH;
+        if (len > (size_t)(oend - op))
+            return -1;
+
+        /* Overlapping copies are how runs are encoded, so copy forward.
+         * With the source at least 8 bytes back, 8-byte steps are safe.
+         */
+        ref = op - offset;
+        if (offset >= 8) {
+            for (; len >= 8; len -= 8) {
+                memcpy(op, ref, 8);
+                op += 8;
+                ref += 8;
+            }
+        }
+        while (len--)
+            *op++ = *ref++;
+    }
+
+    return op == oend ? 0 : -1;
+} /* end fastlz_decompress() */
@@ -0,0 +1,80 @@
+/* fastlz_codec.h
+ *
+ * A small LZ77 block codec in the style of LZ4: greedy matching through a
+ * single-entry hash table, byte-aligned tokens, and no entropy coding.
+ * Compression runs several times faster than deflate level 1 and
+ * decompression is close to memcpy speed, at the cost of some ratio.
+ *
+ * The block format is the LZ4 block format (sequences of a token, literal
+ * run, 16-bit little-endian match offset, and match length), so blocks can
+ * be inspected with any LZ4 block decoder. There is no framing; the caller
+ * stores the uncompressed size.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FASTLZ_CODEC_H
+#define _FASTLZ_CODEC_H
+
+#include <stddef.h>
+
+/* Acceleration limits. 1 is the best ratio; each step up makes the
+ * match search skip ahead faster through incompressible data.
+ */
+#define FASTLZ_ACCELERATION_DEFAULT 1
+#define FASTLZ_ACCELERATION_MAX     65536
+
+/* Worst-case compressed size of n bytes of incompressible input */
+#define FASTLZ_COMPRESS_BOUND(n)    ((n) + (n) / 255 + 16)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Compresses src_size bytes of src into dest, which has room for dest_size
+ * bytes. Returns the compressed size, or 0 if it did not fit. An
+ * acceleration of 0 is treated as 1.
+ */
+size_t fastlz_compress(const void *src, size_t src_size, void *dest,
+        size_t dest_size, unsigned acceleration);
+
+/* Decompresses src_size bytes of src into dest, which must decode to
+ * exactly dest_size bytes. Every read and write is bounds checked, so
+ * corrupt input fails instead of overrunning. Returns 0 on success and -1
+ * on malformed input.
+ */
+int fastlz_decompress(const void *src, size_t src_size, void *dest,
+        size_t dest_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FASTLZ_CODEC_H */
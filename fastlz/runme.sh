@@ -0,0 +1,12 @@
+#!/bin/sh
+#
+# This really isn't necessary, but it makes it obvious that you need to set
+# the plugin path in order to find your fancy new filter plugin.
+export HDF5_PLUGIN_PATH="."
+
+# With and without shuffle, at the best ratio and a fast setting
+for acceleration in 1 16
+do
+    ./fastlz_test_program $acceleration 0
+    ./fastlz_test_program $acceleration 1
+done
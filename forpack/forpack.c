@@ -0,0 +1,639 @@
+/* forpack.c
+ *
+ * HDF5 filter plugin for frame-of-reference bit packing (see forpack.h).
+ *
+ * Chunk layout:
+ *
+ *      bytes 0-3   uncompressed size (little-endian)
+ *      byte  4     bit width w (0-64)
+ *      bytes 5-7   zero
+ *      bytes 8-15  reference (the minimum, little-endian, as an unsigned
+ *                  value with the sign bit flipped for signed types)
+ *      packed      the element offsets from the reference, w bits each
+ *      leftover    any fractional element at the end, as is
+ *
+ * For w <= 32 the offsets go in blocks of 256 in the vertical layout that
+ * SIMD bit packers use: element i of a block belongs to lane i % 8, each of
+ * the 8 lanes packs its 32 offsets into w 32-bit words, and word k of every
+ * lane is stored together (32 * w bytes per block, little-endian words).
+ * An AVX2 register holds exactly one word of every lane, so packing and
+ * unpacking are a shift and an OR per 8 elements. The plain C kernels
+ * produce the same bytes. Elements past the last whole block, and every
+ * element when w > 32, are written as an LSB-first bit stream instead.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+/* The HDF5 external plugin header */
+#include <H5PLextern.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FORPACK_X86
+#endif
+
+#include "forpack.h"
+
+/* Local macros */
+#define FORPACK_PARM_SIZE           0   /* "Local" parameter for element size */
+#define FORPACK_PARM_SIGNED         1   /* "Local" parameter for signedness */
+#define FORPACK_PARM_BIG_ENDIAN     2   /* "Local" parameter for byte order */
+#define FORPACK_USER_NPARMS         0   /* Number of parameters that users can set */
+#define FORPACK_TOTAL_NPARMS        3   /* Total number of parameters for filter */
+
+#define HEADER_SIZE                 16
+#define LANES                       8
+#define BLOCK_ELEMS                 (LANES * 32)
+
+/* The element type, from cd_values */
+typedef struct elem_type_t {
+    unsigned size;
+    int is_signed;
+    int big_endian;
+} elem_type_t;
+
+/* LSB-first bit streams */
+typedef struct bitwriter_t {
+    unsigned char *p;
+    uint64_t acc;
+    unsigned n;                     /* Bits in acc, < 8 between calls */
+} bitwriter_t;
+
+typedef struct bitreader_t {
+    const unsigned char *p;
+    uint64_t acc;
+    unsigned n;                     /* Bits in acc */
+} bitreader_t;
+
+/* Filter callback prototypes */
+static htri_t can_apply_forpack(hid_t dcpl_id, hid_t type_id, hid_t space_id);
+static herr_t set_local_forpack(hid_t dcpl_id, hid_t type_id, hid_t space_id);
+static size_t filter_forpack(unsigned int flags, size_t cd_nelmts,
+        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
+        void **buf);
+
+/* Local prototypes */
+static void pack_block(const uint32_t *in, unsigned w, unsigned char *out);
+static void unpack_block(const unsigned char *in, unsigned w, uint32_t *out);
+
+
+/* Information about this filter
+ * H5Z_class2_t is defined in H5Zpublic.h
+ */
+const H5Z_class2_t FORPACK_CLASS[1] = {{
+    H5Z_CLASS_T_VERS,                       /* Filter class version */
+    FORPACK_ID,                             /* Filter id number */
+    1,                                      /* encoder_present flag */
+    1,                                      /* decoder_present flag */
+    "forpack",                              /* Filter name for debugging */
+    can_apply_forpack,                      /* The "can apply" callback */
+    set_local_forpack,                      /* The "set local" callback */
+    (H5Z_func_t)filter_forpack,             /* The actual filter function */
+}};
+
+
+/* The plugin functions you must implement when you include H5PLextern.h */
+H5PL_type_t H5PLget_plugin_type(void) { return H5PL_TYPE_FILTER; }
+const void *H5PLget_plugin_info(void) { return FORPACK_CLASS; }
+
+
+/* 1, 2, 4, or 8 byte integers */
+static htri_t
+can_apply_forpack(hid_t dcpl_id, hid_t type_id, hid_t space_id)
+{
+    size_t size;
+
+    (void)dcpl_id;
+    (void)space_id;
+
+    if (H5T_INTEGER != H5Tget_class(type_id))
+        return 0;
+
+    size = H5Tget_size(type_id);
+
+    return 1 == size || 2 == size || 4 == size || 8 == size;
+} /* end can_apply_forpack() */
+
+
+static herr_t
+set_local_forpack(hid_t dcpl_id, hid_t type_id, hid_t space_id)
+{
+    unsigned flags;                             /* Filter flags */
+    size_t type_size;                           /* Datatype size */
+    H5T_sign_t sign;                            /* Datatype signedness */
+    H5T_order_t order;                          /* Datatype byte order */
+    size_t cd_nelmts = FORPACK_USER_NPARMS;     /* # of filter parameters */
+    unsigned cd_values[FORPACK_TOTAL_NPARMS];   /* Filter parameters */
+
+    (void)space_id;
+
+    /* Get the filter's current parameters */
+    if (H5Pget_filter_by_id(dcpl_id, FORPACK_ID, &flags, &cd_nelmts, cd_values, (size_t)0, NULL, NULL) < 0)
+        goto error;
+
+    /* Get the type information */
+    if (0 == (type_size = H5Tget_size(type_id)))
+        goto error;
+    if (H5T_SGN_ERROR == (sign = H5Tget_sign(type_id)))
+        goto error;
+    if (H5T_ORDER_ERROR == (order = H5Tget_order(type_id)))
+        goto error;
+
+    /* Set "local" parameters for this dataset */
+    cd_values[FORPACK_PARM_SIZE] = (unsigned)type_size;
+    cd_values[FORPACK_PARM_SIGNED] = H5T_SGN_2 == sign;
+    cd_values[FORPACK_PARM_BIG_ENDIAN] = H5T_ORDER_BE == order;
+
+    /* Modify the filter's parameters for this dataset */
+    if (H5Pmodify_filter(dcpl_id, FORPACK_ID, flags, (size_t)FORPACK_TOTAL_NPARMS, cd_values) < 0)
+        goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end set_local_forpack() */
+
+
+/************/
+/* ELEMENTS */
+/************/
+
+/* Elements are handled as unsigned values with the sign bit flipped for
+ * signed types, so that unsigned order matches the types' order. These are
+ * always called with a constant size, so the byte loops unroll.
+ */
+static inline uint64_t
+load_elem(const unsigned char *p, unsigned size, const elem_type_t *t)
+{
+    uint64_t v = 0;
+    unsigned j;
+
+    if (t->big_endian)
+        for (j = 0; j < size; j++)
+            v = (v << 8) | p[j];
+    else
+        for (j = size; j > 0; j--)
+            v = (v << 8) | p[j - 1];
+    if (t->is_signed)
+        v ^= UINT64_C(1) << (8 * size - 1);
+
+    return v;
+} /* end load_elem() */
+
+static inline void
+store_elem(unsigned char *p, unsigned size, const elem_type_t *t, uint64_t v)
+{
+    unsigned j;
+
+    if (t->is_signed)
+        v ^= UINT64_C(1) << (8 * size - 1);
+    if (t->big_endian)
+        for (j = size; j > 0; j--, v >>= 8)
+            p[j - 1] = (unsigned char)v;
+    else
+        for (j = 0; j < size; j++, v >>= 8)
+            p[j] = (unsigned char)v;
+} /* end store_elem() */
+
+/* Runs BODY with SIZE a constant matching t->size */
+#define FOR_EACH_SIZE(t, BODY)                                              \
+    do {                                                                    \
+        switch ((t)->size) {                                                \
+            case 1: { const unsigned SIZE = 1; BODY; } break;               \
+            case 2: { const unsigned SIZE = 2; BODY; } break;               \
+            case 4: { const unsigned SIZE = 4; BODY; } break;               \
+            default: { const unsigned SIZE = 8; BODY; } break;              \
+        }                                                                   \
+    } while (0)
+
+static void
+find_range(const unsigned char *src, size_t n, const elem_type_t *t,
+        uint64_t *min, uint64_t *max)
+{
+    uint64_t lo = UINT64_MAX;
+    uint64_t hi = 0;
+    size_t i;
+
+    FOR_EACH_SIZE(t,
+        for (i = 0; i < n; i++) {
+            uint64_t v = load_elem(src + i * SIZE, SIZE, t);
+
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        });
+
+    *min = n ? lo : 0;
+    *max = n ? hi : 0;
+} /* end find_range() */
+
+/* Offsets from the reference (only used when they fit in 32 bits) */
+static void
+to_offsets(const unsigned char *src, size_t n, const elem_type_t *t,
+        uint64_t min, uint32_t *offsets)
+{
+    size_t i;
+
+    FOR_EACH_SIZE(t,
+        for (i = 0; i < n; i++)
+            offsets[i] = (uint32_t)(load_elem(src + i * SIZE, SIZE, t) - min));
+} /* end to_offsets() */
+
+static void
+from_offsets(const uint32_t *offsets, size_t n, const elem_type_t *t,
+        uint64_t min, unsigned char *dest)
+{
+    size_t i;
+
+    FOR_EACH_SIZE(t,
+        for (i = 0; i < n; i++)
+            store_elem(dest + i * SIZE, SIZE, t, min + offsets[i]));
+} /* end from_offsets() */
+
+
+/***************/
+/* BIT STREAMS */
+/***************/
+
+static void
+put_bits(bitwriter_t *bw, uint64_t v, unsigned w)
+{
+    if (w > 32) {
+        put_bits(bw, v & 0xFFFFFFFF, 32);
+        put_bits(bw, v >> 32, w - 32);
+        return;
+    }
+
+    bw->acc |= v << bw->n;
+    bw->n += w;
+    while (bw->n >= 8) {
+        *bw->p++ = (unsigned char)bw->acc;
+        bw->acc >>= 8;
+        bw->n -= 8;
+    }
+} /* end put_bits() */
+
+static void
+flush_bits(bitwriter_t *bw)
+{
+    if (bw->n > 0)
+        *bw->p++ = (unsigned char)bw->acc;
+    bw->acc = 0;
+    bw->n = 0;
+} /* end flush_bits() */
+
+static uint64_t
+get_bits(bitreader_t *br, unsigned w)
+{
+    uint64_t v;
+
+    if (w > 32) {
+        v = get_bits(br, 32);
+        return v | (get_bits(br, w - 32) << 32);
+    }
+
+    while (br->n < w) {
+        br->acc |= (uint64_t)*br->p++ << br->n;
+        br->n += 8;
+    }
+    v = br->acc & ((UINT64_C(1) << w) - 1);
+    br->acc >>= w;
+    br->n -= w;
+
+    return v;
+} /* end get_bits() */
+
+/* Bytes taken by n offsets of w bits */
+static size_t
+packed_size(size_t n, unsigned w)
+{
+    if (w <= 32)
+        return (n / BLOCK_ELEMS) * (BLOCK_ELEMS / 8) * w + ((n % BLOCK_ELEMS) * w + 7) / 8;
+
+    return (n * w + 7) / 8;
+} /* end packed_size() */
+
+
+static size_t
+filter_forpack(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    const unsigned char *src = (const unsigned char *)*buf;
+    unsigned char *dest = NULL;
+    size_t dest_size;
+    elem_type_t t;
+    uint32_t offsets[BLOCK_ELEMS];
+    uint64_t min, max;
+    size_t n_elements;
+    size_t leftover;
+    size_t n_blocks;
+    size_t i, b;
+    unsigned w;
+
+    /* Check arguments */
+    if (cd_nelmts != FORPACK_TOTAL_NPARMS)
+        goto error;
+    t.size = cd_values[FORPACK_PARM_SIZE];
+    t.is_signed = cd_values[FORPACK_PARM_SIGNED] != 0;
+    t.big_endian = cd_values[FORPACK_PARM_BIG_ENDIAN] != 0;
+    if (1 != t.size && 2 != t.size && 4 != t.size && 8 != t.size)
+        goto error;
+
+    if (flags & H5Z_FLAG_REVERSE) {
+        /* Unpack */
+        const unsigned char *p = src + HEADER_SIZE;
+        bitreader_t br = {NULL, 0, 0};
+
+        if (nbytes < HEADER_SIZE)
+            goto error;
+        dest_size = (size_t)src[0] | ((size_t)src[1] << 8) | ((size_t)src[2] << 16) | ((size_t)src[3] << 24);
+        w = src[4];
+        for (min = 0, i = 8; i > 0; i--)
+            min = (min << 8) | src[8 + i - 1];
+
+        n_elements = dest_size / t.size;
+        leftover = dest_size % t.size;
+        if (w > 8 * t.size || nbytes != HEADER_SIZE + packed_size(n_elements, w) + leftover)
+            goto error;
+
+        if (NULL == (dest = (unsigned char *)malloc(dest_size ? dest_size : 1)))
+            goto error;
+
+        if (w <= 32) {
+            n_blocks = n_elements / BLOCK_ELEMS;
+            for (b = 0; b < n_blocks; b++) {
+                unpack_block(p, w, offsets);
+                from_offsets(offsets, BLOCK_ELEMS, &t, min, dest + b * BLOCK_ELEMS * t.size);
+                p += (BLOCK_ELEMS / 8) * w;
+            }
+
+            br.p = p;
+            for (i = 0; i < n_elements - n_blocks * BLOCK_ELEMS; i++)
+                offsets[i] = (uint32_t)get_bits(&br, w);
+            from_offsets(offsets, i, &t, min, dest + n_blocks * BLOCK_ELEMS * t.size);
+        }
+        else {
+            br.p = p;
+            FOR_EACH_SIZE(&t,
+                for (i = 0; i < n_elements; i++)
+                    store_elem(dest + i * SIZE, SIZE, &t, min + get_bits(&br, w)));
+        }
+
+        memcpy(dest + (dest_size - leftover), src + (nbytes - leftover), leftover);
+    }
+    else {
+        /* Pack */
+        unsigned char *p;
+        bitwriter_t bw = {NULL, 0, 0};
+
+        if (nbytes > UINT32_MAX)
+            goto error;
+
+        n_elements = nbytes / t.size;
+        leftover = nbytes % t.size;
+
+        find_range(src, n_elements, &t, &min, &max);
+        for (w = 0; w < 64 && (max - min) >> w; w++)
+            ;
+
+        dest_size = HEADER_SIZE + packed_size(n_elements, w) + leftover;
+        if (NULL == (dest = (unsigned char *)malloc(dest_size)))
+            goto error;
+
+        for (i = 0; i < 4; i++)
+            dest[i] = (unsigned char)(nbytes >> (8 * i));
+        dest[4] = (unsigned char)w;
+        dest[5] = dest[6] = dest[7] = 0;
+        for (i = 0; i < 8; i++)
+            dest[8 + i] = (unsigned char)(min >> (8 * i));
+        p = dest + HEADER_SIZE;
+
+        if (w <= 32) {
+            n_blocks = n_elements / BLOCK_ELEMS;
+            for (b = 0; b < n_blocks; b++) {
+                to_offsets(src + b * BLOCK_ELEMS * t.size, BLOCK_ELEMS, &t, min, offsets);
+                pack_block(offsets, w, p);
+                p += (BLOCK_ELEMS / 8) * w;
+            }
+
+            bw.p = p;
+            to_offsets(src + n_blocks * BLOCK_ELEMS * t.size, n_elements - n_blocks * BLOCK_ELEMS, &t, min, offsets);
+            for (i = 0; i < n_elements - n_blocks * BLOCK_ELEMS; i++)
+                put_bits(&bw, offsets[i], w);
+        }
+        else {
+            bw.p = p;
+            FOR_EACH_SIZE(&t,
+                for (i = 0; i < n_elements; i++)
+                    put_bits(&bw, load_elem(src + i * SIZE, SIZE, &t) - min, w));
+        }
+        flush_bits(&bw);
+
+        memcpy(dest + (dest_size - leftover), src + (nbytes - leftover), leftover);
+    }
+
+    /* Swap in the new buffer */
+    free(*buf);
+    *buf = dest;
+    *buf_size = dest_size ? dest_size : 1;
+
+    return dest_size;
+
+error:
+    free(dest);
+
+    return 0;
+} /* end filter_forpack() */
+
+
+/**********/
+/* SCALAR */
+/**********/
+
+static void
+pack_block_scalar(const uint32_t *in, unsigned w, unsigned char *out)
+{
+    unsigned lane, j;
+
+    for (lane = 0; lane < LANES; lane++) {
+        uint64_t acc = 0;
+        unsigned n = 0;
+        size_t k = 0;
+
+        for (j = 0; j < 32; j++) {
+            acc |= (uint64_t)in[j * LANES + lane] << n;
+            n += w;
+            if (n >= 32) {
+                unsigned char *word = out + 4 * (k * LANES + lane);
+
+                word[0] = (unsigned char)acc;
+                word[1] = (unsigned char)(acc >> 8);
+                word[2] = (unsigned char)(acc >> 16);
+                word[3] = (unsigned char)(acc >> 24);
+                acc >>= 32;
+                n -= 32;
+                k++;
+            }
+        }
+    }
+} /* end pack_block_scalar() */
+
+static void
+unpack_block_scalar(const unsigned char *in, unsigned w, uint32_t *out)
+{
+    uint64_t mask = (UINT64_C(1) << w) - 1;
+    unsigned lane, j;
+
+    for (lane = 0; lane < LANES; lane++) {
+        uint64_t acc = 0;
+        unsigned n = 0;
+        size_t k = 0;
+
+        for (j = 0; j < 32; j++) {
+            if (n < w) {
+                const unsigned char *word = in + 4 * (k * LANES + lane);
+
+                acc |= ((uint64_t)word[0] | ((uint64_t)word[1] << 8)
+                        | ((uint64_t)word[2] << 16) | ((uint64_t)word[3] << 24)) << n;
+                n += 32;
+                k++;
+            }
+            out[j * LANES + lane] = (uint32_t)(acc & mask);
+            acc >>= w;
+            n -= w;
+        }
+    }
+} /* end unpack_block_scalar() */
+
+
+/********/
+/* AVX2 */
+/********/
+
+#ifdef FORPACK_X86
+
+/* One 32-bit word of every lane per register: the 8 offsets loaded together
+ * are the next value of each lane
+ */
+__attribute__((target("avx2")))
+static void
+pack_block_avx2(const uint32_t *in, unsigned w, unsigned char *out)
+{
+    __m256i acc = _mm256_setzero_si256();
+    unsigned n = 0;
+    unsigned j;
+
+    for (j = 0; j < 32; j++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + j * LANES));
+
+        acc = _mm256_or_si256(acc, _mm256_sll_epi32(v, _mm_cvtsi32_si128((int)n)));
+        n += w;
+        if (n >= 32) {
+            _mm256_storeu_si256((__m256i *)out, acc);
+            out += 32;
+            n -= 32;
+
+            /* Whatever didn't fit starts the next word */
+            acc = n ? _mm256_srl_epi32(v, _mm_cvtsi32_si128((int)(w - n))) : _mm256_setzero_si256();
+        }
+    }
+} /* end pack_block_avx2() */
+
+__attribute__((target("avx2")))
+static void
+unpack_block_avx2(const unsigned char *in, unsigned w, uint32_t *out)
+{
+    const __m256i mask = _mm256_set1_epi32(w >= 32 ? -1 : (int)((1U << w) - 1));
+    __m256i word = _mm256_setzero_si256();
+    unsigned used = 32;             /* Bits of word already consumed */
+    unsigned j;
+
+    for (j = 0; j < 32; j++) {
+        __m256i v;
+
+        if (used + w <= 32) {
+            v = _mm256_srl_epi32(word, _mm_cvtsi32_si128((int)used));
+            used += w;
+        }
+        else {
+            /* Straddles two words */
+            __m256i lo = _mm256_srl_epi32(word, _mm_cvtsi32_si128((int)used));
+
+            word = _mm256_loadu_si256((const __m256i *)in);
+            in += 32;
+            v = _mm256_or_si256(lo, _mm256_sll_epi32(word, _mm_cvtsi32_si128((int)(32 - used))));
+            used = used + w - 32;
+        }
+        _mm256_storeu_si256((__m256i *)(out + j * LANES), _mm256_and_si256(v, mask));
+    }
+} /* end unpack_block_avx2() */
+
+static int
+have_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+} /* end have_avx2() */
+
+#endif /* FORPACK_X86 */
+
+
+static void
+pack_block(const uint32_t *in, unsigned w, unsigned char *out)
+{
+#ifdef FORPACK_X86
+    if (have_avx2()) {
+        pack_block_avx2(in, w, out);
+        return;
+    }
+#endif
+
+    pack_block_scalar(in, w, out);
+} /* end pack_block() */
+
+static void
+unpack_block(const unsigned char *in, unsigned w, uint32_t *out)
+{
+#ifdef FORPACK_X86
+    if (have_avx2()) {
+        unpack_block_avx2(in, w, out);
+        return;
+    }
+#endif
+
+    unpack_block_scalar(in, w, out);
+} /* end unpack_block() */
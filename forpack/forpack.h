@@ -0,0 +1,57 @@
+/* forpack.h
+ *
+ * Public header for the frame-of-reference bit packing filter.
+ *
+ * The filter finds each chunk's minimum and maximum, subtracts the minimum
+ * from every element, and packs the offsets into just as many bits as the
+ * chunk's range needs. A chunk of counters or indices that spans a few
+ * thousand values shrinks from 32 bits per element to 12 or so, and
+ * decoding is a fast unpack rather than an inflate. It is lossless and
+ * works on any integer type of 1, 2, 4, or 8 bytes, either byte order.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FORPACK_H
+#define _FORPACK_H
+
+/* The filter ID number (NOTE: Has nothing to do with HDF5 hid_t IDs)
+ */
+#define FORPACK_ID                  ((H5Z_filter_t)325)
+
+/* Filter parameters (cd_values)
+ *
+ * There are no user parameters; the element size, signedness, and byte
+ * order are added when the dataset is created.
+ *
+ *  H5Pset_filter(dcpl_id, FORPACK_ID, H5Z_FLAG_MANDATORY, 0, NULL);
+ */
+
+#endif /* _FORPACK_H */
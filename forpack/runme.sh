@@ -0,0 +1,12 @@
+#!/bin/sh
+#
+# This really isn't necessary, but it makes it obvious that you need to set
+# the plugin path in order to find your fancy new filter plugin.
+export HDF5_PLUGIN_PATH="."
+
+# Each integer width, packed alone and then with gzip
+for int_bits in 8 16 32 64
+do
+    ./forpack_test_program $int_bits 0
+    ./forpack_test_program $int_bits 1
+done
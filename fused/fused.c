@@ -0,0 +1,510 @@
+/* fused.c
+ *
+ * HDF5 filter plugin for the fused pipeline (see fused.h).
+ *
+ * Encoding walks the chunk one tile at a time. Each element of the tile is
+ * loaded once (as a little-endian integer), trimmed and delta coded in a
+ * register, and stored to its byte planes in the output; the Adler-32 is
+ * then updated from the tile while it's still in cache. Decoding does the
+ * reverse, checksumming each tile as it's read. The output buffer is the
+ * only allocation and every byte of the chunk is read and written once.
+ *
+ * The shuffle is per tile (byte planes span a tile, not the whole chunk),
+ * so the tile size is fixed when the dataset is created and stored in
+ * cd_values; a chunk always decodes with the tile size it was written with.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+/* The HDF5 external plugin header */
+#include <H5PLextern.h>
+
+#include "fused.h"
+
+/* Tile size when the L2 size is unknown */
+#define FUSED_DEFAULT_TILE_KIB      256
+#define FUSED_MIN_TILE_KIB          16
+
+/* Adler-32 */
+#define CHECKSUM_SIZE               4
+#define ADLER_BASE                  65521U
+#define ADLER_NMAX                  5552    /* Max bytes before the sums can overflow */
+
+/* A parsed stage list */
+typedef struct pipeline_t {
+    unsigned bytes_per_elem;        /* Element size */
+    size_t tile_elems;              /* Elements per tile */
+    int trim;                       /* Stages present? */
+    int delta;
+    int shuffle;
+    int checksum;
+    uint64_t width_mask;            /* All the bits of an element */
+    uint64_t trim_mask;             /* The bits trim keeps */
+} pipeline_t;
+
+/* Adler-32 running state */
+typedef struct adler_t {
+    uint32_t a;
+    uint32_t b;
+} adler_t;
+
+/* Filter callback prototypes */
+static htri_t can_apply_fused(hid_t dcpl_id, hid_t type_id, hid_t space_id);
+static herr_t set_local_fused(hid_t dcpl_id, hid_t type_id, hid_t space_id);
+static size_t filter_fused(unsigned int flags, size_t cd_nelmts,
+        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
+        void **buf);
+
+/* Local prototypes */
+static herr_t parse_pipeline(size_t cd_nelmts, const unsigned int cd_values[],
+        pipeline_t *pipeline);
+static void encode_tile(const pipeline_t *p, const unsigned char *in,
+        unsigned char *out, size_t n, uint64_t *prev);
+static void decode_tile(const pipeline_t *p, const unsigned char *in,
+        unsigned char *out, size_t n, uint64_t *prev);
+
+
+/* Information about this filter
+ * H5Z_class2_t is defined in H5Zpublic.h
+ */
+const H5Z_class2_t FUSED_CLASS[1] = {{
+    H5Z_CLASS_T_VERS,                       /* Filter class version */
+    FUSED_ID,                               /* Filter id number */
+    1,                                      /* encoder_present flag */
+    1,                                      /* decoder_present flag */
+    "fused",                                /* Filter name for debugging */
+    can_apply_fused,                        /* The "can apply" callback */
+    set_local_fused,                        /* The "set local" callback */
+    (H5Z_func_t)filter_fused,               /* The actual filter function */
+}};
+
+
+/* The plugin functions you must implement when you include H5PLextern.h */
+H5PL_type_t H5PLget_plugin_type(void) { return H5PL_TYPE_FILTER; }
+const void *H5PLget_plugin_info(void) { return FUSED_CLASS; }
+
+
+/* Fixed-size types only; the stage list is checked in set_local */
+static htri_t
+can_apply_fused(hid_t dcpl_id, hid_t type_id, hid_t space_id)
+{
+    htri_t is_variable;
+
+    (void)dcpl_id;
+    (void)space_id;
+
+    if ((is_variable = H5Tis_variable_str(type_id)) < 0)
+        return -1;
+    if (is_variable || H5T_VLEN == H5Tget_class(type_id))
+        return 0;
+
+    return 1;
+} /* end can_apply_fused() */
+
+
+/* Half the L2 cache, so that a tile of input and a tile of output fit */
+static unsigned
+default_tile_kib(void)
+{
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+
+    if (l2 > 0 && (unsigned long)l2 / 2048 >= FUSED_MIN_TILE_KIB)
+        return (unsigned)((unsigned long)l2 / 2048);
+#endif
+
+    return FUSED_DEFAULT_TILE_KIB;
+} /* end default_tile_kib() */
+
+
+static herr_t
+set_local_fused(hid_t dcpl_id, hid_t type_id, hid_t space_id)
+{
+    unsigned flags;                                 /* Filter flags */
+    size_t type_size;                               /* Datatype size */
+    size_t cd_nelmts = FUSED_MAX_USER_NPARMS;       /* # of filter parameters */
+    unsigned cd_values[FUSED_MAX_USER_NPARMS + 1];  /* Filter parameters */
+    pipeline_t pipeline;
+
+    (void)space_id;
+
+    /* Get the filter's current parameters */
+    if (H5Pget_filter_by_id(dcpl_id, FUSED_ID, &flags, &cd_nelmts, cd_values, (size_t)0, NULL, NULL) < 0)
+        goto error;
+    if (cd_nelmts < FUSED_PARM_STAGES || cd_nelmts > FUSED_MAX_USER_NPARMS)
+        goto error;
+
+    /* Get the type size */
+    if (0 == (type_size = H5Tget_size(type_id)))
+        goto error;
+
+    /* Pin the tile size down now; it's part of the stored layout */
+    if (0 == cd_values[FUSED_PARM_TILE_KIB])
+        cd_values[FUSED_PARM_TILE_KIB] = default_tile_kib();
+
+    /* Set "local" parameter for this dataset */
+    cd_values[cd_nelmts++] = (unsigned)type_size;
+
+    /* Reject stage lists the filter would choke on */
+    if (parse_pipeline(cd_nelmts, cd_values, &pipeline) < 0)
+        goto error;
+
+    /* The element stages load and store little-endian integers */
+    if ((pipeline.trim || pipeline.delta) && type_size > 1 && H5T_ORDER_LE != H5Tget_order(type_id))
+        goto error;
+
+    /* Modify the filter's parameters for this dataset */
+    if (H5Pmodify_filter(dcpl_id, FUSED_ID, flags, cd_nelmts, cd_values) < 0)
+        goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end set_local_fused() */
+
+
+/* Checks the stage list (the element size is the last value) */
+static herr_t
+parse_pipeline(size_t cd_nelmts, const unsigned int cd_values[], pipeline_t *p)
+{
+    size_t n_values;                /* cd_values, less the element size */
+    size_t i;
+    unsigned s;
+    unsigned last_stage = 0;
+    unsigned trim_bits = 0;
+
+    memset(p, 0, sizeof(*p));
+
+    if (cd_nelmts < FUSED_PARM_STAGES + 1)
+        goto error;
+    n_values = cd_nelmts - 1;
+    p->bytes_per_elem = cd_values[n_values];
+    if (0 == p->bytes_per_elem || 0 == cd_values[FUSED_PARM_TILE_KIB])
+        goto error;
+
+    for (s = 0, i = FUSED_PARM_STAGES; s < cd_values[FUSED_PARM_N_STAGES]; s++) {
+        unsigned stage;
+
+        if (i >= n_values)
+            goto error;
+        stage = cd_values[i++];
+
+        /* The stage codes are in pipeline order */
+        if (stage <= last_stage || stage > FUSED_STAGE_CHECKSUM)
+            goto error;
+        last_stage = stage;
+
+        switch (stage) {
+            case FUSED_STAGE_TRIM:
+                if (i >= n_values)
+                    goto error;
+                trim_bits = cd_values[i++];
+                p->trim = 1;
+                break;
+            case FUSED_STAGE_DELTA:
+                p->delta = 1;
+                break;
+            case FUSED_STAGE_SHUFFLE:
+                p->shuffle = 1;
+                break;
+            default:
+                p->checksum = 1;
+                break;
+        }
+    }
+    if (i != n_values)
+        goto error;
+
+    /* The element stages need an integer to work on */
+    if (p->trim || p->delta) {
+        unsigned size = p->bytes_per_elem;
+
+        if (1 != size && 2 != size && 4 != size && 8 != size)
+            goto error;
+        if (trim_bits >= 8 * size)
+            goto error;
+    }
+    p->width_mask = p->bytes_per_elem >= 8 ? ~UINT64_C(0) : (UINT64_C(1) << (8 * p->bytes_per_elem)) - 1;
+    p->trim_mask = p->width_mask & ~((UINT64_C(1) << trim_bits) - 1);
+
+    p->tile_elems = (size_t)cd_values[FUSED_PARM_TILE_KIB] * 1024 / p->bytes_per_elem;
+    if (0 == p->tile_elems)
+        p->tile_elems = 1;
+
+    return 0;
+
+error:
+    return -1;
+} /* end parse_pipeline() */
+
+
+static void
+adler_update(adler_t *adler, const unsigned char *p, size_t len)
+{
+    uint32_t a = adler->a;
+    uint32_t b = adler->b;
+
+    while (len > 0) {
+        size_t n = len < ADLER_NMAX ? len : ADLER_NMAX;
+
+        len -= n;
+        while (n--) {
+            a += *p++;
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+
+    adler->a = a;
+    adler->b = b;
+} /* end adler_update() */
+
+
+static size_t
+filter_fused(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    const unsigned char *src = (const unsigned char *)*buf;
+    unsigned char *dest = NULL;
+    pipeline_t p;
+    adler_t adler = {1, 0};
+    uint64_t prev = 0;              /* Last element, carried across tiles for delta */
+    size_t data_size;               /* Chunk size without the checksum */
+    size_t dest_size;
+    size_t n_elements;
+    size_t leftover;
+    size_t start;
+
+    if (parse_pipeline(cd_nelmts, cd_values, &p) < 0)
+        goto error;
+
+    if (flags & H5Z_FLAG_REVERSE) {
+        if (p.checksum && nbytes < CHECKSUM_SIZE)
+            goto error;
+        data_size = nbytes - (p.checksum ? CHECKSUM_SIZE : 0);
+        dest_size = data_size;
+    }
+    else {
+        data_size = nbytes;
+        dest_size = nbytes + (p.checksum ? CHECKSUM_SIZE : 0);
+    }
+
+    /* The only allocation */
+    if (NULL == (dest = (unsigned char *)malloc(dest_size ? dest_size : 1)))
+        goto error;
+
+    n_elements = data_size / p.bytes_per_elem;
+    leftover = data_size - n_elements * p.bytes_per_elem;
+
+    for (start = 0; start < n_elements; start += p.tile_elems) {
+        size_t n = n_elements - start < p.tile_elems ? n_elements - start : p.tile_elems;
+        size_t offset = start * p.bytes_per_elem;
+
+        if (flags & H5Z_FLAG_REVERSE) {
+            if (p.checksum)
+                adler_update(&adler, src + offset, n * p.bytes_per_elem);
+            decode_tile(&p, src + offset, dest + offset, n, &prev);
+        }
+        else {
+            encode_tile(&p, src + offset, dest + offset, n, &prev);
+            if (p.checksum)
+                adler_update(&adler, dest + offset, n * p.bytes_per_elem);
+        }
+    }
+
+    /* Leftover bytes (a fractional element) pass through */
+    memcpy(dest + (data_size - leftover), src + (data_size - leftover), leftover);
+    if (p.checksum) {
+        uint32_t sum;
+
+        adler_update(&adler, src + (data_size - leftover), leftover);
+        sum = (adler.b << 16) | adler.a;
+
+        if (flags & H5Z_FLAG_REVERSE) {
+            const unsigned char *stored = src + data_size;
+
+            if (sum != ((uint32_t)stored[0] | ((uint32_t)stored[1] << 8)
+                        | ((uint32_t)stored[2] << 16) | ((uint32_t)stored[3] << 24)))
+                goto error;
+        }
+        else {
+            dest[data_size] = (unsigned char)(sum & 0xFF);
+            dest[data_size + 1] = (unsigned char)((sum >> 8) & 0xFF);
+            dest[data_size + 2] = (unsigned char)((sum >> 16) & 0xFF);
+            dest[data_size + 3] = (unsigned char)((sum >> 24) & 0xFF);
+        }
+    }
+
+    /* Swap in the new buffer */
+    free(*buf);
+    *buf = dest;
+    *buf_size = dest_size ? dest_size : 1;
+
+    return dest_size;
+
+error:
+    free(dest);
+
+    return 0;
+} /* end filter_fused() */
+
+
+/*********/
+/* TILES */
+/*********/
+
+/* One element in, one element out. SIZE is a constant in each expansion
+ * so the byte loops unroll into plain loads, stores, and shifts.
+ */
+#define ENCODE_ELEMENTS(SIZE)                                               \
+    do {                                                                    \
+        for (i = 0; i < n; i++) {                                           \
+            const unsigned char *e = in + i * (SIZE);                       \
+            uint64_t v = 0;                                                 \
+                                                                            \
+            for (j = 0; j < (SIZE); j++)                                    \
+                v |= (uint64_t)e[j] << (8 * j);                             \
+            v &= p->trim_mask;                                              \
+            if (p->delta) {                                                 \
+                uint64_t d = (v - last) & p->width_mask;                    \
+                                                                            \
+                last = v;                                                   \
+                v = d;                                                      \
+            }                                                               \
+            if (p->shuffle)                                                 \
+                for (j = 0; j < (SIZE); j++)                                \
+                    out[j * n + i] = (unsigned char)(v >> (8 * j));         \
+            else                                                            \
+                for (j = 0; j < (SIZE); j++)                                \
+                    out[i * (SIZE) + j] = (unsigned char)(v >> (8 * j));    \
+        }                                                                   \
+    } while (0)
+
+#define DECODE_ELEMENTS(SIZE)                                               \
+    do {                                                                    \
+        for (i = 0; i < n; i++) {                                           \
+            unsigned char *e = out + i * (SIZE);                            \
+            uint64_t v = 0;                                                 \
+                                                                            \
+            if (p->shuffle)                                                 \
+                for (j = 0; j < (SIZE); j++)                                \
+                    v |= (uint64_t)in[j * n + i] << (8 * j);                \
+            else                                                            \
+                for (j = 0; j < (SIZE); j++)                                \
+                    v |= (uint64_t)in[i * (SIZE) + j] << (8 * j);           \
+            if (p->delta) {                                                 \
+                v = (last + v) & p->width_mask;                             \
+                last = v;                                                   \
+            }                                                               \
+            for (j = 0; j < (SIZE); j++)                                    \
+                e[j] = (unsigned char)(v >> (8 * j));                       \
+        }                                                                   \
+    } while (0)
+
+static void
+encode_tile(const pipeline_t *p, const unsigned char *in, unsigned char *out,
+        size_t n, uint64_t *prev)
+{
+    uint64_t last = *prev;
+    size_t i;
+    unsigned j;
+
+    switch (p->bytes_per_elem) {
+        case 1:
+            ENCODE_ELEMENTS(1);
+            break;
+        case 2:
+            ENCODE_ELEMENTS(2);
+            break;
+        case 4:
+            ENCODE_ELEMENTS(4);
+            break;
+        case 8:
+            ENCODE_ELEMENTS(8);
+            break;
+        default:
+            /* Only shuffle and checksum apply to other sizes */
+            if (p->shuffle) {
+                for (i = 0; i < n; i++)
+                    for (j = 0; j < p->bytes_per_elem; j++)
+                        out[j * n + i] = in[i * p->bytes_per_elem + j];
+            }
+            else
+                memcpy(out, in, n * p->bytes_per_elem);
+            break;
+    }
+
+    *prev = last;
+} /* end encode_tile() */
+
+static void
+decode_tile(const pipeline_t *p, const unsigned char *in, unsigned char *out,
+        size_t n, uint64_t *prev)
+{
+    uint64_t last = *prev;
+    size_t i;
+    unsigned j;
+
+    switch (p->bytes_per_elem) {
+        case 1:
+            DECODE_ELEMENTS(1);
+            break;
+        case 2:
+            DECODE_ELEMENTS(2);
+            break;
+        case 4:
+            DECODE_ELEMENTS(4);
+            break;
+        case 8:
+            DECODE_ELEMENTS(8);
+            break;
+        default:
+            if (p->shuffle) {
+                for (i = 0; i < n; i++)
+                    for (j = 0; j < p->bytes_per_elem; j++)
+                        out[i * p->bytes_per_elem + j] = in[j * n + i];
+            }
+            else
+                memcpy(out, in, n * p->bytes_per_elem);
+            break;
+    }
+
+    *prev = last;
+} /* end decode_tile() */
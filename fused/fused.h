@@ -0,0 +1,81 @@
+/* fused.h
+ *
+ * Public header for the fused pipeline filter.
+ *
+ * One filter that runs a short chain of simple stages (trim, delta,
+ * shuffle, checksum) in a single pass. The chunk is processed in tiles
+ * sized to fit in L2: each element is read once, pushed through the
+ * element stages, and written straight to its place in the tile's byte
+ * planes, and the checksum is taken while the tile is still in cache. That
+ * replaces a chain of separate filters, each of which allocates a whole
+ * chunk and walks all of it.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FUSED_H
+#define _FUSED_H
+
+/* The filter ID number (NOTE: Has nothing to do with HDF5 hid_t IDs)
+ */
+#define FUSED_ID                    ((H5Z_filter_t)324)
+
+/* Filter parameters (cd_values)
+ *
+ *  [0] tile size in KiB (0 = half the L2 cache, or 256 KiB if unknown)
+ *  [1] number of stages
+ *  [2...] the stages in order, each a FUSED_STAGE_* code; FUSED_STAGE_TRIM
+ *      is followed by its parameter
+ *
+ * Any subset of the stages may be used, each at most once and in the
+ * order trim, delta, shuffle, checksum. Trim and delta work on 1, 2, 4, or
+ * 8 byte little-endian elements. E.g., trim the low 4 bits, delta,
+ * shuffle, checksum:
+ *
+ *  unsigned cd_values[] = {0, 4, FUSED_STAGE_TRIM, 4, FUSED_STAGE_DELTA,
+ *          FUSED_STAGE_SHUFFLE, FUSED_STAGE_CHECKSUM};
+ *  H5Pset_filter(dcpl_id, FUSED_ID, H5Z_FLAG_MANDATORY, 7, cd_values);
+ *
+ * The element size is appended when the dataset is created.
+ */
+#define FUSED_PARM_TILE_KIB         0
+#define FUSED_PARM_N_STAGES         1
+#define FUSED_PARM_STAGES           2
+
+/* Largest number of cd_values a user may pass */
+#define FUSED_MAX_USER_NPARMS       16
+
+/* The stages */
+#define FUSED_STAGE_TRIM            1   /* Lossy: zero the N low bits of each element */
+#define FUSED_STAGE_DELTA           2   /* Replace each element with its difference from the previous one */
+#define FUSED_STAGE_SHUFFLE         3   /* Byte shuffle (per tile) */
+#define FUSED_STAGE_CHECKSUM        4   /* Append an Adler-32 of the output, checked on read */
+
+#endif /* _FUSED_H */
@@ -0,0 +1,361 @@
+/* fused_test_program.c
+ *
+ * Test program for the fused pipeline filter.
+ *
+ * Writes integer data through fused (delta -> shuffle -> checksum) [-> gzip],
+ * reads it back, checks it, and reports the storage size.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hdf5.h>
+
+#include "fused.h"
+
+/* Names */
+#define TEST_FILE_NAME  "fused_%d_%d.h5"
+#define FNAME_MAX       64
+#define DSET_NAME       "filtered data"
+
+/* Dataset and chunk sizes
+ * Note that the sizes are in elements, not bytes
+ */
+#define NDIMS           1                       /* 1-dimensional */
+#define DSET_DIMS       (5 * 1024 * 1024)       /* 20 MiB w/ 32-bit ints */
+#define CHUNK_DIMS      (128 * 1024)            /* 512 KiB w/ 32-bit ints */
+
+/* I/O size */
+#define ELEMS_PER_IO    (64 * 1024)             /* 1/2 chunk to force partial chunk writes */
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define HDF5_ERROR              do {PRINT_ERROR_MSG; goto error;} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+
+int
+create_file(const char *filename, unsigned tile_kib, int gzip_level)
+{
+    hid_t fid       = H5I_INVALID_HID;
+    hid_t sid       = H5I_INVALID_HID;
+    hid_t dcpl_id   = H5I_INVALID_HID;
+    hid_t did       = H5I_INVALID_HID;
+    hsize_t dset_dims   = DSET_DIMS;
+    hsize_t chunk_dims  = CHUNK_DIMS;
+    unsigned cd_values[5] = {tile_kib, 3, FUSED_STAGE_DELTA, FUSED_STAGE_SHUFFLE, FUSED_STAGE_CHECKSUM};
+
+    /* Create the test file */
+    if (H5I_INVALID_HID == (fid = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)))
+        HDF5_ERROR;
+
+    /* Create a simple dataspace to describe the dataset's size */
+    if (H5I_INVALID_HID == (sid = H5Screate_simple(NDIMS, &dset_dims, NULL)))
+        HDF5_ERROR;
+
+    /* Create a dataset creation property list and turn chunking on */
+    if (H5I_INVALID_HID == (dcpl_id = H5Pcreate(H5P_DATASET_CREATE)))
+        HDF5_ERROR;
+    if (H5Pset_chunk(dcpl_id, NDIMS, &chunk_dims) < 0)
+        HDF5_ERROR;
+
+    /* One fused filter instead of delta, shuffle, and fletcher32 filters */
+    printf("FUSED DELTA - SHUFFLE - CHECKSUM (TILE %u KiB) - ", tile_kib);
+    if (H5Pset_filter(dcpl_id, FUSED_ID, H5Z_FLAG_MANDATORY, 5, cd_values) < 0)
+        HDF5_ERROR;
+    if (0 == gzip_level)
+        printf("NO GZIP\n");
+    else {
+        printf("GZIP LEVEL %d\n", gzip_level);
+        if (H5Pset_deflate(dcpl_id, (unsigned)gzip_level) < 0)
+            HDF5_ERROR;
+    }
+
+    /* Create the dataset (in the root group) */
+    if (H5I_INVALID_HID == (did = H5Dcreate(fid, DSET_NAME, H5T_STD_I32LE, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)))
+        HDF5_ERROR;
+
+    /* Close everything */
+    if (H5Fclose(fid) < 0)
+        HDF5_ERROR;
+    if (H5Sclose(sid) < 0)
+        HDF5_ERROR;
+    if (H5Pclose(dcpl_id) < 0)
+        HDF5_ERROR;
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+
+    return 0;
+
+error:
+    /* Error case clean up */
+    H5E_BEGIN_TRY {
+        H5Fclose(fid);
+        H5Sclose(sid);
+        H5Pclose(dcpl_id);
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end create_file() */
+
+int
+write_to_file(const char *filename)
+{
+    hid_t fid       = H5I_INVALID_HID;
+    hid_t msid      = H5I_INVALID_HID;
+    hid_t fsid      = H5I_INVALID_HID;
+    hid_t did       = H5I_INVALID_HID;
+    int *buf        = NULL;
+    hsize_t msid_dims       = ELEMS_PER_IO;
+    hsize_t n_elems_written = 0;
+    int i;
+
+    /* Open the test file */
+    if (H5I_INVALID_HID == (fid = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT)))
+        HDF5_ERROR;
+
+    /* Open the dataset */
+    if (H5I_INVALID_HID == (did = H5Dopen(fid, DSET_NAME, H5P_DEFAULT)))
+        HDF5_ERROR;
+
+    /* Set up a dataspace to represent the in-memory data */
+    if (H5I_INVALID_HID == (msid = H5Screate_simple(NDIMS, &msid_dims, NULL)))
+        HDF5_ERROR;
+
+    /* Set up a dataspace to represent a subset of the dataset */
+    if (H5I_INVALID_HID == (fsid = H5Dget_space(did)))
+        HDF5_ERROR;
+
+    /* Allocate the buffer */
+    if (NULL == (buf = (int *)calloc(ELEMS_PER_IO, sizeof(int))))
+        PROGRAM_ERROR("memory allocation for buf failed");
+
+    /* Write data to the file */
+    while (n_elems_written < DSET_DIMS) {
+        hsize_t start   = n_elems_written;
+        hsize_t stride  = 1;
+        hsize_t count   = 1;
+        hsize_t block   = ELEMS_PER_IO;
+
+        for (i = 0; i < ELEMS_PER_IO; i++)
+            buf[i] = (int)start + i;
+
+        /* Adjust the dataset dataspace's hyperslab */
+        if (H5Sselect_hyperslab(fsid, H5S_SELECT_SET, &start, &stride, &count, &block) < 0)
+            HDF5_ERROR;
+
+        /* Write the data */
+        if (H5Dwrite(did, H5T_NATIVE_INT, msid, fsid, H5P_DEFAULT, buf) < 0)
+            HDF5_ERROR;
+
+        /* Update the count */
+        n_elems_written += ELEMS_PER_IO;
+    }
+
+    /* Close everything */
+    if (H5Fclose(fid) < 0)
+        HDF5_ERROR;
+    if (H5Sclose(msid) < 0)
+        HDF5_ERROR;
+    if (H5Sclose(fsid) < 0)
+        HDF5_ERROR;
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+    free(buf);
+
+    return 0;
+
+error:
+    /* Error case clean up */
+    H5E_BEGIN_TRY {
+        H5Fclose(fid);
+        H5Sclose(msid);
+        H5Sclose(fsid);
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    free(buf);
+
+    return -1;
+} /* end write_to_file() */
+
+int
+read_from_file(const char *filename)
+{
+    hid_t fid       = H5I_INVALID_HID;
+    hid_t msid      = H5I_INVALID_HID;
+    hid_t fsid      = H5I_INVALID_HID;
+    hid_t did       = H5I_INVALID_HID;
+    int *buf        = NULL;
+    hsize_t msid_dims       = ELEMS_PER_IO;
+    hsize_t n_elems_read    = 0;
+    hsize_t storage_size;
+    int i;
+
+    /* Open the test file (read-only) */
+    if (H5I_INVALID_HID == (fid = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT)))
+        HDF5_ERROR;
+
+    /* Open the dataset */
+    if (H5I_INVALID_HID == (did = H5Dopen(fid, DSET_NAME, H5P_DEFAULT)))
+        HDF5_ERROR;
+
+    /* Set up a dataspace to represent the in-memory data */
+    if (H5I_INVALID_HID == (msid = H5Screate_simple(NDIMS, &msid_dims, NULL)))
+        HDF5_ERROR;
+
+    /* Set up a dataspace to represent a subset of the dataset */
+    if (H5I_INVALID_HID == (fsid = H5Dget_space(did)))
+        HDF5_ERROR;
+
+    /* Allocate the buffer */
+    if (NULL == (buf = (int *)calloc(ELEMS_PER_IO, sizeof(int))))
+        PROGRAM_ERROR("memory allocation for buf failed");
+
+    /* Read the data from the file */
+    while (n_elems_read < DSET_DIMS) {
+        hsize_t start   = n_elems_read;
+        hsize_t stride  = 1;
+        hsize_t count   = 1;
+        hsize_t block   = ELEMS_PER_IO;
+
+        /* Adjust the dataset dataspace's hyperslab */
+        if (H5Sselect_hyperslab(fsid, H5S_SELECT_SET, &start, &stride, &count, &block) < 0)
+            HDF5_ERROR;
+
+        /* Read the data */
+        if (H5Dread(did, H5T_NATIVE_INT, msid, fsid, H5P_DEFAULT, buf) < 0)
+            HDF5_ERROR;
+
+        /* Verify the data and reset the buffer */
+        for (i = 0; i < ELEMS_PER_IO; i++)
+            if (buf[i] != (int)start + i)
+                PROGRAM_ERROR("incorrect data read from file");
+        memset(buf, 0, (size_t)(ELEMS_PER_IO * sizeof(int)));
+
+        /* Update the count */
+        n_elems_read += ELEMS_PER_IO;
+    }
+
+    /* How much did it save? */
+    storage_size = H5Dget_storage_size(did);
+    printf("stored %llu of %llu bytes (ratio %.2f)\n", (unsigned long long)storage_size,
+            (unsigned long long)(DSET_DIMS * sizeof(int)),
+            storage_size ? (double)(DSET_DIMS * sizeof(int)) / (double)storage_size : 0.0);
+
+    /* Close everything */
+    if (H5Fclose(fid) < 0)
+        HDF5_ERROR;
+    if (H5Sclose(msid) < 0)
+        HDF5_ERROR;
+    if (H5Sclose(fsid) < 0)
+        HDF5_ERROR;
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+    free(buf);
+
+    return 0;
+
+error:
+    /* Error case clean up */
+    H5E_BEGIN_TRY {
+        H5Fclose(fid);
+        H5Sclose(msid);
+        H5Sclose(fsid);
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    free(buf);
+
+    return -1;
+} /* end read_from_file() */
+
+void
+usage(FILE *stream)
+{
+    fprintf(stream, "Usage: fused_test_program <tile KiB> <gzip level>\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "<tile KiB>:\n");
+    fprintf(stream, "   0 = Half the L2 cache\n");
+    fprintf(stream, "   n = Work in tiles of n KiB\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "<gzip level>:\n");
+    fprintf(stream, "   0 = Don't follow the fused filter with gzip\n");
+    fprintf(stream, "   1-9 = Use gzip after the fused filter with compression level n\n");
+    fprintf(stream, "\n");
+} /* end usage() */
+
+int
+main(int argc, char *argv[])
+{
+    int tile_kib = 0;
+    int gzip_level = 0;
+    char filename[FNAME_MAX];
+
+    /* Parse command line (crudely) */
+    if (argc != 3) {
+        usage(stderr);
+        PROGRAM_ERROR("Incorrect number of parameters");
+    }
+
+    tile_kib = atoi(argv[1]);
+    if (tile_kib < 0) {
+        usage(stderr);
+        PROGRAM_ERROR("tile size can't be negative");
+    }
+
+    gzip_level = atoi(argv[2]);
+    if (gzip_level < 0 || gzip_level > 9) {
+        usage(stderr);
+        PROGRAM_ERROR("gzip level must be between 0 and 9 (inclusive)");
+    }
+
+    if (snprintf(filename, FNAME_MAX, TEST_FILE_NAME, tile_kib, gzip_level) < 0)
+        PROGRAM_ERROR("Unable to compose filename");
+
+    /* Create file, write to it, and read the data back */
+    if (create_file(filename, (unsigned)tile_kib, gzip_level) < 0)
+        PROGRAM_ERROR("Unable to create file");
+
+    if (write_to_file(filename) < 0)
+        PROGRAM_ERROR("Unable to write to file");
+
+    if (read_from_file(filename) < 0)
+        PROGRAM_ERROR("Unable to read from file");
+
+    return EXIT_SUCCESS;
+
+error:
+    return EXIT_FAILURE;
+} /* end main */
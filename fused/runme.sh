@@ -0,0 +1,13 @@
+#!/bin/sh
+#
+# This really isn't necessary, but it makes it obvious that you need to set
+# the plugin path in order to find your fancy new filter plugin.
+export HDF5_PLUGIN_PATH="."
+
+# L2-sized tiles with and without gzip, then a few fixed tile sizes
+./fused_test_program 0 0
+./fused_test_program 0 1
+for tile_kib in 16 64 1024
+do
+    ./fused_test_program $tile_kib 1
+done
@@ -0,0 +1,372 @@
+/* pdeflate.c
+ *
+ * HDF5 filter plugin for block-parallel deflate, plus the random access
+ * functions declared in pdeflate.h.
+ *
+ * Chunk layout (all integers are 32-bit little-endian):
+ *
+ *      uncompressed size
+ *      block size
+ *      end offset of each block, measured from the start of the first block
+ *      the blocks, each a zlib stream
+ *
+ * A block whose stored length equals its uncompressed length didn't shrink
+ * and is stored as is. Every block but the last holds exactly block size
+ * bytes, so block i starts at byte i * block size of the uncompressed chunk
+ * and any byte range maps straight to a run of blocks.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+/* The HDF5 external plugin header */
+#include <H5PLextern.h>
+
+#include "pdeflate.h"
+
+/* Size of the fixed part of the header */
+#define HEADER_FIXED_SIZE           8
+
+/* A parsed chunk header */
+typedef struct layout_t {
+    size_t nbytes;                  /* Uncompressed size */
+    size_t block_size;              /* Uncompressed bytes per block */
+    size_t n_blocks;                /* Number of blocks */
+    const uint8_t *table;           /* Block end offsets */
+    const uint8_t *blocks;          /* First block */
+    size_t blocks_size;             /* Bytes from blocks to the end of the chunk */
+} layout_t;
+
+/* The data conversion function for this filter */
+static size_t filter_pdeflate(unsigned int flags, size_t cd_nelmts,
+        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
+        void **buf);
+
+
+/* Information about this filter
+ * H5Z_class2_t is defined in H5Zpublic.h
+ */
+const H5Z_class2_t PDEFLATE_CLASS[1] = {{
+    H5Z_CLASS_T_VERS,                       /* Filter class version */
+    PDEFLATE_ID,                            /* Filter id number */
+    1,                                      /* encoder_present flag */
+    1,                                      /* decoder_present flag */
+    "pdeflate",                             /* Filter name for debugging */
+    NULL,                                   /* The "can apply" callback */
+    NULL,                                   /* The "set local" callback */
+    (H5Z_func_t)filter_pdeflate,            /* The actual filter function */
+}};
+
+
+/* The plugin functions you must implement when you include H5PLextern.h */
+H5PL_type_t H5PLget_plugin_type(void) { return H5PL_TYPE_FILTER; }
+const void *H5PLget_plugin_info(void) { return PDEFLATE_CLASS; }
+
+
+static void
+put32(uint8_t *p, size_t v)
+{
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)((v >> 24) & 0xFF);
+} /* end put32() */
+
+static size_t
+get32(const uint8_t *p)
+{
+    return (size_t)p[0] | ((size_t)p[1] << 8) | ((size_t)p[2] << 16) | ((size_t)p[3] << 24);
+} /* end get32() */
+
+
+/* Reads and sanity checks the header of a compressed chunk */
+static herr_t
+parse_layout(const void *chunk, size_t chunk_size, layout_t *layout)
+{
+    const uint8_t *p = (const uint8_t *)chunk;
+    size_t header_size;
+
+    if (NULL == chunk || chunk_size < HEADER_FIXED_SIZE)
+        goto error;
+
+    layout->nbytes = get32(p);
+    layout->block_size = get32(p + 4);
+    if (0 == layout->block_size)
+        goto error;
+    layout->n_blocks = (layout->nbytes + layout->block_size - 1) / layout->block_size;
+
+    header_size = HEADER_FIXED_SIZE + 4 * layout->n_blocks;
+    if (header_size > chunk_size)
+        goto error;
+
+    layout->table = p + HEADER_FIXED_SIZE;
+    layout->blocks = p + header_size;
+    layout->blocks_size = chunk_size - header_size;
+
+    return 0;
+
+error:
+    return -1;
+} /* end parse_layout() */
+
+/* Decodes block i into dest, which has room for the whole block */
+static herr_t
+decode_block(const layout_t *layout, size_t i, uint8_t *dest)
+{
+    size_t raw_size = layout->block_size;
+    size_t start = i ? get32(layout->table + 4 * (i - 1)) : 0;
+    size_t end = get32(layout->table + 4 * i);
+
+    if (i == layout->n_blocks - 1)
+        raw_size = layout->nbytes - i * layout->block_size;
+    if (start > end || end > layout->blocks_size)
+        goto error;
+
+    if (end - start == raw_size)
+        memcpy(dest, layout->blocks + start, raw_size);
+    else {
+        uLongf out_size = (uLongf)raw_size;
+
+        if (Z_OK != uncompress(dest, &out_size, layout->blocks + start, (uLong)(end - start)))
+            goto error;
+        if (out_size != raw_size)
+            goto error;
+    }
+
+    return 0;
+
+error:
+    return -1;
+} /* end decode_block() */
+
+
+static size_t
+filter_pdeflate(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    const uint8_t *src = (const uint8_t *)*buf;
+    uint8_t *dest = NULL;
+    size_t dest_size;                       /* Valid bytes in dest */
+    size_t alloc_size;                      /* Size of the dest allocation */
+    long long i;
+    int n_failed = 0;                       /* Number of blocks that failed */
+
+    if (flags & H5Z_FLAG_REVERSE) {
+        /* Decompress data */
+        layout_t layout;
+
+        if (parse_layout(src, nbytes, &layout) < 0)
+            goto error;
+
+        dest_size = layout.nbytes;
+        alloc_size = dest_size ? dest_size : 1;
+        if (NULL == (dest = (uint8_t *)malloc(alloc_size)))
+            goto error;
+
+        /* Every block decodes into its own slice of the output */
+        #pragma omp parallel for schedule(dynamic) reduction(+:n_failed) if(layout.n_blocks > 1)
+        for (i = 0; i < (long long)layout.n_blocks; i++) {
+            if (decode_block(&layout, (size_t)i, dest + (size_t)i * layout.block_size) < 0)
+                n_failed++;
+        }
+
+        if (n_failed > 0)
+            goto error;
+    }
+    else {
+        /* Compress data */
+        unsigned level = PDEFLATE_LEVEL_DEFAULT;
+        unsigned block_kib = PDEFLATE_BLOCK_KIB_DEFAULT;
+        size_t block_size;
+        size_t n_blocks;
+        size_t header_size;
+        size_t slot_size;
+        size_t end;
+        uint8_t *table;
+        void *shrunk;
+
+        if (cd_nelmts > PDEFLATE_PARM_LEVEL)
+            level = cd_values[PDEFLATE_PARM_LEVEL];
+        if (cd_nelmts > PDEFLATE_PARM_BLOCK_KIB)
+            block_kib = cd_values[PDEFLATE_PARM_BLOCK_KIB];
+        if (level < 1 || level > 9)
+            goto error;
+        if (block_kib < PDEFLATE_BLOCK_KIB_MIN || block_kib > UINT32_MAX / 1024)
+            goto error;
+        if (nbytes > UINT32_MAX)
+            goto error;
+
+        block_size = (size_t)block_kib * 1024;
+        n_blocks = (nbytes + block_size - 1) / block_size;
+        header_size = HEADER_FIXED_SIZE + 4 * n_blocks;
+
+        /* Each block first goes into its own worst-case slot so the threads
+         * never have to agree on where a block lands. The blocks are packed
+         * together afterwards.
+         */
+        slot_size = (size_t)compressBound((uLong)block_size);
+        alloc_size = header_size + n_blocks * slot_size;
+        if (NULL == (dest = (uint8_t *)malloc(alloc_size)))
+            goto error;
+        table = dest + HEADER_FIXED_SIZE;
+
+        put32(dest, nbytes);
+        put32(dest + 4, block_size);
+
+        #pragma omp parallel for schedule(dynamic) if(n_blocks > 1)
+        for (i = 0; i < (long long)n_blocks; i++) {
+            size_t offset = (size_t)i * block_size;
+            size_t raw_size = nbytes - offset < block_size ? nbytes - offset : block_size;
+            uint8_t *slot = dest + header_size + (size_t)i * slot_size;
+            uLongf out_size = (uLongf)slot_size;
+
+            /* Blocks that don't shrink (or that zlib chokes on) are stored */
+            if (Z_OK != compress2(slot, &out_size, src + offset, (uLong)raw_size, (int)level)
+                    || out_size >= raw_size) {
+                memcpy(slot, src + offset, raw_size);
+                out_size = (uLongf)raw_size;
+            }
+            put32(table + 4 * (size_t)i, (size_t)out_size);
+        }
+
+        /* Pack the blocks and turn the lengths into end offsets */
+        for (end = 0, i = 0; i < (long long)n_blocks; i++) {
+            size_t len = get32(table + 4 * (size_t)i);
+
+            memmove(dest + header_size + end, dest + header_size + (size_t)i * slot_size, len);
+            end += len;
+            put32(table + 4 * (size_t)i, end);
+        }
+        dest_size = header_size + end;
+
+        /* Give back the unused slot space */
+        if (NULL != (shrunk = realloc(dest, dest_size))) {
+            dest = (uint8_t *)shrunk;
+            alloc_size = dest_size;
+        }
+    }
+
+    /* Swap in the new buffer */
+    free(*buf);
+    *buf = dest;
+    *buf_size = alloc_size;
+
+    return dest_size;
+
+error:
+    free(dest);
+
+    return 0;
+} /* end filter_pdeflate() */
+
+
+herr_t
+pdeflate_get_info(const void *chunk, size_t chunk_size, size_t *nbytes,
+        size_t *block_size)
+{
+    layout_t layout;
+
+    if (parse_layout(chunk, chunk_size, &layout) < 0)
+        goto error;
+
+    if (nbytes)
+        *nbytes = layout.nbytes;
+    if (block_size)
+        *block_size = layout.block_size;
+
+    return 0;
+
+error:
+    return -1;
+} /* end pdeflate_get_info() */
+
+
+herr_t
+pdeflate_read_range(const void *chunk, size_t chunk_size, size_t offset,
+        size_t length, void *dest)
+{
+    layout_t layout;
+    uint8_t *out = (uint8_t *)dest;
+    uint8_t *scratch = NULL;
+    size_t first, last, b;
+
+    if (parse_layout(chunk, chunk_size, &layout) < 0)
+        goto error;
+    if (NULL == dest || offset > layout.nbytes || length > layout.nbytes - offset)
+        goto error;
+    if (0 == length)
+        return 0;
+
+    first = offset / layout.block_size;
+    last = (offset + length - 1) / layout.block_size;
+
+    /* Whole blocks decode straight into dest; the partial ones at either
+     * end go through one block of scratch space.
+     */
+    for (b = first; b <= last; b++) {
+        size_t block_start = b * layout.block_size;
+        size_t block_end = block_start + layout.block_size;
+        size_t lo, hi;
+
+        if (block_end > layout.nbytes)
+            block_end = layout.nbytes;
+        lo = offset > block_start ? offset : block_start;
+        hi = offset + length < block_end ? offset + length : block_end;
+
+        if (lo == block_start && hi == block_end) {
+            if (decode_block(&layout, b, out + (block_start - offset)) < 0)
+                goto error;
+        }
+        else {
+            if (NULL == scratch && NULL == (scratch = (uint8_t *)malloc(layout.block_size)))
+                goto error;
+            if (decode_block(&layout, b, scratch) < 0)
+                goto error;
+            memcpy(out + (lo - offset), scratch + (lo - block_start), hi - lo);
+        }
+    }
+
+    free(scratch);
+
+    return 0;
+
+error:
+    free(scratch);
+
+    return -1;
+} /* end pdeflate_read_range() */
@@ -0,0 +1,95 @@
+/* pdeflate.h
+ *
+ * Public header for the block-parallel deflate filter.
+ *
+ * The filter splits each chunk into fixed-size blocks and deflates them
+ * independently, spread over the OpenMP thread pool, so compressing a big
+ * chunk is no longer stuck on one core. A small table of block offsets
+ * goes in front of the blocks. Decoding is parallel too, and the table
+ * makes it possible to decode just the blocks that cover a byte range of
+ * a chunk read with H5Dread_chunk() (see pdeflate_read_range() below).
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PDEFLATE_H
+#define _PDEFLATE_H
+
+/* The filter ID number (NOTE: Has nothing to do with HDF5 hid_t IDs)
+ */
+#define PDEFLATE_ID                 ((H5Z_filter_t)323)
+
+/* Filter parameters (cd_values)
+ *
+ * Both are optional:
+ *
+ *  [0] gzip level, 1-9 (default 6)
+ *  [1] block size in KiB (default 256, minimum 4)
+ *
+ *  unsigned cd_values[2] = {1, 256};
+ *  H5Pset_filter(dcpl_id, PDEFLATE_ID, H5Z_FLAG_OPTIONAL, 2, cd_values);
+ *
+ * Smaller blocks give more parallelism and finer random access but cost
+ * some ratio, since deflate's window restarts at every block.
+ */
+#define PDEFLATE_PARM_LEVEL         0
+#define PDEFLATE_PARM_BLOCK_KIB     1
+
+#define PDEFLATE_LEVEL_DEFAULT      6
+#define PDEFLATE_BLOCK_KIB_DEFAULT  256
+#define PDEFLATE_BLOCK_KIB_MIN      4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Random access into compressed chunks
+ *
+ * These work on a chunk exactly as this filter stored it, e.g. as returned
+ * by H5Dread_chunk() when pdeflate is the last filter in the pipeline.
+ *
+ * pdeflate_get_info() returns the chunk's uncompressed size and block size.
+ *
+ * pdeflate_read_range() decodes only the blocks that cover bytes
+ * [offset, offset + length) of the uncompressed chunk and copies that range
+ * into dest.
+ *
+ * Both return 0 on success and -1 on a malformed chunk or a bad range.
+ */
+herr_t pdeflate_get_info(const void *chunk, size_t chunk_size,
+        size_t *nbytes, size_t *block_size);
+herr_t pdeflate_read_range(const void *chunk, size_t chunk_size,
+        size_t offset, size_t length, void *dest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PDEFLATE_H */
@@ -0,0 +1,11 @@
+#!/bin/sh
+#
+# This really isn't necessary, but it makes it obvious that you need to set
+# the plugin path in order to find your fancy new filter plugin.
+export HDF5_PLUGIN_PATH="."
+
+# Small blocks (lots of parallelism) to one block per chunk (plain deflate)
+for block_kib in 16 64 256 1024
+do
+    ./pdeflate_test_program 1 $block_kib
+done
@@ -0,0 +1,643 @@
+/* rle.c
+ *
+ * HDF5 filter plugin for run-length encoding at the element level (see
+ * rle.h).
+ *
+ * Chunk layout:
+ *
+ *      bytes 0-3   uncompressed size (little-endian)
+ *      bytes 4-7   element size (little-endian)
+ *      byte  8     mode (see below)
+ *      byte  9     1 if literal elements are byte-shuffled
+ *      bytes 10-11 zero
+ *
+ * followed by, for each mode:
+ *
+ *      CONSTANT    one element, repeated to fill the chunk
+ *      RUNS        records, then any fractional element at the end as is
+ *      STORED      the elements (shuffled if flagged), then any fractional
+ *                  element as is. Used when RUNS would not be smaller.
+ *
+ * A record is a LEB128 token, (count << 1) | is_run, then either one element
+ * (a run of count copies) or count literal elements, byte-shuffled within
+ * the record when flagged.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+/* The HDF5 external plugin header */
+#include <H5PLextern.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RLE_X86
+#endif
+
+#include "rle.h"
+
+/* Local macros */
+#define RLE_PARM_SIZE               1   /* "Local" parameter for element size */
+#define RLE_USER_NPARMS             1   /* Number of parameters that users can set */
+#define RLE_TOTAL_NPARMS            2   /* Total number of parameters for filter */
+
+#define HEADER_SIZE                 12
+#define MODE_STORED                 0
+#define MODE_CONSTANT               1
+#define MODE_RUNS                   2
+
+#define MIN_RUN_BYTES               16  /* Shorter runs stay in the literals */
+#define TOKEN_MAX_SIZE              10  /* LEB128 bytes for a 64-bit token */
+
+/* Filter callback prototypes */
+static herr_t set_local_rle(hid_t dcpl_id, hid_t type_id, hid_t space_id);
+static size_t filter_rle(unsigned int flags, size_t cd_nelmts,
+        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
+        void **buf);
+
+/* Local prototypes */
+static size_t run_length(const unsigned char *p, size_t n, unsigned size, int avx2);
+static size_t next_pair(const unsigned char *p, size_t i, size_t n, unsigned size, int avx2);
+static int have_avx2(void);
+
+
+/* Information about this filter
+ * H5Z_class2_t is defined in H5Zpublic.h
+ */
+const H5Z_class2_t RLE_CLASS[1] = {{
+    H5Z_CLASS_T_VERS,                       /* Filter class version */
+    RLE_ID,                                 /* Filter id number */
+    1,                                      /* encoder_present flag */
+    1,                                      /* decoder_present flag */
+    "rle",                                  /* Filter name for debugging */
+    NULL,                                   /* The "can apply" callback */
+    set_local_rle,                          /* The "set local" callback */
+    (H5Z_func_t)filter_rle,                 /* The actual filter function */
+}};
+
+
+/* The plugin functions you must implement when you include H5PLextern.h */
+H5PL_type_t H5PLget_plugin_type(void) { return H5PL_TYPE_FILTER; }
+const void *H5PLget_plugin_info(void) { return RLE_CLASS; }
+
+
+static herr_t
+set_local_rle(hid_t dcpl_id, hid_t type_id, hid_t space_id)
+{
+    unsigned flags;                             /* Filter flags */
+    size_t type_size;                           /* Datatype size */
+    size_t cd_nelmts = RLE_USER_NPARMS;         /* # of filter parameters */
+    unsigned cd_values[RLE_TOTAL_NPARMS];       /* Filter parameters */
+
+    (void)space_id;
+
+    /* Get the filter's current parameters */
+    if (H5Pget_filter_by_id(dcpl_id, RLE_ID, &flags, &cd_nelmts, cd_values, (size_t)0, NULL, NULL) < 0)
+        goto error;
+
+    /* Shuffle the literals unless told not to */
+    if (cd_nelmts < RLE_USER_NPARMS)
+        cd_values[RLE_PARM_SHUFFLE] = 1;
+
+    /* Set "local" parameter for this dataset */
+    if (0 == (type_size = H5Tget_size(type_id)))
+        goto error;
+    cd_values[RLE_PARM_SIZE] = (unsigned)type_size;
+
+    /* Modify the filter's parameters for this dataset */
+    if (H5Pmodify_filter(dcpl_id, RLE_ID, flags, (size_t)RLE_TOTAL_NPARMS, cd_values) < 0)
+        goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end set_local_rle() */
+
+
+/************/
+/* ELEMENTS */
+/************/
+
+static void
+put32le(unsigned char *p, size_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+} /* end put32le() */
+
+static size_t
+get32le(const unsigned char *p)
+{
+    return (size_t)p[0] | ((size_t)p[1] << 8) | ((size_t)p[2] << 16) | ((size_t)p[3] << 24);
+} /* end get32le() */
+
+/* Writes count literal elements, byte-shuffled or as is */
+static void
+put_literals(const unsigned char *src, size_t count, unsigned size, int shuffle,
+        unsigned char *dest)
+{
+    size_t i;
+    unsigned b;
+
+    if (!shuffle || 1 == size) {
+        memcpy(dest, src, count * size);
+        return;
+    }
+
+    for (b = 0; b < size; b++)
+        for (i = 0; i < count; i++)
+            *dest++ = src[i * size + b];
+} /* end put_literals() */
+
+static void
+get_literals(const unsigned char *src, size_t count, unsigned size, int shuffle,
+        unsigned char *dest)
+{
+    size_t i;
+    unsigned b;
+
+    if (!shuffle || 1 == size) {
+        memcpy(dest, src, count * size);
+        return;
+    }
+
+    for (b = 0; b < size; b++)
+        for (i = 0; i < count; i++)
+            dest[i * size + b] = *src++;
+} /* end get_literals() */
+
+/* Fills count elements with value: a memset when every byte of the
+ * element is the same (zeros, most fill values), doubling copies otherwise
+ */
+static void
+fill_elements(unsigned char *dest, const unsigned char *value, size_t count, unsigned size)
+{
+    size_t total = count * size;
+    size_t done;
+    unsigned b;
+
+    if (0 == count)
+        return;
+
+    for (b = 1; b < size && value[b] == value[0]; b++)
+        ;
+    if (b == size) {
+        memset(dest, value[0], total);
+        return;
+    }
+
+    memcpy(dest, value, size);
+    for (done = size; done < total; done *= 2)
+        memcpy(dest + done, dest, done < total - done ? done : total - done);
+} /* end fill_elements() */
+
+
+/**********/
+/* TOKENS */
+/**********/
+
+static unsigned char *
+put_token(unsigned char *p, uint64_t token)
+{
+    while (token >= 0x80) {
+        *p++ = (unsigned char)(token | 0x80);
+        token >>= 7;
+    }
+    *p++ = (unsigned char)token;
+
+    return p;
+} /* end put_token() */
+
+/* Returns NULL on a malformed token */
+static const unsigned char *
+get_token(const unsigned char *p, const unsigned char *end, uint64_t *token)
+{
+    unsigned shift;
+
+    *token = 0;
+    for (shift = 0; p < end && shift < 64; shift += 7) {
+        *token |= (uint64_t)(*p & 0x7F) << shift;
+        if (!(*p++ & 0x80))
+            return p;
+    }
+
+    return NULL;
+} /* end get_token() */
+
+
+/* Encodes the n elements at src as RUNS records into dest, which has room
+ * for cap bytes. Returns the end of the records, or NULL if they don't fit.
+ */
+static unsigned char *
+encode_runs(const unsigned char *src, size_t n, unsigned size, int shuffle,
+        int avx2, unsigned char *dest, size_t cap)
+{
+    unsigned char *end = dest + cap;
+    size_t lit = 0;                 /* First element of the pending literals */
+    size_t i = 0;
+    size_t r;
+
+    while (i < n) {
+        /* Next place two neighbouring elements match, and how far it goes */
+        if (n == (i = next_pair(src, i, n, size, avx2)))
+            break;
+        r = run_length(src + i * size, n - i, size, avx2);
+        if (r * size < MIN_RUN_BYTES) {
+            i += r;
+            continue;
+        }
+
+        /* Flush the literals before the run, then the run */
+        if (i > lit) {
+            if ((size_t)(end - dest) < TOKEN_MAX_SIZE + (i - lit) * size)
+                return NULL;
+            dest = put_token(dest, (uint64_t)(i - lit) << 1);
+            put_literals(src + lit * size, i - lit, size, shuffle, dest);
+            dest += (i - lit) * size;
+        }
+        if ((size_t)(end - dest) < TOKEN_MAX_SIZE + size)
+            return NULL;
+        dest = put_token(dest, ((uint64_t)r << 1) | 1);
+        memcpy(dest, src + i * size, size);
+        dest += size;
+
+        i += r;
+        lit = i;
+    }
+
+    /* Trailing literals */
+    if (n > lit) {
+        if ((size_t)(end - dest) < TOKEN_MAX_SIZE + (n - lit) * size)
+            return NULL;
+        dest = put_token(dest, (uint64_t)(n - lit) << 1);
+        put_literals(src + lit * size, n - lit, size, shuffle, dest);
+        dest += (n - lit) * size;
+    }
+
+    return dest;
+} /* end encode_runs() */
+
+/* Decodes exactly n elements of RUNS records from [src, end) into dest.
+ * Returns the end of the records, or NULL if they are malformed.
+ */
+static const unsigned char *
+decode_runs(const unsigned char *src, const unsigned char *end, size_t n,
+        unsigned size, int shuffle, unsigned char *dest)
+{
+    size_t done = 0;
+    uint64_t token;
+    size_t count;
+
+    while (done < n) {
+        if (NULL == (src = get_token(src, end, &token)))
+            return NULL;
+        if (0 == (token >> 1) || (token >> 1) > n - done)
+            return NULL;
+        count = (size_t)(token >> 1);
+
+        if (token & 1) {
+            if ((size_t)(end - src) < size)
+                return NULL;
+            fill_elements(dest + done * size, src, count, size);
+            src += size;
+        }
+        else {
+            if ((size_t)(end - src) / size < count)
+                return NULL;
+            get_literals(src, count, size, shuffle, dest + done * size);
+            src += count * size;
+        }
+        done += count;
+    }
+
+    return src;
+} /* end decode_runs() */
+
+
+static size_t
+filter_rle(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    const unsigned char *src = (const unsigned char *)*buf;
+    unsigned char *dest = NULL;
+    size_t dest_size;               /* Valid bytes in dest */
+    size_t alloc_size;              /* Allocated bytes in dest */
+    size_t n_elements;
+    size_t leftover;
+    unsigned size;
+    int shuffle;
+    int avx2 = have_avx2();
+
+    if (flags & H5Z_FLAG_REVERSE) {
+        /* Decode (the header wins over cd_values) */
+        const unsigned char *p = src + HEADER_SIZE;
+        const unsigned char *end = src + nbytes;
+
+        if (nbytes < HEADER_SIZE)
+            goto error;
+        dest_size = get32le(src);
+        size = (unsigned)get32le(src + 4);
+        shuffle = src[9] != 0;
+        if (0 == size)
+            goto error;
+        n_elements = dest_size / size;
+        leftover = dest_size % size;
+
+        alloc_size = dest_size ? dest_size : 1;
+        if (NULL == (dest = (unsigned char *)malloc(alloc_size)))
+            goto error;
+
+        switch (src[8]) {
+            case MODE_CONSTANT:
+                if (0 == n_elements || nbytes != HEADER_SIZE + size + leftover)
+                    goto error;
+                fill_elements(dest, p, n_elements, size);
+                p += size;
+                break;
+
+            case MODE_RUNS:
+                if (NULL == (p = decode_runs(p, end, n_elements, size, shuffle, dest)))
+                    goto error;
+                if ((size_t)(end - p) != leftover)
+                    goto error;
+                break;
+
+            case MODE_STORED:
+                if (nbytes != HEADER_SIZE + dest_size)
+                    goto error;
+                get_literals(p, n_elements, size, shuffle, dest);
+                p += n_elements * size;
+                break;
+
+            default:
+                goto error;
+        }
+
+        memcpy(dest + n_elements * size, p, leftover);
+    }
+    else {
+        /* Encode */
+        unsigned char *p;
+
+        if (cd_nelmts != RLE_TOTAL_NPARMS)
+            goto error;
+        shuffle = cd_values[RLE_PARM_SHUFFLE] != 0;
+        size = cd_values[RLE_PARM_SIZE];
+        if (0 == size || nbytes > UINT32_MAX)
+            goto error;
+        n_elements = nbytes / size;
+        leftover = nbytes % size;
+
+        /* Uniform chunks are the common case for fill regions, so check for
+         * them before allocating a whole chunk's worth of output
+         */
+        if (n_elements > 0 && run_length(src, n_elements, size, avx2) == n_elements) {
+            alloc_size = dest_size = HEADER_SIZE + size + leftover;
+            if (NULL == (dest = (unsigned char *)malloc(alloc_size)))
+                goto error;
+            dest[8] = MODE_CONSTANT;
+            memcpy(dest + HEADER_SIZE, src, size);
+            memcpy(dest + HEADER_SIZE + size, src + n_elements * size, leftover);
+        }
+        else {
+            alloc_size = HEADER_SIZE + nbytes;
+            if (NULL == (dest = (unsigned char *)malloc(alloc_size)))
+                goto error;
+
+            /* Fall back to storing the elements if the runs don't pay */
+            p = encode_runs(src, n_elements, size, shuffle, avx2, dest + HEADER_SIZE, nbytes - leftover);
+            if (p) {
+                dest[8] = MODE_RUNS;
+            }
+            else {
+                dest[8] = MODE_STORED;
+                put_literals(src, n_elements, size, shuffle, dest + HEADER_SIZE);
+                p = dest + HEADER_SIZE + n_elements * size;
+            }
+            memcpy(p, src + n_elements * size, leftover);
+            dest_size = (size_t)(p - dest) + leftover;
+        }
+
+        put32le(dest, nbytes);
+        put32le(dest + 4, size);
+        dest[9] = (unsigned char)shuffle;
+        dest[10] = dest[11] = 0;
+    }
+
+    /* Swap in the new buffer */
+    free(*buf);
+    *buf = dest;
+    *buf_size = alloc_size;
+
+    return dest_size;
+
+error:
+    free(dest);
+
+    return 0;
+} /* end filter_rle() */
+
+
+/**********/
+/* SCALAR */
+/**********/
+
+/* First byte of p[0, nbytes) that differs from the 32-byte repeating
+ * pattern, or nbytes
+ */
+static size_t
+mismatch_scalar(const unsigned char *p, size_t nbytes, const unsigned char *pattern)
+{
+    size_t k;
+
+    for (k = 0; k + 8 <= nbytes; k += 8) {
+        uint64_t a, b;
+
+        memcpy(&a, p + k, 8);
+        memcpy(&b, pattern + k % 32, 8);
+        if (a != b)
+            break;
+    }
+    for (; k < nbytes; k++)
+        if (p[k] != pattern[k % 32])
+            return k;
+
+    return nbytes;
+} /* end mismatch_scalar() */
+
+static size_t
+next_pair_scalar(const unsigned char *p, size_t i, size_t n, unsigned size)
+{
+    for (; i + 1 < n; i++)
+        if (0 == memcmp(p + i * size, p + (i + 1) * size, size))
+            return i;
+
+    return n;
+} /* end next_pair_scalar() */
+
+
+/********/
+/* AVX2 */
+/********/
+
+#ifdef RLE_X86
+
+__attribute__((target("avx2")))
+static size_t
+mismatch_avx2(const unsigned char *p, size_t nbytes, const unsigned char *pattern)
+{
+    const __m256i pat = _mm256_loadu_si256((const __m256i *)pattern);
+    size_t k;
+
+    /* 4 vectors per test while everything matches */
+    for (k = 0; k + 128 <= nbytes; k += 128) {
+        __m256i eq = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + k)), pat),
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + k + 32)), pat)),
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + k + 64)), pat),
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + k + 96)), pat)));
+
+        if (-1 != _mm256_movemask_epi8(eq))
+            break;
+    }
+    for (; k + 32 <= nbytes; k += 32) {
+        unsigned m = ~(unsigned)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + k)), pat));
+
+        if (m)
+            return k + (size_t)__builtin_ctz(m);
+    }
+
+    return k + mismatch_scalar(p + k, nbytes - k, pattern);
+} /* end mismatch_avx2() */
+
+/* Compares 32 bytes with the 32 bytes one element later; a bit per element
+ * (at its first byte) is set where the whole element matched
+ */
+__attribute__((target("avx2")))
+static size_t
+next_pair_avx2(const unsigned char *p, size_t i, size_t n, unsigned size)
+{
+    size_t nbytes = n * size;
+    size_t off = i * size;
+
+    for (; off + size + 32 <= nbytes; off += 32) {
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)(p + off)),
+                _mm256_loadu_si256((const __m256i *)(p + off + size))));
+
+        switch (size) {
+            case 2:
+                m &= (m >> 1) & 0x55555555u;
+                break;
+            case 4:
+                m &= m >> 1;
+                m &= (m >> 2) & 0x11111111u;
+                break;
+            case 8:
+                m &= m >> 1;
+                m &= m >> 2;
+                m &= (m >> 4) & 0x01010101u;
+                break;
+            default:
+                break;
+        }
+        if (m)
+            return (off + (size_t)__builtin_ctz(m)) / size;
+    }
+
+    return next_pair_scalar(p, off / size, n, size);
+} /* end next_pair_avx2() */
+
+#endif /* RLE_X86 */
+
+
+static int
+have_avx2(void)
+{
+#ifdef RLE_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+} /* end have_avx2() */
+
+/* Number of elements from p[0] on that equal p[0] (at least 1) */
+static size_t
+run_length(const unsigned char *p, size_t n, unsigned size, int avx2)
+{
+    unsigned char pattern[32];
+    size_t k;
+    unsigned j;
+
+    /* Cheap way out for literals */
+    if (n < 2 || 0 != memcmp(p, p + size, size))
+        return 1;
+
+    if (size > 32 || 32 % size) {
+        for (k = 2; k < n && 0 == memcmp(p, p + k * size, size); k++)
+            ;
+        return k;
+    }
+
+    for (j = 0; j < 32; j++)
+        pattern[j] = p[j % size];
+
+#ifdef RLE_X86
+    if (avx2)
+        return mismatch_avx2(p, n * size, pattern) / size;
+#endif
+
+    return mismatch_scalar(p, n * size, pattern) / size;
+} /* end run_length() */
+
+/* First element at or after i that equals the one after it, or n */
+static size_t
+next_pair(const unsigned char *p, size_t i, size_t n, unsigned size, int avx2)
+{
+#ifdef RLE_X86
+    if (avx2 && size <= 8 && 0 == (size & (size - 1)))
+        return next_pair_avx2(p, i, n, size);
+#endif
+
+    return next_pair_scalar(p, i, n, size);
+} /* end next_pair() */
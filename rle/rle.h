@@ -0,0 +1,62 @@
+/* rle.h
+ *
+ * Public header for the run-length filter.
+ *
+ * Sparse simulation output is mostly fill value, and shuffle + gzip still
+ * transposes and deflates every byte of it. This filter scans each chunk
+ * for runs of identical elements (a chunk that is all one value is stored
+ * as that value) and stores everything else as literals, byte-shuffled so
+ * that a following gzip does as well as it would after the shuffle filter.
+ * Decoding a run is a memset-style fill.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RLE_H
+#define _RLE_H
+
+/* The filter ID number (NOTE: Has nothing to do with HDF5 hid_t IDs)
+ */
+#define RLE_ID                      ((H5Z_filter_t)320)
+
+/* Filter parameters (cd_values)
+ *
+ * Users may pass one optional value: 1 (the default) to byte-shuffle the
+ * literal elements, 0 to store them as they are. Use it in place of the
+ * shuffle filter, not with it:
+ *
+ *  H5Pset_filter(dcpl_id, RLE_ID, H5Z_FLAG_MANDATORY, 0, NULL);
+ *  H5Pset_deflate(dcpl_id, 6);
+ *
+ * The element size is added when the dataset is created.
+ */
+#define RLE_PARM_SHUFFLE            0
+
+#endif /* _RLE_H */
@@ -0,0 +1,12 @@
+#!/bin/sh
+#
+# This really isn't necessary, but it makes it obvious that you need to set
+# the plugin path in order to find your fancy new filter plugin.
+export HDF5_PLUGIN_PATH="."
+
+# Plain and shuffled literals, alone and with gzip
+for shuffle in 0 1
+do
+    ./rle_test_program $shuffle 0
+    ./rle_test_program $shuffle 1
+done
@@ -0,0 +1,34 @@
+#!/bin/bash
+#
+# Compares the system's default pages with transparent and explicit huge
+# pages for big chunks. The default is normal pages only while transparent
+# huge pages are set to "madvise" or "never", so check that first.
+#
+# Explicit huge pages need a hugetlbfs pool, e.g.:
+#   echo 1024 | sudo tee /proc/sys/vm/nr_hugepages
+# Without one, shuffle_bench falls back to transparent huge pages.
+#
+# perf needs kernel.perf_event_paranoid <= 2 to count user-space TLB misses.
+
+# Make sure we have a fresh build
+make
+
+thp=/sys/kernel/mm/transparent_hugepage/enabled
+if [ -r $thp ] && grep -q '\[always\]' $thp
+then
+    echo "Transparent huge pages are set to \"always\", so the default run uses them too"
+    echo
+fi
+
+for pages in default transparent explicit
+do
+    echo "=== $pages ==="
+    if command -v perf > /dev/null
+    then
+        perf stat -e dTLB-loads,dTLB-load-misses,dTLB-store-misses \
+            ./shuffle_bench -p $pages "$@"
+    else
+        ./shuffle_bench -p $pages "$@"
+    fi
+    echo
+done
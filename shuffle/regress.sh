@@ -0,0 +1,26 @@
+#!/bin/bash
+#
+# Checks the shuffle kernels for performance regressions.
+#
+# The first run saves shuffle_baseline.json. Later runs compare against it
+# and exit nonzero if any kernel got significantly slower. Delete (or
+# re-save with -o) the baseline after an intentional change, and keep
+# baselines per machine: they aren't portable.
+#
+# Extra arguments go to shuffle_regress, e.g., -k avx2 or -t 10.
+
+baseline=${BASELINE:-shuffle_baseline.json}
+
+# Make sure we have a fresh build
+make
+
+# Pin the OpenMP kernels' threads so runs are comparable
+export OMP_PROC_BIND=${OMP_PROC_BIND:-close}
+
+if [ -f "$baseline" ]
+then
+    ./shuffle_regress -b "$baseline" "$@"
+else
+    echo "No baseline yet, saving $baseline"
+    ./shuffle_regress -o "$baseline" "$@"
+fi
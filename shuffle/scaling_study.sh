@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Scaling study for the OpenMP shuffle kernels.
+#
+# Runs shuffle_bench -S under each thread affinity policy and reports the
+# chunk size below which the serial kernel is faster. Build the plugins with
+# that threshold (cmake -DSHUFFLE_OMP_MIN_BYTES=...) or export
+# SHUFFLE_OMP_MIN_BYTES and the OpenMP plugins will stay serial for smaller
+# chunks.
+#
+# Extra arguments go to shuffle_bench, e.g., -k duff_omp or -t 1,2,4,8,16.
+
+# Make sure we have a fresh build
+make
+
+export OMP_PLACES=${OMP_PLACES:-cores}
+
+threshold=0
+for bind in false close spread
+do
+    echo "=== OMP_PROC_BIND=$bind ==="
+    OMP_PROC_BIND=$bind ./shuffle_bench -S "$@" | tee scaling_$bind.txt
+    echo
+
+    # Keep the most conservative crossover of the three
+    bytes=$(sed -n 's/^crossover:.*SHUFFLE_OMP_MIN_BYTES=\([0-9]*\)$/\1/p' scaling_$bind.txt)
+    if [ -z "$bytes" ]
+    then
+        threshold=none
+    elif [ "$threshold" != "none" ] && [ "$bytes" -gt "$threshold" ]
+    then
+        threshold=$bytes
+    fi
+done
+
+if [ "$threshold" = "none" ]
+then
+    echo "The OpenMP kernel never beat the serial one under some policy; use a serial plugin."
+else
+    echo "Recommended threshold:"
+    echo "    cmake -DSHUFFLE_OMP_MIN_BYTES=$threshold"
+    echo "    export SHUFFLE_OMP_MIN_BYTES=$threshold"
+fi
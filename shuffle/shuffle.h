@@ -42,11 +42,290 @@
  * 2) Shuffle w/o Duff's device copy
  * 3) #1 w/ OpenMP support
  * 4) #2 w/ OpenMP support
+ * 5) Blocked layout w/ sub-chunk random access (see below)
  */
 #define SHUFFLE_ID                  ((H5Z_filter_t)315)
 #define SHUFFLE_NODUFF_ID           ((H5Z_filter_t)316)
 #define SHUFFLE_OMP_ID              ((H5Z_filter_t)317)
 #define SHUFFLE_NODUFF_OMP_ID       ((H5Z_filter_t)318)
+#define SHUFFLE_BLOCKED_ID          ((H5Z_filter_t)319)
+
+/* Optional parameter of the blocked filter (cd_values): elements per block.
+ * 0 or no value means as many elements as fit in 16 KiB.
+ */
+#define SHUFFLE_BLOCKED_PARM_BLOCK_ELEMS    0
+
+/* The plugins are built with hidden visibility, so only what's marked here
+ * is exported. Each plugin then keeps its own kernel and state even when an
+ * application has linked another plugin for this API.
+ */
+#if defined(__GNUC__)
+#define SHUFFLE_API                 __attribute__((visibility("default")))
+#else
+#define SHUFFLE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Batched [un]shuffle for callers that bypass HDF5's per-chunk filter loop
+ * (e.g., direct chunk I/O).
+ *
+ * Each bufs[i] holds nbytes[i] bytes and is replaced with a newly allocated
+ * buffer holding the result, exactly as the HDF5 filter callback would do,
+ * so the buffers must come from malloc() and be released with free(). Pass
+ * H5Z_FLAG_REVERSE in flags to unshuffle.
+ *
+ * The chunks are spread across the OpenMP thread pool, so this is worth
+ * using even when the chunks are too small for per-chunk threading to pay
+ * off.
+ *
+ * Returns 0 on success and -1 on failure. On failure, some of the chunks may
+ * already have been processed, but every bufs[i] remains a valid buffer.
+ */
+SHUFFLE_API herr_t shuffle_chunks(unsigned int flags, unsigned bytes_per_elem,
+        size_t n_chunks, void *bufs[], const size_t nbytes[]);
+
+/* Zero-copy [un]shuffle of nbytes from src into a caller-supplied dest of at
+ * least nbytes (e.g., a reused, pre-faulted staging buffer). Nothing is
+ * allocated or freed. src and dest must not overlap.
+ *
+ * Returns 0 on success and -1 on failure.
+ */
+SHUFFLE_API herr_t shuffle_into(unsigned int flags, unsigned bytes_per_elem,
+        size_t nbytes, const void *src, void *dest);
+
+/* Scatter/gather [un]shuffle
+ *
+ * A chunk assembled from (or destined for) several separate memory regions,
+ * e.g., the rows of a strided hyperslab. The regions are concatenated in
+ * order and treated as one chunk; elements may straddle region boundaries.
+ *
+ * Shuffling reads the regions and writes the shuffled chunk in one pass, with
+ * no intermediate gather buffer. Unshuffling (H5Z_FLAG_REVERSE) reads a
+ * shuffled chunk and scatters the elements straight into the regions.
+ * chunk must hold the total length of the regions and must not overlap any
+ * of them.
+ *
+ * Returns 0 on success and -1 on failure.
+ */
+typedef struct shuffle_iovec_t {
+    void *base;                     /* Start of the region */
+    size_t len;                     /* Bytes in the region */
+} shuffle_iovec_t;
+
+SHUFFLE_API herr_t shuffle_iov(unsigned int flags, unsigned bytes_per_elem,
+        const shuffle_iovec_t iov[], size_t iov_count, void *chunk);
+
+/* Huge page support for large chunks
+ *
+ * With 4 KiB pages, the strided walk over a 16-256 MiB chunk misses the TLB
+ * on nearly every access.
+ *
+ * shuffle_set_huge_pages() sets the policy for the buffers the filter (and
+ * shuffle_chunks()/the async engine) allocate. Only DEFAULT and TRANSPARENT
+ * are allowed since HDF5 releases those buffers with free(). The default
+ * comes from the SHUFFLE_HUGE_PAGES environment variable ("transparent" or
+ * "1").
+ *
+ * shuffle_alloc_staging() returns a pre-faulted buffer for use with
+ * shuffle_into(), backed by the requested kind of page (EXPLICIT falls back
+ * to TRANSPARENT if the hugetlbfs pool is empty). Release it with
+ * shuffle_free_staging() and the same nbytes.
+ */
+typedef enum shuffle_pages_t {
+    SHUFFLE_PAGES_DEFAULT = 0,      /* Whatever the system gives us */
+    SHUFFLE_PAGES_TRANSPARENT,      /* 2 MiB aligned + madvise(MADV_HUGEPAGE) */
+    SHUFFLE_PAGES_EXPLICIT          /* mmap(MAP_HUGETLB) */
+} shuffle_pages_t;
+
+SHUFFLE_API herr_t shuffle_set_huge_pages(shuffle_pages_t pages);
+SHUFFLE_API void *shuffle_alloc_staging(size_t nbytes, shuffle_pages_t pages);
+SHUFFLE_API void shuffle_free_staging(void *buf, size_t nbytes);
+
+/* Asynchronous [un]shuffle offload
+ *
+ * shuffle_async_init() starts a pool of n_workers threads with room for
+ * queue_depth jobs in flight (0 picks a default for either; the depth is
+ * rounded up to a power of two). Only one engine can exist at a time.
+ *
+ * shuffle_async_submit() hands a malloc()ed buffer to the engine and returns
+ * immediately with a ticket (> 0). It returns 0 if queue_depth jobs are
+ * already in flight (collect some completions and try again) and -1 on
+ * error. The engine owns the buffer until its completion is collected.
+ *
+ * shuffle_async_poll() collects one finished job if there is one and returns
+ * 1, or returns 0 if nothing has finished yet (-1 on error).
+ * shuffle_async_wait() blocks until a job finishes and collects it. Jobs
+ * finish in no particular order, so match them up by ticket or user_data.
+ * The completion's buf replaces the submitted buffer and must be free()d by
+ * the caller.
+ *
+ * shuffle_async_term() finishes any queued jobs, stops the workers, and
+ * frees the buffers of any completions that were never collected. Calls
+ * made while it runs fail, and a shuffle_async_wait() with nothing left to
+ * collect is woken and fails, so it is safe to call from another thread.
+ */
+typedef long long shuffle_ticket_t;
+
+typedef struct shuffle_completion_t {
+    shuffle_ticket_t ticket;        /* Ticket returned by the submit call */
+    herr_t status;                  /* 0 on success, -1 on failure */
+    void *buf;                      /* [Un]shuffled data */
+    size_t nbytes;                  /* Size of buf */
+    void *user_data;                /* Passed through from the submit call */
+} shuffle_completion_t;
+
+SHUFFLE_API herr_t shuffle_async_init(unsigned n_workers, size_t queue_depth);
+SHUFFLE_API herr_t shuffle_async_term(void);
+SHUFFLE_API shuffle_ticket_t shuffle_async_submit(unsigned int flags,
+        unsigned bytes_per_elem, size_t nbytes, void *buf, void *user_data);
+SHUFFLE_API int shuffle_async_poll(shuffle_completion_t *completion);
+SHUFFLE_API herr_t shuffle_async_wait(shuffle_completion_t *completion);
+
+/* Sub-chunk random access (the blocked filter, SHUFFLE_BLOCKED_ID)
+ *
+ * A normal shuffled chunk has to be unshuffled whole, since every byte plane
+ * spans all of its elements. The blocked filter instead shuffles fixed-size
+ * blocks of elements independently (block after block, each in the normal
+ * byte plane layout) behind an 8-byte header giving the element size and
+ * the block size. Every block but the last is the same size, so the header
+ * is a complete index: block b starts at byte 8 + b * block size.
+ *
+ * These work on a chunk exactly as the blocked filter stored it, e.g., from
+ * H5Dread_chunk() when it is the only filter, or after undoing the filters
+ * that follow it.
+ *
+ * shuffle_blocked_get_info() returns the element size, the number of whole
+ * elements, and the elements per block. Any pointer may be NULL.
+ *
+ * shuffle_blocked_read_range() unshuffles elements [first, first + count)
+ * into dest (count * element size bytes), touching only the blocks that
+ * cover them.
+ *
+ * Both return 0 on success and -1 on a malformed chunk or a bad range.
+ */
+SHUFFLE_API herr_t shuffle_blocked_get_info(const void *chunk, size_t chunk_size,
+        unsigned *bytes_per_elem, size_t *n_elements, size_t *block_elems);
+SHUFFLE_API herr_t shuffle_blocked_read_range(const void *chunk, size_t chunk_size,
+        size_t first, size_t count, void *dest);
+
+/* Unshuffle with type conversion, for direct chunk readers
+ *
+ * Unshuffles a chunk of file_type elements (nbytes of shuffled bytes, after
+ * undoing any later filters) straight into dest as mem_type, e.g., float or
+ * short data read as double. H5Dread() unshuffles into a temporary chunk
+ * and converts that in a second pass; this converts each piece while it is
+ * still in cache (or, for the common 2 and 4 byte cases with AVX2, still in
+ * registers), so there is one pass and no temporary. dest holds
+ * nbytes / H5Tget_size(file_type) elements of mem_type.
+ *
+ * Any native integer or float type converts to itself. 1, 2, and 4 byte
+ * integers and float convert to double and float, and 1 and 2 byte integers
+ * to 32-bit int. Native byte order only. shuffle_can_convert() says whether
+ * a pair is supported.
+ *
+ * Returns 0 on success and -1 on failure or an unsupported pair.
+ */
+SHUFFLE_API int shuffle_can_convert(hid_t file_type, hid_t mem_type);
+SHUFFLE_API herr_t shuffle_unshuffle_convert(hid_t file_type, const void *chunk, size_t nbytes,
+        hid_t mem_type, void *dest);
+
+/* Per-chunk statistics for predicate pushdown
+ *
+ * For datasets created with statistics turned on, the filters (315-318)
+ * work out the minimum, the maximum, and the number of nulls of every chunk
+ * they shuffle on write, in the same pass over the data as the shuffle, and
+ * store them in a SHUFFLE_STATS_HEADER_SIZE byte header in front of the
+ * shuffled bytes. The reverse filter strips it again, so H5Dread() never
+ * sees it.
+ *
+ * Turn them on when creating the dataset, so that set_local records the
+ * element type and fill value:
+ *
+ *      unsigned stats = SHUFFLE_STATS_ENABLE;
+ *      H5Pset_filter(dcpl_id, SHUFFLE_ID, H5Z_FLAG_MANDATORY, 1, &stats);
+ *
+ * Otherwise the filter stores just the element size, as it always has, and
+ * any version of these plugins can read the dataset; a dataset created with
+ * statistics needs this version or later. Integers of 1, 2, 4, or 8 bytes
+ * and native float and double, in native byte order, are supported. Chunks
+ * of other types (or of datasets without statistics) are shuffled without
+ * them, and without the header.
+ *
+ * A query layer reads a chunk's statistics with shuffle_chunk_get_stats()
+ * from the chunk as stored: from H5Dread_chunk() when the shuffle is the
+ * only filter, or after undoing the filters that follow it. This fails on
+ * chunks without the header. Pass the bytes after the header to
+ * shuffle_into(), shuffle_unshuffle_convert(), and the like.
+ *
+ * Nulls are elements bitwise equal to the dataset's fill value (if one was
+ * set) and, for floating point types, NaNs. min and max cover the other
+ * elements and are meaningless when n_null == n_elements.
+ *
+ * While a callback is registered, it is also handed each chunk's statistics
+ * as they are stored, e.g., to keep running totals for a whole dataset. The
+ * filter isn't told which chunk it is working on, and the chunk cache can
+ * write chunks out in any order, so use the header for anything per chunk.
+ * The callback runs on the thread that runs the filter and must not call
+ * into HDF5. Registering NULL turns it off again.
+ */
+#define SHUFFLE_STATS_ENABLE        0x53544154u     /* "STAT", so a copied size isn't taken for it */
+#define SHUFFLE_STATS_HEADER_SIZE   40              /* Bytes in front of a chunk with statistics */
+
+typedef enum shuffle_stats_type_t {
+    SHUFFLE_STATS_NONE = 0,         /* No statistics for this type */
+    SHUFFLE_STATS_INT = 1,          /* Signed integers, use .i */
+    SHUFFLE_STATS_UINT = 2,         /* Unsigned integers, use .u */
+    SHUFFLE_STATS_FLOAT = 3         /* float or double, use .f */
+} shuffle_stats_type_t;
+
+typedef union shuffle_stats_value_t {
+    long long i;
+    unsigned long long u;
+    double f;
+} shuffle_stats_value_t;
+
+typedef struct shuffle_chunk_stats_t {
+    shuffle_stats_type_t type;      /* Which member of min and max to use */
+    unsigned bytes_per_elem;
+    size_t n_elements;              /* Whole elements in the chunk */
+    size_t n_null;                  /* Fill values and NaNs */
+    shuffle_stats_value_t min;      /* Smallest non-null element */
+    shuffle_stats_value_t max;      /* Largest non-null element */
+} shuffle_chunk_stats_t;
+
+typedef void (*shuffle_stats_func_t)(const shuffle_chunk_stats_t *stats,
+        void *user_data);
+
+SHUFFLE_API herr_t shuffle_chunk_get_stats(const void *chunk, size_t nbytes,
+        shuffle_chunk_stats_t *stats);
+SHUFFLE_API herr_t shuffle_set_stats_callback(shuffle_stats_func_t func, void *user_data);
+
+/* Reports the kernel behind the filter and this API, and why it was picked
+ * (the plugin's default or the SHUFFLE_KERNEL environment variable). Either
+ * pointer may be NULL. The strings are owned by the library.
+ */
+SHUFFLE_API void shuffle_get_kernel_info(const char **name, const char **reason);
+
+/* Thread budget for the OpenMP plugins (317, 318) and the threaded kernel
+ *
+ * Every OpenMP region in the library is sized against one process-wide
+ * budget: the teams running at once, started from any number of
+ * application threads, never hold more than n_threads threads between
+ * them, and a call that finds the budget spent runs serially. A call made
+ * from inside an active parallel region (e.g., the application's own
+ * OpenMP loop) always runs serially. The budget starts at the number of
+ * processors, or SHUFFLE_THREAD_BUDGET; 0 means no limit.
+ *
+ * Returns 0 on success and -1 on failure.
+ */
+SHUFFLE_API herr_t shuffle_set_thread_budget(int n_threads);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* _SHUFFLE_H */
 
@@ -0,0 +1,691 @@
+/* shuffle_advise.c
+ *
+ * Chunk shape advisor for the shuffle plugins.
+ *
+ * Given a dataset's shape, its element size, and the shape of a typical
+ * read, tries chunk shapes of several sizes and recommends the ones that
+ * write the whole dataset fastest, serve the reads fastest, and do best on
+ * a mix of the two. Each candidate is shaped three ways: like the reads,
+ * as runs of whole rows along the fastest-varying dimensions, and as
+ * evenly as the dataset allows.
+ *
+ * The times come from the plugins' own kernels (and zlib, with -z) run in
+ * memory on synthetic data, one chunk at a time, so they include the
+ * per-chunk cost of the kernel and compressor calls and the cache effects
+ * of the chunk size. A read pays for every chunk it touches, on average
+ * over where it starts, including the parts of those chunks it doesn't
+ * want. HDF5's own per-chunk cost (the chunk index lookup, the I/O call)
+ * isn't measured; give an estimate with -p to include it.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include <hdf5.h>
+
+#include "shuffle_kernels.h"
+
+/* Defaults */
+#define DEFAULT_ELEM_SIZE       4
+#define DEFAULT_WRITE_SHARE     50.0    /* % of the time spent writing */
+#define KIB                     ((size_t)1024)
+#define MIB                     ((size_t)1024 * 1024)
+#define MAX_DIMS                8
+#define MAX_SIZES               16
+
+/* Each timing runs the chunk at least this many times, and for at least this
+ * many bytes; the fastest run counts
+ */
+#define MIN_REPS                3
+#define MIN_BYTES_PER_TIMING    (64 * MIB)
+
+static const size_t default_chunk_sizes[] = {
+    16 * KIB, 64 * KIB, 256 * KIB, 1 * MIB, 4 * MIB, 16 * MIB
+};
+static const int default_filters[] = {315, 316, 317, 318};
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+/* The dataset and how it's used */
+typedef struct workload_t {
+    int ndims;
+    hsize_t dims[MAX_DIMS];
+    hsize_t read[MAX_DIMS];         /* Shape of a typical read */
+    unsigned elem_size;
+    int gzip_level;                 /* 0 = no gzip */
+    double overhead;                /* Extra seconds per chunk (-p) */
+    double write_share;             /* Fraction of the time spent writing */
+} workload_t;
+
+/* Measured cost of one chunk of a given size */
+typedef struct chunk_timing_t {
+    size_t nbytes;
+    double encode;                  /* Seconds per chunk */
+    double decode;
+    double ratio;                   /* Compressed / uncompressed, 1 without gzip */
+} chunk_timing_t;
+
+/* One chunk shape and what it would do for the workload */
+typedef struct candidate_t {
+    hsize_t chunk[MAX_DIMS];
+    const char *how;                /* Which way it was shaped */
+    size_t nbytes;
+    double write_mibs;              /* Whole dataset */
+    double chunks_per_read;         /* Expected */
+    double read_mibs;               /* Bytes the reads asked for */
+    double mix_mibs;                /* At the write share */
+} candidate_t;
+
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+} /* end now() */
+
+
+/* Parses a size: a plain number is bytes, or use a K, M, or G suffix */
+static size_t
+parse_size(const char *s)
+{
+    char *end = NULL;
+    unsigned long long n = strtoull(s, &end, 10);
+
+    switch (toupper((unsigned char)*end)) {
+        case 'G':
+            return (size_t)n * 1024 * MIB;
+        case 'M':
+            return (size_t)n * MIB;
+        case 'K':
+            return (size_t)n * KIB;
+        default:
+            return (size_t)n;
+    }
+} /* end parse_size() */
+
+
+/* Parses a shape like 1000x2000x500. Returns the number of dimensions, or
+ * -1 if it isn't one.
+ */
+static int
+parse_shape(const char *s, hsize_t shape[])
+{
+    int n = 0;
+
+    while (*s) {
+        char *end = NULL;
+        unsigned long long d = strtoull(s, &end, 10);
+
+        if (end == s || 0 == d || n == MAX_DIMS)
+            return -1;
+        shape[n++] = (hsize_t)d;
+        s = end;
+        if ('x' == *s || 'X' == *s || ',' == *s)
+            s++;
+        else if (*s)
+            return -1;
+    }
+
+    return n > 0 ? n : -1;
+} /* end parse_shape() */
+
+
+static const char *
+shape_name(const hsize_t shape[], int ndims, char *buf, size_t len)
+{
+    size_t used = 0;
+    int d;
+
+    buf[0] = '\0';
+    for (d = 0; d < ndims && used < len; d++)
+        used += (size_t)snprintf(buf + used, len - used, d ? "x%llu" : "%llu",
+                (unsigned long long)shape[d]);
+
+    return buf;
+} /* end shape_name() */
+
+
+static double
+n_elements(const hsize_t shape[], int ndims)
+{
+    double n = 1.0;
+    int d;
+
+    for (d = 0; d < ndims; d++)
+        n *= (double)shape[d];
+
+    return n;
+} /* end n_elements() */
+
+
+/* The kernel behind each plugin */
+static const shuffle_kernel_t *
+plugin_kernel(int filter_number)
+{
+    switch (filter_number) {
+        case 315:   return &shuffle_kernel_duff;
+        case 316:   return &shuffle_kernel_noduff;
+        case 317:   return &shuffle_kernel_duff_omp;
+        case 318:   return &shuffle_kernel_noduff_omp;
+        default:    return NULL;
+    }
+} /* end plugin_kernel() */
+
+
+/* Something vaguely like simulation output: smooth, with a little noise in
+ * the low bits, stored in elem_size bytes
+ */
+static void
+fill_data(unsigned char *buf, size_t nbytes, unsigned elem_size)
+{
+    size_t n = nbytes / elem_size;
+    unsigned seed = 12345;
+    size_t i;
+    unsigned b;
+
+    for (i = 0; i < n; i++) {
+        unsigned long long v;
+
+        seed = seed * 1103515245u + 12345u;
+        v = (unsigned long long)(long long)(1.0e4 * sin((double)i * 1.0e-3)) + ((seed >> 16) & 7);
+        for (b = 0; b < elem_size; b++)
+            buf[i * elem_size + b] = (unsigned char)(b < 8 ? v >> (8 * b) : 0);
+    }
+} /* end fill_data() */
+
+
+/* Times a chunk of nbytes through the kernel (and gzip) both ways */
+static int
+time_chunk(const shuffle_kernel_t *kernel, const workload_t *w, chunk_timing_t *t)
+{
+    size_t nbytes = t->nbytes;
+    uLong bound = compressBound((uLong)nbytes);
+    unsigned char *src = NULL;
+    unsigned char *shuffled = NULL;
+    unsigned char *packed = NULL;
+    unsigned char *out = NULL;
+    uLongf packed_len = bound;
+    int reps = (int)(MIN_BYTES_PER_TIMING / nbytes);
+    int r;
+
+    if (reps < MIN_REPS)
+        reps = MIN_REPS;
+
+    if (NULL == (src = (unsigned char *)malloc(nbytes)) || NULL == (shuffled = (unsigned char *)malloc(nbytes))
+            || NULL == (packed = (unsigned char *)malloc(bound)) || NULL == (out = (unsigned char *)malloc(nbytes)))
+        PROGRAM_ERROR("memory allocation for chunk buffers failed");
+    fill_data(src, nbytes, w->elem_size);
+
+    t->encode = t->decode = HUGE_VAL;
+    t->ratio = 1.0;
+
+    for (r = 0; r < reps; r++) {
+        double start = now();
+        double elapsed;
+
+        shuffle_kernel_run(kernel, 0, w->elem_size, nbytes, src, shuffled);
+        if (w->gzip_level) {
+            packed_len = bound;
+            if (compress2(packed, &packed_len, shuffled, (uLong)nbytes, w->gzip_level) != Z_OK)
+                PROGRAM_ERROR("compress2 failed");
+        }
+        elapsed = now() - start;
+        if (elapsed < t->encode)
+            t->encode = elapsed;
+    }
+    if (w->gzip_level)
+        t->ratio = (double)packed_len / (double)nbytes;
+
+    for (r = 0; r < reps; r++) {
+        double start = now();
+        double elapsed;
+
+        if (w->gzip_level) {
+            uLongf out_len = (uLongf)nbytes;
+
+            if (uncompress(shuffled, &out_len, packed, packed_len) != Z_OK || out_len != nbytes)
+                PROGRAM_ERROR("uncompress failed");
+        }
+        shuffle_kernel_run(kernel, H5Z_FLAG_REVERSE, w->elem_size, nbytes, shuffled, out);
+        elapsed = now() - start;
+        if (elapsed < t->decode)
+            t->decode = elapsed;
+    }
+
+    if (memcmp(src, out, nbytes) != 0)
+        PROGRAM_ERROR("round trip mismatch");
+
+    free(src);
+    free(shuffled);
+    free(packed);
+    free(out);
+
+    return 0;
+
+error:
+    free(src);
+    free(shuffled);
+    free(packed);
+    free(out);
+
+    return -1;
+} /* end time_chunk() */
+
+
+/* Shapes a chunk of about target elements after like[]: shrinks it from the
+ * slowest-varying dimension, or grows it from the fastest-varying dimension
+ * that isn't already the whole dataset, so the chunk stays as contiguous as
+ * it can
+ */
+static void
+shape_after(const workload_t *w, const hsize_t like[], double target, hsize_t chunk[])
+{
+    int d;
+
+    for (d = 0; d < w->ndims; d++)
+        chunk[d] = like[d] < w->dims[d] ? like[d] : w->dims[d];
+
+    for (d = 0; d < w->ndims && n_elements(chunk, w->ndims) > target; d++) {
+        double rest = n_elements(chunk, w->ndims) / (double)chunk[d];
+        double fit = floor(target / rest);
+
+        chunk[d] = fit >= 1.0 ? (hsize_t)fit : 1;
+    }
+
+    for (d = w->ndims - 1; d >= 0 && n_elements(chunk, w->ndims) < target; d--) {
+        double rest = n_elements(chunk, w->ndims) / (double)chunk[d];
+        double fit = floor(target / rest);
+
+        chunk[d] = fit < (double)w->dims[d] ? (hsize_t)fit : w->dims[d];
+        if (0 == chunk[d])
+            chunk[d] = 1;
+    }
+} /* end shape_after() */
+
+
+/* Shapes a chunk of about target elements with every dimension the same
+ * length, as far as the dataset allows
+ */
+static void
+shape_even(const workload_t *w, double target, hsize_t chunk[])
+{
+    int free_dims = w->ndims;
+    double left = target;
+    int done[MAX_DIMS];
+    int d, changed;
+
+    memset(done, 0, sizeof(done));
+
+    /* Dimensions shorter than the even length are taken whole, which leaves
+     * more for the others
+     */
+    do {
+        double side = pow(left, 1.0 / free_dims);
+
+        changed = 0;
+        for (d = 0; d < w->ndims; d++)
+            if (!done[d] && (double)w->dims[d] <= side) {
+                chunk[d] = w->dims[d];
+                left /= (double)w->dims[d];
+                done[d] = 1;
+                free_dims--;
+                changed = 1;
+            }
+        if (!changed)
+            for (d = 0; d < w->ndims; d++)
+                if (!done[d]) {
+                    chunk[d] = side >= 1.0 ? (hsize_t)side : 1;
+                    done[d] = 1;
+                }
+    } while (changed && free_dims > 0);
+} /* end shape_even() */
+
+
+/* Fills in what a candidate would do, from the timing for its size */
+static void
+evaluate(const workload_t *w, const chunk_timing_t *t, candidate_t *c)
+{
+    double dataset_mib = n_elements(w->dims, w->ndims) * w->elem_size / (double)MIB;
+    double read_mib = n_elements(w->read, w->ndims) * w->elem_size / (double)MIB;
+    double n_chunks = 1.0;
+    double per_read = 1.0;
+    double write_time, read_time;
+    int d;
+
+    for (d = 0; d < w->ndims; d++) {
+        double across = ceil((double)w->dims[d] / (double)c->chunk[d]);
+        /* A read of s elements starting anywhere covers 1 + (s - 1) / c
+         * chunks on average, but never more than there are
+         */
+        double touched = 1.0 + (double)(w->read[d] - 1) / (double)c->chunk[d];
+
+        n_chunks *= across;
+        per_read *= touched < across ? touched : across;
+    }
+
+    /* Edge chunks cost as much as full ones */
+    write_time = n_chunks * (t->encode + w->overhead);
+    read_time = per_read * (t->decode + w->overhead);
+
+    c->write_mibs = dataset_mib / write_time;
+    c->chunks_per_read = per_read;
+    c->read_mibs = read_mib / read_time;
+    c->mix_mibs = 1.0 / (w->write_share / c->write_mibs + (1.0 - w->write_share) / c->read_mibs);
+} /* end evaluate() */
+
+
+static int
+add_candidate(candidate_t *list, int n, const workload_t *w, const hsize_t chunk[], const char *how)
+{
+    int i;
+
+    /* The same shape can come out more than one way */
+    for (i = 0; i < n; i++)
+        if (0 == memcmp(list[i].chunk, chunk, (size_t)w->ndims * sizeof(hsize_t)))
+            return n;
+
+    memset(&list[n], 0, sizeof(list[n]));
+    memcpy(list[n].chunk, chunk, (size_t)w->ndims * sizeof(hsize_t));
+    list[n].how = how;
+    list[n].nbytes = (size_t)n_elements(chunk, w->ndims) * w->elem_size;
+
+    return n + 1;
+} /* end add_candidate() */
+
+
+static void
+print_pick(const char *label, const candidate_t *c, int ndims, double mibs)
+{
+    char buf[128];
+
+    printf("  %-22s %s (%.1f KiB, %s), %.1f MiB/s\n", label, shape_name(c->chunk, ndims, buf, sizeof(buf)),
+            (double)c->nbytes / KIB, c->how, mibs);
+} /* end print_pick() */
+
+
+/* Tries every candidate with one plugin's kernel and prints the advice */
+static int
+advise(int filter_number, const workload_t *w, const size_t sizes[], int n_sizes)
+{
+    const shuffle_kernel_t *kernel = plugin_kernel(filter_number);
+    candidate_t *cands = NULL;
+    chunk_timing_t *timings = NULL;
+    int n_cands = 0;
+    int best_write = 0, best_read = 0, best_mix = 0;
+    hsize_t rows[MAX_DIMS];
+    hsize_t chunk[MAX_DIMS];
+    char buf[128];
+    int i, j, d;
+
+    if (NULL == (cands = (candidate_t *)calloc((size_t)n_sizes * 3, sizeof(candidate_t))))
+        PROGRAM_ERROR("memory allocation for candidates failed");
+    if (NULL == (timings = (chunk_timing_t *)calloc((size_t)n_sizes * 3, sizeof(chunk_timing_t))))
+        PROGRAM_ERROR("memory allocation for timings failed");
+
+    /* Whole rows: 1 x ... x 1 x the fastest-varying dimension */
+    for (d = 0; d < w->ndims; d++)
+        rows[d] = d == w->ndims - 1 ? w->dims[d] : 1;
+
+    for (i = 0; i < n_sizes; i++) {
+        double target = (double)(sizes[i] / w->elem_size);
+
+        if (target < 1.0)
+            continue;
+        if (target > n_elements(w->dims, w->ndims))
+            target = n_elements(w->dims, w->ndims);
+
+        shape_after(w, w->read, target, chunk);
+        n_cands = add_candidate(cands, n_cands, w, chunk, "read-shaped");
+        shape_after(w, rows, target, chunk);
+        n_cands = add_candidate(cands, n_cands, w, chunk, "rows");
+        shape_even(w, target, chunk);
+        n_cands = add_candidate(cands, n_cands, w, chunk, "even");
+    }
+
+    /* Time each distinct chunk size once; the kernels only see bytes */
+    for (i = 0; i < n_cands; i++) {
+        chunk_timing_t *t = NULL;
+
+        for (j = 0; j < i; j++)
+            if (timings[j].nbytes == cands[i].nbytes) {
+                t = &timings[j];
+                break;
+            }
+        if (NULL == t) {
+            t = &timings[i];
+            t->nbytes = cands[i].nbytes;
+            if (time_chunk(kernel, w, t) < 0)
+                goto error;
+        }
+        else
+            timings[i] = *t;
+
+        evaluate(w, t, &cands[i]);
+        if (cands[i].write_mibs > cands[best_write].write_mibs)
+            best_write = i;
+        if (cands[i].read_mibs > cands[best_read].read_mibs)
+            best_read = i;
+        if (cands[i].mix_mibs > cands[best_mix].mix_mibs)
+            best_mix = i;
+    }
+
+    printf("SHUFFLE FILTER %d (%s kernel)", filter_number, kernel->name);
+    if (w->gzip_level)
+        printf(" - GZIP LEVEL %d", w->gzip_level);
+    printf("\n");
+    printf("  %-24s %-12s %9s %6s %12s %12s %12s %12s\n", "chunk", "shape", "KiB", "ratio",
+            "write MiB/s", "chunks/read", "read MiB/s", "mixed MiB/s");
+    for (i = 0; i < n_cands; i++)
+        printf("  %-24s %-12s %9.1f %6.3f %12.1f %12.2f %12.1f %12.1f\n",
+                shape_name(cands[i].chunk, w->ndims, buf, sizeof(buf)), cands[i].how,
+                (double)cands[i].nbytes / KIB, timings[i].ratio, cands[i].write_mibs,
+                cands[i].chunks_per_read, cands[i].read_mibs, cands[i].mix_mibs);
+    printf("\n");
+    print_pick("best for writing:", &cands[best_write], w->ndims, cands[best_write].write_mibs);
+    print_pick("best for reading:", &cands[best_read], w->ndims, cands[best_read].read_mibs);
+    print_pick("recommended:", &cands[best_mix], w->ndims, cands[best_mix].mix_mibs);
+    printf("\n");
+
+    free(cands);
+    free(timings);
+
+    return 0;
+
+error:
+    free(cands);
+    free(timings);
+
+    return -1;
+} /* end advise() */
+
+
+void
+usage(FILE *stream)
+{
+    fprintf(stream, "Usage: shuffle_advise -d dims [-r read shape] [-e elem size] [-z gzip level] [-c sizes] [-p us] [-w %%] [filter # ...]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-d dims:\n");
+    fprintf(stream, "   The dataset's shape, slowest-varying dimension first, e.g., 1000x2000x500\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-r read shape:\n");
+    fprintf(stream, "   Shape of a typical read, e.g., 1x2000x500 (default: one row of the\n");
+    fprintf(stream, "   fastest-varying dimension)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-e elem size:\n");
+    fprintf(stream, "   Bytes per element (default %d)\n", DEFAULT_ELEM_SIZE);
+    fprintf(stream, "\n");
+    fprintf(stream, "-z gzip level:\n");
+    fprintf(stream, "   Time gzip after the shuffle too (default 0, off)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-c sizes:\n");
+    fprintf(stream, "   Comma-separated chunk sizes to try, in bytes or with K, M, or G\n");
+    fprintf(stream, "   (default 16K,64K,256K,1M,4M,16M)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-p us:\n");
+    fprintf(stream, "   HDF5 and storage overhead per chunk, in microseconds (default 0)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-w %%:\n");
+    fprintf(stream, "   Share of the time spent writing, for the recommendation (default %.0f)\n", DEFAULT_WRITE_SHARE);
+    fprintf(stream, "\n");
+    fprintf(stream, "filter #: 315-318 (default: all of them)\n");
+    fprintf(stream, "\n");
+} /* end usage() */
+
+int
+main(int argc, char *argv[])
+{
+    workload_t w;
+    size_t sizes[MAX_SIZES];
+    int n_sizes = 0;
+    int have_read = 0;
+    char buf[128];
+    int opt;
+    int i, d;
+
+    memset(&w, 0, sizeof(w));
+    w.elem_size = DEFAULT_ELEM_SIZE;
+    w.write_share = DEFAULT_WRITE_SHARE / 100.0;
+
+    /* Parse command line */
+    while ((opt = getopt(argc, argv, "d:r:e:z:c:p:w:h")) != -1) {
+        switch (opt) {
+            case 'd':
+                if ((w.ndims = parse_shape(optarg, w.dims)) < 0) {
+                    usage(stderr);
+                    PROGRAM_ERROR("invalid dataset shape");
+                }
+                break;
+            case 'r':
+                if ((have_read = parse_shape(optarg, w.read)) < 0) {
+                    usage(stderr);
+                    PROGRAM_ERROR("invalid read shape");
+                }
+                break;
+            case 'e':
+                w.elem_size = (unsigned)atoi(optarg);
+                break;
+            case 'z':
+                w.gzip_level = atoi(optarg);
+                break;
+            case 'c': {
+                char *s = optarg;
+
+                n_sizes = 0;
+                while (*s && n_sizes < MAX_SIZES) {
+                    sizes[n_sizes++] = parse_size(s);
+                    s += strcspn(s, ",");
+                    if (',' == *s)
+                        s++;
+                }
+                break;
+            }
+            case 'p':
+                w.overhead = atof(optarg) * 1.0e-6;
+                break;
+            case 'w':
+                w.write_share = atof(optarg) / 100.0;
+                break;
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                PROGRAM_ERROR("unknown option");
+        }
+    }
+    if (0 == w.ndims) {
+        usage(stderr);
+        PROGRAM_ERROR("the dataset shape (-d) is mandatory");
+    }
+    if (have_read && have_read != w.ndims) {
+        usage(stderr);
+        PROGRAM_ERROR("the read shape needs as many dimensions as the dataset");
+    }
+    if (0 == w.elem_size || w.gzip_level < 0 || w.gzip_level > 9 || w.overhead < 0.0
+            || w.write_share < 0.0 || w.write_share > 1.0) {
+        usage(stderr);
+        PROGRAM_ERROR("invalid parameter");
+    }
+    for (d = 0; d < w.ndims; d++) {
+        if (!have_read)
+            w.read[d] = d == w.ndims - 1 ? w.dims[d] : 1;
+        else if (w.read[d] > w.dims[d])
+            PROGRAM_ERROR("the read shape is bigger than the dataset");
+    }
+    if (0 == n_sizes)
+        for (i = 0; i < (int)(sizeof(default_chunk_sizes) / sizeof(default_chunk_sizes[0])); i++)
+            sizes[n_sizes++] = default_chunk_sizes[i];
+    for (i = 0; i < n_sizes; i++)
+        if (sizes[i] < w.elem_size)
+            PROGRAM_ERROR("chunk sizes must hold at least one element");
+
+    printf("Dataset %s, %u byte elements", shape_name(w.dims, w.ndims, buf, sizeof(buf)), w.elem_size);
+    printf(", reads of %s, %.0f%% writing", shape_name(w.read, w.ndims, buf, sizeof(buf)),
+            100.0 * w.write_share);
+    if (w.overhead > 0.0)
+        printf(", %.1f us per chunk overhead", w.overhead * 1.0e6);
+    printf("\n\n");
+
+    if (optind < argc) {
+        for (i = optind; i < argc; i++) {
+            int filter_number = atoi(argv[i]);
+
+            if (NULL == plugin_kernel(filter_number))
+                PROGRAM_ERROR("invalid filter number (315-318)");
+            if (advise(filter_number, &w, sizes, n_sizes) < 0)
+                goto error;
+        }
+    }
+    else {
+        for (i = 0; i < (int)(sizeof(default_filters) / sizeof(default_filters[0])); i++)
+            if (advise(default_filters[i], &w, sizes, n_sizes) < 0)
+                goto error;
+    }
+
+    return EXIT_SUCCESS;
+
+error:
+    return EXIT_FAILURE;
+} /* end main */
@@ -0,0 +1,584 @@
+/* shuffle_async.c
+ *
+ * Asynchronous [un]shuffle offload for the shuffle plugin.
+ *
+ * Callers submit buffers and get a ticket back, then poll or wait on a
+ * completion queue. Submissions and completions travel through bounded
+ * lock-free MPMC queues (Dmitry Vyukov's sequence-number design) and the
+ * work is done by a small pool of worker threads, so the shuffle overlaps
+ * with the producer threads and with file I/O.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle.h"
+
+
+/* Keeps the producer and consumer counters on separate cache lines */
+#define CACHE_LINE_SIZE         64
+
+/* Defaults for shuffle_async_init() */
+#define DEFAULT_N_WORKERS       4
+#define DEFAULT_QUEUE_DEPTH     256
+
+/* A unit of work. Used for both submissions and completions. */
+typedef struct job_t {
+    shuffle_ticket_t ticket;
+    unsigned int flags;
+    unsigned bytes_per_elem;
+    size_t nbytes;
+    void *buf;
+    void *user_data;
+    herr_t status;
+} job_t;
+
+/* A queue slot. seq tells producers and consumers whose turn it is. */
+typedef struct cell_t {
+    atomic_size_t seq;
+    job_t job;
+} cell_t;
+
+/* Bounded lock-free multi-producer/multi-consumer queue */
+typedef struct mpmc_queue_t {
+    cell_t *cells;
+    size_t mask;                                /* Capacity - 1 (power of 2) */
+    char pad0[CACHE_LINE_SIZE];
+    atomic_size_t enqueue_pos;
+    char pad1[CACHE_LINE_SIZE];
+    atomic_size_t dequeue_pos;
+    char pad2[CACHE_LINE_SIZE];
+} mpmc_queue_t;
+
+/* The offload engine */
+typedef struct async_engine_t {
+    mpmc_queue_t submitted;                     /* Jobs waiting for a worker */
+    mpmc_queue_t completed;                     /* Jobs waiting to be collected */
+    sem_t work_sem;                             /* # of jobs in submitted */
+    sem_t done_sem;                             /* # of jobs in completed */
+    atomic_size_t n_in_flight;                  /* Submitted but not collected */
+    size_t capacity;                            /* Max # of jobs in flight */
+    atomic_llong next_ticket;
+    atomic_int shutdown;                        /* Workers exit when idle */
+    atomic_int stopped;                         /* Workers have exited */
+    unsigned n_workers;
+    pthread_t *workers;
+    int closing;                                /* In shuffle_async_term(), under engine_mutex */
+    unsigned n_users;                           /* Calls using the engine, under engine_mutex */
+    unsigned n_submitting;                      /* Of those, submits */
+} async_engine_t;
+
+/* Local prototypes */
+static herr_t mpmc_init(mpmc_queue_t *q, size_t capacity);
+static void mpmc_term(mpmc_queue_t *q);
+static int mpmc_enqueue(mpmc_queue_t *q, const job_t *job);
+static int mpmc_dequeue(mpmc_queue_t *q, job_t *job);
+static void *worker_main(void *arg);
+static async_engine_t *engine_acquire(int submitting);
+static void engine_release(async_engine_t *e, int submitting);
+static herr_t next_completion(async_engine_t *e, job_t *job);
+static void collect(async_engine_t *e, job_t *job, shuffle_completion_t *completion);
+
+/* The one and only engine. The pointer, and each engine's closing flag and
+ * user counts, are protected by the mutex.
+ */
+static async_engine_t *engine = NULL;
+static pthread_mutex_t engine_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t engine_cond = PTHREAD_COND_INITIALIZER;
+
+
+static herr_t
+mpmc_init(mpmc_queue_t *q, size_t capacity)
+{
+    size_t i;
+
+    /* Capacity must be a power of two so positions can be masked */
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+        goto error;
+
+    if (NULL == (q->cells = (cell_t *)malloc(capacity * sizeof(cell_t))))
+        goto error;
+    for (i = 0; i < capacity; i++)
+        atomic_init(&q->cells[i].seq, i);
+
+    q->mask = capacity - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+
+    return 0;
+
+error:
+    return -1;
+} /* end mpmc_init() */
+
+
+static void
+mpmc_term(mpmc_queue_t *q)
+{
+    free(q->cells);
+    q->cells = NULL;
+} /* end mpmc_term() */
+
+
+/* Returns 1 if the job was added and 0 if the queue is full */
+static int
+mpmc_enqueue(mpmc_queue_t *q, const job_t *job)
+{
+    cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        size_t seq;
+        intptr_t diff;
+
+        cell = &q->cells[pos & q->mask];
+        seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (0 == diff) {
+            /* The slot is free, try to claim it */
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+            return 0;
+        else
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    }
+
+    /* Fill in the slot and publish it to the consumers */
+    cell->job = *job;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return 1;
+} /* end mpmc_enqueue() */
+
+
+/* Returns 1 if a job was removed and 0 if the queue is empty */
+static int
+mpmc_dequeue(mpmc_queue_t *q, job_t *job)
+{
+    cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+    for (;;) {
+        size_t seq;
+        intptr_t diff;
+
+        cell = &q->cells[pos & q->mask];
+        seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (0 == diff) {
+            /* The slot has been published, try to claim it */
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+            return 0;
+        else
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    }
+
+    /* Copy the job out and hand the slot back to the producers */
+    *job = cell->job;
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+
+    return 1;
+} /* end mpmc_dequeue() */
+
+
+static void *
+worker_main(void *arg)
+{
+    async_engine_t *e = (async_engine_t *)arg;
+    job_t job;
+
+    for (;;) {
+        /* Sleep until there is work (or we are told to exit) */
+        while (sem_wait(&e->work_sem) < 0 && EINTR == errno)
+            ;
+
+        /* The semaphore is posted after the job is published, but an
+         * earlier slot may still be in the middle of being filled in by
+         * another producer. Spin until it shows up. shutdown is only set
+         * once every submit has returned, so then an empty queue is final.
+         */
+        while (!mpmc_dequeue(&e->submitted, &job)) {
+            if (atomic_load(&e->shutdown))
+                return NULL;
+            sched_yield();
+        }
+
+        job.status = shuffle_chunks(job.flags, job.bytes_per_elem, 1, &job.buf, &job.nbytes);
+
+        /* Can't fail, the in-flight count keeps this from filling up */
+        while (!mpmc_enqueue(&e->completed, &job))
+            sched_yield();
+        sem_post(&e->done_sem);
+    }
+
+    return NULL;
+} /* end worker_main() */
+
+
+/* Takes a reference to the engine for the length of one call. Fails if
+ * there is no engine or it is being shut down.
+ */
+static async_engine_t *
+engine_acquire(int submitting)
+{
+    async_engine_t *e;
+
+    pthread_mutex_lock(&engine_mutex);
+    if (NULL != (e = engine) && !e->closing) {
+        e->n_users++;
+        if (submitting)
+            e->n_submitting++;
+    }
+    else
+        e = NULL;
+    pthread_mutex_unlock(&engine_mutex);
+
+    return e;
+} /* end engine_acquire() */
+
+
+static void
+engine_release(async_engine_t *e, int submitting)
+{
+    pthread_mutex_lock(&engine_mutex);
+    e->n_users--;
+    if (submitting)
+        e->n_submitting--;
+    if (e->closing)
+        pthread_cond_broadcast(&engine_cond);
+    pthread_mutex_unlock(&engine_mutex);
+} /* end engine_release() */
+
+
+/* Takes a job off the completion queue after done_sem said there is one.
+ * Fails if the wakeup came from shuffle_async_term() instead.
+ */
+static herr_t
+next_completion(async_engine_t *e, job_t *job)
+{
+    /* See worker_main() for why this might need to spin */
+    while (!mpmc_dequeue(&e->completed, job)) {
+        if (atomic_load(&e->stopped))
+            return -1;
+        sched_yield();
+    }
+
+    return 0;
+} /* end next_completion() */
+
+
+static void
+collect(async_engine_t *e, job_t *job, shuffle_completion_t *completion)
+{
+    /* Release the in-flight slot so another job can be submitted */
+    atomic_fetch_sub(&e->n_in_flight, 1);
+
+    completion->ticket = job->ticket;
+    completion->status = job->status;
+    completion->buf = job->buf;
+    completion->nbytes = job->nbytes;
+    completion->user_data = job->user_data;
+} /* end collect() */
+
+
+herr_t
+shuffle_async_init(unsigned n_workers, size_t queue_depth)
+{
+    async_engine_t *e = NULL;
+    size_t capacity = 2;
+    unsigned n_started = 0;
+    int sems_created = 0;
+
+    pthread_mutex_lock(&engine_mutex);
+
+    /* Only one engine at a time */
+    if (engine)
+        goto error;
+
+    if (0 == n_workers)
+        n_workers = DEFAULT_N_WORKERS;
+    if (0 == queue_depth)
+        queue_depth = DEFAULT_QUEUE_DEPTH;
+
+    /* Round the depth up to a power of two */
+    while (capacity < queue_depth)
+        capacity <<= 1;
+
+    if (NULL == (e = (async_engine_t *)calloc(1, sizeof(async_engine_t))))
+        goto error;
+
+    if (mpmc_init(&e->submitted, capacity) < 0)
+        goto error;
+    if (mpmc_init(&e->completed, capacity) < 0)
+        goto error;
+    if (sem_init(&e->work_sem, 0, 0) < 0)
+        goto error;
+    if (sem_init(&e->done_sem, 0, 0) < 0) {
+        sem_destroy(&e->work_sem);
+        goto error;
+    }
+    sems_created = 1;
+
+    e->capacity = capacity;
+    e->n_workers = n_workers;
+    atomic_init(&e->n_in_flight, 0);
+    atomic_init(&e->next_ticket, 1);
+    atomic_init(&e->shutdown, 0);
+    atomic_init(&e->stopped, 0);
+
+    /* Start the worker pool */
+    if (NULL == (e->workers = (pthread_t *)calloc(n_workers, sizeof(pthread_t))))
+        goto error;
+    for (n_started = 0; n_started < n_workers; n_started++)
+        if (0 != pthread_create(&e->workers[n_started], NULL, worker_main, e))
+            goto error;
+
+    engine = e;
+    pthread_mutex_unlock(&engine_mutex);
+
+    return 0;
+
+error:
+    pthread_mutex_unlock(&engine_mutex);
+    if (e) {
+        unsigned u;
+
+        /* Stop any workers that did start */
+        atomic_store(&e->shutdown, 1);
+        for (u = 0; u < n_started; u++)
+            sem_post(&e->work_sem);
+        for (u = 0; u < n_started; u++)
+            pthread_join(e->workers[u], NULL);
+
+        if (sems_created) {
+            sem_destroy(&e->work_sem);
+            sem_destroy(&e->done_sem);
+        }
+        mpmc_term(&e->submitted);
+        mpmc_term(&e->completed);
+        free(e->workers);
+        free(e);
+    }
+
+    return -1;
+} /* end shuffle_async_init() */
+
+
+herr_t
+shuffle_async_term(void)
+{
+    async_engine_t *e;
+    job_t job;
+    unsigned u;
+
+    /* Turn new calls away, then let submits already under way publish
+     * their jobs so none is left half enqueued when the workers stop
+     */
+    pthread_mutex_lock(&engine_mutex);
+    if (NULL == (e = engine) || e->closing) {
+        pthread_mutex_unlock(&engine_mutex);
+        goto error;
+    }
+    e->closing = 1;
+    while (e->n_submitting > 0)
+        pthread_cond_wait(&engine_cond, &engine_mutex);
+    pthread_mutex_unlock(&engine_mutex);
+
+    /* Wake every worker. Each one drains whatever is left in the submission
+     * queue and exits when it finds it empty.
+     */
+    atomic_store(&e->shutdown, 1);
+    for (u = 0; u < e->n_workers; u++)
+        sem_post(&e->work_sem);
+    for (u = 0; u < e->n_workers; u++)
+        pthread_join(e->workers[u], NULL);
+    atomic_store(&e->stopped, 1);
+
+    /* Wake anyone still blocked in shuffle_async_wait() (there is at most
+     * one wakeup per call) and wait for every call to return
+     */
+    pthread_mutex_lock(&engine_mutex);
+    for (u = 0; u < e->n_users; u++)
+        sem_post(&e->done_sem);
+    while (e->n_users > 0)
+        pthread_cond_wait(&engine_cond, &engine_mutex);
+    engine = NULL;
+    pthread_mutex_unlock(&engine_mutex);
+
+    /* Discard anything that was never collected */
+    while (mpmc_dequeue(&e->completed, &job))
+        free(job.buf);
+
+    sem_destroy(&e->work_sem);
+    sem_destroy(&e->done_sem);
+    mpmc_term(&e->submitted);
+    mpmc_term(&e->completed);
+    free(e->workers);
+    free(e);
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_async_term() */
+
+
+shuffle_ticket_t
+shuffle_async_submit(unsigned int flags, unsigned bytes_per_elem, size_t nbytes,
+        void *buf, void *user_data)
+{
+    async_engine_t *e = NULL;
+    job_t job;
+    size_t n_in_flight;
+
+    /* Check arguments */
+    if (0 == bytes_per_elem || NULL == buf)
+        goto error;
+    if (NULL == (e = engine_acquire(1)))
+        goto error;
+
+    /* Reserve an in-flight slot. Bounding the jobs in flight by the queue
+     * capacity guarantees the workers never find the completion queue full.
+     */
+    n_in_flight = atomic_load(&e->n_in_flight);
+    do {
+        if (n_in_flight >= e->capacity) {
+            engine_release(e, 1);
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak(&e->n_in_flight, &n_in_flight, n_in_flight + 1));
+
+    job.ticket = atomic_fetch_add(&e->next_ticket, 1);
+    job.flags = flags;
+    job.bytes_per_elem = bytes_per_elem;
+    job.nbytes = nbytes;
+    job.buf = buf;
+    job.user_data = user_data;
+    job.status = -1;
+
+    /* Can't fail, we hold an in-flight slot */
+    while (!mpmc_enqueue(&e->submitted, &job))
+        sched_yield();
+    sem_post(&e->work_sem);
+
+    engine_release(e, 1);
+
+    return job.ticket;
+
+error:
+    return -1;
+} /* end shuffle_async_submit() */
+
+
+int
+shuffle_async_poll(shuffle_completion_t *completion)
+{
+    async_engine_t *e = NULL;
+    job_t job;
+
+    /* Check arguments */
+    if (NULL == completion)
+        goto error;
+    if (NULL == (e = engine_acquire(0)))
+        goto error;
+
+    if (sem_trywait(&e->done_sem) < 0) {
+        if (EAGAIN == errno || EINTR == errno) {
+            engine_release(e, 0);
+            return 0;
+        }
+        goto error;
+    }
+
+    if (next_completion(e, &job) < 0)
+        goto error;
+    collect(e, &job, completion);
+
+    engine_release(e, 0);
+
+    return 1;
+
+error:
+    if (e)
+        engine_release(e, 0);
+
+    return -1;
+} /* end shuffle_async_poll() */
+
+
+herr_t
+shuffle_async_wait(shuffle_completion_t *completion)
+{
+    async_engine_t *e = NULL;
+    job_t job;
+
+    /* Check arguments */
+    if (NULL == completion)
+        goto error;
+    if (NULL == (e = engine_acquire(0)))
+        goto error;
+
+    while (sem_wait(&e->done_sem) < 0) {
+        if (EINTR != errno)
+            goto error;
+    }
+
+    if (next_completion(e, &job) < 0)
+        goto error;
+    collect(e, &job, completion);
+
+    engine_release(e, 0);
+
+    return 0;
+
+error:
+    if (e)
+        engine_release(e, 0);
+
+    return -1;
+} /* end shuffle_async_wait() */
@@ -0,0 +1,359 @@
+/* shuffle_async_test.c
+ *
+ * Tests the asynchronous offload engine (shuffle_async_*()). More jobs than
+ * the queue holds are pushed through it both ways and checked against the
+ * reference shuffle, a full queue has to push back, calls without an engine
+ * have to fail, and shutting down has to wake a thread blocked waiting.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_reference.h"
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+#define N_JOBS                  100
+#define N_WORKERS               3
+#define QUEUE_DEPTH             16
+#define BYTES_PER_ELEM          4
+
+/* Job j is JOB_BYTES(j) long, so they don't all finish in order */
+#define JOB_BYTES(j)            (1024 * (size_t)((j) % 7 + 1) + (size_t)(j) % 5)
+#define MAX_JOB_BYTES           (1024 * 7 + 4)
+
+
+/* Runs every buffer through the engine once, keeping at most QUEUE_DEPTH
+ * in flight, and puts each result back in its slot (user_data)
+ */
+static int
+run_jobs(unsigned int flags, void *bufs[], const size_t nbytes[])
+{
+    shuffle_ticket_t last_ticket = 0;
+    shuffle_completion_t completion;
+    int n_submitted = 0;
+    int n_collected = 0;
+
+    while (n_collected < N_JOBS) {
+        if (n_submitted < N_JOBS) {
+            shuffle_ticket_t ticket = shuffle_async_submit(flags, BYTES_PER_ELEM, nbytes[n_submitted],
+                    bufs[n_submitted], (void *)&bufs[n_submitted]);
+
+            if (ticket < 0)
+                PROGRAM_ERROR("shuffle_async_submit() failed");
+            if (ticket > 0) {
+                /* Tickets are handed out in increasing order */
+                if (ticket <= last_ticket)
+                    PROGRAM_ERROR("ticket was reused");
+                last_ticket = ticket;
+                bufs[n_submitted++] = NULL;
+                continue;
+            }
+        }
+
+        /* Queue full or everything submitted */
+        if (shuffle_async_wait(&completion) < 0)
+            PROGRAM_ERROR("shuffle_async_wait() failed");
+        if (completion.status < 0)
+            PROGRAM_ERROR("job failed");
+        if (NULL == completion.user_data || NULL != *(void **)completion.user_data)
+            PROGRAM_ERROR("completion has the wrong user_data");
+        *(void **)completion.user_data = completion.buf;
+        n_collected++;
+    }
+
+    /* Nothing left */
+    if (0 != shuffle_async_poll(&completion))
+        PROGRAM_ERROR("shuffle_async_poll() found a job that was never submitted");
+
+    return 0;
+
+error:
+    return -1;
+} /* end run_jobs() */
+
+
+static int
+test_round_trip(void)
+{
+    void *bufs[N_JOBS] = {NULL};
+    unsigned char *original[N_JOBS] = {NULL};
+    size_t nbytes[N_JOBS];
+    unsigned char *expected = NULL;
+    int engine_up = 0;
+    int j;
+
+    printf("Testing shuffle_async_*() round trip... ");
+
+    if (NULL == (expected = (unsigned char *)malloc(MAX_JOB_BYTES)))
+        PROGRAM_ERROR("memory allocation for expected failed");
+    for (j = 0; j < N_JOBS; j++) {
+        nbytes[j] = JOB_BYTES(j);
+        if (NULL == (original[j] = (unsigned char *)malloc(nbytes[j])))
+            PROGRAM_ERROR("memory allocation for original failed");
+        if (NULL == (bufs[j] = malloc(nbytes[j])))
+            PROGRAM_ERROR("memory allocation for bufs failed");
+        reference_fill(original[j], nbytes[j], (unsigned)j);
+        memcpy(bufs[j], original[j], nbytes[j]);
+    }
+
+    if (shuffle_async_init(N_WORKERS, QUEUE_DEPTH) < 0)
+        PROGRAM_ERROR("shuffle_async_init() failed");
+    engine_up = 1;
+
+    if (run_jobs(0, bufs, nbytes) < 0)
+        goto error;
+    for (j = 0; j < N_JOBS; j++) {
+        reference_shuffle(0, BYTES_PER_ELEM, nbytes[j], original[j], expected);
+        if (0 != memcmp(bufs[j], expected, nbytes[j]))
+            PROGRAM_ERROR("shuffled job differs from the reference");
+    }
+
+    if (run_jobs(H5Z_FLAG_REVERSE, bufs, nbytes) < 0)
+        goto error;
+    for (j = 0; j < N_JOBS; j++)
+        if (0 != memcmp(bufs[j], original[j], nbytes[j]))
+            PROGRAM_ERROR("unshuffled job differs from the original");
+
+    engine_up = 0;
+    if (shuffle_async_term() < 0)
+        PROGRAM_ERROR("shuffle_async_term() failed");
+
+    for (j = 0; j < N_JOBS; j++) {
+        free(bufs[j]);
+        free(original[j]);
+    }
+    free(expected);
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    /* Buffers still in the engine are freed by term */
+    if (engine_up)
+        shuffle_async_term();
+    for (j = 0; j < N_JOBS; j++) {
+        free(bufs[j]);
+        free(original[j]);
+    }
+    free(expected);
+
+    return -1;
+} /* end test_round_trip() */
+
+
+/* The engine holds at most the (rounded up) queue depth of uncollected
+ * jobs, and term frees whatever was never collected
+ */
+static int
+test_queue_full(void)
+{
+    int engine_up = 0;
+    int j;
+
+    printf("Testing shuffle_async_submit() with a full queue... ");
+
+    if (shuffle_async_init(1, 3) < 0)
+        PROGRAM_ERROR("shuffle_async_init() failed");
+    engine_up = 1;
+
+    for (j = 0; j < 5; j++) {
+        void *buf;
+        shuffle_ticket_t ticket;
+
+        if (NULL == (buf = malloc(64)))
+            PROGRAM_ERROR("memory allocation for buf failed");
+        memset(buf, j, 64);
+        ticket = shuffle_async_submit(0, BYTES_PER_ELEM, 64, buf, NULL);
+        if (ticket <= 0)
+            free(buf);
+
+        /* 3 rounds up to 4 */
+        if (j < 4 && ticket <= 0)
+            PROGRAM_ERROR("submit failed before the queue was full");
+        if (j >= 4 && 0 != ticket)
+            PROGRAM_ERROR("submit to a full queue didn't return 0");
+    }
+
+    engine_up = 0;
+    if (shuffle_async_term() < 0)
+        PROGRAM_ERROR("shuffle_async_term() failed");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    if (engine_up)
+        shuffle_async_term();
+
+    return -1;
+} /* end test_queue_full() */
+
+
+static int
+test_bad_arguments(void)
+{
+    shuffle_completion_t completion;
+    unsigned char buf[64];
+    int engine_up = 0;
+
+    printf("Testing shuffle_async_*() with bad arguments... ");
+
+    memset(buf, 0, sizeof(buf));
+
+    /* No engine */
+    if (shuffle_async_submit(0, BYTES_PER_ELEM, sizeof(buf), buf, NULL) >= 0)
+        PROGRAM_ERROR("submit without an engine was accepted");
+    if (shuffle_async_poll(&completion) >= 0)
+        PROGRAM_ERROR("poll without an engine was accepted");
+    if (shuffle_async_wait(&completion) >= 0)
+        PROGRAM_ERROR("wait without an engine was accepted");
+    if (shuffle_async_term() >= 0)
+        PROGRAM_ERROR("term without an engine was accepted");
+
+    if (shuffle_async_init(0, 0) < 0)
+        PROGRAM_ERROR("shuffle_async_init() with defaults failed");
+    engine_up = 1;
+
+    if (shuffle_async_init(1, 4) >= 0)
+        PROGRAM_ERROR("a second engine was started");
+    if (shuffle_async_submit(0, 0, sizeof(buf), buf, NULL) >= 0)
+        PROGRAM_ERROR("zero element size was accepted");
+    if (shuffle_async_submit(0, BYTES_PER_ELEM, sizeof(buf), NULL, NULL) >= 0)
+        PROGRAM_ERROR("NULL buffer was accepted");
+    if (shuffle_async_poll(NULL) >= 0)
+        PROGRAM_ERROR("poll with NULL completion was accepted");
+    if (shuffle_async_wait(NULL) >= 0)
+        PROGRAM_ERROR("wait with NULL completion was accepted");
+
+    engine_up = 0;
+    if (shuffle_async_term() < 0)
+        PROGRAM_ERROR("shuffle_async_term() failed");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    if (engine_up)
+        shuffle_async_term();
+
+    return -1;
+} /* end test_bad_arguments() */
+
+
+static void *
+wait_thread(void *arg)
+{
+    shuffle_completion_t completion;
+
+    *(herr_t *)arg = shuffle_async_wait(&completion);
+
+    return NULL;
+} /* end wait_thread() */
+
+
+/* A thread blocked in wait with nothing in flight has to be let go */
+static int
+test_term_wakes_waiter(void)
+{
+    pthread_t thread;
+    herr_t status = 0;
+    int engine_up = 0;
+    int thread_up = 0;
+
+    printf("Testing shuffle_async_term() with a thread waiting... ");
+
+    if (shuffle_async_init(2, 4) < 0)
+        PROGRAM_ERROR("shuffle_async_init() failed");
+    engine_up = 1;
+
+    if (0 != pthread_create(&thread, NULL, wait_thread, &status))
+        PROGRAM_ERROR("unable to start the waiting thread");
+    thread_up = 1;
+
+    /* Give it time to block. If it hasn't yet, its wait fails anyway. */
+    usleep(50 * 1000);
+
+    engine_up = 0;
+    if (shuffle_async_term() < 0)
+        PROGRAM_ERROR("shuffle_async_term() failed");
+    thread_up = 0;
+    pthread_join(thread, NULL);
+    if (status >= 0)
+        PROGRAM_ERROR("wait with nothing in flight succeeded");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    if (engine_up)
+        shuffle_async_term();
+    if (thread_up)
+        pthread_join(thread, NULL);
+
+    return -1;
+} /* end test_term_wakes_waiter() */
+
+
+int
+main(void)
+{
+    int n_failed = 0;
+
+    if (test_round_trip() < 0)
+        n_failed++;
+    if (test_queue_full() < 0)
+        n_failed++;
+    if (test_bad_arguments() < 0)
+        n_failed++;
+    if (test_term_wakes_waiter() < 0)
+        n_failed++;
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%d test(s) FAILED\n", n_failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+} /* end main() */
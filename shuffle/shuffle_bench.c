@@ -0,0 +1,751 @@
+/* shuffle_bench.c
+ *
+ * In-memory benchmark for the shuffle plugins' kernels.
+ *
+ * Shuffles and unshuffles large chunks straight through the kernel library
+ * so that only the kernel and the memory system are measured, with every
+ * kernel run side by side and the buffers backed by the system's default,
+ * transparent huge, or explicit huge pages. Run it under hugepage_profile.sh
+ * to get the dTLB miss counts to go with the throughput.
+ *
+ * -P adds hardware counters around every kernel call (perf_event_open, see
+ * shuffle_counters.c) and reports IPC and bytes per cycle along with the
+ * cache, TLB, and branch misses per MiB: enough to tell whether a kernel is
+ * memory bound, instruction bound, or mispredicting.
+ *
+ * -R measures a copy bandwidth ceiling at each chunk size (memcpy, and a
+ * STREAM-style parallel copy loop) and reports every kernel as a percentage
+ * of it. A shuffle reads and writes each byte once, just like a copy, so
+ * 100% means the kernel runs at the speed of memory. Serial kernels are held
+ * to the single-threaded ceiling and the OpenMP kernels to the ceiling at
+ * their thread count; -t reruns the OpenMP kernels at several thread counts.
+ *
+ * -S is a scaling study of one OpenMP kernel (noduff_omp unless -k says
+ * otherwise): every chunk size from 4 KiB to 256 MiB at every thread count,
+ * with speedup and efficiency against the kernel's serial counterpart, and
+ * the crossover chunk size below which serial wins. That crossover is what
+ * SHUFFLE_OMP_MIN_BYTES should be set to; scaling_study.sh runs the study
+ * under each thread affinity policy.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_kernels.h"
+#include "shuffle_counters.h"
+
+/* Defaults */
+#define DEFAULT_ELEM_SIZE       4
+#define DEFAULT_REPS            5
+#define MIB                     ((size_t)1024 * 1024)
+#define KIB                     ((size_t)1024)
+#define MAX_SIZES               64
+#define MAX_THREAD_COUNTS       32
+
+/* Each scaling sample moves at least this much, so small chunks time well */
+#define SCALING_BYTES_PER_SAMPLE    (64 * MIB)
+
+/* Chunk sizes to run if none are given on the command line (MiB) */
+static const size_t default_sizes[] = {16, 32, 64, 128, 256};
+
+/* Chunk sizes for the scaling study (bytes) */
+static const size_t scaling_sizes[] = {4 * KIB, 16 * KIB, 64 * KIB, 256 * KIB,
+    1 * MIB, 4 * MIB, 16 * MIB, 64 * MIB, 256 * MIB};
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+} /* end now() */
+
+
+/* Parses a chunk size: a plain number is MiB, or use a K, M, or G suffix */
+static size_t
+parse_size(const char *s)
+{
+    char *end = NULL;
+    unsigned long long n = strtoull(s, &end, 10);
+
+    switch (toupper((unsigned char)*end)) {
+        case 'G':
+            return (size_t)n * 1024 * MIB;
+        case 'K':
+            return (size_t)n * KIB;
+        case 'M':
+        default:
+            return (size_t)n * MIB;
+    }
+} /* end parse_size() */
+
+
+/* Formats a chunk size as, e.g., "4K" or "256M" */
+static const char *
+size_name(size_t nbytes, char *buf, size_t len)
+{
+    if (nbytes >= MIB && 0 == nbytes % MIB)
+        snprintf(buf, len, "%zuM", nbytes / MIB);
+    else if (nbytes >= KIB && 0 == nbytes % KIB)
+        snprintf(buf, len, "%zuK", nbytes / KIB);
+    else
+        snprintf(buf, len, "%zu", nbytes);
+
+    return buf;
+} /* end size_name() */
+
+
+static const char *
+pages_name(shuffle_pages_t pages)
+{
+    switch (pages) {
+        case SHUFFLE_PAGES_TRANSPARENT:
+            return "transparent";
+        case SHUFFLE_PAGES_EXPLICIT:
+            return "explicit";
+        case SHUFFLE_PAGES_DEFAULT:
+        default:
+            return "default";
+    }
+} /* end pages_name() */
+
+
+/* Copy bandwidth at one chunk size, MiB/s */
+typedef struct ceiling_t {
+    double memcpy_mibs;         /* memcpy(), one thread */
+    double copy1_mibs;          /* STREAM-style copy, one thread */
+    double copy_mibs;           /* STREAM-style copy, all threads */
+} ceiling_t;
+
+
+/* The single-threaded kernel an OpenMP kernel runs on each thread */
+static const shuffle_kernel_t *
+serial_kernel_of(const shuffle_kernel_t *kernel)
+{
+    if (kernel == &shuffle_kernel_duff_omp)
+        return &shuffle_kernel_duff;
+    if (kernel == &shuffle_kernel_noduff_omp)
+        return &shuffle_kernel_noduff;
+    if (kernel == &shuffle_kernel_threaded)
+        return shuffle_kernel_best_simd();
+
+    return kernel;
+} /* end serial_kernel_of() */
+
+
+/* STREAM's copy kernel (a[i] = b[i]) over the current OpenMP team */
+static void
+stream_copy(size_t n, const double *src, double *dest, int n_threads)
+{
+    size_t i;
+
+    #pragma omp parallel for schedule(static) num_threads(n_threads)
+    for (i = 0; i < n; i++)
+        dest[i] = src[i];
+} /* end stream_copy() */
+
+
+/* Measures the copy bandwidth ceiling for one chunk size */
+int
+measure_ceiling(ceiling_t *ceiling, size_t nbytes, int reps, shuffle_pages_t pages)
+{
+    unsigned char *src  = NULL;
+    unsigned char *dest = NULL;
+    double best_memcpy  = 0.0;
+    double best_copy1   = 0.0;
+    double best_copy    = 0.0;
+    size_t n_doubles    = nbytes / sizeof(double);
+    int n_threads       = omp_get_max_threads();
+    char size_buf[32];
+    int r;
+
+    if (NULL == (src = (unsigned char *)shuffle_alloc_staging(nbytes, pages)))
+        PROGRAM_ERROR("unable to allocate source buffer");
+    if (NULL == (dest = (unsigned char *)shuffle_alloc_staging(nbytes, pages)))
+        PROGRAM_ERROR("unable to allocate destination buffer");
+
+    /* Fault everything in first, as the kernels' warm buffers would be */
+    memset(src, 1, nbytes);
+    memset(dest, 0, nbytes);
+
+    for (r = 0; r < reps; r++) {
+        double t;
+
+        t = now();
+        memcpy(dest, src, nbytes);
+        t = now() - t;
+        if (0 == r || t < best_memcpy)
+            best_memcpy = t;
+
+        t = now();
+        stream_copy(n_doubles, (const double *)src, (double *)dest, 1);
+        t = now() - t;
+        if (0 == r || t < best_copy1)
+            best_copy1 = t;
+
+        t = now();
+        stream_copy(n_doubles, (const double *)src, (double *)dest, n_threads);
+        t = now() - t;
+        if (0 == r || t < best_copy)
+            best_copy = t;
+    }
+
+    ceiling->memcpy_mibs = (double)nbytes / MIB / best_memcpy;
+    ceiling->copy1_mibs = (double)nbytes / MIB / best_copy1;
+    ceiling->copy_mibs = (double)nbytes / MIB / best_copy;
+
+    size_name(nbytes, size_buf, sizeof(size_buf));
+    printf("%-12s %-12s %8s %4s %12.1f %12s %3d  (memcpy; 1 thread)\n", "memcpy", pages_name(pages),
+            size_buf, "-", ceiling->memcpy_mibs, "", 1);
+    printf("%-12s %-12s %8s %4s %12.1f %12s %3d  (STREAM copy)\n", "copy", pages_name(pages),
+            size_buf, "-", ceiling->copy1_mibs, "", 1);
+    if (n_threads > 1)
+        printf("%-12s %-12s %8s %4s %12.1f %12s %3d  (STREAM copy)\n", "copy", pages_name(pages),
+                size_buf, "-", ceiling->copy_mibs, "", n_threads);
+
+    shuffle_free_staging(src, nbytes);
+    shuffle_free_staging(dest, nbytes);
+
+    return 0;
+
+error:
+    shuffle_free_staging(src, nbytes);
+    shuffle_free_staging(dest, nbytes);
+
+    return -1;
+} /* end measure_ceiling() */
+
+
+/* Prints the counters for one direction, averaged over reps calls */
+void
+print_counters(const char *op, const counter_values_t *values, size_t nbytes, int reps)
+{
+    double cycles = values->value[COUNTER_CYCLES] / reps;
+    double instructions = values->value[COUNTER_INSTRUCTIONS] / reps;
+    double mib = (double)nbytes / MIB;
+    int i;
+
+    printf("    %-6s", op);
+    if (values->valid[COUNTER_CYCLES] && values->valid[COUNTER_INSTRUCTIONS] && cycles > 0.0)
+        printf(" IPC %5.2f", instructions / cycles);
+    else
+        printf(" IPC   n/a");
+    if (values->valid[COUNTER_CYCLES] && cycles > 0.0)
+        printf("  B/cycle %6.3f", (double)nbytes / cycles);
+    else
+        printf("  B/cycle    n/a");
+
+    /* Everything else per MiB shuffled, so chunk sizes compare */
+    for (i = COUNTER_LLC_MISSES; i < N_COUNTERS; i++) {
+        if (values->valid[i])
+            printf("  %s/MiB %.1f", counter_names[i], values->value[i] / reps / mib);
+        else
+            printf("  %s/MiB n/a", counter_names[i]);
+    }
+    printf("\n");
+} /* end print_counters() */
+
+
+/* Times the best of reps encodes and decodes of one chunk size. With
+ * counters, every call is also counted. With a ceiling, the speeds are also
+ * given as a percentage of it.
+ */
+int
+bench_size(const shuffle_kernel_t *kernel, size_t nbytes, unsigned elem_size,
+        int reps, shuffle_pages_t pages, counters_t *counters, const ceiling_t *ceiling)
+{
+    counter_values_t encode_counts;
+    counter_values_t decode_counts;
+    unsigned char *src  = NULL;
+    unsigned char *dest = NULL;
+    double best_encode  = 0.0;
+    double best_decode  = 0.0;
+    char size_buf[32];
+    size_t i;
+    int r;
+
+    if (NULL == (src = (unsigned char *)shuffle_alloc_staging(nbytes, pages)))
+        PROGRAM_ERROR("unable to allocate source buffer");
+    if (NULL == (dest = (unsigned char *)shuffle_alloc_staging(nbytes, pages)))
+        PROGRAM_ERROR("unable to allocate destination buffer");
+
+    /* Something vaguely like the test program's data */
+    for (i = 0; i < nbytes / sizeof(int); i++)
+        ((int *)src)[i] = (int)i;
+
+    memset(&encode_counts, 0, sizeof(encode_counts));
+    memset(&decode_counts, 0, sizeof(decode_counts));
+
+    for (r = 0; r < reps; r++) {
+        double t;
+
+        if (counters)
+            counters_begin(counters);
+        t = now();
+        shuffle_kernel_run(kernel, 0, elem_size, nbytes, src, dest);
+        t = now() - t;
+        if (counters)
+            counters_end(counters, &encode_counts);
+        if (0 == r || t < best_encode)
+            best_encode = t;
+
+        if (counters)
+            counters_begin(counters);
+        t = now();
+        shuffle_kernel_run(kernel, H5Z_FLAG_REVERSE, elem_size, nbytes, dest, src);
+        t = now() - t;
+        if (counters)
+            counters_end(counters, &decode_counts);
+        if (0 == r || t < best_decode)
+            best_decode = t;
+    }
+
+    printf("%-12s %-12s %8s %4u %12.1f %12.1f %3d", kernel->name, pages_name(pages),
+            size_name(nbytes, size_buf, sizeof(size_buf)), elem_size, (double)nbytes / MIB / best_encode,
+            (double)nbytes / MIB / best_decode,
+            kernel->threaded ? omp_get_max_threads() : 1);
+    if (ceiling) {
+        double roof;
+
+        /* The best copy with the same number of threads */
+        roof = ceiling->memcpy_mibs > ceiling->copy1_mibs ? ceiling->memcpy_mibs : ceiling->copy1_mibs;
+        if (kernel->threaded && ceiling->copy_mibs > roof)
+            roof = ceiling->copy_mibs;
+
+        printf(" %8.1f%% %8.1f%%", 100.0 * (double)nbytes / MIB / best_encode / roof,
+                100.0 * (double)nbytes / MIB / best_decode / roof);
+    }
+    printf("\n");
+    if (counters) {
+        print_counters("encode", &encode_counts, nbytes, reps);
+        print_counters("decode", &decode_counts, nbytes, reps);
+    }
+
+    shuffle_free_staging(src, nbytes);
+    shuffle_free_staging(dest, nbytes);
+
+    return 0;
+
+error:
+    shuffle_free_staging(src, nbytes);
+    shuffle_free_staging(dest, nbytes);
+
+    return -1;
+} /* end bench_size() */
+
+/* Best time for one [un]shuffle of nbytes, in seconds. Small chunks are
+ * run many times per sample so the clock's resolution doesn't matter.
+ */
+static double
+time_kernel(const shuffle_kernel_t *kernel, unsigned int flags, unsigned elem_size,
+        size_t nbytes, const unsigned char *src, unsigned char *dest, int reps)
+{
+    size_t iters = SCALING_BYTES_PER_SAMPLE / nbytes;
+    double best = 0.0;
+    size_t i;
+    int r;
+
+    if (0 == iters)
+        iters = 1;
+
+    /* Warm up, including starting the OpenMP team */
+    shuffle_kernel_run(kernel, flags, elem_size, nbytes, src, dest);
+
+    for (r = 0; r < reps; r++) {
+        double t = now();
+
+        for (i = 0; i < iters; i++)
+            shuffle_kernel_run(kernel, flags, elem_size, nbytes, src, dest);
+        t = (now() - t) / (double)iters;
+        if (0 == r || t < best)
+            best = t;
+    }
+
+    return best;
+} /* end time_kernel() */
+
+
+/* Runs an OpenMP kernel at every chunk size and thread count and reports
+ * speedup and efficiency against its serial counterpart, and the chunk
+ * size below which the serial kernel is faster.
+ */
+int
+scaling_study(const shuffle_kernel_t *kernel, unsigned elem_size, int reps,
+        shuffle_pages_t pages, const size_t sizes[], int n_sizes,
+        const int thread_counts[], int n_thread_counts)
+{
+    const shuffle_kernel_t *serial = serial_kernel_of(kernel);
+    const char *bind = getenv("OMP_PROC_BIND");
+    const char *places = getenv("OMP_PLACES");
+    size_t saved_min_bytes = shuffle_kernel_omp_min_bytes();
+    unsigned char *src = NULL;
+    unsigned char *dest = NULL;
+    size_t nbytes = 0;
+    int crossover = -1;         /* Index of the smallest size where parallel wins from there on */
+    char size_buf[32];
+    size_t j;
+    int i, t;
+
+    /* Always start the team, or there's nothing to measure */
+    shuffle_kernel_set_omp_min_bytes(0);
+
+    printf("Scaling: %s vs. %s, %u byte elements, OMP_PROC_BIND=%s, OMP_PLACES=%s, %s pages\n",
+            kernel->name, serial->name, elem_size, bind ? bind : "(unset)",
+            places ? places : "(unset)", pages_name(pages));
+    printf("%8s %4s %12s %12s %8s %10s\n", "chunk", "thr", "encode MiB/s", "decode MiB/s",
+            "speedup", "efficiency");
+
+    for (i = 0; i < n_sizes; i++) {
+        double serial_encode, serial_decode;
+        double best_speedup = 0.0;
+
+        nbytes = sizes[i];
+        if (NULL == (src = (unsigned char *)shuffle_alloc_staging(nbytes, pages)))
+            PROGRAM_ERROR("unable to allocate source buffer");
+        if (NULL == (dest = (unsigned char *)shuffle_alloc_staging(nbytes, pages)))
+            PROGRAM_ERROR("unable to allocate destination buffer");
+        for (j = 0; j < nbytes / sizeof(int); j++)
+            ((int *)src)[j] = (int)j;
+
+        size_name(nbytes, size_buf, sizeof(size_buf));
+
+        serial_encode = time_kernel(serial, 0, elem_size, nbytes, src, dest, reps);
+        serial_decode = time_kernel(serial, H5Z_FLAG_REVERSE, elem_size, nbytes, dest, src, reps);
+        printf("%8s %4s %12.1f %12.1f %8s %10s\n", size_buf, "ser",
+                (double)nbytes / MIB / serial_encode, (double)nbytes / MIB / serial_decode, "1.00", "-");
+
+        for (t = 0; t < n_thread_counts; t++) {
+            double encode, decode, speedup;
+
+            omp_set_num_threads(thread_counts[t]);
+            encode = time_kernel(kernel, 0, elem_size, nbytes, src, dest, reps);
+            decode = time_kernel(kernel, H5Z_FLAG_REVERSE, elem_size, nbytes, dest, src, reps);
+
+            /* Encode and decode count equally: a chunk is written once and read at least once */
+            speedup = (serial_encode + serial_decode) / (encode + decode);
+            if (thread_counts[t] > 1 && speedup > best_speedup)
+                best_speedup = speedup;
+
+            printf("%8s %4d %12.1f %12.1f %8.2f %9.0f%%\n", size_buf, thread_counts[t],
+                    (double)nbytes / MIB / encode, (double)nbytes / MIB / decode, speedup,
+                    100.0 * speedup / thread_counts[t]);
+        }
+
+        /* The crossover is where parallel starts winning and keeps winning */
+        if (best_speedup > 1.0) {
+            if (crossover < 0)
+                crossover = i;
+        }
+        else
+            crossover = -1;
+
+        shuffle_free_staging(src, nbytes);
+        shuffle_free_staging(dest, nbytes);
+        src = dest = NULL;
+    }
+
+    if (crossover < 0)
+        printf("crossover: none (serial was always faster); leave SHUFFLE_OMP_MIN_BYTES above %s\n",
+                size_name(sizes[n_sizes - 1], size_buf, sizeof(size_buf)));
+    else
+        printf("crossover: serial is faster below %s; SHUFFLE_OMP_MIN_BYTES=%zu\n",
+                size_name(sizes[crossover], size_buf, sizeof(size_buf)), sizes[crossover]);
+
+    shuffle_kernel_set_omp_min_bytes(saved_min_bytes);
+
+    return 0;
+
+error:
+    shuffle_free_staging(src, nbytes);
+    shuffle_free_staging(dest, nbytes);
+    shuffle_kernel_set_omp_min_bytes(saved_min_bytes);
+
+    return -1;
+} /* end scaling_study() */
+
+
+void
+usage(FILE *stream)
+{
+    fprintf(stream, "Usage: shuffle_bench [-k kernel] [-p pages] [-e elem size] [-r reps] [-P] [-R] [-S] [-t threads,...] [chunk ...]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-k kernel:\n");
+    fprintf(stream, "   Only run this kernel (default: all of them)\n");
+    fprintf(stream, "   duff, noduff, duff_omp, noduff_omp, sse, avx2, avx512, threaded\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-p pages:\n");
+    fprintf(stream, "   default = Whatever the system gives (normal pages unless THP is \"always\")\n");
+    fprintf(stream, "   transparent = Transparent huge pages\n");
+    fprintf(stream, "   explicit = hugetlbfs pages (falls back to transparent)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-e elem size:\n");
+    fprintf(stream, "   Bytes per element (default %d)\n", DEFAULT_ELEM_SIZE);
+    fprintf(stream, "\n");
+    fprintf(stream, "-r reps:\n");
+    fprintf(stream, "   Repetitions per size, the best is reported (default %d)\n", DEFAULT_REPS);
+    fprintf(stream, "\n");
+    fprintf(stream, "-P:\n");
+    fprintf(stream, "   Profile each kernel call with hardware performance counters\n");
+    fprintf(stream, "   (needs kernel.perf_event_paranoid <= 2). Counts include all threads.\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-R:\n");
+    fprintf(stream, "   Measure memcpy and STREAM copy bandwidth at each chunk size and report\n");
+    fprintf(stream, "   the kernels as a percentage of it\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-S:\n");
+    fprintf(stream, "   Scaling study of one OpenMP kernel (default noduff_omp) vs. its serial\n");
+    fprintf(stream, "   kernel, with speedup, efficiency, and the serial/parallel crossover\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-t threads,...:\n");
+    fprintf(stream, "   Rerun the OpenMP kernels at each of these thread counts\n");
+    fprintf(stream, "   (default: OMP_NUM_THREADS or all cores, once; with -S, 1 2 4 ... cores)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "chunk:\n");
+    fprintf(stream, "   Chunk sizes to run, in MiB or with a K/M/G suffix\n");
+    fprintf(stream, "   (default 16 32 64 128 256; with -S, 4K to 256M by factors of 4)\n");
+    fprintf(stream, "\n");
+} /* end usage() */
+
+int
+main(int argc, char *argv[])
+{
+    const shuffle_kernel_t *only_kernel = NULL;
+    shuffle_pages_t pages = SHUFFLE_PAGES_DEFAULT;
+    unsigned elem_size = DEFAULT_ELEM_SIZE;
+    int reps = DEFAULT_REPS;
+    int profile = 0;
+    int counting = 0;
+    counters_t counters;
+    int roofline = 0;
+    int scaling = 0;
+    ceiling_t ceilings[MAX_SIZES];
+    size_t sizes[MAX_SIZES];
+    int n_sizes = 0;
+    int thread_counts[MAX_THREAD_COUNTS];
+    int n_thread_counts = 0;
+    int opt;
+    int i;
+    int k;
+    int t;
+
+    /* Parse command line */
+    while ((opt = getopt(argc, argv, "k:p:e:r:PRSt:h")) != -1) {
+        switch (opt) {
+            case 'k':
+                if (NULL == (only_kernel = shuffle_kernel_find(optarg))) {
+                    usage(stderr);
+                    PROGRAM_ERROR("unknown kernel");
+                }
+                break;
+            case 'p':
+                if (0 == strcasecmp(optarg, "default"))
+                    pages = SHUFFLE_PAGES_DEFAULT;
+                else if (0 == strcasecmp(optarg, "transparent"))
+                    pages = SHUFFLE_PAGES_TRANSPARENT;
+                else if (0 == strcasecmp(optarg, "explicit"))
+                    pages = SHUFFLE_PAGES_EXPLICIT;
+                else {
+                    usage(stderr);
+                    PROGRAM_ERROR("unknown page type");
+                }
+                break;
+            case 'e':
+                elem_size = (unsigned)atoi(optarg);
+                break;
+            case 'r':
+                reps = atoi(optarg);
+                break;
+            case 'P':
+                profile = 1;
+                break;
+            case 'R':
+                roofline = 1;
+                break;
+            case 'S':
+                scaling = 1;
+                break;
+            case 't': {
+                char *p = optarg;
+
+                while (*p && n_thread_counts < MAX_THREAD_COUNTS) {
+                    char *end;
+                    long n = strtol(p, &end, 10);
+
+                    if (end == p || n < 1) {
+                        usage(stderr);
+                        PROGRAM_ERROR("thread counts must be positive integers");
+                    }
+                    thread_counts[n_thread_counts++] = (int)n;
+                    p = (',' == *end) ? end + 1 : end;
+                }
+                break;
+            }
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                PROGRAM_ERROR("unknown option");
+        }
+    }
+    if (0 == elem_size || reps < 1) {
+        usage(stderr);
+        PROGRAM_ERROR("element size and reps must be positive");
+    }
+
+    if (optind < argc) {
+        for (i = optind; i < argc && n_sizes < MAX_SIZES; i++)
+            sizes[n_sizes++] = parse_size(argv[i]);
+    }
+    else if (scaling) {
+        for (i = 0; i < (int)(sizeof(scaling_sizes) / sizeof(scaling_sizes[0])); i++)
+            sizes[n_sizes++] = scaling_sizes[i];
+    }
+    else {
+        for (i = 0; i < (int)(sizeof(default_sizes) / sizeof(default_sizes[0])); i++)
+            sizes[n_sizes++] = default_sizes[i] * MIB;
+    }
+    for (i = 0; i < n_sizes; i++)
+        if (0 == sizes[i]) {
+            usage(stderr);
+            PROGRAM_ERROR("chunk sizes must be positive");
+        }
+
+    /* Run the thread counts asked for, even past the number of processors */
+    shuffle_kernel_set_thread_budget(0);
+
+    if (scaling) {
+        int n_procs = omp_get_num_procs();
+
+        if (NULL == only_kernel)
+            only_kernel = &shuffle_kernel_noduff_omp;
+        if (!only_kernel->threaded) {
+            usage(stderr);
+            PROGRAM_ERROR("the scaling study needs an OpenMP kernel");
+        }
+        if (!shuffle_kernel_supported(only_kernel))
+            PROGRAM_ERROR("kernel not supported on this CPU");
+
+        /* 1, 2, 4, ..., and every core */
+        if (0 == n_thread_counts) {
+            for (i = 1; i < n_procs && n_thread_counts < MAX_THREAD_COUNTS - 1; i *= 2)
+                thread_counts[n_thread_counts++] = i;
+            thread_counts[n_thread_counts++] = n_procs;
+        }
+
+        if (scaling_study(only_kernel, elem_size, reps, pages, sizes, n_sizes,
+                    thread_counts, n_thread_counts) < 0)
+            goto error;
+
+        return EXIT_SUCCESS;
+    }
+
+    /* One pass at the default thread count */
+    if (0 == n_thread_counts)
+        thread_counts[n_thread_counts++] = omp_get_max_threads();
+
+    /* Before any kernel runs: the OpenMP threads must inherit the counters */
+    if (profile) {
+        if (counters_open(&counters) > 0)
+            counting = 1;
+        else {
+            counters_close(&counters);
+            fprintf(stderr, "Hardware counters are unavailable (see perf_event_paranoid); not profiling\n");
+        }
+    }
+
+    printf("%-12s %-12s %8s %4s %12s %12s %3s", "kernel", "pages", "chunk", "size",
+            "encode MiB/s", "decode MiB/s", "thr");
+    if (roofline)
+        printf(" %9s %9s", "enc %copy", "dec %copy");
+    printf("\n");
+
+    for (t = 0; t < n_thread_counts; t++) {
+        omp_set_num_threads(thread_counts[t]);
+
+        if (roofline)
+            for (i = 0; i < n_sizes; i++)
+                if (measure_ceiling(&ceilings[i], sizes[i], reps, pages) < 0)
+                    goto error;
+
+        for (k = 0; shuffle_kernel_list[k]; k++) {
+            const shuffle_kernel_t *kernel = shuffle_kernel_list[k];
+
+            if (only_kernel && kernel != only_kernel)
+                continue;
+
+            /* The serial kernels don't care about the thread count */
+            if (t > 0 && !kernel->threaded)
+                continue;
+
+            /* e.g., AVX-512 on a CPU without it */
+            if (!shuffle_kernel_supported(kernel)) {
+                if (0 == t)
+                    printf("%-12s (not supported on this CPU)\n", kernel->name);
+                continue;
+            }
+
+            for (i = 0; i < n_sizes; i++)
+                if (bench_size(kernel, sizes[i], elem_size, reps, pages,
+                            counting ? &counters : NULL, roofline ? &ceilings[i] : NULL) < 0)
+                    goto error;
+        }
+    }
+
+    if (counting)
+        counters_close(&counters);
+
+    return EXIT_SUCCESS;
+
+error:
+    if (counting)
+        counters_close(&counters);
+
+    return EXIT_FAILURE;
+} /* end main */
@@ -0,0 +1,295 @@
+/* shuffle_blocked_test.c
+ *
+ * Tests the blocked filter and its random access API. Chunks are run through
+ * the filter callback for assorted element, block and chunk sizes, and each
+ * stored block has to be the reference shuffle of its elements.
+ * shuffle_blocked_get_info() and shuffle_blocked_read_range() are then
+ * checked against the original data, the reverse filter has to restore it,
+ * and out-of-range reads and malformed chunks have to be rejected.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hdf5.h>
+#include <H5PLextern.h>
+
+#include "shuffle.h"
+#include "shuffle_reference.h"
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+#define HEADER_SIZE             8
+
+static const unsigned elem_sizes[] = {1, 3, 4, 8, 16};
+static const size_t block_sizes[] = {1, 7, 1000, 4096};
+/* HDF5 never passes an empty chunk; 5 bytes holds no whole wide elements */
+static const size_t chunk_sizes[] = {5, 4099, 100001};
+
+#define N_ELEM_SIZES            (sizeof(elem_sizes) / sizeof(elem_sizes[0]))
+#define N_BLOCK_SIZES           (sizeof(block_sizes) / sizeof(block_sizes[0]))
+#define N_CHUNK_SIZES           (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))
+
+
+/* Runs the blocked filter over a copy of src and returns the stored chunk
+ * (or NULL), the way HDF5 would call it
+ */
+static unsigned char *
+blocked_filter(unsigned int flags, unsigned bytes_per_elem, size_t block_elems,
+        size_t nbytes, const void *src, size_t *out_size)
+{
+    const H5Z_class2_t *cls = (const H5Z_class2_t *)H5PLget_plugin_info();
+    unsigned cd_values[2];
+    size_t buf_size = nbytes ? nbytes : 1;
+    void *buf = NULL;
+
+    cd_values[SHUFFLE_BLOCKED_PARM_BLOCK_ELEMS] = (unsigned)block_elems;
+    cd_values[1] = bytes_per_elem;
+
+    if (NULL == (buf = malloc(buf_size)))
+        return NULL;
+    memcpy(buf, src, nbytes);
+
+    if (0 == (*out_size = cls->filter(flags, 2, cd_values, nbytes, &buf_size, &buf))) {
+        /* A failing filter leaves the buffer with the caller */
+        free(buf);
+        return NULL;
+    }
+
+    return (unsigned char *)buf;
+} /* end blocked_filter() */
+
+
+static int
+test_chunk(unsigned bytes_per_elem, size_t block_elems, size_t nbytes)
+{
+    unsigned char *original = NULL;
+    unsigned char *chunk = NULL;
+    unsigned char *unshuffled = NULL;
+    unsigned char *expected = NULL;
+    unsigned char *range = NULL;
+    size_t chunk_size;
+    size_t unshuffled_size;
+    size_t n_elements = nbytes / bytes_per_elem;
+    size_t info_n_elements;
+    size_t info_block_elems;
+    unsigned info_bpe;
+    size_t start;
+    size_t i;
+
+    printf("Testing blocked filter with %u byte elements, %zu element blocks and %zu bytes... ",
+            bytes_per_elem, block_elems, nbytes);
+
+    if (NULL == (original = (unsigned char *)malloc(nbytes + 1)))
+        PROGRAM_ERROR("memory allocation for original failed");
+    if (NULL == (expected = (unsigned char *)malloc(nbytes + 1)))
+        PROGRAM_ERROR("memory allocation for expected failed");
+    if (NULL == (range = (unsigned char *)malloc(nbytes + 1)))
+        PROGRAM_ERROR("memory allocation for range failed");
+    reference_fill(original, nbytes, (unsigned)(bytes_per_elem + block_elems + nbytes));
+
+    if (NULL == (chunk = blocked_filter(0, bytes_per_elem, block_elems, nbytes, original, &chunk_size)))
+        PROGRAM_ERROR("blocked filter failed to shuffle");
+    if (chunk_size != nbytes + HEADER_SIZE)
+        PROGRAM_ERROR("blocked chunk is the wrong size");
+
+    /* Every block is shuffled on its own, then the leftover bytes */
+    for (start = 0; start < n_elements; start += block_elems) {
+        size_t n = n_elements - start < block_elems ? n_elements - start : block_elems;
+        size_t offset = start * bytes_per_elem;
+
+        reference_shuffle(0, bytes_per_elem, n * bytes_per_elem, original + offset, expected + offset);
+    }
+    memcpy(expected + n_elements * bytes_per_elem, original + n_elements * bytes_per_elem,
+            nbytes - n_elements * bytes_per_elem);
+    if (0 != memcmp(chunk + HEADER_SIZE, expected, nbytes))
+        PROGRAM_ERROR("blocked chunk differs from the reference");
+
+    if (shuffle_blocked_get_info(chunk, chunk_size, &info_bpe, &info_n_elements, &info_block_elems) < 0)
+        PROGRAM_ERROR("shuffle_blocked_get_info() failed");
+    if (info_bpe != bytes_per_elem || info_n_elements != n_elements || info_block_elems != block_elems)
+        PROGRAM_ERROR("shuffle_blocked_get_info() returned the wrong header");
+    if (shuffle_blocked_get_info(chunk, chunk_size, NULL, NULL, NULL) < 0)
+        PROGRAM_ERROR("shuffle_blocked_get_info() failed with NULL outputs");
+
+    /* Whole chunk, single elements at both ends, and ranges inside a block,
+     * across a block boundary and running to the end
+     */
+    {
+        size_t ranges[][2] = {
+            {0, n_elements},
+            {0, n_elements ? 1 : 0},
+            {n_elements ? n_elements - 1 : 0, n_elements ? 1 : 0},
+            {n_elements / 3, n_elements / 3},
+            {block_elems < n_elements ? block_elems - 1 : 0, block_elems + 1 < n_elements ? 2 : 0},
+            {n_elements / 2, n_elements - n_elements / 2},
+            {n_elements, 0}
+        };
+
+        for (i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+            size_t first = ranges[i][0];
+            size_t count = ranges[i][1];
+
+            memset(range, 0, nbytes + 1);
+            if (shuffle_blocked_read_range(chunk, chunk_size, first, count, range) < 0)
+                PROGRAM_ERROR("shuffle_blocked_read_range() failed");
+            if (0 != memcmp(range, original + first * bytes_per_elem, count * bytes_per_elem))
+                PROGRAM_ERROR("range differs from the original");
+            if (0 != range[count * bytes_per_elem])
+                PROGRAM_ERROR("shuffle_blocked_read_range() wrote past the range");
+        }
+    }
+
+    if (NULL == (unshuffled = blocked_filter(H5Z_FLAG_REVERSE, bytes_per_elem, block_elems, chunk_size, chunk, &unshuffled_size)))
+        PROGRAM_ERROR("blocked filter failed to unshuffle");
+    if (unshuffled_size != nbytes || 0 != memcmp(unshuffled, original, nbytes))
+        PROGRAM_ERROR("unshuffled chunk differs from the original");
+
+    free(original);
+    free(chunk);
+    free(unshuffled);
+    free(expected);
+    free(range);
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    free(original);
+    free(chunk);
+    free(unshuffled);
+    free(expected);
+    free(range);
+
+    return -1;
+} /* end test_chunk() */
+
+
+static int
+test_bad_arguments(void)
+{
+    unsigned char original[400];
+    unsigned char dest[400];
+    unsigned char header[HEADER_SIZE];
+    unsigned char *chunk = NULL;
+    unsigned char *unshuffled = NULL;
+    size_t chunk_size;
+    size_t unshuffled_size;
+
+    printf("Testing blocked API with bad arguments... ");
+
+    /* 100 four-byte elements in blocks of 16 */
+    reference_fill(original, sizeof(original), 1);
+    if (NULL == (chunk = blocked_filter(0, 4, 16, sizeof(original), original, &chunk_size)))
+        PROGRAM_ERROR("blocked filter failed to shuffle");
+
+    /* Ranges past the end, and ones whose end overflows */
+    if (shuffle_blocked_read_range(chunk, chunk_size, 0, 101, dest) >= 0)
+        PROGRAM_ERROR("range past the end was accepted");
+    if (shuffle_blocked_read_range(chunk, chunk_size, 99, 2, dest) >= 0)
+        PROGRAM_ERROR("range past the end was accepted");
+    if (shuffle_blocked_read_range(chunk, chunk_size, 101, 0, dest) >= 0)
+        PROGRAM_ERROR("first past the end was accepted");
+    if (shuffle_blocked_read_range(chunk, chunk_size, 1, SIZE_MAX, dest) >= 0)
+        PROGRAM_ERROR("overflowing count was accepted");
+    if (shuffle_blocked_read_range(chunk, chunk_size, SIZE_MAX, 2, dest) >= 0)
+        PROGRAM_ERROR("overflowing first was accepted");
+    if (shuffle_blocked_read_range(chunk, chunk_size, 0, 1, NULL) >= 0)
+        PROGRAM_ERROR("NULL dest was accepted");
+
+    /* Truncated and malformed chunks */
+    if (shuffle_blocked_get_info(NULL, chunk_size, NULL, NULL, NULL) >= 0)
+        PROGRAM_ERROR("NULL chunk was accepted");
+    if (shuffle_blocked_get_info(chunk, HEADER_SIZE - 1, NULL, NULL, NULL) >= 0)
+        PROGRAM_ERROR("truncated header was accepted");
+    if (shuffle_blocked_read_range(chunk, HEADER_SIZE - 1, 0, 0, dest) >= 0)
+        PROGRAM_ERROR("truncated header was accepted by read_range");
+    if (shuffle_blocked_read_range(chunk, HEADER_SIZE + 8, 0, 3, dest) >= 0)
+        PROGRAM_ERROR("range past a truncated chunk was accepted");
+
+    memset(header, 0, sizeof(header));
+    header[4] = 16;
+    if (shuffle_blocked_get_info(header, sizeof(header), NULL, NULL, NULL) >= 0)
+        PROGRAM_ERROR("zero element size in the header was accepted");
+    header[0] = 4;
+    header[4] = 0;
+    if (shuffle_blocked_get_info(header, sizeof(header), NULL, NULL, NULL) >= 0)
+        PROGRAM_ERROR("zero block size in the header was accepted");
+
+    /* The reverse filter checks the header against the dataset */
+    if (NULL != (unshuffled = blocked_filter(H5Z_FLAG_REVERSE, 8, 16, chunk_size, chunk, &unshuffled_size)))
+        PROGRAM_ERROR("chunk with a different element size was unshuffled");
+    if (NULL != (unshuffled = blocked_filter(H5Z_FLAG_REVERSE, 4, 16, HEADER_SIZE - 1, chunk, &unshuffled_size)))
+        PROGRAM_ERROR("truncated chunk was unshuffled");
+
+    free(chunk);
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    free(chunk);
+    free(unshuffled);
+
+    return -1;
+} /* end test_bad_arguments() */
+
+
+int
+main(void)
+{
+    int n_failed = 0;
+    size_t i;
+    size_t j;
+    size_t k;
+
+    for (i = 0; i < N_ELEM_SIZES; i++)
+        for (j = 0; j < N_BLOCK_SIZES; j++)
+            for (k = 0; k < N_CHUNK_SIZES; k++)
+                if (test_chunk(elem_sizes[i], block_sizes[j], chunk_sizes[k]) < 0)
+                    n_failed++;
+    if (test_bad_arguments() < 0)
+        n_failed++;
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%d test(s) FAILED\n", n_failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+} /* end main() */
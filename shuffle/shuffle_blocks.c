@@ -0,0 +1,318 @@
+/* shuffle_blocks.c
+ *
+ * The blocked shuffle layout: the filter behind SHUFFLE_BLOCKED_ID and the
+ * sub-chunk random access API (see shuffle.h).
+ *
+ * A blocked chunk is an 8-byte header followed by the blocks:
+ *
+ *      bytes 0-3   element size (little-endian)
+ *      bytes 4-7   elements per block (little-endian)
+ *      blocks      each block_elems elements (fewer in the last one) in the
+ *                  normal byte plane layout
+ *      leftover    any fractional element at the end, as is
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_kernels.h"
+#include "shuffle_private.h"
+
+
+/* Local macros */
+#define BLOCKED_PARM_BLOCK_ELEMS    SHUFFLE_BLOCKED_PARM_BLOCK_ELEMS
+#define BLOCKED_PARM_SIZE           1   /* "Local" parameter for element size */
+#define BLOCKED_USER_NPARMS         1   /* Number of parameters that users can set */
+#define BLOCKED_TOTAL_NPARMS        2   /* Total number of parameters for filter */
+
+#define BLOCKED_HEADER_SIZE         8
+#define BLOCKED_DEFAULT_BYTES       (16 * 1024)
+
+/* Local prototypes */
+static void run_blocks(unsigned int flags, unsigned bytes_per_elem,
+        size_t block_elems, size_t n_elements, const unsigned char *src,
+        unsigned char *dest);
+static herr_t parse_header(const void *chunk, size_t chunk_size,
+        unsigned *bytes_per_elem, size_t *n_elements, size_t *block_elems);
+
+
+static void
+put32(unsigned char *p, size_t v)
+{
+    p[0] = (unsigned char)(v & 0xFF);
+    p[1] = (unsigned char)((v >> 8) & 0xFF);
+    p[2] = (unsigned char)((v >> 16) & 0xFF);
+    p[3] = (unsigned char)((v >> 24) & 0xFF);
+} /* end put32() */
+
+static size_t
+get32(const unsigned char *p)
+{
+    return (size_t)p[0] | ((size_t)p[1] << 8) | ((size_t)p[2] << 16) | ((size_t)p[3] << 24);
+} /* end get32() */
+
+
+herr_t
+shuffle_blocked_set_local(hid_t dcpl_id, hid_t type_id)
+{
+    unsigned flags;                             /* Filter flags */
+    size_t type_size;                           /* Datatype size */
+    size_t cd_nelmts = BLOCKED_USER_NPARMS;     /* # of filter parameters */
+    unsigned cd_values[BLOCKED_TOTAL_NPARMS];   /* Filter parameters */
+
+    /* Get the filter's current parameters */
+    if (H5Pget_filter_by_id(dcpl_id, SHUFFLE_BLOCKED_ID, &flags, &cd_nelmts, cd_values, (size_t)0, NULL, NULL) < 0)
+        goto error;
+
+    /* Get the type size */
+    if (0 == (type_size = H5Tget_size(type_id)))
+        goto error;
+
+    /* Default to 16 KiB blocks */
+    if (0 == cd_nelmts || 0 == cd_values[BLOCKED_PARM_BLOCK_ELEMS])
+        cd_values[BLOCKED_PARM_BLOCK_ELEMS] = type_size < BLOCKED_DEFAULT_BYTES
+                ? (unsigned)(BLOCKED_DEFAULT_BYTES / type_size) : 1;
+
+    /* Set "local" parameter for this dataset */
+    cd_values[BLOCKED_PARM_SIZE] = (unsigned)type_size;
+
+    /* Modify the filter's parameters for this dataset */
+    if(H5Pmodify_filter(dcpl_id, SHUFFLE_BLOCKED_ID, flags, (size_t)BLOCKED_TOTAL_NPARMS, cd_values) < 0)
+        goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_blocked_set_local() */
+
+
+size_t
+shuffle_blocked_filter(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    const unsigned char *src = (const unsigned char *)*buf;
+    unsigned char *dest = NULL;
+    unsigned bytes_per_elem;        /* Number of bytes per element */
+    size_t block_elems;             /* Number of elements per block */
+    size_t n_elements;              /* Whole elements in the chunk */
+    size_t data_size;               /* Chunk size without the header */
+    size_t dest_size;
+
+    /* Check arguments */
+    if (cd_nelmts != BLOCKED_TOTAL_NPARMS || 0 == cd_values[BLOCKED_PARM_SIZE]
+            || 0 == cd_values[BLOCKED_PARM_BLOCK_ELEMS])
+        goto error;
+
+    bytes_per_elem = cd_values[BLOCKED_PARM_SIZE];
+    block_elems = cd_values[BLOCKED_PARM_BLOCK_ELEMS];
+
+    if (flags & H5Z_FLAG_REVERSE) {
+        unsigned stored_bpe;
+
+        /* Trust the header over cd_values for the block size, so chunks
+         * stay readable whatever the dataset's current parameters are
+         */
+        if (parse_header(src, nbytes, &stored_bpe, &n_elements, &block_elems) < 0)
+            goto error;
+        if (stored_bpe != bytes_per_elem)
+            goto error;
+
+        data_size = nbytes - BLOCKED_HEADER_SIZE;
+        dest_size = data_size;
+        if (NULL == (dest = (unsigned char *)shuffle_malloc(dest_size ? dest_size : 1)))
+            goto error;
+
+        src += BLOCKED_HEADER_SIZE;
+        run_blocks(flags, bytes_per_elem, block_elems, n_elements, src, dest);
+        memcpy(dest + n_elements * bytes_per_elem, src + n_elements * bytes_per_elem,
+                data_size - n_elements * bytes_per_elem);
+    }
+    else {
+        if (nbytes > SIZE_MAX - BLOCKED_HEADER_SIZE)
+            goto error;
+
+        data_size = nbytes;
+        n_elements = nbytes / bytes_per_elem;
+        dest_size = nbytes + BLOCKED_HEADER_SIZE;
+        if (NULL == (dest = (unsigned char *)shuffle_malloc(dest_size)))
+            goto error;
+
+        put32(dest, bytes_per_elem);
+        put32(dest + 4, block_elems);
+        run_blocks(flags, bytes_per_elem, block_elems, n_elements, src,
+                dest + BLOCKED_HEADER_SIZE);
+        memcpy(dest + BLOCKED_HEADER_SIZE + n_elements * bytes_per_elem,
+                src + n_elements * bytes_per_elem, data_size - n_elements * bytes_per_elem);
+    }
+
+    /* Swap in the new buffer */
+    free(*buf);
+    *buf = dest;
+    *buf_size = dest_size ? dest_size : 1;
+
+    return dest_size;
+
+error:
+    free(dest);
+
+    return 0;
+} /* end shuffle_blocked_filter() */
+
+
+herr_t
+shuffle_blocked_get_info(const void *chunk, size_t chunk_size,
+        unsigned *bytes_per_elem, size_t *n_elements, size_t *block_elems)
+{
+    unsigned bpe;
+    size_t n, block;
+
+    if (parse_header(chunk, chunk_size, &bpe, &n, &block) < 0)
+        goto error;
+
+    if (bytes_per_elem)
+        *bytes_per_elem = bpe;
+    if (n_elements)
+        *n_elements = n;
+    if (block_elems)
+        *block_elems = block;
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_blocked_get_info() */
+
+
+herr_t
+shuffle_blocked_read_range(const void *chunk, size_t chunk_size, size_t first,
+        size_t count, void *dest)
+{
+    const shuffle_kernel_t *kernel = shuffle_active_kernel();
+    const unsigned char *blocks;
+    unsigned char *out = (unsigned char *)dest;
+    unsigned bytes_per_elem;
+    size_t n_elements;
+    size_t block_elems;
+    size_t b, last;
+
+    if (parse_header(chunk, chunk_size, &bytes_per_elem, &n_elements, &block_elems) < 0)
+        goto error;
+    if (NULL == dest || first > n_elements || count > n_elements - first)
+        goto error;
+    if (0 == count)
+        return 0;
+
+    blocks = (const unsigned char *)chunk + BLOCKED_HEADER_SIZE;
+    last = (first + count - 1) / block_elems;
+
+    for (b = first / block_elems; b <= last; b++) {
+        size_t start = b * block_elems;
+        size_t n = n_elements - start < block_elems ? n_elements - start : block_elems;
+        size_t lo = first > start ? first : start;
+        size_t hi = first + count < start + n ? first + count : start + n;
+        const unsigned char *planes = blocks + start * bytes_per_elem;
+        unsigned char *block_out = out + (lo - first) * bytes_per_elem;
+
+        if (lo == start && hi == start + n)
+            kernel->decode(bytes_per_elem, n, n, planes, block_out);
+        else {
+            /* Part of a block: gather just those elements */
+            size_t e;
+            unsigned j;
+
+            for (e = lo - start; e < hi - start; e++)
+                for (j = 0; j < bytes_per_elem; j++)
+                    *block_out++ = planes[j * n + e];
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_blocked_read_range() */
+
+
+/* [Un]shuffles every block, spreading the blocks over the OpenMP threads
+ * for chunks big enough to be worth it
+ */
+static void
+run_blocks(unsigned int flags, unsigned bytes_per_elem, size_t block_elems,
+        size_t n_elements, const unsigned char *src, unsigned char *dest)
+{
+    const shuffle_kernel_t *kernel = shuffle_active_kernel();
+    shuffle_kernel_func_t func = (flags & H5Z_FLAG_REVERSE) ? kernel->decode : kernel->encode;
+    long long n_blocks = (long long)((n_elements + block_elems - 1) / block_elems);
+    int team = n_blocks > 1 ? shuffle_kernel_team_begin(n_elements * bytes_per_elem) : 1;
+    long long b;
+
+    #pragma omp parallel for schedule(static) num_threads(team) if(team > 1)
+    for (b = 0; b < n_blocks; b++) {
+        size_t start = (size_t)b * block_elems;
+        size_t n = n_elements - start < block_elems ? n_elements - start : block_elems;
+        size_t offset = start * bytes_per_elem;
+
+        func(bytes_per_elem, n, n, src + offset, dest + offset);
+    }
+
+    shuffle_kernel_team_end(team);
+} /* end run_blocks() */
+
+
+/* Reads and sanity checks a blocked chunk's header */
+static herr_t
+parse_header(const void *chunk, size_t chunk_size, unsigned *bytes_per_elem,
+        size_t *n_elements, size_t *block_elems)
+{
+    const unsigned char *p = (const unsigned char *)chunk;
+
+    if (NULL == chunk || chunk_size < BLOCKED_HEADER_SIZE)
+        goto error;
+
+    *bytes_per_elem = (unsigned)get32(p);
+    *block_elems = get32(p + 4);
+    if (0 == *bytes_per_elem || 0 == *block_elems)
+        goto error;
+
+    *n_elements = (chunk_size - BLOCKED_HEADER_SIZE) / *bytes_per_elem;
+
+    return 0;
+
+error:
+    return -1;
+} /* end parse_header() */
@@ -0,0 +1,346 @@
+/* shuffle_budget_test.c
+ *
+ * Tests the thread budget (shuffle_set_thread_budget()) with an OpenMP
+ * plugin. Chunks large enough to start teams are shuffled and unshuffled
+ * under a range of budgets, from inside the program's own parallel region,
+ * and from several threads while another keeps changing the budget, and
+ * every result has to match the reference shuffle. Negative budgets have
+ * to be rejected.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hdf5.h>
+#include <omp.h>
+
+#include "shuffle.h"
+#include "shuffle_reference.h"
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+static const int budgets[] = {0, 1, 2, 3, 64};
+static const unsigned elem_sizes[] = {2, 4, 8};
+
+/* Small enough to run serially, and big enough for teams */
+static const size_t chunk_sizes[] = {4099, 1024 * 1024 + 5, 4 * 1024 * 1024 + 3};
+
+#define N_BUDGETS               (sizeof(budgets) / sizeof(budgets[0]))
+#define N_ELEM_SIZES            (sizeof(elem_sizes) / sizeof(elem_sizes[0]))
+#define N_CHUNK_SIZES           (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))
+
+#define N_TEAM_THREADS          4
+#define N_WORKERS               4
+#define WORKER_ROUNDS           20
+
+
+/* One round trip through shuffle_into() */
+static int
+check_into(unsigned bytes_per_elem, size_t nbytes, unsigned seed)
+{
+    unsigned char *original = NULL;
+    unsigned char *shuffled = NULL;
+    unsigned char *unshuffled = NULL;
+    unsigned char *expected = NULL;
+
+    if (NULL == (original = (unsigned char *)malloc(nbytes)))
+        PROGRAM_ERROR("memory allocation for original failed");
+    if (NULL == (shuffled = (unsigned char *)malloc(nbytes)))
+        PROGRAM_ERROR("memory allocation for shuffled failed");
+    if (NULL == (unshuffled = (unsigned char *)malloc(nbytes)))
+        PROGRAM_ERROR("memory allocation for unshuffled failed");
+    if (NULL == (expected = (unsigned char *)malloc(nbytes)))
+        PROGRAM_ERROR("memory allocation for expected failed");
+
+    reference_fill(original, nbytes, seed);
+    reference_shuffle(0, bytes_per_elem, nbytes, original, expected);
+
+    if (shuffle_into(0, bytes_per_elem, nbytes, original, shuffled) < 0)
+        PROGRAM_ERROR("shuffle_into() failed to shuffle");
+    if (0 != memcmp(shuffled, expected, nbytes))
+        PROGRAM_ERROR("shuffled buffer differs from the reference");
+    if (shuffle_into(H5Z_FLAG_REVERSE, bytes_per_elem, nbytes, shuffled, unshuffled) < 0)
+        PROGRAM_ERROR("shuffle_into() failed to unshuffle");
+    if (0 != memcmp(unshuffled, original, nbytes))
+        PROGRAM_ERROR("unshuffled buffer differs from the original");
+
+    free(original);
+    free(shuffled);
+    free(unshuffled);
+    free(expected);
+
+    return 0;
+
+error:
+    free(original);
+    free(shuffled);
+    free(unshuffled);
+    free(expected);
+
+    return -1;
+} /* end check_into() */
+
+
+/* One round trip of every chunk size through shuffle_chunks() */
+static int
+check_chunks(unsigned bytes_per_elem, unsigned seed)
+{
+    void *bufs[N_CHUNK_SIZES];
+    unsigned char *originals[N_CHUNK_SIZES];
+    unsigned char *expected = NULL;
+    size_t i;
+
+    memset(bufs, 0, sizeof(bufs));
+    memset(originals, 0, sizeof(originals));
+
+    if (NULL == (expected = (unsigned char *)malloc(chunk_sizes[N_CHUNK_SIZES - 1])))
+        PROGRAM_ERROR("memory allocation for expected failed");
+    for (i = 0; i < N_CHUNK_SIZES; i++) {
+        if (NULL == (originals[i] = (unsigned char *)malloc(chunk_sizes[i])))
+            PROGRAM_ERROR("memory allocation for original failed");
+        if (NULL == (bufs[i] = malloc(chunk_sizes[i])))
+            PROGRAM_ERROR("memory allocation for chunk failed");
+        reference_fill(originals[i], chunk_sizes[i], seed + (unsigned)i);
+        memcpy(bufs[i], originals[i], chunk_sizes[i]);
+    }
+
+    if (shuffle_chunks(0, bytes_per_elem, N_CHUNK_SIZES, bufs, chunk_sizes) < 0)
+        PROGRAM_ERROR("shuffle_chunks() failed to shuffle");
+    for (i = 0; i < N_CHUNK_SIZES; i++) {
+        reference_shuffle(0, bytes_per_elem, chunk_sizes[i], originals[i], expected);
+        if (0 != memcmp(bufs[i], expected, chunk_sizes[i]))
+            PROGRAM_ERROR("shuffled chunk differs from the reference");
+    }
+
+    if (shuffle_chunks(H5Z_FLAG_REVERSE, bytes_per_elem, N_CHUNK_SIZES, bufs, chunk_sizes) < 0)
+        PROGRAM_ERROR("shuffle_chunks() failed to unshuffle");
+    for (i = 0; i < N_CHUNK_SIZES; i++)
+        if (0 != memcmp(bufs[i], originals[i], chunk_sizes[i]))
+            PROGRAM_ERROR("unshuffled chunk differs from the original");
+
+    for (i = 0; i < N_CHUNK_SIZES; i++) {
+        free(bufs[i]);
+        free(originals[i]);
+    }
+    free(expected);
+
+    return 0;
+
+error:
+    for (i = 0; i < N_CHUNK_SIZES; i++) {
+        free(bufs[i]);
+        free(originals[i]);
+    }
+    free(expected);
+
+    return -1;
+} /* end check_chunks() */
+
+
+static int
+test_budget(int budget)
+{
+    size_t i;
+    size_t j;
+
+    printf("Testing with a thread budget of %d... ", budget);
+
+    if (shuffle_set_thread_budget(budget) < 0)
+        PROGRAM_ERROR("shuffle_set_thread_budget() failed");
+
+    for (i = 0; i < N_ELEM_SIZES; i++) {
+        for (j = 0; j < N_CHUNK_SIZES; j++)
+            if (check_into(elem_sizes[i], chunk_sizes[j], (unsigned)(budget + i + j)) < 0)
+                goto error;
+        if (check_chunks(elem_sizes[i], (unsigned)(budget + i)) < 0)
+            goto error;
+    }
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    return -1;
+} /* end test_budget() */
+
+
+/* Calls from inside an active parallel region run serially */
+static int
+test_nested(void)
+{
+    int n_bad = 0;
+
+    printf("Testing calls from inside a parallel region... ");
+
+    if (shuffle_set_thread_budget(0) < 0)
+        PROGRAM_ERROR("shuffle_set_thread_budget() failed");
+
+    #pragma omp parallel num_threads(N_TEAM_THREADS) reduction(+:n_bad)
+    {
+        unsigned seed = 100 + (unsigned)omp_get_thread_num();
+
+        if (check_into(4, chunk_sizes[N_CHUNK_SIZES - 1], seed) < 0)
+            n_bad++;
+        if (check_chunks(8, seed) < 0)
+            n_bad++;
+    }
+
+    if (n_bad > 0)
+        PROGRAM_ERROR("a call from inside the parallel region failed");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    return -1;
+} /* end test_nested() */
+
+
+/* Workers shuffle while the main thread keeps changing the budget */
+typedef struct worker_t {
+    pthread_t thread;
+    unsigned id;
+    int n_bad;
+    atomic_int *n_running;
+} worker_t;
+
+static void *
+worker(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    int r;
+
+    for (r = 0; r < WORKER_ROUNDS; r++)
+        if (check_into(w->id % 2 ? 8 : 4, chunk_sizes[1], w->id * WORKER_ROUNDS + (unsigned)r) < 0)
+            w->n_bad++;
+
+    atomic_fetch_sub(w->n_running, 1);
+
+    return NULL;
+} /* end worker() */
+
+static int
+test_concurrent(void)
+{
+    worker_t workers[N_WORKERS];
+    atomic_int n_running = 0;
+    int n_started = 0;
+    int n_bad = 0;
+    int b = 0;
+    int i;
+
+    printf("Testing budget changes while other threads shuffle... ");
+
+    for (i = 0; i < N_WORKERS; i++) {
+        workers[i].id = (unsigned)i;
+        workers[i].n_bad = 0;
+        workers[i].n_running = &n_running;
+        atomic_fetch_add(&n_running, 1);
+        if (0 != pthread_create(&workers[i].thread, NULL, worker, &workers[i])) {
+            atomic_fetch_sub(&n_running, 1);
+            break;
+        }
+        n_started++;
+    }
+
+    while (atomic_load(&n_running) > 0)
+        if (shuffle_set_thread_budget(b++ % 5) < 0)
+            n_bad++;
+
+    for (i = 0; i < n_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        n_bad += workers[i].n_bad;
+    }
+
+    if (n_started < N_WORKERS)
+        PROGRAM_ERROR("couldn't start the workers");
+    if (n_bad > 0)
+        PROGRAM_ERROR("a worker's round trip failed");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    return -1;
+} /* end test_concurrent() */
+
+
+static int
+test_bad_arguments(void)
+{
+    printf("Testing shuffle_set_thread_budget() with bad arguments... ");
+
+    if (shuffle_set_thread_budget(-1) >= 0)
+        PROGRAM_ERROR("negative budget was accepted");
+    if (shuffle_set_thread_budget(-1000) >= 0)
+        PROGRAM_ERROR("negative budget was accepted");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    return -1;
+} /* end test_bad_arguments() */
+
+
+int
+main(void)
+{
+    int n_failed = 0;
+    size_t i;
+
+    for (i = 0; i < N_BUDGETS; i++)
+        if (test_budget(budgets[i]) < 0)
+            n_failed++;
+    if (test_nested() < 0)
+        n_failed++;
+    if (test_concurrent() < 0)
+        n_failed++;
+    if (test_bad_arguments() < 0)
+        n_failed++;
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%d test(s) FAILED\n", n_failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+} /* end main() */
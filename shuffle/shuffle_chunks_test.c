@@ -0,0 +1,172 @@
+/* shuffle_chunks_test.c
+ *
+ * Tests shuffle_chunks(). Batches of chunks with assorted element and chunk
+ * sizes (including partial trailing elements) are shuffled and unshuffled
+ * and checked against the reference shuffle, and bad arguments have to be
+ * rejected.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_reference.h"
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+/* One batch holds a chunk of each size (in bytes) */
+static const unsigned elem_sizes[] = {1, 2, 3, 4, 8, 16};
+static const size_t chunk_sizes[] = {0, 1, 7, 64, 4099, 65536, 1024 * 1024 + 5};
+
+#define N_ELEM_SIZES            (sizeof(elem_sizes) / sizeof(elem_sizes[0]))
+#define N_CHUNKS                (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))
+#define MAX_CHUNK_SIZE          (1024 * 1024 + 5)
+
+
+/* Shuffles a batch, checks it, then unshuffles it and checks that too */
+static int
+test_round_trip(unsigned bytes_per_elem)
+{
+    void *bufs[N_CHUNKS] = {NULL};
+    unsigned char *original[N_CHUNKS] = {NULL};
+    unsigned char *expected = NULL;
+    size_t i;
+
+    printf("Testing shuffle_chunks() with %u byte elements... ", bytes_per_elem);
+
+    /* Every buffer has at least a byte, so malloc() never returns NULL */
+    if (NULL == (expected = (unsigned char *)malloc(MAX_CHUNK_SIZE)))
+        PROGRAM_ERROR("memory allocation for expected failed");
+    for (i = 0; i < N_CHUNKS; i++) {
+        if (NULL == (original[i] = (unsigned char *)malloc(chunk_sizes[i] + 1)))
+            PROGRAM_ERROR("memory allocation for original failed");
+        if (NULL == (bufs[i] = malloc(chunk_sizes[i] + 1)))
+            PROGRAM_ERROR("memory allocation for bufs failed");
+        reference_fill(original[i], chunk_sizes[i], (unsigned)(bytes_per_elem * N_CHUNKS + i));
+        memcpy(bufs[i], original[i], chunk_sizes[i]);
+    }
+
+    if (shuffle_chunks(0, bytes_per_elem, N_CHUNKS, bufs, chunk_sizes) < 0)
+        PROGRAM_ERROR("shuffle_chunks() failed to shuffle");
+    for (i = 0; i < N_CHUNKS; i++) {
+        reference_shuffle(0, bytes_per_elem, chunk_sizes[i], original[i], expected);
+        if (0 != memcmp(bufs[i], expected, chunk_sizes[i]))
+            PROGRAM_ERROR("shuffled chunk differs from the reference");
+    }
+
+    if (shuffle_chunks(H5Z_FLAG_REVERSE, bytes_per_elem, N_CHUNKS, bufs, chunk_sizes) < 0)
+        PROGRAM_ERROR("shuffle_chunks() failed to unshuffle");
+    for (i = 0; i < N_CHUNKS; i++)
+        if (0 != memcmp(bufs[i], original[i], chunk_sizes[i]))
+            PROGRAM_ERROR("unshuffled chunk differs from the original");
+
+    for (i = 0; i < N_CHUNKS; i++) {
+        free(bufs[i]);
+        free(original[i]);
+    }
+    free(expected);
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    for (i = 0; i < N_CHUNKS; i++) {
+        free(bufs[i]);
+        free(original[i]);
+    }
+    free(expected);
+
+    return -1;
+} /* end test_round_trip() */
+
+
+static int
+test_bad_arguments(void)
+{
+    void *bufs[1] = {NULL};
+    size_t nbytes[1] = {16};
+
+    printf("Testing shuffle_chunks() with bad arguments... ");
+
+    if (NULL == (bufs[0] = malloc(nbytes[0])))
+        PROGRAM_ERROR("memory allocation for bufs failed");
+    memset(bufs[0], 0, nbytes[0]);
+
+    if (shuffle_chunks(0, 0, 1, bufs, nbytes) >= 0)
+        PROGRAM_ERROR("zero element size was accepted");
+    if (shuffle_chunks(0, 4, 1, NULL, nbytes) >= 0)
+        PROGRAM_ERROR("NULL bufs was accepted");
+    if (shuffle_chunks(0, 4, 1, bufs, NULL) >= 0)
+        PROGRAM_ERROR("NULL nbytes was accepted");
+
+    /* An empty batch is fine */
+    if (shuffle_chunks(0, 4, 0, NULL, NULL) < 0)
+        PROGRAM_ERROR("empty batch was rejected");
+
+    free(bufs[0]);
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    free(bufs[0]);
+
+    return -1;
+} /* end test_bad_arguments() */
+
+
+int
+main(void)
+{
+    int n_failed = 0;
+    size_t i;
+
+    for (i = 0; i < N_ELEM_SIZES; i++)
+        if (test_round_trip(elem_sizes[i]) < 0)
+            n_failed++;
+    if (test_bad_arguments() < 0)
+        n_failed++;
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%d test(s) FAILED\n", n_failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+} /* end main() */
@@ -0,0 +1,284 @@
+/* shuffle_common.c
+ *
+ * The filter scaffolding and exported API shared by all of the shuffle
+ * filter plugins. Each plugin supplies its filter ID and its default
+ * kernel (see shuffle_plugin_kernel and shuffle_dispatch.c), and everything
+ * else lives here.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_kernels.h"
+#include "shuffle_private.h"
+
+
+/* Local macros */
+#define SHUFFLE_PARM_SIZE       0   /* "Local" parameter for shuffling size */
+#define SHUFFLE_PARM_STATS_TYPE 1   /* "Local" parameter for the statistics type */
+#define SHUFFLE_PARM_HAS_FILL   2   /* "Local" parameter, 1 if there is a fill value */
+#define SHUFFLE_PARM_FILL_LO    3   /* "Local" parameter for fill value bytes 0-3 */
+#define SHUFFLE_PARM_FILL_HI    4   /* "Local" parameter for fill value bytes 4-7 */
+#define SHUFFLE_PARM_STATS      0   /* User parameter, SHUFFLE_STATS_ENABLE (replaced by the size) */
+#define SHUFFLE_USER_NPARMS     1   /* Number of parameters that users can set */
+#define SHUFFLE_TOTAL_NPARMS    5   /* Total number of parameters w/ statistics */
+#define SHUFFLE_V1_NPARMS       1   /* Total number of parameters w/o statistics */
+
+/* Local prototypes */
+static herr_t shuffle_chunk(unsigned int flags, unsigned bytes_per_elem,
+        size_t nbytes, void **buf);
+
+
+herr_t
+shuffle_set_local(H5Z_filter_t filter_id, hid_t dcpl_id, hid_t type_id)
+{
+    unsigned flags;                             /* Filter flags */
+    size_t type_size;                           /* Datatype size */
+    shuffle_stats_type_t stats_type;            /* Statistics for this type */
+    H5D_fill_value_t fill_status;               /* Is there a fill value? */
+    unsigned char fill[8];                      /* The fill value */
+    size_t cd_nelmts = SHUFFLE_TOTAL_NPARMS;    /* # of filter parameters */
+    unsigned cd_values[SHUFFLE_TOTAL_NPARMS];   /* Filter parameters */
+    int with_stats;                             /* Record type and fill? */
+    int i;
+
+    /* Get the filter's current parameters */
+    if (H5Pget_filter_by_id(dcpl_id, filter_id, &flags, &cd_nelmts, cd_values, (size_t)0, NULL, NULL) < 0)
+        goto error;
+
+    /* Get the type size */
+    if (0 == (type_size = H5Tget_size(type_id)))
+        goto error;
+
+    /* Statistics only if asked for, so other datasets stay readable by
+     * plugins that only know the size
+     */
+    with_stats = cd_nelmts == SHUFFLE_USER_NPARMS
+        && SHUFFLE_STATS_ENABLE == cd_values[SHUFFLE_PARM_STATS];
+
+    /* Set "local" parameters for this dataset */
+    cd_values[SHUFFLE_PARM_SIZE] = (unsigned)type_size;
+    if (!with_stats) {
+        if (H5Pmodify_filter(dcpl_id, filter_id, flags, (size_t)SHUFFLE_V1_NPARMS, cd_values) < 0)
+            goto error;
+
+        return 0;
+    }
+
+    /* The type and fill value, for per-chunk statistics */
+    stats_type = shuffle_stats_type_of(type_id);
+    if (H5Pfill_value_defined(dcpl_id, &fill_status) < 0)
+        goto error;
+    memset(fill, 0, sizeof(fill));
+    cd_values[SHUFFLE_PARM_STATS_TYPE] = (unsigned)stats_type;
+    cd_values[SHUFFLE_PARM_HAS_FILL] = 0;
+    if (SHUFFLE_STATS_NONE != stats_type && H5D_FILL_VALUE_USER_DEFINED == fill_status) {
+        if (H5Pget_fill_value(dcpl_id, type_id, fill) < 0)
+            goto error;
+        cd_values[SHUFFLE_PARM_HAS_FILL] = 1;
+    }
+    cd_values[SHUFFLE_PARM_FILL_LO] = 0;
+    cd_values[SHUFFLE_PARM_FILL_HI] = 0;
+    for (i = 0; i < 4; i++) {
+        cd_values[SHUFFLE_PARM_FILL_LO] |= (unsigned)fill[i] << (8 * i);
+        cd_values[SHUFFLE_PARM_FILL_HI] |= (unsigned)fill[i + 4] << (8 * i);
+    }
+
+    /* Modify the filter's parameters for this dataset */
+    if(H5Pmodify_filter(dcpl_id, filter_id, flags, (size_t)SHUFFLE_TOTAL_NPARMS, cd_values) < 0)
+        goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_set_local() */
+
+
+size_t
+shuffle_filter(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    unsigned bytes_per_elem;        /* Number of bytes per element */
+
+    /* Check arguments (older datasets only have the size) */
+    if (cd_nelmts != SHUFFLE_TOTAL_NPARMS && cd_nelmts != SHUFFLE_V1_NPARMS)
+        goto error;
+    if (cd_values[SHUFFLE_PARM_SIZE] == 0)
+        goto error;
+
+    /* Get the number of bytes per element from the parameter block */
+    bytes_per_elem = cd_values[SHUFFLE_PARM_SIZE];
+
+    /* Chunks of datasets with statistics carry them in a header */
+    if (cd_nelmts == SHUFFLE_TOTAL_NPARMS
+            && SHUFFLE_STATS_NONE != cd_values[SHUFFLE_PARM_STATS_TYPE]
+            && bytes_per_elem <= 8) {
+        unsigned char fill[8];
+        int i;
+
+        if (flags & H5Z_FLAG_REVERSE) {
+            if (shuffle_unchunk_with_stats(bytes_per_elem, &nbytes, buf) < 0)
+                goto error;
+        }
+        else {
+            for (i = 0; i < 4; i++) {
+                fill[i] = (unsigned char)(cd_values[SHUFFLE_PARM_FILL_LO] >> (8 * i));
+                fill[i + 4] = (unsigned char)(cd_values[SHUFFLE_PARM_FILL_HI] >> (8 * i));
+            }
+
+            if (shuffle_chunk_with_stats(bytes_per_elem, &nbytes,
+                        (shuffle_stats_type_t)cd_values[SHUFFLE_PARM_STATS_TYPE],
+                        cd_values[SHUFFLE_PARM_HAS_FILL] ? fill : NULL, buf) < 0)
+                goto error;
+        }
+
+        *buf_size = nbytes;
+        return nbytes;
+    }
+
+    /* [Un]shuffle the buffer, replacing it with the result */
+    if (shuffle_chunk(flags, bytes_per_elem, nbytes, buf) < 0)
+        goto error;
+
+    return *buf_size;
+
+error:
+    return 0;
+} /* end shuffle_filter() */
+
+
+herr_t
+shuffle_chunks(unsigned int flags, unsigned bytes_per_elem, size_t n_chunks,
+        void *bufs[], const size_t nbytes[])
+{
+    size_t i;
+    size_t total_bytes = 0;
+    int n_failed = 0;               /* Number of chunks that failed */
+    int team = 1;
+
+    /* Check arguments */
+    if (0 == bytes_per_elem)
+        goto error;
+    if (n_chunks > 0 && (NULL == bufs || NULL == nbytes))
+        goto error;
+
+    /* The chunks are independent, so hand them out to the OpenMP thread
+     * pool. Dynamic scheduling keeps the threads busy when the chunk sizes
+     * vary (e.g., partial edge chunks). The kernels see they're inside our
+     * team and stay serial.
+     */
+    if (n_chunks > 1) {
+        for (i = 0; i < n_chunks; i++)
+            total_bytes += nbytes[i];
+        team = shuffle_kernel_team_begin(total_bytes);
+    }
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:n_failed) num_threads(team) if(team > 1)
+    for (i = 0; i < n_chunks; i++) {
+        if (shuffle_chunk(flags, bytes_per_elem, nbytes[i], &bufs[i]) < 0)
+            n_failed++;
+    }
+
+    shuffle_kernel_team_end(team);
+
+    if (n_failed > 0)
+        goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_chunks() */
+
+
+herr_t
+shuffle_into(unsigned int flags, unsigned bytes_per_elem, size_t nbytes,
+        const void *src, void *dest)
+{
+    /* Check arguments */
+    if (0 == bytes_per_elem || NULL == src || NULL == dest)
+        goto error;
+    if ((const unsigned char *)src < (unsigned char *)dest + nbytes
+            && (unsigned char *)dest < (const unsigned char *)src + nbytes)
+        goto error;
+
+    /* Nothing to rearrange, but the caller still expects the bytes in dest */
+    if (bytes_per_elem <= 1 || nbytes / bytes_per_elem <= 1)
+        memcpy(dest, src, nbytes);
+    else
+        shuffle_kernel_run(shuffle_active_kernel(), flags, bytes_per_elem, nbytes,
+                (const unsigned char *)src, (unsigned char *)dest);
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_into() */
+
+
+/* [Un]shuffles a single buffer, replacing *buf with a newly allocated
+ * buffer that holds the result. *buf is left untouched on failure.
+ */
+static herr_t
+shuffle_chunk(unsigned int flags, unsigned bytes_per_elem, size_t nbytes,
+        void **buf)
+{
+    void *dest = NULL;              /* Buffer to deposit [un]shuffled bytes into */
+
+    /* If this is a single byte type or we have fractional elements, do nothing */
+    if (bytes_per_elem <= 1 || nbytes / bytes_per_elem <= 1)
+        return 0;
+
+    /* Allocate the destination buffer */
+    if (NULL == (dest = shuffle_malloc(nbytes)))
+        goto error;
+
+    shuffle_kernel_run(shuffle_active_kernel(), flags, bytes_per_elem, nbytes,
+            (const unsigned char *)(*buf), (unsigned char *)dest);
+
+    /* Free the input buffer */
+    free(*buf);
+
+    /* Set the buffer information to return */
+    *buf = dest;
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_chunk() */
+
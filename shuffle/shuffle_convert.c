@@ -0,0 +1,350 @@
+/* shuffle_convert.c
+ *
+ * Unshuffle with type conversion, for direct chunk readers that want the
+ * data in a wider memory type (see shuffle.h).
+ *
+ * H5Dread() unshuffles a chunk into a temporary buffer and then converts
+ * the whole buffer in a second pass. Here the byte planes are gathered a
+ * tile at a time into a small buffer that stays in L1 and converted from
+ * there, so the chunk crosses memory once and no chunk-sized temporary is
+ * needed. With AVX2, 2 and 4 byte elements skip the tile altogether: the
+ * planes are interleaved in registers and widened on the way to dest.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_kernels.h"
+#include "shuffle_private.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERT_X86
+#include <immintrin.h>
+#endif
+
+
+/* Elements per tile: 2 KiB of 8-byte elements */
+#define CONVERT_TILE    256
+
+/* The types a chunk can be converted from and to */
+typedef enum convert_type_t {
+    CONVERT_NONE = 0,
+    CONVERT_I8, CONVERT_U8,
+    CONVERT_I16, CONVERT_U16,
+    CONVERT_I32, CONVERT_U32,
+    CONVERT_I64, CONVERT_U64,
+    CONVERT_F32, CONVERT_F64
+} convert_type_t;
+
+static const unsigned convert_size[] = {0, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
+
+
+/* Maps a native integer or floating-point type to a convert_type_t */
+static convert_type_t
+convert_type_of(hid_t type_id)
+{
+    H5T_class_t type_class;
+    size_t size;
+
+    if (H5T_NO_CLASS == (type_class = H5Tget_class(type_id)))
+        return CONVERT_NONE;
+    size = H5Tget_size(type_id);
+
+    if (H5T_INTEGER == type_class) {
+        int is_signed = H5T_SGN_2 == H5Tget_sign(type_id);
+
+        if (size > 1 && H5Tget_order(type_id) != H5Tget_order(H5T_NATIVE_INT))
+            return CONVERT_NONE;
+        switch (size) {
+            case 1:     return is_signed ? CONVERT_I8 : CONVERT_U8;
+            case 2:     return is_signed ? CONVERT_I16 : CONVERT_U16;
+            case 4:     return is_signed ? CONVERT_I32 : CONVERT_U32;
+            case 8:     return is_signed ? CONVERT_I64 : CONVERT_U64;
+            default:    return CONVERT_NONE;
+        }
+    }
+    if (H5T_FLOAT == type_class) {
+        if (H5Tequal(type_id, H5T_NATIVE_FLOAT) > 0)
+            return CONVERT_F32;
+        if (H5Tequal(type_id, H5T_NATIVE_DOUBLE) > 0)
+            return CONVERT_F64;
+    }
+
+    return CONVERT_NONE;
+} /* end convert_type_of() */
+
+
+/* Only conversions that can't lose anything, plus 32-bit integers to
+ * float, which rounds exactly as H5Dread() would
+ */
+static int
+convert_supported(convert_type_t from, convert_type_t to)
+{
+    if (CONVERT_NONE == from || CONVERT_NONE == to)
+        return 0;
+    if (from == to)
+        return 1;
+
+    switch (to) {
+        case CONVERT_F64:
+            return from != CONVERT_I64 && from != CONVERT_U64;
+        case CONVERT_F32:
+            return from <= CONVERT_U32;
+        case CONVERT_I32:
+            return from <= CONVERT_U16;
+        default:
+            return 0;
+    }
+} /* end convert_supported() */
+
+
+/****************/
+/* TILE BY TILE */
+/****************/
+
+#define CONVERT_LOOP(stype, dtype)                                          \
+    do {                                                                    \
+        const stype *s_ = (const stype *)src;                               \
+        dtype *d_ = (dtype *)dest;                                          \
+        size_t j_;                                                          \
+                                                                            \
+        _Pragma("omp simd")                                                 \
+        for (j_ = 0; j_ < count; j_++)                                      \
+            d_[j_] = (dtype)s_[j_];                                         \
+    } while (0)
+
+#define CONVERT_FROM(stype)                                                 \
+    do {                                                                    \
+        if (CONVERT_F64 == to)                                              \
+            CONVERT_LOOP(stype, double);                                    \
+        else if (CONVERT_F32 == to)                                         \
+            CONVERT_LOOP(stype, float);                                     \
+        else                                                                \
+            CONVERT_LOOP(stype, int32_t);                                   \
+    } while (0)
+
+/* Converts count whole elements from src to dest */
+static void
+convert_elements(convert_type_t from, convert_type_t to, size_t count,
+        const void *src, void *dest)
+{
+    switch (from) {
+        case CONVERT_I8:    CONVERT_FROM(int8_t);   break;
+        case CONVERT_U8:    CONVERT_FROM(uint8_t);  break;
+        case CONVERT_I16:   CONVERT_FROM(int16_t);  break;
+        case CONVERT_U16:   CONVERT_FROM(uint16_t); break;
+        case CONVERT_I32:   CONVERT_FROM(int32_t);  break;
+        case CONVERT_U32:   CONVERT_FROM(uint32_t); break;
+        case CONVERT_F32:   CONVERT_FROM(float);    break;
+        default:                                    break;
+    }
+} /* end convert_elements() */
+
+/* Unshuffles and converts elements [first, last) a tile at a time */
+static void
+convert_tiles(convert_type_t from, convert_type_t to, size_t n_elements,
+        size_t first, size_t last, const unsigned char *chunk, unsigned char *dest)
+{
+    const shuffle_kernel_t *kernel = shuffle_active_kernel();
+    unsigned src_size = convert_size[from];
+    unsigned dest_size = convert_size[to];
+    double tile[CONVERT_TILE];      /* For the alignment */
+    size_t i;
+
+    for (i = first; i < last; i += CONVERT_TILE) {
+        size_t count = last - i < CONVERT_TILE ? last - i : CONVERT_TILE;
+
+        /* One byte elements aren't shuffled */
+        if (1 == src_size)
+            convert_elements(from, to, count, chunk + i, dest + i * dest_size);
+        else {
+            kernel->decode(src_size, count, n_elements, chunk + i, (unsigned char *)tile);
+            convert_elements(from, to, count, tile, dest + i * dest_size);
+        }
+    }
+} /* end convert_tiles() */
+
+
+/********/
+/* AVX2 */
+/********/
+
+#ifdef CONVERT_X86
+
+/* 16 elements of 2 bytes at a time, straight from the planes. Returns how
+ * many elements were done; the caller does the rest.
+ */
+__attribute__((target("avx2")))
+static size_t
+convert_2_avx2(convert_type_t from, convert_type_t to, size_t n_elements,
+        const unsigned char *chunk, unsigned char *dest)
+{
+    const unsigned char *p0 = chunk;
+    const unsigned char *p1 = chunk + n_elements;
+    int is_signed = CONVERT_I16 == from;
+    size_t i;
+
+    for (i = 0; i + 16 <= n_elements; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(p0 + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(p1 + i));
+        __m128i lo = _mm_unpacklo_epi8(b0, b1);
+        __m128i hi = _mm_unpackhi_epi8(b0, b1);
+        __m256i v0 = is_signed ? _mm256_cvtepi16_epi32(lo) : _mm256_cvtepu16_epi32(lo);
+        __m256i v1 = is_signed ? _mm256_cvtepi16_epi32(hi) : _mm256_cvtepu16_epi32(hi);
+
+        if (CONVERT_F64 == to) {
+            double *d = (double *)dest + i;
+
+            _mm256_storeu_pd(d, _mm256_cvtepi32_pd(_mm256_castsi256_si128(v0)));
+            _mm256_storeu_pd(d + 4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(v0, 1)));
+            _mm256_storeu_pd(d + 8, _mm256_cvtepi32_pd(_mm256_castsi256_si128(v1)));
+            _mm256_storeu_pd(d + 12, _mm256_cvtepi32_pd(_mm256_extracti128_si256(v1, 1)));
+        }
+        else if (CONVERT_F32 == to) {
+            float *d = (float *)dest + i;
+
+            _mm256_storeu_ps(d, _mm256_cvtepi32_ps(v0));
+            _mm256_storeu_ps(d + 8, _mm256_cvtepi32_ps(v1));
+        }
+        else {
+            int32_t *d = (int32_t *)dest + i;
+
+            _mm256_storeu_si256((__m256i *)d, v0);
+            _mm256_storeu_si256((__m256i *)(d + 8), v1);
+        }
+    }
+
+    return i;
+} /* end convert_2_avx2() */
+
+/* 16 elements of 4 bytes (float or int) to double at a time */
+__attribute__((target("avx2")))
+static size_t
+convert_4_avx2(convert_type_t from, size_t n_elements, const unsigned char *chunk,
+        unsigned char *dest)
+{
+    const unsigned char *p0 = chunk;
+    const unsigned char *p1 = chunk + n_elements;
+    const unsigned char *p2 = chunk + 2 * n_elements;
+    const unsigned char *p3 = chunk + 3 * n_elements;
+    double *d = (double *)dest;
+    size_t i;
+
+    for (i = 0; i + 16 <= n_elements; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(p0 + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(p1 + i));
+        __m128i b2 = _mm_loadu_si128((const __m128i *)(p2 + i));
+        __m128i b3 = _mm_loadu_si128((const __m128i *)(p3 + i));
+        __m128i a = _mm_unpacklo_epi8(b0, b1);
+        __m128i b = _mm_unpackhi_epi8(b0, b1);
+        __m128i c = _mm_unpacklo_epi8(b2, b3);
+        __m128i e = _mm_unpackhi_epi8(b2, b3);
+        __m128i x[4];
+        int k;
+
+        /* Elements 0-3, 4-7, 8-11, 12-15 */
+        x[0] = _mm_unpacklo_epi16(a, c);
+        x[1] = _mm_unpackhi_epi16(a, c);
+        x[2] = _mm_unpacklo_epi16(b, e);
+        x[3] = _mm_unpackhi_epi16(b, e);
+
+        for (k = 0; k < 4; k++) {
+            __m256d v = CONVERT_F32 == from ? _mm256_cvtps_pd(_mm_castsi128_ps(x[k]))
+                                            : _mm256_cvtepi32_pd(x[k]);
+
+            _mm256_storeu_pd(d + i + 4 * k, v);
+        }
+    }
+
+    return i;
+} /* end convert_4_avx2() */
+
+#endif /* CONVERT_X86 */
+
+
+/*******/
+/* API */
+/*******/
+
+int
+shuffle_can_convert(hid_t file_type, hid_t mem_type)
+{
+    return convert_supported(convert_type_of(file_type), convert_type_of(mem_type));
+} /* end shuffle_can_convert() */
+
+
+herr_t
+shuffle_unshuffle_convert(hid_t file_type, const void *chunk, size_t nbytes,
+        hid_t mem_type, void *dest)
+{
+    convert_type_t from = convert_type_of(file_type);
+    convert_type_t to = convert_type_of(mem_type);
+    const unsigned char *src = (const unsigned char *)chunk;
+    size_t n_elements;
+    size_t done = 0;
+
+    /* Check arguments */
+    if (!convert_supported(from, to))
+        goto error;
+    if (NULL == chunk || NULL == dest)
+        goto error;
+    if (nbytes % convert_size[from])
+        goto error;
+    n_elements = nbytes / convert_size[from];
+
+    /* Nothing to convert, just unshuffle */
+    if (from == to) {
+        shuffle_kernel_run(shuffle_active_kernel(), H5Z_FLAG_REVERSE, convert_size[from],
+                nbytes, src, (unsigned char *)dest);
+        return 0;
+    }
+
+#ifdef CONVERT_X86
+    if (shuffle_kernel_supported(&shuffle_kernel_avx2)) {
+        if (2 == convert_size[from])
+            done = convert_2_avx2(from, to, n_elements, src, (unsigned char *)dest);
+        else if (CONVERT_F64 == to && (CONVERT_F32 == from || CONVERT_I32 == from))
+            done = convert_4_avx2(from, n_elements, src, (unsigned char *)dest);
+    }
+#endif
+
+    convert_tiles(from, to, n_elements, done, n_elements, src, (unsigned char *)dest);
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_unshuffle_convert() */
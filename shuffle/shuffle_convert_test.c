@@ -0,0 +1,306 @@
+/* shuffle_convert_test.c
+ *
+ * Tests shuffle_unshuffle_convert(). Every pair of native integer and
+ * floating-point types is tried: the supported ones have to match
+ * H5Tconvert() of the unshuffled data for assorted element counts, and
+ * the rest (plus big-endian and string types) have to be refused by both
+ * shuffle_can_convert() and shuffle_unshuffle_convert(), as do chunks of
+ * a partial element and NULL buffers.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_reference.h"
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define HDF5_ERROR              do {PRINT_ERROR_MSG; goto error;} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+/* The native types, in the order of the table below */
+enum {
+    T_SCHAR, T_UCHAR, T_SHORT, T_USHORT, T_INT, T_UINT,
+    T_LLONG, T_ULLONG, T_FLOAT, T_DOUBLE, N_TYPES
+};
+
+static const char *type_names[N_TYPES] = {
+    "schar", "uchar", "short", "ushort", "int", "uint",
+    "llong", "ullong", "float", "double"
+};
+
+/* Which pairs are supported: anything to itself, everything but 64-bit
+ * integers to double, 32-bit and smaller integers to float, and 8 and 16
+ * bit integers to int. Rows are the file type, columns the memory type.
+ */
+static const int supported[N_TYPES][N_TYPES] = {
+    /*             sc us sh us in ui ll ul fl db */
+    /* schar  */  {1, 0, 0, 0, 1, 0, 0, 0, 1, 1},
+    /* uchar  */  {0, 1, 0, 0, 1, 0, 0, 0, 1, 1},
+    /* short  */  {0, 0, 1, 0, 1, 0, 0, 0, 1, 1},
+    /* ushort */  {0, 0, 0, 1, 1, 0, 0, 0, 1, 1},
+    /* int    */  {0, 0, 0, 0, 1, 0, 0, 0, 1, 1},
+    /* uint   */  {0, 0, 0, 0, 0, 1, 0, 0, 1, 1},
+    /* llong  */  {0, 0, 0, 0, 0, 0, 1, 0, 0, 0},
+    /* ullong */  {0, 0, 0, 0, 0, 0, 0, 1, 0, 0},
+    /* float  */  {0, 0, 0, 0, 0, 0, 0, 0, 1, 1},
+    /* double */  {0, 0, 0, 0, 0, 0, 0, 0, 0, 1}
+};
+
+/* Around the SIMD widths and the tile size */
+static const size_t elem_counts[] = {1, 15, 16, 17, 255, 256, 257, 10003};
+
+#define N_ELEM_COUNTS           (sizeof(elem_counts) / sizeof(elem_counts[0]))
+#define MAX_ELEMS               10003
+
+static hid_t native_types[N_TYPES];
+
+
+/* Random values that convert exactly to every supported type */
+static void
+make_data(int type, unsigned char *data, size_t n, unsigned seed)
+{
+    size_t i;
+
+    reference_fill(data, n * H5Tget_size(native_types[type]), seed);
+
+    if (T_FLOAT == type)
+        for (i = 0; i < n; i++) {
+            float f = (float)((int)(i * 2654435761u) % 1000000) / 16.0f;
+
+            memcpy(data + i * sizeof(float), &f, sizeof(float));
+        }
+    else if (T_DOUBLE == type)
+        for (i = 0; i < n; i++) {
+            double d = (double)((int)(i * 2654435761u) % 1000000) / 16.0;
+
+            memcpy(data + i * sizeof(double), &d, sizeof(double));
+        }
+} /* end make_data() */
+
+
+static int
+test_pair(int from, int to)
+{
+    hid_t file_type = native_types[from];
+    hid_t mem_type = native_types[to];
+    size_t from_size = H5Tget_size(file_type);
+    size_t to_size = H5Tget_size(mem_type);
+    size_t max_size = from_size > to_size ? from_size : to_size;
+    unsigned char *original = NULL;
+    unsigned char *shuffled = NULL;
+    unsigned char *converted = NULL;
+    unsigned char *expected = NULL;
+    size_t i;
+
+    printf("Testing conversion from %s to %s... ", type_names[from], type_names[to]);
+
+    if (NULL == (original = (unsigned char *)malloc(MAX_ELEMS * from_size)))
+        PROGRAM_ERROR("memory allocation for original failed");
+    if (NULL == (shuffled = (unsigned char *)malloc(MAX_ELEMS * from_size)))
+        PROGRAM_ERROR("memory allocation for shuffled failed");
+    if (NULL == (converted = (unsigned char *)malloc(MAX_ELEMS * to_size)))
+        PROGRAM_ERROR("memory allocation for converted failed");
+    if (NULL == (expected = (unsigned char *)malloc(MAX_ELEMS * max_size)))
+        PROGRAM_ERROR("memory allocation for expected failed");
+
+    if (!supported[from][to]) {
+        if (shuffle_can_convert(file_type, mem_type))
+            PROGRAM_ERROR("shuffle_can_convert() accepted an unsupported pair");
+
+        make_data(from, original, MAX_ELEMS, 1);
+        if (shuffle_unshuffle_convert(file_type, original, MAX_ELEMS * from_size, mem_type, converted) >= 0)
+            PROGRAM_ERROR("shuffle_unshuffle_convert() accepted an unsupported pair");
+    }
+    else {
+        if (!shuffle_can_convert(file_type, mem_type))
+            PROGRAM_ERROR("shuffle_can_convert() refused a supported pair");
+
+        for (i = 0; i < N_ELEM_COUNTS; i++) {
+            size_t n = elem_counts[i];
+
+            make_data(from, original, n, (unsigned)(from * N_TYPES + to + i));
+            reference_shuffle(0, (unsigned)from_size, n * from_size, original, shuffled);
+
+            memcpy(expected, original, n * from_size);
+            if (H5Tconvert(file_type, mem_type, n, expected, NULL, H5P_DEFAULT) < 0)
+                HDF5_ERROR;
+
+            if (shuffle_unshuffle_convert(file_type, shuffled, n * from_size, mem_type, converted) < 0)
+                PROGRAM_ERROR("shuffle_unshuffle_convert() failed");
+            if (0 != memcmp(converted, expected, n * to_size))
+                PROGRAM_ERROR("converted data differs from H5Tconvert()");
+        }
+    }
+
+    free(original);
+    free(shuffled);
+    free(converted);
+    free(expected);
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    free(original);
+    free(shuffled);
+    free(converted);
+    free(expected);
+
+    return -1;
+} /* end test_pair() */
+
+
+/* Types other than the native integers and floats */
+static int
+test_other_types(void)
+{
+    hid_t str_type = H5I_INVALID_HID;
+    unsigned char chunk[64];
+    unsigned char dest[128];
+
+    printf("Testing conversion of non-native types... ");
+
+    memset(chunk, 0, sizeof(chunk));
+
+    if (H5I_INVALID_HID == (str_type = H5Tcopy(H5T_C_S1)))
+        HDF5_ERROR;
+    if (H5Tset_size(str_type, 4) < 0)
+        HDF5_ERROR;
+
+    if (shuffle_can_convert(H5T_STD_I32BE, H5T_NATIVE_DOUBLE))
+        PROGRAM_ERROR("big-endian integers were accepted");
+    if (shuffle_unshuffle_convert(H5T_STD_I32BE, chunk, sizeof(chunk), H5T_NATIVE_DOUBLE, dest) >= 0)
+        PROGRAM_ERROR("big-endian integers were converted");
+    if (shuffle_can_convert(H5T_IEEE_F32BE, H5T_NATIVE_DOUBLE))
+        PROGRAM_ERROR("big-endian floats were accepted");
+    if (shuffle_unshuffle_convert(H5T_IEEE_F32BE, chunk, sizeof(chunk), H5T_NATIVE_DOUBLE, dest) >= 0)
+        PROGRAM_ERROR("big-endian floats were converted");
+    if (shuffle_can_convert(H5T_NATIVE_INT, H5T_STD_I32BE))
+        PROGRAM_ERROR("conversion to big-endian was accepted");
+    if (shuffle_can_convert(str_type, H5T_NATIVE_INT))
+        PROGRAM_ERROR("strings were accepted");
+    if (shuffle_unshuffle_convert(str_type, chunk, sizeof(chunk), H5T_NATIVE_INT, dest) >= 0)
+        PROGRAM_ERROR("strings were converted");
+    if (shuffle_can_convert(H5T_NATIVE_INT, str_type))
+        PROGRAM_ERROR("conversion to strings was accepted");
+
+    if (H5Tclose(str_type) < 0)
+        HDF5_ERROR;
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Tclose(str_type);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end test_other_types() */
+
+
+static int
+test_bad_arguments(void)
+{
+    unsigned char chunk[64];
+    unsigned char dest[128];
+    herr_t ret;
+
+    printf("Testing shuffle_unshuffle_convert() with bad arguments... ");
+
+    memset(chunk, 0, sizeof(chunk));
+
+    if (shuffle_unshuffle_convert(H5T_NATIVE_INT, chunk, 6, H5T_NATIVE_DOUBLE, dest) >= 0)
+        PROGRAM_ERROR("partial element was accepted");
+    if (shuffle_unshuffle_convert(H5T_NATIVE_SHORT, chunk, 7, H5T_NATIVE_SHORT, dest) >= 0)
+        PROGRAM_ERROR("partial element was accepted without conversion");
+    if (shuffle_unshuffle_convert(H5T_NATIVE_INT, NULL, sizeof(chunk), H5T_NATIVE_DOUBLE, dest) >= 0)
+        PROGRAM_ERROR("NULL chunk was accepted");
+    if (shuffle_unshuffle_convert(H5T_NATIVE_INT, chunk, sizeof(chunk), H5T_NATIVE_DOUBLE, NULL) >= 0)
+        PROGRAM_ERROR("NULL dest was accepted");
+    H5E_BEGIN_TRY {
+        ret = shuffle_unshuffle_convert(H5I_INVALID_HID, chunk, sizeof(chunk), H5T_NATIVE_DOUBLE, dest);
+    } H5E_END_TRY;
+    if (ret >= 0)
+        PROGRAM_ERROR("invalid file type was accepted");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    return -1;
+} /* end test_bad_arguments() */
+
+
+int
+main(void)
+{
+    int n_failed = 0;
+    int from;
+    int to;
+
+    native_types[T_SCHAR] = H5T_NATIVE_SCHAR;
+    native_types[T_UCHAR] = H5T_NATIVE_UCHAR;
+    native_types[T_SHORT] = H5T_NATIVE_SHORT;
+    native_types[T_USHORT] = H5T_NATIVE_USHORT;
+    native_types[T_INT] = H5T_NATIVE_INT;
+    native_types[T_UINT] = H5T_NATIVE_UINT;
+    native_types[T_LLONG] = H5T_NATIVE_LLONG;
+    native_types[T_ULLONG] = H5T_NATIVE_ULLONG;
+    native_types[T_FLOAT] = H5T_NATIVE_FLOAT;
+    native_types[T_DOUBLE] = H5T_NATIVE_DOUBLE;
+
+    for (from = 0; from < N_TYPES; from++)
+        for (to = 0; to < N_TYPES; to++)
+            if (test_pair(from, to) < 0)
+                n_failed++;
+    if (test_other_types() < 0)
+        n_failed++;
+    if (test_bad_arguments() < 0)
+        n_failed++;
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%d test(s) FAILED\n", n_failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+} /* end main() */
@@ -0,0 +1,187 @@
+/* shuffle_counters.c
+ *
+ * Hardware performance counters for shuffle_bench.
+ *
+ * Each event gets its own inherited counter rather than a group: the
+ * kernel can't read a group back with inheritance on, and without it the
+ * OpenMP threads wouldn't be counted.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "shuffle_counters.h"
+
+
+const char *const counter_names[N_COUNTERS] = {
+    "cycles",
+    "instructions",
+    "LLC-misses",
+    "dTLB-load-misses",
+    "dTLB-store-misses",
+    "branch-misses"
+};
+
+#ifdef __linux__
+
+#define HW_CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static const struct {
+    unsigned type;
+    unsigned long long config;
+} counter_events[N_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, HW_CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB,
+            PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HW_CACHE, HW_CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB,
+            PERF_COUNT_HW_CACHE_OP_WRITE, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+
+
+int
+counters_open(counters_t *counters)
+{
+    int n_open = 0;
+    int i;
+
+    memset(counters, 0, sizeof(counters_t));
+
+    for (i = 0; i < N_COUNTERS; i++) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_events[i].type;
+        attr.config = counter_events[i].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        /* This process and its future threads, on any CPU */
+        counters->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (counters->fd[i] >= 0)
+            n_open++;
+    }
+
+    return n_open;
+} /* end counters_open() */
+
+
+void
+counters_close(counters_t *counters)
+{
+    int i;
+
+    for (i = 0; i < N_COUNTERS; i++)
+        if (counters->fd[i] >= 0) {
+            close(counters->fd[i]);
+            counters->fd[i] = -1;
+        }
+} /* end counters_close() */
+
+
+void
+counters_begin(counters_t *counters)
+{
+    int i;
+
+    for (i = 0; i < N_COUNTERS; i++)
+        if (counters->fd[i] >= 0
+                && sizeof(counters->start[i]) != read(counters->fd[i], counters->start[i], sizeof(counters->start[i])))
+            memset(counters->start[i], 0, sizeof(counters->start[i]));
+
+    /* Enabling also enables the inherited counters in the other threads */
+    for (i = 0; i < N_COUNTERS; i++)
+        if (counters->fd[i] >= 0)
+            ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+} /* end counters_begin() */
+
+
+void
+counters_end(counters_t *counters, counter_values_t *values)
+{
+    int i;
+
+    for (i = 0; i < N_COUNTERS; i++)
+        if (counters->fd[i] >= 0)
+            ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (i = 0; i < N_COUNTERS; i++) {
+        unsigned long long end[3];
+        double value, enabled, running;
+
+        if (counters->fd[i] < 0 || sizeof(end) != read(counters->fd[i], end, sizeof(end)))
+            continue;
+
+        value = (double)(end[0] - counters->start[i][0]);
+        enabled = (double)(end[1] - counters->start[i][1]);
+        running = (double)(end[2] - counters->start[i][2]);
+
+        /* Never got on the PMU, so there's nothing to scale */
+        if (running <= 0.0)
+            continue;
+
+        values->value[i] += value * enabled / running;
+        values->valid[i] = 1;
+    }
+} /* end counters_end() */
+
+#else /* __linux__ */
+
+int
+counters_open(counters_t *counters)
+{
+    int i;
+
+    for (i = 0; i < N_COUNTERS; i++)
+        counters->fd[i] = -1;
+
+    return 0;
+} /* end counters_open() */
+
+void counters_close(counters_t *counters) { (void)counters; }
+void counters_begin(counters_t *counters) { (void)counters; }
+void counters_end(counters_t *counters, counter_values_t *values) { (void)counters; (void)values; }
+
+#endif /* __linux__ */
@@ -0,0 +1,78 @@
+/* shuffle_counters.h
+ *
+ * Hardware performance counters for shuffle_bench (Linux perf_event_open).
+ * Not part of the plugins.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SHUFFLE_COUNTERS_H
+#define _SHUFFLE_COUNTERS_H
+
+/* The counted events, in the order of the arrays below */
+enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_LLC_MISSES,
+    COUNTER_DTLB_LOAD_MISSES,
+    COUNTER_DTLB_STORE_MISSES,
+    COUNTER_BRANCH_MISSES,
+    N_COUNTERS
+};
+
+/* Short names for reports, indexed as above */
+extern const char *const counter_names[N_COUNTERS];
+
+typedef struct counters_t {
+    int fd[N_COUNTERS];                 /* -1 if the event isn't available */
+    unsigned long long start[N_COUNTERS][3];    /* value, enabled, running */
+} counters_t;
+
+/* Totals over any number of counted regions */
+typedef struct counter_values_t {
+    double value[N_COUNTERS];
+    int valid[N_COUNTERS];
+} counter_values_t;
+
+/* Opens the counters for this process, disabled. Call it before the first
+ * OpenMP parallel region: only threads created afterwards are counted, and
+ * their counts are summed into ours. Returns the number of events that
+ * could be opened (0 if perf is unavailable or not permitted).
+ */
+int counters_open(counters_t *counters);
+void counters_close(counters_t *counters);
+
+/* Counts the code between begin and end, adding it to values. Counts are
+ * scaled up if the kernel had to multiplex the events.
+ */
+void counters_begin(counters_t *counters);
+void counters_end(counters_t *counters, counter_values_t *values);
+
+#endif /* _SHUFFLE_COUNTERS_H */
@@ -0,0 +1,143 @@
+/* shuffle_dispatch.c
+ *
+ * Picks the kernel behind a shuffle plugin at load time.
+ *
+ * Each plugin names its own kernel (shuffle_plugin_kernel) and uses it by
+ * default, so the four filter IDs keep behaving the way they always have.
+ * The SHUFFLE_KERNEL environment variable overrides that:
+ *
+ *  auto        The fastest single-threaded SIMD kernel this CPU can run
+ *  scalar      The simple loops
+ *  <name>      Any kernel by name: duff, noduff, duff_omp, noduff_omp,
+ *              sse, avx2, avx512, threaded
+ *
+ * A kernel the CPU can't run, or a name we don't know, leaves the plugin's
+ * own kernel in place. shuffle_get_kernel_info() says what was picked and
+ * why.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_private.h"
+
+
+/* Local prototypes */
+static void select_kernel(void);
+
+/* The kernel all [un]shuffling goes through, and why */
+static const shuffle_kernel_t *active_kernel = NULL;
+static char active_reason[128];
+static pthread_once_t active_once = PTHREAD_ONCE_INIT;
+
+
+void
+shuffle_select_kernel(void)
+{
+    pthread_once(&active_once, select_kernel);
+} /* end shuffle_select_kernel() */
+
+
+const shuffle_kernel_t *
+shuffle_active_kernel(void)
+{
+    /* Normally already done by H5PLget_plugin_info(), but the exported API
+     * can be called without HDF5 ever loading the plugin.
+     */
+    pthread_once(&active_once, select_kernel);
+
+    return active_kernel;
+} /* end shuffle_active_kernel() */
+
+
+void
+shuffle_get_kernel_info(const char **name, const char **reason)
+{
+    const shuffle_kernel_t *kernel = shuffle_active_kernel();
+
+    if (name)
+        *name = kernel->name;
+    if (reason)
+        *reason = active_reason;
+} /* end shuffle_get_kernel_info() */
+
+
+herr_t
+shuffle_set_thread_budget(int n_threads)
+{
+    if (n_threads < 0)
+        return -1;
+
+    shuffle_kernel_set_thread_budget(n_threads);
+
+    return 0;
+} /* end shuffle_set_thread_budget() */
+
+
+static void
+select_kernel(void)
+{
+    const char *env = getenv("SHUFFLE_KERNEL");
+    const shuffle_kernel_t *kernel = NULL;
+
+    active_kernel = shuffle_plugin_kernel;
+
+    if (NULL == env || '\0' == *env) {
+        snprintf(active_reason, sizeof(active_reason), "plugin default");
+        return;
+    }
+
+    if (0 == strcasecmp(env, "auto"))
+        kernel = shuffle_kernel_best_simd();
+    else if (0 == strcasecmp(env, "scalar"))
+        kernel = &shuffle_kernel_noduff;
+    else
+        kernel = shuffle_kernel_find(env);
+
+    if (NULL == kernel)
+        snprintf(active_reason, sizeof(active_reason),
+                "SHUFFLE_KERNEL=%s is not a kernel, using plugin default", env);
+    else if (!shuffle_kernel_supported(kernel))
+        snprintf(active_reason, sizeof(active_reason),
+                "SHUFFLE_KERNEL=%s is not supported by this CPU, using plugin default", env);
+    else {
+        active_kernel = kernel;
+        snprintf(active_reason, sizeof(active_reason), "SHUFFLE_KERNEL=%s", env);
+    }
+} /* end select_kernel() */
@@ -0,0 +1,225 @@
+/* shuffle_into_test.c
+ *
+ * Tests shuffle_into(). Buffers of assorted element and chunk sizes are
+ * shuffled and unshuffled into caller-supplied destinations and checked
+ * against the reference shuffle, without writing past nbytes, and
+ * overlapping buffers and other bad arguments have to be rejected.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_reference.h"
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+static const unsigned elem_sizes[] = {1, 2, 3, 4, 8, 16};
+static const size_t chunk_sizes[] = {0, 1, 7, 64, 4099, 65536, 1024 * 1024 + 5};
+
+#define N_ELEM_SIZES            (sizeof(elem_sizes) / sizeof(elem_sizes[0]))
+#define N_CHUNK_SIZES           (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))
+#define MAX_CHUNK_SIZE          (1024 * 1024 + 5)
+
+/* Written past the end of dest, to catch overruns */
+#define GUARD_SIZE              64
+#define GUARD_BYTE              0xA5
+
+
+static int
+guard_intact(const unsigned char *p)
+{
+    int i;
+
+    for (i = 0; i < GUARD_SIZE; i++)
+        if (GUARD_BYTE != p[i])
+            return 0;
+
+    return 1;
+} /* end guard_intact() */
+
+
+/* Shuffles into one reused staging buffer, checks it, then unshuffles into
+ * another
+ */
+static int
+test_round_trip(unsigned bytes_per_elem)
+{
+    unsigned char *original = NULL;
+    unsigned char *shuffled = NULL;
+    unsigned char *unshuffled = NULL;
+    unsigned char *expected = NULL;
+    size_t i;
+
+    printf("Testing shuffle_into() with %u byte elements... ", bytes_per_elem);
+
+    if (NULL == (original = (unsigned char *)malloc(MAX_CHUNK_SIZE)))
+        PROGRAM_ERROR("memory allocation for original failed");
+    if (NULL == (shuffled = (unsigned char *)malloc(MAX_CHUNK_SIZE + GUARD_SIZE)))
+        PROGRAM_ERROR("memory allocation for shuffled failed");
+    if (NULL == (unshuffled = (unsigned char *)malloc(MAX_CHUNK_SIZE + GUARD_SIZE)))
+        PROGRAM_ERROR("memory allocation for unshuffled failed");
+    if (NULL == (expected = (unsigned char *)malloc(MAX_CHUNK_SIZE)))
+        PROGRAM_ERROR("memory allocation for expected failed");
+
+    for (i = 0; i < N_CHUNK_SIZES; i++) {
+        size_t nbytes = chunk_sizes[i];
+
+        reference_fill(original, nbytes, (unsigned)(bytes_per_elem * N_CHUNK_SIZES + i));
+        memset(shuffled + nbytes, GUARD_BYTE, GUARD_SIZE);
+        memset(unshuffled + nbytes, GUARD_BYTE, GUARD_SIZE);
+
+        if (shuffle_into(0, bytes_per_elem, nbytes, original, shuffled) < 0)
+            PROGRAM_ERROR("shuffle_into() failed to shuffle");
+        reference_shuffle(0, bytes_per_elem, nbytes, original, expected);
+        if (0 != memcmp(shuffled, expected, nbytes))
+            PROGRAM_ERROR("shuffled buffer differs from the reference");
+        if (!guard_intact(shuffled + nbytes))
+            PROGRAM_ERROR("shuffle_into() wrote past nbytes");
+
+        if (shuffle_into(H5Z_FLAG_REVERSE, bytes_per_elem, nbytes, shuffled, unshuffled) < 0)
+            PROGRAM_ERROR("shuffle_into() failed to unshuffle");
+        if (0 != memcmp(unshuffled, original, nbytes))
+            PROGRAM_ERROR("unshuffled buffer differs from the original");
+        if (!guard_intact(unshuffled + nbytes))
+            PROGRAM_ERROR("shuffle_into() wrote past nbytes");
+    }
+
+    free(original);
+    free(shuffled);
+    free(unshuffled);
+    free(expected);
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    free(original);
+    free(shuffled);
+    free(unshuffled);
+    free(expected);
+
+    return -1;
+} /* end test_round_trip() */
+
+
+static int
+test_overlap(void)
+{
+    unsigned char buf[1024];
+    unsigned char expected[256];
+
+    printf("Testing shuffle_into() with overlapping buffers... ");
+
+    reference_fill(buf, sizeof(buf), 1);
+
+    /* In place, and every partial overlap */
+    if (shuffle_into(0, 4, 256, buf, buf) >= 0)
+        PROGRAM_ERROR("src == dest was accepted");
+    if (shuffle_into(0, 4, 256, buf, buf + 4) >= 0)
+        PROGRAM_ERROR("dest starting inside src was accepted");
+    if (shuffle_into(0, 4, 256, buf + 4, buf) >= 0)
+        PROGRAM_ERROR("src starting inside dest was accepted");
+    if (shuffle_into(0, 4, 256, buf, buf + 255) >= 0)
+        PROGRAM_ERROR("one byte of overlap was accepted");
+    if (shuffle_into(H5Z_FLAG_REVERSE, 4, 256, buf + 255, buf) >= 0)
+        PROGRAM_ERROR("one byte of overlap was accepted on unshuffle");
+
+    /* Back to back in one allocation is fine */
+    if (shuffle_into(0, 4, 256, buf, buf + 256) < 0)
+        PROGRAM_ERROR("adjacent buffers were rejected");
+    reference_shuffle(0, 4, 256, buf, expected);
+    if (0 != memcmp(buf + 256, expected, 256))
+        PROGRAM_ERROR("shuffled buffer differs from the reference");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    return -1;
+} /* end test_overlap() */
+
+
+static int
+test_bad_arguments(void)
+{
+    unsigned char src[64];
+    unsigned char dest[64];
+
+    printf("Testing shuffle_into() with bad arguments... ");
+
+    memset(src, 0, sizeof(src));
+
+    if (shuffle_into(0, 0, sizeof(src), src, dest) >= 0)
+        PROGRAM_ERROR("zero element size was accepted");
+    if (shuffle_into(0, 4, sizeof(src), NULL, dest) >= 0)
+        PROGRAM_ERROR("NULL src was accepted");
+    if (shuffle_into(0, 4, sizeof(src), src, NULL) >= 0)
+        PROGRAM_ERROR("NULL dest was accepted");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    return -1;
+} /* end test_bad_arguments() */
+
+
+int
+main(void)
+{
+    int n_failed = 0;
+    size_t i;
+
+    for (i = 0; i < N_ELEM_SIZES; i++)
+        if (test_round_trip(elem_sizes[i]) < 0)
+            n_failed++;
+    if (test_overlap() < 0)
+        n_failed++;
+    if (test_bad_arguments() < 0)
+        n_failed++;
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%d test(s) FAILED\n", n_failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+} /* end main() */
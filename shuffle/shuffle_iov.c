@@ -0,0 +1,153 @@
+/* shuffle_iov.c
+ *
+ * Scatter/gather [un]shuffle: shuffle_iov().
+ *
+ * Each region's whole elements go straight through the active kernel, which
+ * writes them to (or reads them from) their place in every byte plane of
+ * the chunk, since the kernels take the plane stride separately from the
+ * element count. The only bytes handled one at a time are elements split
+ * across two regions and the chunk's leftover bytes.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_private.h"
+
+
+/* Local prototypes */
+static int overlaps(const void *a, size_t a_len, const void *b, size_t b_len);
+
+
+herr_t
+shuffle_iov(unsigned int flags, unsigned bytes_per_elem,
+        const shuffle_iovec_t iov[], size_t iov_count, void *chunk)
+{
+    const shuffle_kernel_t *kernel = shuffle_active_kernel();
+    int reverse = (flags & H5Z_FLAG_REVERSE) ? 1 : 0;
+    unsigned char *planes = (unsigned char *)chunk;
+    size_t total = 0;
+    size_t n_elements;
+    size_t pos = 0;                 /* Byte offset in the concatenated regions */
+    size_t i;
+
+    /* Check arguments */
+    if (0 == bytes_per_elem || NULL == chunk)
+        goto error;
+    if (iov_count > 0 && NULL == iov)
+        goto error;
+    for (i = 0; i < iov_count; i++) {
+        if (iov[i].len > 0 && NULL == iov[i].base)
+            goto error;
+        total += iov[i].len;
+    }
+    for (i = 0; i < iov_count; i++)
+        if (overlaps(iov[i].base, iov[i].len, chunk, total))
+            goto error;
+
+    n_elements = total / bytes_per_elem;
+
+    for (i = 0; i < iov_count; i++) {
+        unsigned char *p = (unsigned char *)iov[i].base;
+        size_t len = iov[i].len;
+
+        while (len > 0) {
+            size_t elem = pos / bytes_per_elem;
+            size_t offset = pos % bytes_per_elem;
+            size_t n;
+
+            if (elem >= n_elements) {
+                /* Leftover bytes sit unshuffled at the end of the chunk */
+                if (reverse)
+                    memcpy(p, planes + pos, len);
+                else
+                    memcpy(planes + pos, p, len);
+                pos += len;
+                break;
+            }
+
+            if (0 == offset && len >= bytes_per_elem) {
+                /* As many whole elements as this region holds */
+                n = len / bytes_per_elem;
+                if (n > n_elements - elem)
+                    n = n_elements - elem;
+
+                if (reverse)
+                    kernel->decode(bytes_per_elem, n, n_elements, planes + elem, p);
+                else
+                    kernel->encode(bytes_per_elem, n, n_elements, p, planes + elem);
+
+                n *= bytes_per_elem;
+            }
+            else {
+                /* Part of an element that continues in the next region */
+                size_t j;
+
+                n = bytes_per_elem - offset;
+                if (n > len)
+                    n = len;
+
+                if (reverse)
+                    for (j = 0; j < n; j++)
+                        p[j] = planes[(offset + j) * n_elements + elem];
+                else
+                    for (j = 0; j < n; j++)
+                        planes[(offset + j) * n_elements + elem] = p[j];
+            }
+
+            p += n;
+            len -= n;
+            pos += n;
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_iov() */
+
+
+static int
+overlaps(const void *a, size_t a_len, const void *b, size_t b_len)
+{
+    const unsigned char *pa = (const unsigned char *)a;
+    const unsigned char *pb = (const unsigned char *)b;
+
+    if (0 == a_len || 0 == b_len)
+        return 0;
+
+    return pa < pb + b_len && pb < pa + a_len;
+} /* end overlaps() */
@@ -0,0 +1,275 @@
+/* shuffle_iov_test.c
+ *
+ * Tests shuffle_iov(). Data is split over separate regions whose lengths are
+ * not multiples of the element size, so elements straddle region boundaries.
+ * Gathering the regions into a shuffled chunk has to match the reference
+ * shuffle of their concatenation, and scattering it back has to restore
+ * every region without touching the gaps between them. Regions that overlap
+ * the chunk and other bad arguments have to be rejected.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_reference.h"
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+static const unsigned elem_sizes[] = {1, 2, 3, 4, 8, 16};
+
+#define N_ELEM_SIZES            (sizeof(elem_sizes) / sizeof(elem_sizes[0]))
+
+/* Region layouts. Each one's lengths are repeated until it has n_regions
+ * regions.
+ */
+typedef struct layout_t {
+    const char *name;
+    size_t n_regions;
+    size_t lengths[4];
+    size_t n_lengths;
+} layout_t;
+
+static const layout_t layouts[] = {
+    {"no regions",              0,      {0},                    1},
+    {"one region",              1,      {4099},                 1},
+    {"one byte regions",        301,    {1},                    1},
+    {"empty regions",           40,     {0, 3, 0, 5},           4},
+    {"odd length regions",      97,     {7, 64, 1, 13},         4},
+    {"large regions",           3,      {65536 + 3, 4099, 1},   3}
+};
+
+#define N_LAYOUTS               (sizeof(layouts) / sizeof(layouts[0]))
+#define MAX_REGIONS             301
+
+/* Bytes between regions, which must never be written */
+#define GAP_SIZE                5
+#define GAP_BYTE                0xA5
+
+
+/* Lays the regions out one after another in image, with a gap before each,
+ * and returns their total length
+ */
+static size_t
+make_regions(const layout_t *layout, unsigned char *image, shuffle_iovec_t *iov)
+{
+    size_t offset = 0;
+    size_t total = 0;
+    size_t i;
+
+    for (i = 0; i < layout->n_regions; i++) {
+        offset += GAP_SIZE;
+        iov[i].base = image + offset;
+        iov[i].len = layout->lengths[i % layout->n_lengths];
+        offset += iov[i].len;
+        total += iov[i].len;
+    }
+
+    return total;
+} /* end make_regions() */
+
+
+static size_t
+image_size(const layout_t *layout)
+{
+    size_t size = GAP_SIZE;
+    size_t i;
+
+    for (i = 0; i < layout->n_regions; i++)
+        size += GAP_SIZE + layout->lengths[i % layout->n_lengths];
+
+    return size;
+} /* end image_size() */
+
+
+static int
+gaps_intact(const layout_t *layout, const unsigned char *image, const shuffle_iovec_t *iov)
+{
+    const unsigned char *gap = image;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i <= layout->n_regions; i++) {
+        for (j = 0; j < GAP_SIZE; j++)
+            if (GAP_BYTE != gap[j])
+                return 0;
+        if (i < layout->n_regions)
+            gap = (const unsigned char *)iov[i].base + iov[i].len;
+    }
+
+    return 1;
+} /* end gaps_intact() */
+
+
+static int
+test_round_trip(unsigned bytes_per_elem, const layout_t *layout)
+{
+    shuffle_iovec_t iov[MAX_REGIONS];
+    unsigned char *image = NULL;
+    unsigned char *concat = NULL;
+    unsigned char *chunk = NULL;
+    unsigned char *expected = NULL;
+    size_t size = image_size(layout);
+    size_t total;
+    size_t pos;
+    size_t i;
+
+    printf("Testing shuffle_iov() with %u byte elements and %s... ", bytes_per_elem, layout->name);
+
+    if (NULL == (image = (unsigned char *)malloc(size)))
+        PROGRAM_ERROR("memory allocation for image failed");
+    memset(image, GAP_BYTE, size);
+    total = make_regions(layout, image, iov);
+
+    /* The extra byte keeps malloc(0) out of it */
+    if (NULL == (concat = (unsigned char *)malloc(total + 1)))
+        PROGRAM_ERROR("memory allocation for concat failed");
+    if (NULL == (chunk = (unsigned char *)malloc(total + 1)))
+        PROGRAM_ERROR("memory allocation for chunk failed");
+    if (NULL == (expected = (unsigned char *)malloc(total + 1)))
+        PROGRAM_ERROR("memory allocation for expected failed");
+
+    /* Fill the regions and keep a copy of their concatenation */
+    reference_fill(concat, total, (unsigned)(bytes_per_elem * N_LAYOUTS + layout->n_regions));
+    for (i = 0, pos = 0; i < layout->n_regions; pos += iov[i].len, i++)
+        memcpy(iov[i].base, concat + pos, iov[i].len);
+
+    if (shuffle_iov(0, bytes_per_elem, iov, layout->n_regions, chunk) < 0)
+        PROGRAM_ERROR("shuffle_iov() failed to shuffle");
+    reference_shuffle(0, bytes_per_elem, total, concat, expected);
+    if (0 != memcmp(chunk, expected, total))
+        PROGRAM_ERROR("shuffled chunk differs from the reference");
+
+    /* Scatter it back over cleared regions */
+    for (i = 0; i < layout->n_regions; i++)
+        memset(iov[i].base, 0, iov[i].len);
+    if (shuffle_iov(H5Z_FLAG_REVERSE, bytes_per_elem, iov, layout->n_regions, chunk) < 0)
+        PROGRAM_ERROR("shuffle_iov() failed to unshuffle");
+    for (i = 0, pos = 0; i < layout->n_regions; pos += iov[i].len, i++)
+        if (0 != memcmp(iov[i].base, concat + pos, iov[i].len))
+            PROGRAM_ERROR("unshuffled region differs from the original");
+    if (!gaps_intact(layout, image, iov))
+        PROGRAM_ERROR("shuffle_iov() wrote between the regions");
+
+    free(image);
+    free(concat);
+    free(chunk);
+    free(expected);
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    free(image);
+    free(concat);
+    free(chunk);
+    free(expected);
+
+    return -1;
+} /* end test_round_trip() */
+
+
+static int
+test_bad_arguments(void)
+{
+    unsigned char buf[256];
+    unsigned char chunk[128];
+    shuffle_iovec_t iov[2];
+
+    printf("Testing shuffle_iov() with bad arguments... ");
+
+    memset(buf, 0, sizeof(buf));
+    iov[0].base = buf;
+    iov[0].len = 64;
+    iov[1].base = buf + 100;
+    iov[1].len = 64;
+
+    if (shuffle_iov(0, 0, iov, 2, chunk) >= 0)
+        PROGRAM_ERROR("zero element size was accepted");
+    if (shuffle_iov(0, 4, iov, 2, NULL) >= 0)
+        PROGRAM_ERROR("NULL chunk was accepted");
+    if (shuffle_iov(0, 4, NULL, 2, chunk) >= 0)
+        PROGRAM_ERROR("NULL iov with regions was accepted");
+
+    iov[1].base = NULL;
+    if (shuffle_iov(0, 4, iov, 2, chunk) >= 0)
+        PROGRAM_ERROR("NULL region base was accepted");
+    iov[1].len = 0;
+    if (shuffle_iov(0, 4, iov, 2, chunk) < 0)
+        PROGRAM_ERROR("NULL base of an empty region was rejected");
+
+    /* The chunk must not overlap any region */
+    iov[1].base = buf + 100;
+    iov[1].len = 64;
+    if (shuffle_iov(0, 4, iov, 2, buf + 150) >= 0)
+        PROGRAM_ERROR("chunk overlapping a region was accepted");
+    if (shuffle_iov(H5Z_FLAG_REVERSE, 4, iov, 2, buf + 36) >= 0)
+        PROGRAM_ERROR("chunk overlapping a region was accepted on unshuffle");
+    if (shuffle_iov(0, 4, iov, 1, buf + 64) < 0)
+        PROGRAM_ERROR("chunk right after a region was rejected");
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    return -1;
+} /* end test_bad_arguments() */
+
+
+int
+main(void)
+{
+    int n_failed = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < N_ELEM_SIZES; i++)
+        for (j = 0; j < N_LAYOUTS; j++)
+            if (test_round_trip(elem_sizes[i], &layouts[j]) < 0)
+                n_failed++;
+    if (test_bad_arguments() < 0)
+        n_failed++;
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%d test(s) FAILED\n", n_failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+} /* end main() */
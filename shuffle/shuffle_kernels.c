@@ -0,0 +1,546 @@
+/* shuffle_kernels.c
+ *
+ * The [un]shuffle kernels behind all of the shuffle filter plugins.
+ *
+ * The plugins used to carry their own copies of the filter scaffolding and
+ * differed only in the inner loop, which now lives here behind
+ * shuffle_kernel_t.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle_kernels.h"
+
+
+/* Chunks smaller than this are [un]shuffled by one thread in the OpenMP
+ * kernels, since starting the team would cost more than splitting the work
+ * saves. shuffle_bench -S measures the crossover on a given machine; build
+ * with it (SHUFFLE_OMP_MIN_BYTES in CMake) or set it at run time with the
+ * SHUFFLE_OMP_MIN_BYTES environment variable (e.g., "256K").
+ */
+#ifndef SHUFFLE_OMP_MIN_BYTES_DEFAULT
+#define SHUFFLE_OMP_MIN_BYTES_DEFAULT   (128 * 1024)
+#endif
+
+
+/* Kernel prototypes */
+static void encode_duff(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void decode_duff(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void encode_noduff(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void decode_noduff(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void encode_duff_omp(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void decode_duff_omp(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void encode_noduff_omp(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void decode_noduff_omp(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void encode_parallel(shuffle_kernel_func_t encode, unsigned bytes_per_elem,
+        size_t n_elements, size_t plane_stride, const unsigned char *src,
+        unsigned char *dest);
+static void decode_parallel(shuffle_kernel_func_t decode, unsigned bytes_per_elem,
+        size_t n_elements, size_t plane_stride, const unsigned char *src,
+        unsigned char *dest);
+static void encode_threaded(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void decode_threaded(unsigned bytes_per_elem, size_t n_elements,
+        size_t plane_stride, const unsigned char *src, unsigned char *dest);
+static void init_omp_min_bytes(void);
+static void init_thread_budget(void);
+
+/* Serial cutoff for the OpenMP kernels, see above */
+static size_t omp_min_bytes = SHUFFLE_OMP_MIN_BYTES_DEFAULT;
+static pthread_once_t omp_min_bytes_once = PTHREAD_ONCE_INIT;
+
+/* Process-wide cap on the threads in our teams, and how many they hold */
+static atomic_int thread_budget = 0;
+static pthread_once_t thread_budget_once = PTHREAD_ONCE_INIT;
+static atomic_int threads_in_use = 0;
+
+
+/* The kernels */
+const shuffle_kernel_t shuffle_kernel_duff = {
+    "duff", encode_duff, decode_duff, NULL, 0
+};
+const shuffle_kernel_t shuffle_kernel_noduff = {
+    "noduff", encode_noduff, decode_noduff, NULL, 0
+};
+const shuffle_kernel_t shuffle_kernel_duff_omp = {
+    "duff_omp", encode_duff_omp, decode_duff_omp, NULL, 1
+};
+const shuffle_kernel_t shuffle_kernel_noduff_omp = {
+    "noduff_omp", encode_noduff_omp, decode_noduff_omp, NULL, 1
+};
+const shuffle_kernel_t shuffle_kernel_threaded = {
+    "threaded", encode_threaded, decode_threaded, NULL, 1
+};
+
+/* The SIMD kernels are in shuffle_kernels_x86.c */
+const shuffle_kernel_t *const shuffle_kernel_list[] = {
+    &shuffle_kernel_duff,
+    &shuffle_kernel_noduff,
+    &shuffle_kernel_duff_omp,
+    &shuffle_kernel_noduff_omp,
+    &shuffle_kernel_sse,
+    &shuffle_kernel_avx2,
+    &shuffle_kernel_avx512,
+    &shuffle_kernel_threaded,
+    NULL
+};
+
+
+const shuffle_kernel_t *
+shuffle_kernel_find(const char *name)
+{
+    int i;
+
+    for (i = 0; shuffle_kernel_list[i]; i++)
+        if (0 == strcmp(shuffle_kernel_list[i]->name, name))
+            return shuffle_kernel_list[i];
+
+    return NULL;
+} /* end shuffle_kernel_find() */
+
+
+int
+shuffle_kernel_supported(const shuffle_kernel_t *kernel)
+{
+    return NULL == kernel->supported || kernel->supported();
+} /* end shuffle_kernel_supported() */
+
+
+const shuffle_kernel_t *
+shuffle_kernel_best_simd(void)
+{
+    if (shuffle_kernel_supported(&shuffle_kernel_avx512))
+        return &shuffle_kernel_avx512;
+    if (shuffle_kernel_supported(&shuffle_kernel_avx2))
+        return &shuffle_kernel_avx2;
+    if (shuffle_kernel_supported(&shuffle_kernel_sse))
+        return &shuffle_kernel_sse;
+
+    return &shuffle_kernel_noduff;
+} /* end shuffle_kernel_best_simd() */
+
+
+size_t
+shuffle_kernel_omp_min_bytes(void)
+{
+    pthread_once(&omp_min_bytes_once, init_omp_min_bytes);
+
+    return omp_min_bytes;
+} /* end shuffle_kernel_omp_min_bytes() */
+
+
+void
+shuffle_kernel_set_omp_min_bytes(size_t nbytes)
+{
+    /* Make sure a later first use doesn't clobber this with the environment */
+    pthread_once(&omp_min_bytes_once, init_omp_min_bytes);
+
+    omp_min_bytes = nbytes;
+} /* end shuffle_kernel_set_omp_min_bytes() */
+
+
+/* Reads SHUFFLE_OMP_MIN_BYTES (e.g., "256K") */
+static void
+init_omp_min_bytes(void)
+{
+    const char *env = getenv("SHUFFLE_OMP_MIN_BYTES");
+    char *end = NULL;
+    unsigned long long limit;
+
+    if (NULL == env)
+        return;
+
+    limit = strtoull(env, &end, 10);
+    if (end == env)
+        return;
+    switch (toupper((unsigned char)*end)) {
+        case 'G':
+            limit *= 1024;
+            /* FALLTHROUGH */
+        case 'M':
+            limit *= 1024;
+            /* FALLTHROUGH */
+        case 'K':
+            limit *= 1024;
+            break;
+        default:
+            break;
+    }
+
+    omp_min_bytes = (size_t)limit;
+} /* end init_omp_min_bytes() */
+
+
+int
+shuffle_kernel_thread_budget(void)
+{
+    pthread_once(&thread_budget_once, init_thread_budget);
+
+    return atomic_load(&thread_budget);
+} /* end shuffle_kernel_thread_budget() */
+
+
+void
+shuffle_kernel_set_thread_budget(int n_threads)
+{
+    pthread_once(&thread_budget_once, init_thread_budget);
+
+    /* Read by every team on every thread, so set atomically */
+    atomic_store(&thread_budget, n_threads < 0 ? 0 : n_threads);
+} /* end shuffle_kernel_set_thread_budget() */
+
+
+/* Reads SHUFFLE_THREAD_BUDGET, defaulting to the number of processors */
+static void
+init_thread_budget(void)
+{
+    const char *env = getenv("SHUFFLE_THREAD_BUDGET");
+    char *end = NULL;
+    long n;
+
+    atomic_store(&thread_budget, omp_get_num_procs());
+
+    if (NULL == env)
+        return;
+
+    n = strtol(env, &end, 10);
+    if (end == env || n < 0)
+        return;
+
+    atomic_store(&thread_budget, (int)n);
+} /* end init_thread_budget() */
+
+
+int
+shuffle_kernel_team_begin(size_t nbytes)
+{
+    int budget = shuffle_kernel_thread_budget();
+    int want, grant, in_use;
+
+    /* Too small to pay for a team, or already running on one. An inner
+     * team would only multiply the threads the caller's team started.
+     */
+    if (nbytes < shuffle_kernel_omp_min_bytes() || omp_in_parallel())
+        return 1;
+    if ((want = omp_get_max_threads()) < 2)
+        return 1;
+
+    /* Take what's left of the budget, up to a full team. The calling thread
+     * is part of its team, so a team of one isn't worth reserving.
+     */
+    in_use = atomic_load(&threads_in_use);
+    do {
+        grant = want;
+        if (budget > 0 && budget - in_use < grant)
+            grant = budget - in_use;
+        if (grant < 2)
+            return 1;
+    } while (!atomic_compare_exchange_weak(&threads_in_use, &in_use, in_use + grant));
+
+    return grant;
+} /* end shuffle_kernel_team_begin() */
+
+
+void
+shuffle_kernel_team_end(int team)
+{
+    if (team > 1)
+        atomic_fetch_sub(&threads_in_use, team);
+} /* end shuffle_kernel_team_end() */
+
+
+void
+shuffle_kernel_run(const shuffle_kernel_t *kernel, unsigned int flags,
+        unsigned bytes_per_elem, size_t nbytes, const unsigned char *src,
+        unsigned char *dest)
+{
+    size_t n_elements;              /* Number of elements in buffer */
+    size_t leftover;                /* Extra bytes at end of buffer */
+
+    /* Compute the number of elements in buffer */
+    n_elements = nbytes / bytes_per_elem;
+
+    /* Compute the leftover bytes if there are any */
+    leftover = nbytes % bytes_per_elem;
+
+    if (flags & H5Z_FLAG_REVERSE)
+        kernel->decode(bytes_per_elem, n_elements, n_elements, src, dest);
+    else
+        kernel->encode(bytes_per_elem, n_elements, n_elements, src, dest);
+
+    /* The leftover bytes sit at the end of the data in both layouts */
+    if (leftover > 0)
+        memcpy(dest + (nbytes - leftover), src + (nbytes - leftover), leftover);
+} /* end shuffle_kernel_run() */
+
+
+/*****************/
+/* DUFF'S DEVICE */
+/*****************/
+
+/* Runs DUFF_GUTS n_elements times */
+#define DUFF_LOOP(n_elements)                                           \
+    do {                                                                \
+        size_t duffs_index = ((n_elements) + 7) / 8;                    \
+                                                                        \
+        switch ((n_elements) % 8) {                                     \
+        default:                                                        \
+            assert(0 && "This Should never be executed!");              \
+            break;                                                      \
+        case 0:                                                         \
+            do {                                                        \
+                DUFF_GUTS                                               \
+        case 7:                                                         \
+                DUFF_GUTS                                               \
+        case 6:                                                         \
+                DUFF_GUTS                                               \
+        case 5:                                                         \
+                DUFF_GUTS                                               \
+        case 4:                                                         \
+                DUFF_GUTS                                               \
+        case 3:                                                         \
+                DUFF_GUTS                                               \
+        case 2:                                                         \
+                DUFF_GUTS                                               \
+        case 1:                                                         \
+                DUFF_GUTS                                               \
+            } while (--duffs_index > 0);                                \
+        } /* end switch */                                              \
+    } while (0)
+
+static void
+encode_duff(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    const unsigned char *_src;      /* Alias for source buffer */
+    unsigned char *_dest;           /* Alias for destination buffer */
+    unsigned i;
+
+    if (0 == n_elements)
+        return;
+
+/* Define the Duff's device guts for shuffling */
+#define DUFF_GUTS               \
+    *_dest++ = *_src;           \
+    _src += bytes_per_elem;
+
+    for (i = 0; i < bytes_per_elem; i++) {
+        _src = src + i;
+        _dest = dest + i * plane_stride;
+
+        DUFF_LOOP(n_elements);
+    } /* end for */
+
+#undef DUFF_GUTS
+} /* end encode_duff() */
+
+static void
+decode_duff(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    const unsigned char *_src;      /* Alias for source buffer */
+    unsigned char *_dest;           /* Alias for destination buffer */
+    unsigned i;
+
+    if (0 == n_elements)
+        return;
+
+/* Define the Duff's device guts for unshuffling */
+#define DUFF_GUTS                   \
+    *_dest = *_src++;               \
+    _dest += bytes_per_elem;
+
+    for (i = 0; i < bytes_per_elem; i++) {
+        _src = src + i * plane_stride;
+        _dest = dest + i;
+
+        DUFF_LOOP(n_elements);
+    } /* end for */
+
+#undef DUFF_GUTS
+} /* end decode_duff() */
+
+#undef DUFF_LOOP
+
+
+/****************/
+/* SIMPLE LOOPS */
+/****************/
+
+static void
+encode_noduff(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    unsigned i;
+
+    for (i = 0; i < bytes_per_elem; i++) {
+        const unsigned char *_src = src + i;
+        unsigned char *_dest = dest + i * plane_stride;
+        size_t si, di;
+
+        for (si = 0, di = 0; di < n_elements; si += bytes_per_elem, di++)
+            _dest[di] = _src[si];
+    }
+} /* end encode_noduff() */
+
+static void
+decode_noduff(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    unsigned i;
+
+    for (i = 0; i < bytes_per_elem; i++) {
+        const unsigned char *_src = src + i * plane_stride;
+        unsigned char *_dest = dest + i;
+        size_t si, di;
+
+        for (si = 0, di = 0; si < n_elements; si++, di += bytes_per_elem)
+            _dest[di] = _src[si];
+    }
+} /* end decode_noduff() */
+
+
+/**********/
+/* OPENMP */
+/**********/
+
+/* Each thread runs the serial kernel over its own contiguous range of
+ * elements. Unlike splitting by byte plane, this scales past
+ * bytes_per_elem threads and works the same way in both directions.
+ * Small chunks, calls from inside a parallel region, and calls made while
+ * the thread budget is spent get a team of one (see
+ * shuffle_kernel_team_begin()).
+ */
+static void
+encode_parallel(shuffle_kernel_func_t encode, unsigned bytes_per_elem,
+        size_t n_elements, size_t plane_stride, const unsigned char *src,
+        unsigned char *dest)
+{
+    int team = shuffle_kernel_team_begin(n_elements * bytes_per_elem);
+
+    #pragma omp parallel num_threads(team) if(team > 1)
+    {
+        size_t n_threads = (size_t)omp_get_num_threads();
+        size_t t = (size_t)omp_get_thread_num();
+        size_t start = n_elements * t / n_threads;
+        size_t end = n_elements * (t + 1) / n_threads;
+
+        encode(bytes_per_elem, end - start, plane_stride,
+                src + start * bytes_per_elem, dest + start);
+    }
+
+    shuffle_kernel_team_end(team);
+} /* end encode_parallel() */
+
+static void
+decode_parallel(shuffle_kernel_func_t decode, unsigned bytes_per_elem,
+        size_t n_elements, size_t plane_stride, const unsigned char *src,
+        unsigned char *dest)
+{
+    int team = shuffle_kernel_team_begin(n_elements * bytes_per_elem);
+
+    #pragma omp parallel num_threads(team) if(team > 1)
+    {
+        size_t n_threads = (size_t)omp_get_num_threads();
+        size_t t = (size_t)omp_get_thread_num();
+        size_t start = n_elements * t / n_threads;
+        size_t end = n_elements * (t + 1) / n_threads;
+
+        decode(bytes_per_elem, end - start, plane_stride,
+                src + start, dest + start * bytes_per_elem);
+    }
+
+    shuffle_kernel_team_end(team);
+} /* end decode_parallel() */
+
+static void
+encode_duff_omp(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    encode_parallel(encode_duff, bytes_per_elem, n_elements, plane_stride, src, dest);
+} /* end encode_duff_omp() */
+
+static void
+decode_duff_omp(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    decode_parallel(decode_duff, bytes_per_elem, n_elements, plane_stride, src, dest);
+} /* end decode_duff_omp() */
+
+static void
+encode_noduff_omp(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    encode_parallel(encode_noduff, bytes_per_elem, n_elements, plane_stride, src, dest);
+} /* end encode_noduff_omp() */
+
+static void
+decode_noduff_omp(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    decode_parallel(decode_noduff, bytes_per_elem, n_elements, plane_stride, src, dest);
+} /* end decode_noduff_omp() */
+
+static void
+encode_threaded(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    encode_parallel(shuffle_kernel_best_simd()->encode, bytes_per_elem, n_elements,
+            plane_stride, src, dest);
+} /* end encode_threaded() */
+
+static void
+decode_threaded(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    decode_parallel(shuffle_kernel_best_simd()->decode, bytes_per_elem, n_elements,
+            plane_stride, src, dest);
+} /* end decode_threaded() */
+
@@ -0,0 +1,115 @@
+/* shuffle_kernels.h
+ *
+ * The pluggable [un]shuffle kernel interface shared by all of the shuffle
+ * filter plugins. Nothing in here is exported for applications.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SHUFFLE_KERNELS_H
+#define _SHUFFLE_KERNELS_H
+
+#include <stddef.h>
+
+/* A kernel moves n_elements elements of bytes_per_elem bytes each between
+ * the interleaved (element) layout and the shuffled (byte plane) layout.
+ * Byte plane i starts plane_stride bytes after byte plane i - 1.
+ *
+ * plane_stride is normally n_elements, but passing the full chunk's element
+ * count lets a caller work on a sub-range of the elements, which is how the
+ * threaded kernels split up a chunk.
+ *
+ * src and dest must not overlap. Leftover bytes (fractional elements) are
+ * not the kernel's problem; see shuffle_kernel_run().
+ */
+typedef void (*shuffle_kernel_func_t)(unsigned bytes_per_elem,
+        size_t n_elements, size_t plane_stride, const unsigned char *src,
+        unsigned char *dest);
+
+typedef struct shuffle_kernel_t {
+    const char *name;               /* Short name, e.g., for benchmarks */
+    shuffle_kernel_func_t encode;   /* Elements -> byte planes (shuffle) */
+    shuffle_kernel_func_t decode;   /* Byte planes -> elements (unshuffle) */
+    int (*supported)(void);         /* Can this CPU run it? NULL means yes */
+    int threaded;                   /* Spreads a chunk over an OpenMP team? */
+} shuffle_kernel_t;
+
+/* The kernels */
+extern const shuffle_kernel_t shuffle_kernel_duff;          /* Duff's device */
+extern const shuffle_kernel_t shuffle_kernel_noduff;        /* Simple loops */
+extern const shuffle_kernel_t shuffle_kernel_duff_omp;      /* Duff's device w/ OpenMP */
+extern const shuffle_kernel_t shuffle_kernel_noduff_omp;    /* Simple loops w/ OpenMP */
+extern const shuffle_kernel_t shuffle_kernel_sse;           /* SSSE3 */
+extern const shuffle_kernel_t shuffle_kernel_avx2;          /* AVX2 */
+extern const shuffle_kernel_t shuffle_kernel_avx512;        /* AVX-512 (F + BW) */
+extern const shuffle_kernel_t shuffle_kernel_threaded;      /* Best SIMD w/ OpenMP */
+
+/* NULL-terminated list of every kernel, for benchmarks */
+extern const shuffle_kernel_t *const shuffle_kernel_list[];
+
+/* Looks a kernel up by name. Returns NULL if there is no such kernel. */
+const shuffle_kernel_t *shuffle_kernel_find(const char *name);
+
+/* Whether this CPU can run the kernel */
+int shuffle_kernel_supported(const shuffle_kernel_t *kernel);
+
+/* The fastest single-threaded kernel this CPU can run */
+const shuffle_kernel_t *shuffle_kernel_best_simd(void);
+
+/* Chunks smaller than this many bytes don't start an OpenMP team in the
+ * OpenMP kernels. Set to 0 to always go parallel (e.g., for benchmarks).
+ */
+size_t shuffle_kernel_omp_min_bytes(void);
+void shuffle_kernel_set_omp_min_bytes(size_t nbytes);
+
+/* Sizes the OpenMP team for a region that [un]shuffles nbytes and reserves
+ * its threads against the process-wide thread budget. Returns 1 (run
+ * serially) below the cutoff above, inside an active parallel region (the
+ * application's or one of ours), or when the teams already running hold
+ * the budget. Pass the result to shuffle_kernel_team_end() afterwards.
+ *
+ * The budget caps the threads in all of the library's teams at once, from
+ * every application thread together. It defaults to the number of
+ * processors, or SHUFFLE_THREAD_BUDGET; 0 means no limit.
+ */
+int shuffle_kernel_team_begin(size_t nbytes);
+void shuffle_kernel_team_end(int team);
+int shuffle_kernel_thread_budget(void);
+void shuffle_kernel_set_thread_budget(int n_threads);
+
+/* [Un]shuffles nbytes of src into dest with the given kernel, including any
+ * leftover bytes at the end. H5Z_FLAG_REVERSE in flags means unshuffle.
+ * bytes_per_elem must be at least 1.
+ */
+void shuffle_kernel_run(const shuffle_kernel_t *kernel, unsigned int flags,
+        unsigned bytes_per_elem, size_t nbytes, const unsigned char *src,
+        unsigned char *dest);
+
+#endif /* _SHUFFLE_KERNELS_H */
@@ -0,0 +1,321 @@
+/* shuffle_kernels_simd.h
+ *
+ * Template for the SIMD [un]shuffle kernels. shuffle_kernels_x86.c includes
+ * this once per instruction set after defining:
+ *
+ *  SIMD_NAME(x)            Appends the instruction set to a function name
+ *  SIMD_FUNC               Function attributes (target, etc.)
+ *  SIMD_VEC                The vector type
+ *  SIMD_LANES              Number of 16-byte lanes in SIMD_VEC
+ *  SIMD_LOADU(p)           Unaligned vector load
+ *  SIMD_STOREU(p, v)       Unaligned vector store
+ *  SIMD_LOAD_GROUPS(p, s)  Loads lane g from p + g * s
+ *  SIMD_STORE_GROUPS(p, s, v)  Stores lane g to p + g * s
+ *  SIMD_MASK(m)            Broadcasts a 16-byte __m128i to every lane
+ *  SIMD_SHUFFLE_EPI8, SIMD_UNPACK{LO,HI}_EPI{16,32,64}
+ *                          The in-lane shuffle and unpack instructions
+ *
+ * Every operation works within 16-byte lanes, so each lane transposes its
+ * own group of 16 elements exactly as SSSE3 would. Lane g of a vector holds
+ * elements 16g-16g+15 of the block, which makes every byte plane a single
+ * contiguous, full-width store (or load, when unshuffling).
+ *
+ * Element sizes 2, 4, and 8 are vectorized. Anything else, and the tail of
+ * every chunk, goes through the simple loop kernel.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Elements per loop iteration */
+#define SIMD_BLOCK      (16 * SIMD_LANES)
+
+
+/* In-place transpose of an 8x8 matrix of 16-bit words, within each lane */
+#define SIMD_TRANSPOSE_8X16(x0, x1, x2, x3, x4, x5, x6, x7)                 \
+    do {                                                                    \
+        SIMD_VEC a0 = SIMD_UNPACKLO_EPI16(x0, x1);                          \
+        SIMD_VEC a1 = SIMD_UNPACKHI_EPI16(x0, x1);                          \
+        SIMD_VEC a2 = SIMD_UNPACKLO_EPI16(x2, x3);                          \
+        SIMD_VEC a3 = SIMD_UNPACKHI_EPI16(x2, x3);                          \
+        SIMD_VEC a4 = SIMD_UNPACKLO_EPI16(x4, x5);                          \
+        SIMD_VEC a5 = SIMD_UNPACKHI_EPI16(x4, x5);                          \
+        SIMD_VEC a6 = SIMD_UNPACKLO_EPI16(x6, x7);                          \
+        SIMD_VEC a7 = SIMD_UNPACKHI_EPI16(x6, x7);                          \
+        SIMD_VEC b0 = SIMD_UNPACKLO_EPI32(a0, a2);                          \
+        SIMD_VEC b1 = SIMD_UNPACKHI_EPI32(a0, a2);                          \
+        SIMD_VEC b2 = SIMD_UNPACKLO_EPI32(a1, a3);                          \
+        SIMD_VEC b3 = SIMD_UNPACKHI_EPI32(a1, a3);                          \
+        SIMD_VEC b4 = SIMD_UNPACKLO_EPI32(a4, a6);                          \
+        SIMD_VEC b5 = SIMD_UNPACKHI_EPI32(a4, a6);                          \
+        SIMD_VEC b6 = SIMD_UNPACKLO_EPI32(a5, a7);                          \
+        SIMD_VEC b7 = SIMD_UNPACKHI_EPI32(a5, a7);                          \
+        x0 = SIMD_UNPACKLO_EPI64(b0, b4);                                   \
+        x1 = SIMD_UNPACKHI_EPI64(b0, b4);                                   \
+        x2 = SIMD_UNPACKLO_EPI64(b1, b5);                                   \
+        x3 = SIMD_UNPACKHI_EPI64(b1, b5);                                   \
+        x4 = SIMD_UNPACKLO_EPI64(b2, b6);                                   \
+        x5 = SIMD_UNPACKHI_EPI64(b2, b6);                                   \
+        x6 = SIMD_UNPACKLO_EPI64(b3, b7);                                   \
+        x7 = SIMD_UNPACKHI_EPI64(b3, b7);                                   \
+    } while (0)
+
+
+/***********/
+/* SHUFFLE */
+/***********/
+
+SIMD_FUNC static size_t
+SIMD_NAME(encode2)(size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    /* Gathers each byte plane into one half of the lane */
+    const SIMD_VEC mask = SIMD_MASK(_mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                1, 3, 5, 7, 9, 11, 13, 15));
+    size_t i;
+
+    for (i = 0; i + SIMD_BLOCK <= n_elements; i += SIMD_BLOCK) {
+        const unsigned char *s = src + i * 2;
+        SIMD_VEC v0 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s, 32), mask);
+        SIMD_VEC v1 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 16, 32), mask);
+
+        SIMD_STOREU(dest + i, SIMD_UNPACKLO_EPI64(v0, v1));
+        SIMD_STOREU(dest + plane_stride + i, SIMD_UNPACKHI_EPI64(v0, v1));
+    }
+
+    return i;
+} /* end encode2() */
+
+SIMD_FUNC static size_t
+SIMD_NAME(encode4)(size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    /* Gathers each byte plane into one 32-bit word of the lane */
+    const SIMD_VEC mask = SIMD_MASK(_mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                2, 6, 10, 14, 3, 7, 11, 15));
+    size_t i;
+
+    for (i = 0; i + SIMD_BLOCK <= n_elements; i += SIMD_BLOCK) {
+        const unsigned char *s = src + i * 4;
+        SIMD_VEC v0 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s, 64), mask);
+        SIMD_VEC v1 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 16, 64), mask);
+        SIMD_VEC v2 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 32, 64), mask);
+        SIMD_VEC v3 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 48, 64), mask);
+        SIMD_VEC t0 = SIMD_UNPACKLO_EPI32(v0, v1);
+        SIMD_VEC t1 = SIMD_UNPACKHI_EPI32(v0, v1);
+        SIMD_VEC t2 = SIMD_UNPACKLO_EPI32(v2, v3);
+        SIMD_VEC t3 = SIMD_UNPACKHI_EPI32(v2, v3);
+
+        SIMD_STOREU(dest + i, SIMD_UNPACKLO_EPI64(t0, t2));
+        SIMD_STOREU(dest + plane_stride + i, SIMD_UNPACKHI_EPI64(t0, t2));
+        SIMD_STOREU(dest + 2 * plane_stride + i, SIMD_UNPACKLO_EPI64(t1, t3));
+        SIMD_STOREU(dest + 3 * plane_stride + i, SIMD_UNPACKHI_EPI64(t1, t3));
+    }
+
+    return i;
+} /* end encode4() */
+
+SIMD_FUNC static size_t
+SIMD_NAME(encode8)(size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    /* Gathers each byte plane into one 16-bit word of the lane */
+    const SIMD_VEC mask = SIMD_MASK(_mm_setr_epi8(0, 8, 1, 9, 2, 10, 3, 11,
+                4, 12, 5, 13, 6, 14, 7, 15));
+    size_t i;
+
+    for (i = 0; i + SIMD_BLOCK <= n_elements; i += SIMD_BLOCK) {
+        const unsigned char *s = src + i * 8;
+        SIMD_VEC v0 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s, 128), mask);
+        SIMD_VEC v1 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 16, 128), mask);
+        SIMD_VEC v2 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 32, 128), mask);
+        SIMD_VEC v3 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 48, 128), mask);
+        SIMD_VEC v4 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 64, 128), mask);
+        SIMD_VEC v5 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 80, 128), mask);
+        SIMD_VEC v6 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 96, 128), mask);
+        SIMD_VEC v7 = SIMD_SHUFFLE_EPI8(SIMD_LOAD_GROUPS(s + 112, 128), mask);
+
+        SIMD_TRANSPOSE_8X16(v0, v1, v2, v3, v4, v5, v6, v7);
+
+        SIMD_STOREU(dest + i, v0);
+        SIMD_STOREU(dest + plane_stride + i, v1);
+        SIMD_STOREU(dest + 2 * plane_stride + i, v2);
+        SIMD_STOREU(dest + 3 * plane_stride + i, v3);
+        SIMD_STOREU(dest + 4 * plane_stride + i, v4);
+        SIMD_STOREU(dest + 5 * plane_stride + i, v5);
+        SIMD_STOREU(dest + 6 * plane_stride + i, v6);
+        SIMD_STOREU(dest + 7 * plane_stride + i, v7);
+    }
+
+    return i;
+} /* end encode8() */
+
+SIMD_FUNC static void
+SIMD_NAME(encode)(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    size_t done = 0;            /* Elements handled by the SIMD loops */
+
+    switch (bytes_per_elem) {
+        case 2:
+            done = SIMD_NAME(encode2)(n_elements, plane_stride, src, dest);
+            break;
+        case 4:
+            done = SIMD_NAME(encode4)(n_elements, plane_stride, src, dest);
+            break;
+        case 8:
+            done = SIMD_NAME(encode8)(n_elements, plane_stride, src, dest);
+            break;
+        default:
+            break;
+    }
+
+    if (done < n_elements)
+        shuffle_kernel_noduff.encode(bytes_per_elem, n_elements - done, plane_stride,
+                src + done * bytes_per_elem, dest + done);
+} /* end encode() */
+
+
+/*************/
+/* UNSHUFFLE */
+/*************/
+
+SIMD_FUNC static size_t
+SIMD_NAME(decode2)(size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    /* Interleaves the two halves of the lane */
+    const SIMD_VEC mask = SIMD_MASK(_mm_setr_epi8(0, 8, 1, 9, 2, 10, 3, 11,
+                4, 12, 5, 13, 6, 14, 7, 15));
+    size_t i;
+
+    for (i = 0; i + SIMD_BLOCK <= n_elements; i += SIMD_BLOCK) {
+        unsigned char *d = dest + i * 2;
+        SIMD_VEC p0 = SIMD_LOADU(src + i);
+        SIMD_VEC p1 = SIMD_LOADU(src + plane_stride + i);
+
+        SIMD_STORE_GROUPS(d, 32, SIMD_SHUFFLE_EPI8(SIMD_UNPACKLO_EPI64(p0, p1), mask));
+        SIMD_STORE_GROUPS(d + 16, 32, SIMD_SHUFFLE_EPI8(SIMD_UNPACKHI_EPI64(p0, p1), mask));
+    }
+
+    return i;
+} /* end decode2() */
+
+SIMD_FUNC static size_t
+SIMD_NAME(decode4)(size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    /* A 4x4 byte transpose is its own inverse */
+    const SIMD_VEC mask = SIMD_MASK(_mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                2, 6, 10, 14, 3, 7, 11, 15));
+    size_t i;
+
+    for (i = 0; i + SIMD_BLOCK <= n_elements; i += SIMD_BLOCK) {
+        unsigned char *d = dest + i * 4;
+        SIMD_VEC p0 = SIMD_LOADU(src + i);
+        SIMD_VEC p1 = SIMD_LOADU(src + plane_stride + i);
+        SIMD_VEC p2 = SIMD_LOADU(src + 2 * plane_stride + i);
+        SIMD_VEC p3 = SIMD_LOADU(src + 3 * plane_stride + i);
+        SIMD_VEC t0 = SIMD_UNPACKLO_EPI32(p0, p1);
+        SIMD_VEC t1 = SIMD_UNPACKHI_EPI32(p0, p1);
+        SIMD_VEC t2 = SIMD_UNPACKLO_EPI32(p2, p3);
+        SIMD_VEC t3 = SIMD_UNPACKHI_EPI32(p2, p3);
+
+        SIMD_STORE_GROUPS(d, 64, SIMD_SHUFFLE_EPI8(SIMD_UNPACKLO_EPI64(t0, t2), mask));
+        SIMD_STORE_GROUPS(d + 16, 64, SIMD_SHUFFLE_EPI8(SIMD_UNPACKHI_EPI64(t0, t2), mask));
+        SIMD_STORE_GROUPS(d + 32, 64, SIMD_SHUFFLE_EPI8(SIMD_UNPACKLO_EPI64(t1, t3), mask));
+        SIMD_STORE_GROUPS(d + 48, 64, SIMD_SHUFFLE_EPI8(SIMD_UNPACKHI_EPI64(t1, t3), mask));
+    }
+
+    return i;
+} /* end decode4() */
+
+SIMD_FUNC static size_t
+SIMD_NAME(decode8)(size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    /* Inverse of the encode8() mask */
+    const SIMD_VEC mask = SIMD_MASK(_mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                1, 3, 5, 7, 9, 11, 13, 15));
+    size_t i;
+
+    for (i = 0; i + SIMD_BLOCK <= n_elements; i += SIMD_BLOCK) {
+        unsigned char *d = dest + i * 8;
+        SIMD_VEC p0 = SIMD_LOADU(src + i);
+        SIMD_VEC p1 = SIMD_LOADU(src + plane_stride + i);
+        SIMD_VEC p2 = SIMD_LOADU(src + 2 * plane_stride + i);
+        SIMD_VEC p3 = SIMD_LOADU(src + 3 * plane_stride + i);
+        SIMD_VEC p4 = SIMD_LOADU(src + 4 * plane_stride + i);
+        SIMD_VEC p5 = SIMD_LOADU(src + 5 * plane_stride + i);
+        SIMD_VEC p6 = SIMD_LOADU(src + 6 * plane_stride + i);
+        SIMD_VEC p7 = SIMD_LOADU(src + 7 * plane_stride + i);
+
+        /* The word transpose is its own inverse too */
+        SIMD_TRANSPOSE_8X16(p0, p1, p2, p3, p4, p5, p6, p7);
+
+        SIMD_STORE_GROUPS(d, 128, SIMD_SHUFFLE_EPI8(p0, mask));
+        SIMD_STORE_GROUPS(d + 16, 128, SIMD_SHUFFLE_EPI8(p1, mask));
+        SIMD_STORE_GROUPS(d + 32, 128, SIMD_SHUFFLE_EPI8(p2, mask));
+        SIMD_STORE_GROUPS(d + 48, 128, SIMD_SHUFFLE_EPI8(p3, mask));
+        SIMD_STORE_GROUPS(d + 64, 128, SIMD_SHUFFLE_EPI8(p4, mask));
+        SIMD_STORE_GROUPS(d + 80, 128, SIMD_SHUFFLE_EPI8(p5, mask));
+        SIMD_STORE_GROUPS(d + 96, 128, SIMD_SHUFFLE_EPI8(p6, mask));
+        SIMD_STORE_GROUPS(d + 112, 128, SIMD_SHUFFLE_EPI8(p7, mask));
+    }
+
+    return i;
+} /* end decode8() */
+
+SIMD_FUNC static void
+SIMD_NAME(decode)(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    size_t done = 0;            /* Elements handled by the SIMD loops */
+
+    switch (bytes_per_elem) {
+        case 2:
+            done = SIMD_NAME(decode2)(n_elements, plane_stride, src, dest);
+            break;
+        case 4:
+            done = SIMD_NAME(decode4)(n_elements, plane_stride, src, dest);
+            break;
+        case 8:
+            done = SIMD_NAME(decode8)(n_elements, plane_stride, src, dest);
+            break;
+        default:
+            break;
+    }
+
+    if (done < n_elements)
+        shuffle_kernel_noduff.decode(bytes_per_elem, n_elements - done, plane_stride,
+                src + done, dest + done * bytes_per_elem);
+} /* end decode() */
+
+#undef SIMD_TRANSPOSE_8X16
+#undef SIMD_BLOCK
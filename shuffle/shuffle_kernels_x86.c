@@ -0,0 +1,261 @@
+/* shuffle_kernels_x86.c
+ *
+ * SSSE3, AVX2, and AVX-512 [un]shuffle kernels.
+ *
+ * The kernels are compiled with per-function target attributes so the rest
+ * of the library keeps the compiler's baseline instruction set; whether the
+ * CPU can actually run them is checked at run time via the kernel's
+ * supported() callback. On other architectures the kernels fall back to the
+ * simple loops and report that they are unsupported.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "shuffle_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+
+/*********/
+/* SSSE3 */
+/*********/
+
+#define SIMD_NAME(x)                sse_ ## x
+#define SIMD_FUNC                   __attribute__((target("ssse3")))
+#define SIMD_VEC                    __m128i
+#define SIMD_LANES                  1
+#define SIMD_LOADU(p)               _mm_loadu_si128((const __m128i *)(p))
+#define SIMD_STOREU(p, v)           _mm_storeu_si128((__m128i *)(p), (v))
+#define SIMD_LOAD_GROUPS(p, s)      SIMD_LOADU(p)
+#define SIMD_STORE_GROUPS(p, s, v)  SIMD_STOREU(p, v)
+#define SIMD_MASK(m)                (m)
+#define SIMD_SHUFFLE_EPI8           _mm_shuffle_epi8
+#define SIMD_UNPACKLO_EPI16         _mm_unpacklo_epi16
+#define SIMD_UNPACKHI_EPI16         _mm_unpackhi_epi16
+#define SIMD_UNPACKLO_EPI32         _mm_unpacklo_epi32
+#define SIMD_UNPACKHI_EPI32         _mm_unpackhi_epi32
+#define SIMD_UNPACKLO_EPI64         _mm_unpacklo_epi64
+#define SIMD_UNPACKHI_EPI64         _mm_unpackhi_epi64
+
+#include "shuffle_kernels_simd.h"
+
+#undef SIMD_NAME
+#undef SIMD_FUNC
+#undef SIMD_VEC
+#undef SIMD_LANES
+#undef SIMD_LOADU
+#undef SIMD_STOREU
+#undef SIMD_LOAD_GROUPS
+#undef SIMD_STORE_GROUPS
+#undef SIMD_MASK
+#undef SIMD_SHUFFLE_EPI8
+#undef SIMD_UNPACKLO_EPI16
+#undef SIMD_UNPACKHI_EPI16
+#undef SIMD_UNPACKLO_EPI32
+#undef SIMD_UNPACKHI_EPI32
+#undef SIMD_UNPACKLO_EPI64
+#undef SIMD_UNPACKHI_EPI64
+
+
+/********/
+/* AVX2 */
+/********/
+
+#define SIMD_NAME(x)                avx2_ ## x
+#define SIMD_FUNC                   __attribute__((target("avx2")))
+#define SIMD_VEC                    __m256i
+#define SIMD_LANES                  2
+#define SIMD_LOADU(p)               _mm256_loadu_si256((const __m256i *)(p))
+#define SIMD_STOREU(p, v)           _mm256_storeu_si256((__m256i *)(p), (v))
+#define SIMD_LOAD_GROUPS(p, s)                                              \
+    _mm256_inserti128_si256(                                                \
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p))),      \
+        _mm_loadu_si128((const __m128i *)((p) + (s))), 1)
+#define SIMD_STORE_GROUPS(p, s, v)                                          \
+    do {                                                                    \
+        __m256i v_ = (v);                                                   \
+        _mm_storeu_si128((__m128i *)(p), _mm256_castsi256_si128(v_));       \
+        _mm_storeu_si128((__m128i *)((p) + (s)), _mm256_extracti128_si256(v_, 1)); \
+    } while (0)
+#define SIMD_MASK(m)                _mm256_broadcastsi128_si256(m)
+#define SIMD_SHUFFLE_EPI8           _mm256_shuffle_epi8
+#define SIMD_UNPACKLO_EPI16         _mm256_unpacklo_epi16
+#define SIMD_UNPACKHI_EPI16         _mm256_unpackhi_epi16
+#define SIMD_UNPACKLO_EPI32         _mm256_unpacklo_epi32
+#define SIMD_UNPACKHI_EPI32         _mm256_unpackhi_epi32
+#define SIMD_UNPACKLO_EPI64         _mm256_unpacklo_epi64
+#define SIMD_UNPACKHI_EPI64         _mm256_unpackhi_epi64
+
+#include "shuffle_kernels_simd.h"
+
+#undef SIMD_NAME
+#undef SIMD_FUNC
+#undef SIMD_VEC
+#undef SIMD_LANES
+#undef SIMD_LOADU
+#undef SIMD_STOREU
+#undef SIMD_LOAD_GROUPS
+#undef SIMD_STORE_GROUPS
+#undef SIMD_MASK
+#undef SIMD_SHUFFLE_EPI8
+#undef SIMD_UNPACKLO_EPI16
+#undef SIMD_UNPACKHI_EPI16
+#undef SIMD_UNPACKLO_EPI32
+#undef SIMD_UNPACKHI_EPI32
+#undef SIMD_UNPACKLO_EPI64
+#undef SIMD_UNPACKHI_EPI64
+
+
+/***********/
+/* AVX-512 */
+/***********/
+
+#define SIMD_NAME(x)                avx512_ ## x
+#define SIMD_FUNC                   __attribute__((target("avx512f,avx512bw")))
+#define SIMD_VEC                    __m512i
+#define SIMD_LANES                  4
+#define SIMD_LOADU(p)               _mm512_loadu_si512((const void *)(p))
+#define SIMD_STOREU(p, v)           _mm512_storeu_si512((void *)(p), (v))
+#define SIMD_LOAD_GROUPS(p, s)                                              \
+    _mm512_inserti32x4(_mm512_inserti32x4(_mm512_inserti32x4(               \
+        _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)(p))),      \
+        _mm_loadu_si128((const __m128i *)((p) + (s))), 1),                  \
+        _mm_loadu_si128((const __m128i *)((p) + 2 * (s))), 2),              \
+        _mm_loadu_si128((const __m128i *)((p) + 3 * (s))), 3)
+#define SIMD_STORE_GROUPS(p, s, v)                                          \
+    do {                                                                    \
+        __m512i v_ = (v);                                                   \
+        _mm_storeu_si128((__m128i *)(p), _mm512_castsi512_si128(v_));       \
+        _mm_storeu_si128((__m128i *)((p) + (s)), _mm512_extracti32x4_epi32(v_, 1)); \
+        _mm_storeu_si128((__m128i *)((p) + 2 * (s)), _mm512_extracti32x4_epi32(v_, 2)); \
+        _mm_storeu_si128((__m128i *)((p) + 3 * (s)), _mm512_extracti32x4_epi32(v_, 3)); \
+    } while (0)
+#define SIMD_MASK(m)                _mm512_broadcast_i32x4(m)
+#define SIMD_SHUFFLE_EPI8           _mm512_shuffle_epi8
+#define SIMD_UNPACKLO_EPI16         _mm512_unpacklo_epi16
+#define SIMD_UNPACKHI_EPI16         _mm512_unpackhi_epi16
+#define SIMD_UNPACKLO_EPI32         _mm512_unpacklo_epi32
+#define SIMD_UNPACKHI_EPI32         _mm512_unpackhi_epi32
+#define SIMD_UNPACKLO_EPI64         _mm512_unpacklo_epi64
+#define SIMD_UNPACKHI_EPI64         _mm512_unpackhi_epi64
+
+#include "shuffle_kernels_simd.h"
+
+#undef SIMD_NAME
+#undef SIMD_FUNC
+#undef SIMD_VEC
+#undef SIMD_LANES
+#undef SIMD_LOADU
+#undef SIMD_STOREU
+#undef SIMD_LOAD_GROUPS
+#undef SIMD_STORE_GROUPS
+#undef SIMD_MASK
+#undef SIMD_SHUFFLE_EPI8
+#undef SIMD_UNPACKLO_EPI16
+#undef SIMD_UNPACKHI_EPI16
+#undef SIMD_UNPACKLO_EPI32
+#undef SIMD_UNPACKHI_EPI32
+#undef SIMD_UNPACKLO_EPI64
+#undef SIMD_UNPACKHI_EPI64
+
+
+/****************/
+/* CPU FEATURES */
+/****************/
+
+static int
+sse_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+} /* end sse_supported() */
+
+static int
+avx2_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+} /* end avx2_supported() */
+
+static int
+avx512_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+} /* end avx512_supported() */
+
+
+/* The kernels */
+const shuffle_kernel_t shuffle_kernel_sse = {
+    "sse", sse_encode, sse_decode, sse_supported, 0
+};
+const shuffle_kernel_t shuffle_kernel_avx2 = {
+    "avx2", avx2_encode, avx2_decode, avx2_supported, 0
+};
+const shuffle_kernel_t shuffle_kernel_avx512 = {
+    "avx512", avx512_encode, avx512_decode, avx512_supported, 0
+};
+
+#else /* defined(__x86_64__) || defined(__i386__) */
+
+/* Not x86: keep the names, but never pick them */
+static void
+encode_unsupported(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    shuffle_kernel_noduff.encode(bytes_per_elem, n_elements, plane_stride, src, dest);
+} /* end encode_unsupported() */
+
+static void
+decode_unsupported(unsigned bytes_per_elem, size_t n_elements, size_t plane_stride,
+        const unsigned char *src, unsigned char *dest)
+{
+    shuffle_kernel_noduff.decode(bytes_per_elem, n_elements, plane_stride, src, dest);
+} /* end decode_unsupported() */
+
+static int
+unsupported(void)
+{
+    return 0;
+} /* end unsupported() */
+
+const shuffle_kernel_t shuffle_kernel_sse = {
+    "sse", encode_unsupported, decode_unsupported, unsupported, 0
+};
+const shuffle_kernel_t shuffle_kernel_avx2 = {
+    "avx2", encode_unsupported, decode_unsupported, unsupported, 0
+};
+const shuffle_kernel_t shuffle_kernel_avx512 = {
+    "avx512", encode_unsupported, decode_unsupported, unsupported, 0
+};
+
+#endif /* defined(__x86_64__) || defined(__i386__) */
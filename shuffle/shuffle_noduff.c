@@ -3,6 +3,9 @@
  * A clone of the official HDF5 shuffle filter, but with the Duff's device
  * replaced with a simple memory copy.
  *
+ * The filter scaffolding is shared by all of the shuffle plugins (see
+ * shuffle_common.c), so this only names the filter and picks its kernel.
+ *
  *
  * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
  * All rights reserved.
@@ -33,10 +36,6 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <assert.h>
-#include <stdlib.h>
-#include <string.h>
-
 /* The HDF5 header */
 #include <hdf5.h>
 
@@ -44,13 +43,11 @@
 #include <H5PLextern.h>
 
 #include "shuffle.h"
+#include "shuffle_private.h"
 
 
 /* Filter callback prototypes */
 static herr_t set_local_shuffle(hid_t dcpl_id, hid_t type_id, hid_t space_id);
-static size_t filter_shuffle(unsigned int flags, size_t cd_nelmts,
-        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
-        void **buf);
 
 
 /* Information about this filter
@@ -64,161 +61,28 @@ const H5Z_class2_t SHUFFLE_CLASS[1] = {{
     "shuffle_noduff",                       /* Filter name for debugging */
     NULL,                                   /* The "can apply" callback */
     set_local_shuffle,                      /* The "set local" callback */
-    (H5Z_func_t)filter_shuffle,             /* The actual filter function */
+    (H5Z_func_t)shuffle_filter,             /* The actual filter function */
 }};
 
-/* Local macros */
-#define SHUFFLE_PARM_SIZE       0   /* "Local" parameter for shuffling size */
-#define SHUFFLE_USER_NPARMS     0   /* Number of parameters that users can set */
-#define SHUFFLE_TOTAL_NPARMS    1   /* Total number of parameters for filter */
-
+/* The kernel behind this filter and the exported API */
+const shuffle_kernel_t *const shuffle_plugin_kernel = &shuffle_kernel_noduff;
 
 
 /* The plugin functions you must implement when you include H5PLextern.h */
 H5PL_type_t H5PLget_plugin_type(void) { return H5PL_TYPE_FILTER; }
-const void *H5PLget_plugin_info(void) { return SHUFFLE_CLASS; }
+const void *
+H5PLget_plugin_info(void)
+{
+    /* Settle on a kernel (SHUFFLE_KERNEL) before HDF5 can call the filter */
+    shuffle_select_kernel();
+
+    return SHUFFLE_CLASS;
+}
 
 
 static herr_t
 set_local_shuffle(hid_t dcpl_id, hid_t type_id, hid_t space_id)
 {
-    unsigned flags;                             /* Filter flags */
-    size_t type_size;                           /* Datatype size */
-    size_t cd_nelmts = SHUFFLE_USER_NPARMS;     /* # of filter parameters */
-    unsigned cd_values[SHUFFLE_TOTAL_NPARMS];   /* Filter parameters */
-
-    /* Get the filter's current parameters */
-    if (H5Pget_filter_by_id(dcpl_id, SHUFFLE_NODUFF_ID, &flags, &cd_nelmts, cd_values, (size_t)0, NULL, NULL) < 0)
-        goto error;
-
-    /* Get the type size */
-    if (0 == (type_size = H5Tget_size(type_id)))
-        goto error;
-
-    /* Set "local" parameter for this dataset */
-    cd_values[SHUFFLE_PARM_SIZE] = (unsigned)type_size;
-
-    /* Modify the filter's parameters for this dataset */
-    if(H5Pmodify_filter(dcpl_id, SHUFFLE_NODUFF_ID, flags, (size_t)SHUFFLE_TOTAL_NPARMS, cd_values) < 0)
-        goto error;
-
-    return 0;
-
-error:
-    return -1;
+    return shuffle_set_local(SHUFFLE_NODUFF_ID, dcpl_id, type_id);
 } /* end set_local_shuffle() */
 
-
-static size_t
-filter_shuffle(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
-        size_t nbytes, size_t *buf_size, void **buf)
-{
-    unsigned bytes_per_elem;        /* Number of bytes per element */
-    size_t n_elements;              /* Number of elements in buffer */
-    size_t leftover;                /* Extra bytes at end of buffer */
-    void *dest = NULL;              /* Buffer to deposit [un]shuffled bytes into */
-    unsigned char *_src = NULL;     /* Alias for source buffer */
-    unsigned char *_dest = NULL;    /* Alias for destination buffer */
-    int i;
-
-    /* Check arguments */
-    if (cd_nelmts != SHUFFLE_TOTAL_NPARMS || cd_values[SHUFFLE_PARM_SIZE] == 0)
-        goto error;
-
-    /* Get the number of bytes per element from the parameter block */
-    bytes_per_elem = cd_values[SHUFFLE_PARM_SIZE];
-
-    /* Compute the number of elements in buffer */
-    n_elements = nbytes / bytes_per_elem;
-
-    /* If this is a single byte type or we have fractional elements, do nothing */
-    if (bytes_per_elem <= 1 || n_elements <= 1)
-        return *buf_size;
-
-    /* Compute the leftover bytes if there are any */
-    leftover = nbytes % bytes_per_elem;
-
-    /* Allocate the destination buffer */
-    if (NULL == (dest = malloc(nbytes)))
-        goto error;
-
-    if (flags & H5Z_FLAG_REVERSE) {
-
-        /*************/
-        /* UNSHUFFLE */
-        /*************/
-
-        /* Get a pointer to the source buffer */
-        _src = (unsigned char *)(*buf);
-
-        /* Input; unshuffle */
-        for (i = 0; i < bytes_per_elem; i++) {
-
-            int j = n_elements;
-
-            _dest = ((unsigned char *)dest) + i;
-
-            while(j > 0) {
-                *_dest = *_src++;
-                _dest += bytes_per_elem;
-
-                j--;
-            }
-        }
-
-        /* Add leftover to the end of data */
-        if (leftover > 0) {
-            /* Adjust back to end of shuffled bytes */
-            _dest -= (bytes_per_elem - 1);
-            memcpy((void *)_dest, (void *)_src, leftover);
-        }
-
-    } /* end unshuffle */
-    else {
-
-        /***********/
-        /* SHUFFLE */
-        /***********/
-
-        /* Get a pointer to the destination buffer */
-        _dest = (unsigned char *)dest;
-
-        /* Output; shuffle */
-        for (i = 0; i < bytes_per_elem; i++) {
-
-            int j = n_elements;
-
-            _src = ((unsigned char *)(*buf)) + i;
-
-            while(j > 0) {
-                *_dest++ = *_src;
-                _src += bytes_per_elem;
-
-                j--;
-            }
-        }
-
-        /* Add leftover to the end of data */
-        if(leftover > 0) {
-            /* Adjust back to end of shuffled bytes */
-            _src -= (bytes_per_elem - 1);
-            memcpy((void*)_dest, (void*)_src, leftover);
-        }
-
-    } /* end shuffle */
-
-
-    /* Free the input buffer */
-    free(*buf);
-
-    /* Set the buffer information to return */
-    *buf = dest;
-
-    return *buf_size;
-
-error:
-    free(dest);
-
-    return 0;
-} /* end filter_shuffle() */
-
@@ -0,0 +1,87 @@
+/* shuffle_omp.c
+ *
+ * A clone of the official HDF5 shuffle filter with OpenMP enabled.
+ *
+ * The filter scaffolding is shared by all of the shuffle plugins (see
+ * shuffle_common.c), so this only names the filter and picks its kernel.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+/* The HDF5 external plugin header */
+#include <H5PLextern.h>
+
+#include "shuffle.h"
+#include "shuffle_private.h"
+
+
+/* Filter callback prototypes */
+static herr_t set_local_shuffle(hid_t dcpl_id, hid_t type_id, hid_t space_id);
+
+
+/* Information about this filter
+ * H5Z_class2_t is defined in H5Zpublic.h
+ */
+const H5Z_class2_t SHUFFLE_CLASS[1] = {{
+    H5Z_CLASS_T_VERS,                       /* Filter class version */
+    SHUFFLE_OMP_ID,                         /* Filter id number */
+    1,                                      /* encoder_present flag */
+    1,                                      /* decoder_present flag */
+    "shuffle_omp",                          /* Filter name for debugging */
+    NULL,                                   /* The "can apply" callback */
+    set_local_shuffle,                      /* The "set local" callback */
+    (H5Z_func_t)shuffle_filter,             /* The actual filter function */
+}};
+
+/* The kernel behind this filter and the exported API */
+const shuffle_kernel_t *const shuffle_plugin_kernel = &shuffle_kernel_duff_omp;
+
+
+/* The plugin functions you must implement when you include H5PLextern.h */
+H5PL_type_t H5PLget_plugin_type(void) { return H5PL_TYPE_FILTER; }
+const void *
+H5PLget_plugin_info(void)
+{
+    /* Settle on a kernel (SHUFFLE_KERNEL) before HDF5 can call the filter */
+    shuffle_select_kernel();
+
+    return SHUFFLE_CLASS;
+}
+
+
+static herr_t
+set_local_shuffle(hid_t dcpl_id, hid_t type_id, hid_t space_id)
+{
+    return shuffle_set_local(SHUFFLE_OMP_ID, dcpl_id, type_id);
+} /* end set_local_shuffle() */
+
@@ -0,0 +1,194 @@
+/* shuffle_pages.c
+ *
+ * Huge page support for the shuffle plugins' chunk buffers.
+ *
+ * With 4 KiB pages, the strided walk over a 16-256 MiB chunk misses the TLB
+ * on nearly every access.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_private.h"
+
+
+/* Huge page size on x86_64 and most aarch64 systems */
+#define HUGE_PAGE_SIZE          ((size_t)2 * 1024 * 1024)
+
+/* Local prototypes */
+static void init_huge_pages(void);
+static size_t round_up_to_huge_page(size_t nbytes);
+
+/* Page policy for the buffers the filter hands back to HDF5. Set from the
+ * SHUFFLE_HUGE_PAGES environment variable on first use, or by
+ * shuffle_set_huge_pages(), while filters on other threads read it, so it
+ * is atomic.
+ */
+static atomic_int filter_pages = SHUFFLE_PAGES_DEFAULT;
+static pthread_once_t filter_pages_once = PTHREAD_ONCE_INIT;
+
+
+herr_t
+shuffle_set_huge_pages(shuffle_pages_t pages)
+{
+    /* HDF5 releases filter buffers with free(), so they can't come from
+     * hugetlbfs mappings.
+     */
+    if (pages != SHUFFLE_PAGES_DEFAULT && pages != SHUFFLE_PAGES_TRANSPARENT)
+        goto error;
+
+    /* Make sure a later first use doesn't clobber this with the environment */
+    pthread_once(&filter_pages_once, init_huge_pages);
+
+    atomic_store(&filter_pages, (int)pages);
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_set_huge_pages() */
+
+
+void *
+shuffle_alloc_staging(size_t nbytes, shuffle_pages_t pages)
+{
+    size_t size = round_up_to_huge_page(nbytes);
+    void *buf = MAP_FAILED;
+
+    if (0 == nbytes)
+        goto error;
+
+#ifdef MAP_HUGETLB
+    /* Explicit huge pages come from the (admin-sized) hugetlbfs pool. Fall
+     * back to transparent huge pages if the pool is empty.
+     */
+    if (SHUFFLE_PAGES_EXPLICIT == pages) {
+        buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (MAP_FAILED != buf)
+            return buf;
+        pages = SHUFFLE_PAGES_TRANSPARENT;
+    }
+#endif
+
+    if (SHUFFLE_PAGES_TRANSPARENT == pages) {
+        unsigned char *raw;
+        unsigned char *aligned;
+        size_t head;
+
+        /* Over-allocate so the mapping can be trimmed to a huge page
+         * boundary. THP only backs aligned 2 MiB extents.
+         */
+        if (MAP_FAILED == (buf = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)))
+            goto error;
+        raw = (unsigned char *)buf;
+        aligned = (unsigned char *)(((size_t)raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        head = (size_t)(aligned - raw);
+        if (head > 0)
+            munmap(raw, head);
+        munmap(aligned + size, HUGE_PAGE_SIZE - head);
+        buf = aligned;
+
+        /* Only a hint. Harmless if THP is disabled. */
+        madvise(buf, size, MADV_HUGEPAGE);
+    }
+    else {
+        if (MAP_FAILED == (buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)))
+            goto error;
+    }
+
+    /* Pre-fault the buffer so the first shuffle doesn't pay for it */
+    memset(buf, 0, size);
+
+    return buf;
+
+error:
+    return NULL;
+} /* end shuffle_alloc_staging() */
+
+
+void
+shuffle_free_staging(void *buf, size_t nbytes)
+{
+    if (buf)
+        munmap(buf, round_up_to_huge_page(nbytes));
+} /* end shuffle_free_staging() */
+
+
+void *
+shuffle_malloc(size_t nbytes)
+{
+    void *buf = NULL;
+
+    pthread_once(&filter_pages_once, init_huge_pages);
+
+    if (SHUFFLE_PAGES_TRANSPARENT == atomic_load(&filter_pages) && nbytes >= HUGE_PAGE_SIZE) {
+        if (0 != posix_memalign(&buf, HUGE_PAGE_SIZE, nbytes))
+            return NULL;
+
+        /* Only whole, aligned huge pages can be advised */
+        madvise(buf, nbytes & ~(HUGE_PAGE_SIZE - 1), MADV_HUGEPAGE);
+
+        return buf;
+    }
+
+    return malloc(nbytes);
+} /* end shuffle_malloc() */
+
+
+/* Reads SHUFFLE_HUGE_PAGES ("transparent" or "1" turns them on) */
+static void
+init_huge_pages(void)
+{
+    const char *env = getenv("SHUFFLE_HUGE_PAGES");
+
+    if (env && (0 == strcasecmp(env, "transparent") || 0 == strcmp(env, "1")))
+        atomic_store(&filter_pages, SHUFFLE_PAGES_TRANSPARENT);
+} /* end init_huge_pages() */
+
+
+static size_t
+round_up_to_huge_page(size_t nbytes)
+{
+    return (nbytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+} /* end round_up_to_huge_page() */
+
@@ -0,0 +1,96 @@
+/* shuffle_private.h
+ *
+ * Internal interfaces shared between the shuffle plugin's source files.
+ * Nothing in here is exported for applications.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SHUFFLE_PRIVATE_H
+#define _SHUFFLE_PRIVATE_H
+
+#include "shuffle_kernels.h"
+
+/* Each plugin defines this to pick the kernel behind its filter and its
+ * exported API.
+ */
+extern const shuffle_kernel_t *const shuffle_plugin_kernel;
+
+/* Kernel selection (shuffle_dispatch.c)
+ *
+ * shuffle_select_kernel() settles on the kernel once per process, honoring
+ * the SHUFFLE_KERNEL environment variable. shuffle_active_kernel() returns
+ * it, selecting first if need be. Everything that [un]shuffles goes through
+ * the active kernel rather than shuffle_plugin_kernel.
+ */
+void shuffle_select_kernel(void);
+const shuffle_kernel_t *shuffle_active_kernel(void);
+
+/* Filter scaffolding shared by the plugins (shuffle_common.c).
+ *
+ * shuffle_set_local() is the body of a plugin's "set local" callback; the
+ * plugin passes in its own filter ID. shuffle_filter() is the filter
+ * function itself.
+ */
+herr_t shuffle_set_local(H5Z_filter_t filter_id, hid_t dcpl_id, hid_t type_id);
+size_t shuffle_filter(unsigned int flags, size_t cd_nelmts,
+        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
+        void **buf);
+
+/* The same for the blocked filter (shuffle_blocks.c) */
+herr_t shuffle_blocked_set_local(hid_t dcpl_id, hid_t type_id);
+size_t shuffle_blocked_filter(unsigned int flags, size_t cd_nelmts,
+        const unsigned int cd_values[], size_t nbytes, size_t *buf_size,
+        void **buf);
+
+/* Allocates a free()able buffer for the filter's output, honoring the huge
+ * page policy for buffers big enough to use them (shuffle_pages.c).
+ */
+void *shuffle_malloc(size_t nbytes);
+
+/* Per-chunk statistics (shuffle_stats.c)
+ *
+ * shuffle_stats_type_of() picks the kind of statistics for a dataset's
+ * datatype, SHUFFLE_STATS_NONE if there are none.
+ *
+ * shuffle_chunk_with_stats() shuffles *buf like shuffle_chunk(), replacing
+ * it with a newly allocated buffer that starts with a header holding the
+ * chunk's statistics, reports them to the callback, and adds the header's
+ * size to *nbytes. fill points to the fill value (bytes_per_elem bytes), or
+ * is NULL if there is none. shuffle_unchunk_with_stats() strips the header
+ * and unshuffles the rest.
+ */
+shuffle_stats_type_t shuffle_stats_type_of(hid_t type_id);
+herr_t shuffle_chunk_with_stats(unsigned bytes_per_elem, size_t *nbytes,
+        shuffle_stats_type_t type, const unsigned char *fill, void **buf);
+herr_t shuffle_unchunk_with_stats(unsigned bytes_per_elem, size_t *nbytes,
+        void **buf);
+
+#endif /* _SHUFFLE_PRIVATE_H */
@@ -0,0 +1,78 @@
+/* shuffle_reference.c
+ *
+ * A plain byte shuffle for the test programs (see shuffle_reference.h).
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "shuffle_reference.h"
+
+
+void
+reference_shuffle(int reverse, unsigned bytes_per_elem, size_t nbytes,
+        const void *src, void *dest)
+{
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *out = (unsigned char *)dest;
+    size_t n_elements = bytes_per_elem ? nbytes / bytes_per_elem : 0;
+    size_t whole = n_elements * bytes_per_elem;
+    size_t e;
+    unsigned b;
+
+    for (e = 0; e < n_elements; e++)
+        for (b = 0; b < bytes_per_elem; b++) {
+            if (reverse)
+                out[e * bytes_per_elem + b] = in[b * n_elements + e];
+            else
+                out[b * n_elements + e] = in[e * bytes_per_elem + b];
+        }
+
+    memcpy(out + whole, in + whole, nbytes - whole);
+} /* end reference_shuffle() */
+
+
+void
+reference_fill(void *buf, size_t nbytes, unsigned seed)
+{
+    unsigned char *p = (unsigned char *)buf;
+    uint32_t x = seed * 2654435761U + 1;
+    size_t i;
+
+    /* xorshift32 */
+    for (i = 0; i < nbytes; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        p[i] = (unsigned char)(x >> 24);
+    }
+} /* end reference_fill() */
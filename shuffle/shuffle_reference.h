@@ -0,0 +1,54 @@
+/* shuffle_reference.h
+ *
+ * A plain byte shuffle, one byte at a time, for the test programs to check
+ * the library against. Not part of the plugins.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SHUFFLE_REFERENCE_H
+#define _SHUFFLE_REFERENCE_H
+
+#include <stddef.h>
+
+/* [Un]shuffles nbytes from src into dest exactly as HDF5's shuffle filter
+ * lays them out: byte plane b of n elements starts at b * n, and the bytes
+ * after the last whole element are copied unchanged. src and dest must not
+ * overlap.
+ */
+void reference_shuffle(int reverse, unsigned bytes_per_elem, size_t nbytes,
+        const void *src, void *dest);
+
+/* Fills buf with bytes from a fixed pseudo-random sequence, so a failure
+ * is the same on every run
+ */
+void reference_fill(void *buf, size_t nbytes, unsigned seed);
+
+#endif /* _SHUFFLE_REFERENCE_H */
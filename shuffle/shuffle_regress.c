@@ -0,0 +1,619 @@
+/* shuffle_regress.c
+ *
+ * Performance regression suite for the shuffle plugins' kernels.
+ *
+ * Times every kernel at every element size and chunk size in the suite,
+ * many times over, and can save the raw samples as a JSON baseline. Run
+ * again with -b to compare against a baseline: a configuration is flagged
+ * when a one-sided Mann-Whitney U test says it got slower (p < 0.001) AND
+ * its median time grew by more than the threshold, so neither noise nor a
+ * statistically real but meaningless 0.5% wobble trips it. The exit status
+ * is nonzero if anything regressed.
+ *
+ * Compare baselines from the same machine, build type, and CPU frequency
+ * settings; the test can't tell a slower kernel from a slower box.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hdf5.h>
+
+#include "shuffle_kernels.h"
+
+/* Defaults */
+#define DEFAULT_SAMPLES         21
+#define DEFAULT_THRESHOLD       5.0     /* % slowdown of the median */
+#define KIB                     ((size_t)1024)
+#define MIB                     ((size_t)1024 * 1024)
+
+/* Each sample runs the kernel enough times to move at least this much */
+#define MIN_BYTES_PER_SAMPLE    (8 * MIB)
+
+/* One-sided z for p < 0.001 */
+#define Z_CRITICAL              3.09
+
+/* The suite */
+static const unsigned suite_elem_sizes[] = {1, 2, 4, 8, 16};
+static const size_t suite_chunk_sizes[] = {64 * KIB, 1 * MIB, 16 * MIB};
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+/* The timings for one kernel/element size/chunk size/direction */
+typedef struct result_t {
+    char kernel[32];
+    unsigned elem_size;
+    size_t chunk_bytes;
+    int decode;                 /* 0 = encode (shuffle), 1 = decode */
+    int n_samples;
+    double *samples;            /* ns per chunk */
+} result_t;
+
+typedef struct result_list_t {
+    result_t *results;
+    size_t n;
+    size_t capacity;
+} result_list_t;
+
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+} /* end now() */
+
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+} /* end compare_doubles() */
+
+
+static double
+median(const double *samples, int n)
+{
+    double *sorted = NULL;
+    double m;
+
+    if (NULL == (sorted = (double *)malloc((size_t)n * sizeof(double))))
+        return 0.0;
+    memcpy(sorted, samples, (size_t)n * sizeof(double));
+    qsort(sorted, (size_t)n, sizeof(double), compare_doubles);
+
+    m = (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+
+    free(sorted);
+
+    return m;
+} /* end median() */
+
+
+/* A sample tagged with the set it came from, for ranking */
+typedef struct ranked_t {
+    double value;
+    int from_b;
+} ranked_t;
+
+static int
+compare_ranked(const void *a, const void *b)
+{
+    return compare_doubles(&((const ranked_t *)a)->value, &((const ranked_t *)b)->value);
+} /* end compare_ranked() */
+
+/* Mann-Whitney U test, normal approximation with tie-averaged ranks.
+ * Returns z, which is positive when the values in b tend to be larger than
+ * those in a.
+ */
+double
+mann_whitney_z(const double *a, int n_a, const double *b, int n_b)
+{
+    ranked_t *all = NULL;
+    double rank_sum_b = 0.0;
+    double u, mu, sigma;
+    int n = n_a + n_b;
+    int i, j;
+
+    if (NULL == (all = (ranked_t *)malloc((size_t)n * sizeof(ranked_t))))
+        return 0.0;
+    for (i = 0; i < n_a; i++) {
+        all[i].value = a[i];
+        all[i].from_b = 0;
+    }
+    for (i = 0; i < n_b; i++) {
+        all[n_a + i].value = b[i];
+        all[n_a + i].from_b = 1;
+    }
+    qsort(all, (size_t)n, sizeof(ranked_t), compare_ranked);
+
+    /* Ranks start at 1. Tied values share the average of their ranks. */
+    for (i = 0; i < n; i = j) {
+        double rank;
+
+        for (j = i + 1; j < n && all[j].value == all[i].value; j++)
+            ;
+        rank = 0.5 * (double)(i + 1 + j);
+        for (; i < j; i++)
+            if (all[i].from_b)
+                rank_sum_b += rank;
+    }
+
+    free(all);
+
+    u = rank_sum_b - (double)n_b * (n_b + 1) / 2.0;
+    mu = (double)n_a * n_b / 2.0;
+    sigma = sqrt((double)n_a * n_b * (n + 1) / 12.0);
+
+    /* Continuity correction, toward zero */
+    if (u > mu)
+        u -= 0.5;
+    else if (u < mu)
+        u += 0.5;
+
+    return (u - mu) / sigma;
+} /* end mann_whitney_z() */
+
+
+static result_t *
+add_result(result_list_t *list)
+{
+    if (list->n == list->capacity) {
+        size_t capacity = list->capacity ? 2 * list->capacity : 64;
+        result_t *results;
+
+        if (NULL == (results = (result_t *)realloc(list->results, capacity * sizeof(result_t))))
+            return NULL;
+        list->results = results;
+        list->capacity = capacity;
+    }
+
+    memset(&list->results[list->n], 0, sizeof(result_t));
+
+    return &list->results[list->n++];
+} /* end add_result() */
+
+
+static void
+free_results(result_list_t *list)
+{
+    size_t i;
+
+    for (i = 0; i < list->n; i++)
+        free(list->results[i].samples);
+    free(list->results);
+    memset(list, 0, sizeof(result_list_t));
+} /* end free_results() */
+
+
+static const result_t *
+find_result(const result_list_t *list, const result_t *key)
+{
+    size_t i;
+
+    for (i = 0; i < list->n; i++) {
+        const result_t *r = &list->results[i];
+
+        if (r->elem_size == key->elem_size && r->chunk_bytes == key->chunk_bytes
+                && r->decode == key->decode && 0 == strcmp(r->kernel, key->kernel))
+            return r;
+    }
+
+    return NULL;
+} /* end find_result() */
+
+
+/* Times n_samples encodes and decodes of one configuration */
+int
+bench_config(result_list_t *list, const shuffle_kernel_t *kernel, unsigned elem_size,
+        size_t nbytes, int n_samples)
+{
+    unsigned char *src  = NULL;
+    unsigned char *dest = NULL;
+    result_t *encode;
+    result_t *decode;
+    size_t iters = MIN_BYTES_PER_SAMPLE / nbytes;
+    size_t i;
+    int s;
+
+    if (0 == iters)
+        iters = 1;
+
+    if (NULL == (src = (unsigned char *)malloc(nbytes)))
+        PROGRAM_ERROR("unable to allocate source buffer");
+    if (NULL == (dest = (unsigned char *)malloc(nbytes)))
+        PROGRAM_ERROR("unable to allocate destination buffer");
+
+    /* Something vaguely like the test program's data */
+    for (i = 0; i < nbytes / sizeof(int); i++)
+        ((int *)src)[i] = (int)i;
+
+    if (NULL == (encode = add_result(list)) || NULL == (decode = add_result(list)))
+        PROGRAM_ERROR("unable to allocate results");
+    encode = decode - 1;
+    snprintf(encode->kernel, sizeof(encode->kernel), "%s", kernel->name);
+    snprintf(decode->kernel, sizeof(decode->kernel), "%s", kernel->name);
+    encode->elem_size = decode->elem_size = elem_size;
+    encode->chunk_bytes = decode->chunk_bytes = nbytes;
+    encode->decode = 0;
+    decode->decode = 1;
+    encode->n_samples = decode->n_samples = n_samples;
+    if (NULL == (encode->samples = (double *)malloc((size_t)n_samples * sizeof(double))))
+        PROGRAM_ERROR("unable to allocate samples");
+    if (NULL == (decode->samples = (double *)malloc((size_t)n_samples * sizeof(double))))
+        PROGRAM_ERROR("unable to allocate samples");
+
+    /* Warm up the caches, page tables, and OpenMP thread pool */
+    shuffle_kernel_run(kernel, 0, elem_size, nbytes, src, dest);
+    shuffle_kernel_run(kernel, H5Z_FLAG_REVERSE, elem_size, nbytes, dest, src);
+
+    /* Interleave the directions so slow drift hits both alike */
+    for (s = 0; s < n_samples; s++) {
+        double t;
+
+        t = now();
+        for (i = 0; i < iters; i++)
+            shuffle_kernel_run(kernel, 0, elem_size, nbytes, src, dest);
+        encode->samples[s] = (now() - t) * 1.0e9 / (double)iters;
+
+        t = now();
+        for (i = 0; i < iters; i++)
+            shuffle_kernel_run(kernel, H5Z_FLAG_REVERSE, elem_size, nbytes, dest, src);
+        decode->samples[s] = (now() - t) * 1.0e9 / (double)iters;
+    }
+
+    free(src);
+    free(dest);
+
+    return 0;
+
+error:
+    free(src);
+    free(dest);
+
+    return -1;
+} /* end bench_config() */
+
+
+/********/
+/* JSON */
+/********/
+
+int
+write_json(const char *path, const result_list_t *list)
+{
+    FILE *f = NULL;
+    size_t i;
+    int s;
+
+    if (NULL == (f = fopen(path, "w")))
+        PROGRAM_ERROR("unable to open JSON file for writing");
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"benchmark\": \"shuffle_regress\",\n");
+    fprintf(f, "  \"version\": 1,\n");
+    fprintf(f, "  \"results\": [\n");
+    for (i = 0; i < list->n; i++) {
+        const result_t *r = &list->results[i];
+
+        fprintf(f, "    {\"kernel\": \"%s\", \"elem_size\": %u, \"chunk_bytes\": %zu, "
+                "\"op\": \"%s\", \"median_ns\": %.0f, \"samples_ns\": [",
+                r->kernel, r->elem_size, r->chunk_bytes, r->decode ? "decode" : "encode",
+                median(r->samples, r->n_samples));
+        for (s = 0; s < r->n_samples; s++)
+            fprintf(f, "%s%.0f", s ? ", " : "", r->samples[s]);
+        fprintf(f, "]}%s\n", i + 1 < list->n ? "," : "");
+    }
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+
+    if (0 != fclose(f)) {
+        f = NULL;
+        PROGRAM_ERROR("unable to write JSON file");
+    }
+
+    return 0;
+
+error:
+    if (f)
+        fclose(f);
+
+    return -1;
+} /* end write_json() */
+
+
+/* Finds "key": between p and end and returns what follows the colon */
+static const char *
+json_value(const char *p, const char *end, const char *key)
+{
+    char quoted[64];
+    size_t len;
+
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+    len = strlen(quoted);
+
+    for (; p + len <= end; p++)
+        if (0 == strncmp(p, quoted, len)) {
+            for (p += len; p < end && (' ' == *p || '\t' == *p || '\n' == *p || '\r' == *p); p++)
+                ;
+            if (p < end && ':' == *p) {
+                for (p++; p < end && (' ' == *p || '\t' == *p || '\n' == *p || '\r' == *p); p++)
+                    ;
+                return p;
+            }
+        }
+
+    return NULL;
+} /* end json_value() */
+
+/* Reads a baseline written by write_json(). This isn't a general JSON
+ * parser, but it doesn't care about whitespace or key order, so a baseline
+ * that's been pretty-printed by another tool still loads.
+ */
+int
+read_json(const char *path, result_list_t *list)
+{
+    FILE *f = NULL;
+    char *text = NULL;
+    const char *p;
+    long size;
+
+    if (NULL == (f = fopen(path, "r")))
+        PROGRAM_ERROR("unable to open baseline");
+    if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) < 0)
+        PROGRAM_ERROR("unable to get baseline size");
+    if (NULL == (text = (char *)malloc((size_t)size + 1)))
+        PROGRAM_ERROR("unable to allocate baseline buffer");
+    if ((size_t)size != fread(text, 1, (size_t)size, f))
+        PROGRAM_ERROR("unable to read baseline");
+    text[size] = '\0';
+    fclose(f);
+    f = NULL;
+
+    /* Each result is a flat object starting with '{' and ending with '}' */
+    if (NULL == (p = json_value(text, text + size, "results")))
+        PROGRAM_ERROR("baseline has no results");
+    while (NULL != (p = strchr(p, '{'))) {
+        const char *end = strchr(p, '}');
+        const char *v;
+        result_t *r;
+        int capacity = 0;
+
+        if (NULL == end)
+            PROGRAM_ERROR("truncated baseline");
+        if (NULL == (r = add_result(list)))
+            PROGRAM_ERROR("unable to allocate results");
+
+        if (NULL == (v = json_value(p, end, "kernel")) || 1 != sscanf(v, "\"%31[^\"]\"", r->kernel))
+            PROGRAM_ERROR("baseline result has no kernel");
+        if (NULL == (v = json_value(p, end, "elem_size")))
+            PROGRAM_ERROR("baseline result has no elem_size");
+        r->elem_size = (unsigned)strtoul(v, NULL, 10);
+        if (NULL == (v = json_value(p, end, "chunk_bytes")))
+            PROGRAM_ERROR("baseline result has no chunk_bytes");
+        r->chunk_bytes = (size_t)strtoull(v, NULL, 10);
+        if (NULL == (v = json_value(p, end, "op")))
+            PROGRAM_ERROR("baseline result has no op");
+        r->decode = 0 == strncmp(v, "\"decode\"", 8);
+
+        if (NULL == (v = json_value(p, end, "samples_ns")) || '[' != *v)
+            PROGRAM_ERROR("baseline result has no samples");
+        for (v++; v < end && ']' != *v; ) {
+            char *next;
+            double x = strtod(v, &next);
+
+            if (next == v) {
+                v++;
+                continue;
+            }
+            if (r->n_samples == capacity) {
+                double *samples;
+
+                capacity = capacity ? 2 * capacity : 32;
+                if (NULL == (samples = (double *)realloc(r->samples, (size_t)capacity * sizeof(double))))
+                    PROGRAM_ERROR("unable to allocate samples");
+                r->samples = samples;
+            }
+            r->samples[r->n_samples++] = x;
+            v = next;
+        }
+        if (r->n_samples < 2)
+            PROGRAM_ERROR("baseline result needs at least two samples");
+
+        p = end + 1;
+    }
+
+    free(text);
+
+    return 0;
+
+error:
+    if (f)
+        fclose(f);
+    free(text);
+
+    return -1;
+} /* end read_json() */
+
+
+void
+usage(FILE *stream)
+{
+    fprintf(stream, "Usage: shuffle_regress [-k kernel] [-n samples] [-o out.json] [-b baseline.json] [-t threshold]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-k kernel:\n");
+    fprintf(stream, "   Only run this kernel (default: every kernel this CPU supports)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-n samples:\n");
+    fprintf(stream, "   Timed samples per configuration (default %d)\n", DEFAULT_SAMPLES);
+    fprintf(stream, "\n");
+    fprintf(stream, "-o out.json:\n");
+    fprintf(stream, "   Save the results, e.g., as a new baseline\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-b baseline.json:\n");
+    fprintf(stream, "   Compare against a saved baseline and exit nonzero on regressions\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-t threshold:\n");
+    fprintf(stream, "   Smallest median slowdown to flag, in percent (default %.0f)\n", DEFAULT_THRESHOLD);
+    fprintf(stream, "\n");
+    fprintf(stream, "Element sizes: 1 2 4 8 16 bytes. Chunk sizes: 64 KiB, 1 MiB, 16 MiB.\n");
+    fprintf(stream, "\n");
+} /* end usage() */
+
+int
+main(int argc, char *argv[])
+{
+    const shuffle_kernel_t *only_kernel = NULL;
+    const char *out_path = NULL;
+    const char *baseline_path = NULL;
+    result_list_t results = {NULL, 0, 0};
+    result_list_t baseline = {NULL, 0, 0};
+    double threshold = DEFAULT_THRESHOLD;
+    int n_samples = DEFAULT_SAMPLES;
+    int n_regressions = 0;
+    int opt;
+    size_t e, c, i;
+    int k;
+
+    /* Parse command line */
+    while ((opt = getopt(argc, argv, "k:n:o:b:t:h")) != -1) {
+        switch (opt) {
+            case 'k':
+                if (NULL == (only_kernel = shuffle_kernel_find(optarg))) {
+                    usage(stderr);
+                    PROGRAM_ERROR("unknown kernel");
+                }
+                break;
+            case 'n':
+                n_samples = atoi(optarg);
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                PROGRAM_ERROR("unknown option");
+        }
+    }
+    if (n_samples < 2 || threshold < 0.0) {
+        usage(stderr);
+        PROGRAM_ERROR("need at least two samples and a non-negative threshold");
+    }
+
+    /* Load the baseline first so a bad path fails fast */
+    if (baseline_path && read_json(baseline_path, &baseline) < 0)
+        PROGRAM_ERROR("unable to load baseline");
+
+    for (k = 0; shuffle_kernel_list[k]; k++) {
+        const shuffle_kernel_t *kernel = shuffle_kernel_list[k];
+
+        if (only_kernel && kernel != only_kernel)
+            continue;
+        if (!shuffle_kernel_supported(kernel))
+            continue;
+
+        for (e = 0; e < sizeof(suite_elem_sizes) / sizeof(suite_elem_sizes[0]); e++)
+            for (c = 0; c < sizeof(suite_chunk_sizes) / sizeof(suite_chunk_sizes[0]); c++)
+                if (bench_config(&results, kernel, suite_elem_sizes[e], suite_chunk_sizes[c], n_samples) < 0)
+                    goto error;
+    }
+
+    /* Report */
+    printf("%-12s %4s %10s %-6s %12s %12s %8s %7s  %s\n", "kernel", "size", "chunk", "op",
+            "median ns", "MiB/s", "change", "z", "status");
+    for (i = 0; i < results.n; i++) {
+        const result_t *r = &results.results[i];
+        const result_t *base = baseline_path ? find_result(&baseline, r) : NULL;
+        double m = median(r->samples, r->n_samples);
+
+        printf("%-12s %4u %10zu %-6s %12.0f %12.1f", r->kernel, r->elem_size, r->chunk_bytes,
+                r->decode ? "decode" : "encode", m, (double)r->chunk_bytes / MIB / (m * 1.0e-9));
+
+        if (base) {
+            double base_m = median(base->samples, base->n_samples);
+            double change = 100.0 * (m - base_m) / base_m;
+            double z = mann_whitney_z(base->samples, base->n_samples, r->samples, r->n_samples);
+            const char *status = "ok";
+
+            if (z > Z_CRITICAL && change > threshold) {
+                status = "REGRESSION";
+                n_regressions++;
+            }
+            else if (z < -Z_CRITICAL && change < -threshold)
+                status = "faster";
+
+            printf(" %+7.1f%% %7.2f  %s", change, z, status);
+        }
+        else if (baseline_path)
+            printf(" %8s %7s  %s", "", "", "not in baseline");
+
+        printf("\n");
+    }
+
+    if (out_path && write_json(out_path, &results) < 0)
+        PROGRAM_ERROR("unable to save results");
+
+    if (baseline_path)
+        printf("\n%d regression(s) against %s\n", n_regressions, baseline_path);
+
+    free_results(&results);
+    free_results(&baseline);
+
+    return n_regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+
+error:
+    free_results(&results);
+    free_results(&baseline);
+
+    return EXIT_FAILURE;
+} /* end main */
@@ -0,0 +1,453 @@
+/* shuffle_stats.c
+ *
+ * Per-chunk statistics (minimum, maximum, and null count) for predicate
+ * pushdown, worked out while the filter shuffles a chunk (see shuffle.h).
+ *
+ * The chunk is shuffled in cache-sized tiles: each tile's statistics are
+ * taken just before the kernel moves it into the byte planes, so the data
+ * come in from memory once for both. They are stored in a small header in
+ * front of the shuffled bytes, which the reverse filter strips again.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The HDF5 header */
+#include <hdf5.h>
+
+#include "shuffle.h"
+#include "shuffle_kernels.h"
+#include "shuffle_private.h"
+
+
+/* Local macros */
+#define STATS_TILE_BYTES        (32 * 1024)
+
+/* The chunk header, all fields little-endian:
+ *
+ *      0   magic, "SHST"
+ *      4   version (1)
+ *      5   shuffle_stats_type_t
+ *      6   bytes per element
+ *      7   reserved (0)
+ *      8   number of elements (64 bits)
+ *      16  number of nulls (64 bits)
+ *      24  min (64 bits)
+ *      32  max (64 bits)
+ */
+#define STATS_MAGIC             "SHST"
+#define STATS_VERSION           1
+
+/* Statistics of part of a chunk */
+typedef struct partial_stats_t {
+    size_t n_elements;
+    size_t n_null;
+    shuffle_stats_value_t min;
+    shuffle_stats_value_t max;
+} partial_stats_t;
+
+/* The registered callback */
+typedef struct stats_callback_t {
+    pthread_mutex_t mutex;
+    shuffle_stats_func_t func;
+    void *user_data;
+} stats_callback_t;
+
+/* Local prototypes */
+static void tile_stats(shuffle_stats_type_t type, unsigned bytes_per_elem,
+        const unsigned char *src, size_t n, const unsigned char *fill,
+        partial_stats_t *stats);
+static void merge_stats(shuffle_stats_type_t type, partial_stats_t *into,
+        const partial_stats_t *from);
+static void encode_u64(unsigned char *p, unsigned long long v);
+static unsigned long long decode_u64(const unsigned char *p);
+
+static stats_callback_t callback = {PTHREAD_MUTEX_INITIALIZER, NULL, NULL};
+
+
+herr_t
+shuffle_set_stats_callback(shuffle_stats_func_t func, void *user_data)
+{
+    pthread_mutex_lock(&callback.mutex);
+    callback.func = func;
+    callback.user_data = user_data;
+    pthread_mutex_unlock(&callback.mutex);
+
+    return 0;
+} /* end shuffle_set_stats_callback() */
+
+
+shuffle_stats_type_t
+shuffle_stats_type_of(hid_t type_id)
+{
+    H5T_class_t type_class;
+    size_t size;
+
+    if (H5T_NO_CLASS == (type_class = H5Tget_class(type_id)))
+        return SHUFFLE_STATS_NONE;
+    size = H5Tget_size(type_id);
+
+    /* Native byte order only, since the values are compared in place */
+    if (H5T_INTEGER == type_class) {
+        if (1 != size && 2 != size && 4 != size && 8 != size)
+            return SHUFFLE_STATS_NONE;
+        if (size > 1 && H5Tget_order(type_id) != H5Tget_order(H5T_NATIVE_INT))
+            return SHUFFLE_STATS_NONE;
+
+        return H5T_SGN_2 == H5Tget_sign(type_id) ? SHUFFLE_STATS_INT : SHUFFLE_STATS_UINT;
+    }
+    if (H5T_FLOAT == type_class) {
+        if (H5Tequal(type_id, H5T_NATIVE_FLOAT) > 0 || H5Tequal(type_id, H5T_NATIVE_DOUBLE) > 0)
+            return SHUFFLE_STATS_FLOAT;
+    }
+
+    return SHUFFLE_STATS_NONE;
+} /* end shuffle_stats_type_of() */
+
+
+herr_t
+shuffle_chunk_get_stats(const void *chunk, size_t nbytes, shuffle_chunk_stats_t *stats)
+{
+    const unsigned char *p = (const unsigned char *)chunk;
+
+    /* Check arguments */
+    if (NULL == chunk || NULL == stats || nbytes < SHUFFLE_STATS_HEADER_SIZE)
+        goto error;
+    if (0 != memcmp(p, STATS_MAGIC, 4) || STATS_VERSION != p[4])
+        goto error;
+    if (p[5] < SHUFFLE_STATS_INT || p[5] > SHUFFLE_STATS_FLOAT)
+        goto error;
+
+    stats->type = (shuffle_stats_type_t)p[5];
+    stats->bytes_per_elem = p[6];
+    stats->n_elements = (size_t)decode_u64(p + 8);
+    stats->n_null = (size_t)decode_u64(p + 16);
+    stats->min.u = decode_u64(p + 24);
+    stats->max.u = decode_u64(p + 32);
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_chunk_get_stats() */
+
+
+herr_t
+shuffle_chunk_with_stats(unsigned bytes_per_elem, size_t *nbytes,
+        shuffle_stats_type_t type, const unsigned char *fill, void **buf)
+{
+    const shuffle_kernel_t *kernel = shuffle_active_kernel();
+    const unsigned char *src = (const unsigned char *)*buf;
+    unsigned char *out = NULL;      /* Header, then the shuffled bytes */
+    unsigned char *dest = NULL;     /* NULL if there's nothing to shuffle */
+    size_t n_elements = *nbytes / bytes_per_elem;
+    size_t tile_elems = STATS_TILE_BYTES / bytes_per_elem;
+    long long n_tiles;
+    int team;
+    partial_stats_t total;
+    shuffle_chunk_stats_t stats;
+    shuffle_stats_func_t func;
+    void *user_data;
+
+    if (0 == tile_elems)
+        tile_elems = 1;
+    n_tiles = (long long)((n_elements + tile_elems - 1) / tile_elems);
+
+    if (NULL == (out = (unsigned char *)shuffle_malloc(SHUFFLE_STATS_HEADER_SIZE + *nbytes)))
+        goto error;
+
+    /* Single byte types and single elements aren't shuffled, see
+     * shuffle_chunk()
+     */
+    if (bytes_per_elem > 1 && n_elements > 1)
+        dest = out + SHUFFLE_STATS_HEADER_SIZE;
+
+    memset(&total, 0, sizeof(total));
+
+    /* Tiles are shared out among the threads if the plugin is a threaded
+     * one. The kernel calls inside don't start teams of their own.
+     */
+    team = kernel->threaded ? shuffle_kernel_team_begin(*nbytes) : 1;
+
+    #pragma omp parallel num_threads(team) if(team > 1)
+    {
+        partial_stats_t mine;
+        long long t;
+
+        memset(&mine, 0, sizeof(mine));
+
+        #pragma omp for schedule(static)
+        for (t = 0; t < n_tiles; t++) {
+            size_t first = (size_t)t * tile_elems;
+            size_t count = n_elements - first < tile_elems ? n_elements - first : tile_elems;
+            partial_stats_t part;
+
+            tile_stats(type, bytes_per_elem, src + first * bytes_per_elem, count, fill, &part);
+            merge_stats(type, &mine, &part);
+
+            if (dest)
+                kernel->encode(bytes_per_elem, count, n_elements,
+                        src + first * bytes_per_elem, dest + first);
+        }
+
+        #pragma omp critical
+        merge_stats(type, &total, &mine);
+    }
+
+    shuffle_kernel_team_end(team);
+
+    /* The leftover bytes sit at the end of the data in both layouts */
+    if (dest)
+        memcpy(dest + n_elements * bytes_per_elem, src + n_elements * bytes_per_elem,
+                *nbytes - n_elements * bytes_per_elem);
+    else
+        memcpy(out + SHUFFLE_STATS_HEADER_SIZE, src, *nbytes);
+
+    /* Store them in the header */
+    memcpy(out, STATS_MAGIC, 4);
+    out[4] = STATS_VERSION;
+    out[5] = (unsigned char)type;
+    out[6] = (unsigned char)bytes_per_elem;
+    out[7] = 0;
+    encode_u64(out + 8, total.n_elements);
+    encode_u64(out + 16, total.n_null);
+    encode_u64(out + 24, total.min.u);
+    encode_u64(out + 32, total.max.u);
+
+    free(*buf);
+    *buf = out;
+    *nbytes += SHUFFLE_STATS_HEADER_SIZE;
+
+    /* And report them */
+    stats.type = type;
+    stats.bytes_per_elem = bytes_per_elem;
+    stats.n_elements = total.n_elements;
+    stats.n_null = total.n_null;
+    stats.min = total.min;
+    stats.max = total.max;
+
+    pthread_mutex_lock(&callback.mutex);
+    func = callback.func;
+    user_data = callback.user_data;
+    pthread_mutex_unlock(&callback.mutex);
+
+    if (func)
+        func(&stats, user_data);
+
+    return 0;
+
+error:
+    return -1;
+} /* end shuffle_chunk_with_stats() */
+
+
+herr_t
+shuffle_unchunk_with_stats(unsigned bytes_per_elem, size_t *nbytes, void **buf)
+{
+    const unsigned char *src = (const unsigned char *)*buf;
+    unsigned char *dest = NULL;
+    size_t data_bytes;
+
+    if (*nbytes < SHUFFLE_STATS_HEADER_SIZE || 0 != memcmp(src, STATS_MAGIC, 4))
+        goto error;
+    data_bytes = *nbytes - SHUFFLE_STATS_HEADER_SIZE;
+
+    if (NULL == (dest = (unsigned char *)shuffle_malloc(data_bytes)))
+        goto error;
+    if (shuffle_into(H5Z_FLAG_REVERSE, bytes_per_elem, data_bytes,
+                src + SHUFFLE_STATS_HEADER_SIZE, dest) < 0)
+        goto error;
+
+    free(*buf);
+    *buf = dest;
+    *nbytes = data_bytes;
+
+    return 0;
+
+error:
+    free(dest);
+    return -1;
+} /* end shuffle_unchunk_with_stats() */
+
+
+static void
+encode_u64(unsigned char *p, unsigned long long v)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+} /* end encode_u64() */
+
+
+static unsigned long long
+decode_u64(const unsigned char *p)
+{
+    unsigned long long v = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        v |= (unsigned long long)p[i] << (8 * i);
+
+    return v;
+} /* end decode_u64() */
+
+
+/* Min, max, and null count of n elements. Nulls are elements bitwise equal
+ * to the fill value (if there is one) and NaNs. The loops are branch-free
+ * and marked as SIMD reductions so that they vectorize.
+ */
+#define INT_STATS(T, MEMBER, LO, HI)                                        \
+    do {                                                                    \
+        T lo = (LO);                                                        \
+        T hi = (HI);                                                        \
+        T fill_value = 0;                                                   \
+        int has_fill = NULL != fill;                                        \
+                                                                            \
+        if (has_fill)                                                       \
+            memcpy(&fill_value, fill, sizeof(T));                           \
+        _Pragma("omp simd reduction(min:lo) reduction(max:hi) reduction(+:n_null)") \
+        for (i = 0; i < n; i++) {                                           \
+            T v, v_lo, v_hi;                                                \
+            int is_null;                                                    \
+                                                                            \
+            memcpy(&v, src + i * sizeof(T), sizeof(T));                     \
+            is_null = has_fill & (v == fill_value);                         \
+            n_null += (size_t)is_null;                                      \
+            v_lo = is_null ? (LO) : v;                                      \
+            v_hi = is_null ? (HI) : v;                                      \
+            lo = v_lo < lo ? v_lo : lo;                                     \
+            hi = v_hi > hi ? v_hi : hi;                                     \
+        }                                                                   \
+        stats->min.MEMBER = lo;                                             \
+        stats->max.MEMBER = hi;                                             \
+    } while (0)
+
+#define FLOAT_STATS(T, BITS_T)                                              \
+    do {                                                                    \
+        T lo = (T)INFINITY;                                                 \
+        T hi = -(T)INFINITY;                                                \
+        BITS_T fill_bits = 0;                                               \
+        int has_fill = NULL != fill;                                        \
+                                                                            \
+        if (has_fill)                                                       \
+            memcpy(&fill_bits, fill, sizeof(T));                            \
+        _Pragma("omp simd reduction(min:lo) reduction(max:hi) reduction(+:n_null)") \
+        for (i = 0; i < n; i++) {                                           \
+            T v, v_lo, v_hi;                                                \
+            BITS_T bits;                                                    \
+            int is_null;                                                    \
+                                                                            \
+            memcpy(&v, src + i * sizeof(T), sizeof(T));                     \
+            memcpy(&bits, src + i * sizeof(T), sizeof(T));                  \
+            is_null = (v != v) | (has_fill & (bits == fill_bits));          \
+            n_null += (size_t)is_null;                                      \
+            v_lo = is_null ? (T)INFINITY : v;                               \
+            v_hi = is_null ? -(T)INFINITY : v;                              \
+            lo = v_lo < lo ? v_lo : lo;                                     \
+            hi = v_hi > hi ? v_hi : hi;                                     \
+        }                                                                   \
+        stats->min.f = (double)lo;                                          \
+        stats->max.f = (double)hi;                                          \
+    } while (0)
+
+static void
+tile_stats(shuffle_stats_type_t type, unsigned bytes_per_elem,
+        const unsigned char *src, size_t n, const unsigned char *fill,
+        partial_stats_t *stats)
+{
+    size_t n_null = 0;
+    size_t i;
+
+    if (SHUFFLE_STATS_FLOAT == type) {
+        if (4 == bytes_per_elem)
+            FLOAT_STATS(float, uint32_t);
+        else
+            FLOAT_STATS(double, uint64_t);
+    }
+    else if (SHUFFLE_STATS_INT == type) {
+        switch (bytes_per_elem) {
+            case 1: INT_STATS(int8_t, i, INT8_MAX, INT8_MIN); break;
+            case 2: INT_STATS(int16_t, i, INT16_MAX, INT16_MIN); break;
+            case 4: INT_STATS(int32_t, i, INT32_MAX, INT32_MIN); break;
+            default: INT_STATS(int64_t, i, INT64_MAX, INT64_MIN); break;
+        }
+    }
+    else {
+        switch (bytes_per_elem) {
+            case 1: INT_STATS(uint8_t, u, UINT8_MAX, 0); break;
+            case 2: INT_STATS(uint16_t, u, UINT16_MAX, 0); break;
+            case 4: INT_STATS(uint32_t, u, UINT32_MAX, 0); break;
+            default: INT_STATS(uint64_t, u, UINT64_MAX, 0); break;
+        }
+    }
+
+    stats->n_elements = n;
+    stats->n_null = n_null;
+} /* end tile_stats() */
+
+
+/* Folds from into into. Partial stats with no non-null elements carry
+ * no min or max.
+ */
+static void
+merge_stats(shuffle_stats_type_t type, partial_stats_t *into,
+        const partial_stats_t *from)
+{
+    int into_empty = into->n_null == into->n_elements;
+    int from_empty = from->n_null == from->n_elements;
+
+    if (into_empty) {
+        into->min = from->min;
+        into->max = from->max;
+    }
+    else if (!from_empty) {
+        if (SHUFFLE_STATS_FLOAT == type) {
+            into->min.f = from->min.f < into->min.f ? from->min.f : into->min.f;
+            into->max.f = from->max.f > into->max.f ? from->max.f : into->max.f;
+        }
+        else if (SHUFFLE_STATS_INT == type) {
+            into->min.i = from->min.i < into->min.i ? from->min.i : into->min.i;
+            into->max.i = from->max.i > into->max.i ? from->max.i : into->max.i;
+        }
+        else {
+            into->min.u = from->min.u < into->min.u ? from->min.u : into->min.u;
+            into->max.u = from->max.u > into->max.u ? from->max.u : into->max.u;
+        }
+    }
+
+    into->n_elements += from->n_elements;
+    into->n_null += from->n_null;
+} /* end merge_stats() */
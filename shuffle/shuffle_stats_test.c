@@ -0,0 +1,695 @@
+/* shuffle_stats_test.c
+ *
+ * Tests the per-chunk statistics. Datasets created with statistics turned on
+ * are written one chunk per H5Dwrite() to an in-memory file, and the
+ * callback has to report each chunk's min, max and null count as worked out
+ * here: for integers with a fill value, and for floats with NaNs. Chunks
+ * written in reverse through the chunk cache have to carry the same
+ * statistics in their headers, read back with H5Dread_chunk(). A dataset
+ * created without them has to keep the one-value parameter block, no
+ * header, and never call back, registering NULL has to stop the callbacks,
+ * and everything has to read back intact.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hdf5.h>
+#include <H5PLextern.h>
+
+#include "shuffle.h"
+#include "shuffle_reference.h"
+
+/* Names */
+#define TEST_FILE_NAME          "shuffle_stats_test.h5"
+#define CORE_INCREMENT          (1024 * 1024)
+
+/* Chunks span several of the filter's statistics tiles */
+#define N_CHUNKS                4
+#define CHUNK_ELEMS             10000
+#define DSET_ELEMS              (N_CHUNKS * CHUNK_ELEMS)
+
+#define INT_FILL                (-7)
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define HDF5_ERROR              do {PRINT_ERROR_MSG; goto error;} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+/* What the callback has been told */
+typedef struct seen_stats_t {
+    int n_calls;
+    shuffle_chunk_stats_t chunks[N_CHUNKS];
+} seen_stats_t;
+
+static seen_stats_t seen;
+
+/* The filter of the plugin this program is linked with */
+static H5Z_filter_t filter_id;
+
+
+static void
+record_stats(const shuffle_chunk_stats_t *stats, void *user_data)
+{
+    seen_stats_t *s = (seen_stats_t *)user_data;
+
+    if (s->n_calls < N_CHUNKS)
+        s->chunks[s->n_calls] = *stats;
+    s->n_calls++;
+} /* end record_stats() */
+
+
+/* Creates a chunked dataset with the shuffle filter, statistics turned on
+ * if asked, and no chunk cache so that each chunk goes through the filter
+ * when it is written
+ */
+static hid_t
+create_dataset(hid_t fid, const char *name, hid_t type_id, const void *fill, int with_stats)
+{
+    hid_t sid = H5I_INVALID_HID;
+    hid_t dcpl_id = H5I_INVALID_HID;
+    hid_t dapl_id = H5I_INVALID_HID;
+    hid_t did = H5I_INVALID_HID;
+    hsize_t dims[1] = {DSET_ELEMS};
+    hsize_t chunk_dims[1] = {CHUNK_ELEMS};
+    unsigned stats = SHUFFLE_STATS_ENABLE;
+
+    if (H5I_INVALID_HID == (sid = H5Screate_simple(1, dims, NULL)))
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (dcpl_id = H5Pcreate(H5P_DATASET_CREATE)))
+        HDF5_ERROR;
+    if (H5Pset_chunk(dcpl_id, 1, chunk_dims) < 0)
+        HDF5_ERROR;
+    if (fill && H5Pset_fill_value(dcpl_id, type_id, fill) < 0)
+        HDF5_ERROR;
+    if (H5Pset_filter(dcpl_id, filter_id, H5Z_FLAG_MANDATORY, with_stats ? 1 : 0, &stats) < 0)
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (dapl_id = H5Pcreate(H5P_DATASET_ACCESS)))
+        HDF5_ERROR;
+    if (H5Pset_chunk_cache(dapl_id, 0, 0, 1.0) < 0)
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (did = H5Dcreate2(fid, name, type_id, sid, H5P_DEFAULT, dcpl_id, dapl_id)))
+        HDF5_ERROR;
+
+    H5Sclose(sid);
+    H5Pclose(dcpl_id);
+    H5Pclose(dapl_id);
+
+    return did;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Sclose(sid);
+        H5Pclose(dcpl_id);
+        H5Pclose(dapl_id);
+    } H5E_END_TRY;
+
+    return H5I_INVALID_HID;
+} /* end create_dataset() */
+
+
+/* Writes data one chunk per H5Dwrite(), then reads it all back */
+static herr_t
+write_and_verify(hid_t did, hid_t type_id, const void *data)
+{
+    hid_t msid = H5I_INVALID_HID;
+    hid_t fsid = H5I_INVALID_HID;
+    hsize_t chunk_dims[1] = {CHUNK_ELEMS};
+    hsize_t start[1];
+    size_t type_size = H5Tget_size(type_id);
+    unsigned char *readback = NULL;
+    int c;
+
+    if (H5I_INVALID_HID == (msid = H5Screate_simple(1, chunk_dims, NULL)))
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (fsid = H5Dget_space(did)))
+        HDF5_ERROR;
+
+    for (c = 0; c < N_CHUNKS; c++) {
+        start[0] = (hsize_t)c * CHUNK_ELEMS;
+        if (H5Sselect_hyperslab(fsid, H5S_SELECT_SET, start, NULL, chunk_dims, NULL) < 0)
+            HDF5_ERROR;
+        if (H5Dwrite(did, type_id, msid, fsid, H5P_DEFAULT,
+                    (const unsigned char *)data + (size_t)c * CHUNK_ELEMS * type_size) < 0)
+            HDF5_ERROR;
+    }
+
+    if (NULL == (readback = (unsigned char *)malloc(DSET_ELEMS * type_size)))
+        PROGRAM_ERROR("memory allocation for readback failed");
+    if (H5Dread(did, type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, readback) < 0)
+        HDF5_ERROR;
+    if (0 != memcmp(readback, data, DSET_ELEMS * type_size))
+        PROGRAM_ERROR("data read back differs from what was written");
+
+    free(readback);
+    H5Sclose(msid);
+    H5Sclose(fsid);
+
+    return 0;
+
+error:
+    free(readback);
+    H5E_BEGIN_TRY {
+        H5Sclose(msid);
+        H5Sclose(fsid);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end write_and_verify() */
+
+
+/* Checks the statistics of one chunk against its data */
+static herr_t
+check_int_chunk(const shuffle_chunk_stats_t *stats, const int *chunk)
+{
+    size_t n_null = 0;
+    int lo = INT32_MAX;
+    int hi = INT32_MIN;
+    size_t i;
+
+    for (i = 0; i < CHUNK_ELEMS; i++) {
+        if (INT_FILL == chunk[i])
+            n_null++;
+        else {
+            lo = chunk[i] < lo ? chunk[i] : lo;
+            hi = chunk[i] > hi ? chunk[i] : hi;
+        }
+    }
+
+    if (SHUFFLE_STATS_INT != stats->type || sizeof(int) != stats->bytes_per_elem)
+        PROGRAM_ERROR("wrong type reported");
+    if (CHUNK_ELEMS != stats->n_elements || n_null != stats->n_null)
+        PROGRAM_ERROR("wrong element or null count reported");
+    if (n_null < CHUNK_ELEMS && (lo != stats->min.i || hi != stats->max.i))
+        PROGRAM_ERROR("wrong min or max reported");
+
+    return 0;
+
+error:
+    return -1;
+} /* end check_int_chunk() */
+
+
+static herr_t
+check_float_chunk(const shuffle_chunk_stats_t *stats, const float *chunk)
+{
+    size_t n_null = 0;
+    float lo = INFINITY;
+    float hi = -INFINITY;
+    size_t i;
+
+    for (i = 0; i < CHUNK_ELEMS; i++) {
+        if (isnan(chunk[i]))
+            n_null++;
+        else {
+            lo = chunk[i] < lo ? chunk[i] : lo;
+            hi = chunk[i] > hi ? chunk[i] : hi;
+        }
+    }
+
+    if (SHUFFLE_STATS_FLOAT != stats->type || sizeof(float) != stats->bytes_per_elem)
+        PROGRAM_ERROR("wrong type reported");
+    if (CHUNK_ELEMS != stats->n_elements || n_null != stats->n_null)
+        PROGRAM_ERROR("wrong element or null count reported");
+    if (n_null < CHUNK_ELEMS && ((double)lo != stats->min.f || (double)hi != stats->max.f))
+        PROGRAM_ERROR("wrong min or max reported");
+
+    return 0;
+
+error:
+    return -1;
+} /* end check_float_chunk() */
+
+
+/* Checks what the callback reported for each chunk against the data */
+static herr_t
+check_int_stats(const int *data)
+{
+    int c;
+
+    if (seen.n_calls != N_CHUNKS)
+        PROGRAM_ERROR("callback wasn't called once per chunk");
+
+    for (c = 0; c < N_CHUNKS; c++)
+        if (check_int_chunk(&seen.chunks[c], data + (size_t)c * CHUNK_ELEMS) < 0)
+            goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end check_int_stats() */
+
+
+static herr_t
+check_float_stats(const float *data)
+{
+    int c;
+
+    if (seen.n_calls != N_CHUNKS)
+        PROGRAM_ERROR("callback wasn't called once per chunk");
+
+    for (c = 0; c < N_CHUNKS; c++)
+        if (check_float_chunk(&seen.chunks[c], data + (size_t)c * CHUNK_ELEMS) < 0)
+            goto error;
+
+    return 0;
+
+error:
+    return -1;
+} /* end check_float_stats() */
+
+
+/* Integers with a fill value: scattered fill values, none, nothing but, and
+ * the extremes of the type
+ */
+static void
+make_int_data(int *data)
+{
+    size_t i;
+
+    reference_fill(data, DSET_ELEMS * sizeof(int), 42);
+    for (i = 0; i < CHUNK_ELEMS; i += 10)
+        data[i] = INT_FILL;
+    for (i = CHUNK_ELEMS; i < 2 * CHUNK_ELEMS; i++)
+        if (INT_FILL == data[i])
+            data[i] = 0;
+    for (i = 2 * CHUNK_ELEMS; i < 3 * CHUNK_ELEMS; i++)
+        data[i] = INT_FILL;
+    data[3 * CHUNK_ELEMS + 17] = INT32_MIN;
+    data[DSET_ELEMS - 1] = INT32_MAX;
+} /* end make_int_data() */
+
+
+/* Floats without a fill value, so zeros count: scattered NaNs, nothing but
+ * NaNs, and all negative
+ */
+static herr_t
+make_float_data(float *data)
+{
+    int *bits = NULL;
+    size_t i;
+
+    if (NULL == (bits = (int *)malloc(DSET_ELEMS * sizeof(int))))
+        PROGRAM_ERROR("memory allocation for bits failed");
+    reference_fill(bits, DSET_ELEMS * sizeof(int), 7);
+
+    for (i = 0; i < DSET_ELEMS; i++)
+        data[i] = (float)(bits[i] % 100000) / 64.0f;
+    for (i = 0; i < CHUNK_ELEMS; i += 7)
+        data[i] = NAN;
+    for (i = 3; i < CHUNK_ELEMS; i += 7)
+        data[i] = 0.0f;
+    for (i = CHUNK_ELEMS; i < 2 * CHUNK_ELEMS; i++)
+        data[i] = NAN;
+    for (i = 2 * CHUNK_ELEMS; i < 3 * CHUNK_ELEMS; i++)
+        data[i] = -fabsf(data[i]) - 1.0f;
+
+    free(bits);
+
+    return 0;
+
+error:
+    return -1;
+} /* end make_float_data() */
+
+
+static int
+test_int_stats(hid_t fid, const int *data)
+{
+    hid_t did = H5I_INVALID_HID;
+    int fill = INT_FILL;
+
+    printf("Testing statistics of int chunks with a fill value... ");
+
+    memset(&seen, 0, sizeof(seen));
+    shuffle_set_stats_callback(record_stats, &seen);
+
+    if (H5I_INVALID_HID == (did = create_dataset(fid, "int", H5T_NATIVE_INT, &fill, 1)))
+        goto error;
+    if (write_and_verify(did, H5T_NATIVE_INT, data) < 0)
+        goto error;
+    if (check_int_stats(data) < 0)
+        goto error;
+
+    shuffle_set_stats_callback(NULL, NULL);
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    shuffle_set_stats_callback(NULL, NULL);
+    H5E_BEGIN_TRY {
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end test_int_stats() */
+
+
+static int
+test_float_stats(hid_t fid, const float *data)
+{
+    hid_t did = H5I_INVALID_HID;
+
+    printf("Testing statistics of float chunks with NaNs... ");
+
+    memset(&seen, 0, sizeof(seen));
+    shuffle_set_stats_callback(record_stats, &seen);
+
+    if (H5I_INVALID_HID == (did = create_dataset(fid, "float", H5T_NATIVE_FLOAT, NULL, 1)))
+        goto error;
+    if (write_and_verify(did, H5T_NATIVE_FLOAT, data) < 0)
+        goto error;
+    if (check_float_stats(data) < 0)
+        goto error;
+
+    shuffle_set_stats_callback(NULL, NULL);
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    shuffle_set_stats_callback(NULL, NULL);
+    H5E_BEGIN_TRY {
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end test_float_stats() */
+
+
+/* Chunks written in reverse through the chunk cache, which writes them out
+ * when the dataset is closed. Each chunk's header, read with
+ * H5Dread_chunk(), has to hold its own statistics, and the bytes after it
+ * have to unshuffle to the chunk's data.
+ */
+static int
+test_chunk_headers(hid_t fid, const int *data)
+{
+    hid_t did = H5I_INVALID_HID;
+    hid_t msid = H5I_INVALID_HID;
+    hid_t fsid = H5I_INVALID_HID;
+    hid_t dcpl_id = H5I_INVALID_HID;
+    hid_t sid = H5I_INVALID_HID;
+    hsize_t dims[1] = {DSET_ELEMS};
+    hsize_t chunk_dims[1] = {CHUNK_ELEMS};
+    hsize_t offset[1];
+    unsigned stats_enable = SHUFFLE_STATS_ENABLE;
+    int fill = INT_FILL;
+    unsigned char *raw = NULL;
+    int *unshuffled = NULL;
+    size_t raw_size = SHUFFLE_STATS_HEADER_SIZE + CHUNK_ELEMS * sizeof(int);
+    shuffle_chunk_stats_t stats;
+    uint32_t filter_mask;
+    hsize_t stored_size;
+    int c;
+
+    printf("Testing statistics in the chunk headers... ");
+
+    if (NULL == (raw = (unsigned char *)malloc(raw_size)))
+        PROGRAM_ERROR("memory allocation for raw chunk failed");
+    if (NULL == (unshuffled = (int *)malloc(CHUNK_ELEMS * sizeof(int))))
+        PROGRAM_ERROR("memory allocation for unshuffled chunk failed");
+
+    /* The default chunk cache, big enough to hold every chunk */
+    if (H5I_INVALID_HID == (sid = H5Screate_simple(1, dims, NULL)))
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (dcpl_id = H5Pcreate(H5P_DATASET_CREATE)))
+        HDF5_ERROR;
+    if (H5Pset_chunk(dcpl_id, 1, chunk_dims) < 0)
+        HDF5_ERROR;
+    if (H5Pset_fill_value(dcpl_id, H5T_NATIVE_INT, &fill) < 0)
+        HDF5_ERROR;
+    if (H5Pset_filter(dcpl_id, filter_id, H5Z_FLAG_MANDATORY, 1, &stats_enable) < 0)
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (did = H5Dcreate2(fid, "headers", H5T_NATIVE_INT, sid, H5P_DEFAULT, dcpl_id, H5P_DEFAULT)))
+        HDF5_ERROR;
+
+    if (H5I_INVALID_HID == (msid = H5Screate_simple(1, chunk_dims, NULL)))
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (fsid = H5Dget_space(did)))
+        HDF5_ERROR;
+    for (c = N_CHUNKS - 1; c >= 0; c--) {
+        offset[0] = (hsize_t)c * CHUNK_ELEMS;
+        if (H5Sselect_hyperslab(fsid, H5S_SELECT_SET, offset, NULL, chunk_dims, NULL) < 0)
+            HDF5_ERROR;
+        if (H5Dwrite(did, H5T_NATIVE_INT, msid, fsid, H5P_DEFAULT, data + offset[0]) < 0)
+            HDF5_ERROR;
+    }
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+    did = H5I_INVALID_HID;
+
+    if (H5I_INVALID_HID == (did = H5Dopen2(fid, "headers", H5P_DEFAULT)))
+        HDF5_ERROR;
+    for (c = 0; c < N_CHUNKS; c++) {
+        offset[0] = (hsize_t)c * CHUNK_ELEMS;
+        if (H5Dget_chunk_storage_size(did, offset, &stored_size) < 0)
+            HDF5_ERROR;
+        if (raw_size != stored_size)
+            PROGRAM_ERROR("chunk wasn't stored with a header");
+        if (H5Dread_chunk(did, H5P_DEFAULT, offset, &filter_mask, raw) < 0)
+            HDF5_ERROR;
+
+        if (shuffle_chunk_get_stats(raw, raw_size, &stats) < 0)
+            PROGRAM_ERROR("couldn't read the statistics in the header");
+        if (check_int_chunk(&stats, data + offset[0]) < 0)
+            goto error;
+
+        if (shuffle_into(H5Z_FLAG_REVERSE, sizeof(int), CHUNK_ELEMS * sizeof(int),
+                    raw + SHUFFLE_STATS_HEADER_SIZE, unshuffled) < 0)
+            PROGRAM_ERROR("couldn't unshuffle the bytes after the header");
+        if (0 != memcmp(unshuffled, data + offset[0], CHUNK_ELEMS * sizeof(int)))
+            PROGRAM_ERROR("bytes after the header aren't the shuffled chunk");
+    }
+
+    /* A buffer that doesn't start with a header is turned away */
+    if (shuffle_chunk_get_stats(data, raw_size, &stats) >= 0)
+        PROGRAM_ERROR("statistics read from a chunk without a header");
+    if (shuffle_chunk_get_stats(raw, SHUFFLE_STATS_HEADER_SIZE - 1, &stats) >= 0)
+        PROGRAM_ERROR("statistics read from a truncated header");
+
+    free(raw);
+    free(unshuffled);
+    H5Sclose(msid);
+    H5Sclose(fsid);
+    H5Sclose(sid);
+    H5Pclose(dcpl_id);
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    free(raw);
+    free(unshuffled);
+    H5E_BEGIN_TRY {
+        H5Sclose(msid);
+        H5Sclose(fsid);
+        H5Sclose(sid);
+        H5Pclose(dcpl_id);
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end test_chunk_headers() */
+
+
+/* Without the opt-in the dataset keeps just the element size */
+static int
+test_default_dataset(hid_t fid, const int *data)
+{
+    hid_t did = H5I_INVALID_HID;
+    hid_t dcpl_id = H5I_INVALID_HID;
+    unsigned flags;
+    size_t cd_nelmts = 8;
+    unsigned cd_values[8];
+    hsize_t chunk_offset[1] = {0};
+    hsize_t stored_size;
+
+    printf("Testing a dataset without statistics... ");
+
+    memset(&seen, 0, sizeof(seen));
+    shuffle_set_stats_callback(record_stats, &seen);
+
+    if (H5I_INVALID_HID == (did = create_dataset(fid, "default", H5T_NATIVE_INT, NULL, 0)))
+        goto error;
+    if (H5I_INVALID_HID == (dcpl_id = H5Dget_create_plist(did)))
+        HDF5_ERROR;
+    if (H5Pget_filter_by_id(dcpl_id, filter_id, &flags, &cd_nelmts, cd_values, 0, NULL, NULL) < 0)
+        HDF5_ERROR;
+    if (1 != cd_nelmts || sizeof(int) != cd_values[0])
+        PROGRAM_ERROR("dataset without statistics stored more than the element size");
+
+    if (write_and_verify(did, H5T_NATIVE_INT, data) < 0)
+        goto error;
+    if (0 != seen.n_calls)
+        PROGRAM_ERROR("callback was called for a dataset without statistics");
+    if (H5Dget_chunk_storage_size(did, chunk_offset, &stored_size) < 0)
+        HDF5_ERROR;
+    if (CHUNK_ELEMS * sizeof(int) != stored_size)
+        PROGRAM_ERROR("chunk of a dataset without statistics has a header");
+
+    shuffle_set_stats_callback(NULL, NULL);
+    if (H5Pclose(dcpl_id) < 0)
+        HDF5_ERROR;
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    shuffle_set_stats_callback(NULL, NULL);
+    H5E_BEGIN_TRY {
+        H5Pclose(dcpl_id);
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end test_default_dataset() */
+
+
+static int
+test_unregister(hid_t fid, const int *data)
+{
+    hid_t did = H5I_INVALID_HID;
+    int fill = INT_FILL;
+
+    printf("Testing unregistering the callback... ");
+
+    memset(&seen, 0, sizeof(seen));
+    shuffle_set_stats_callback(record_stats, &seen);
+    shuffle_set_stats_callback(NULL, NULL);
+
+    if (H5I_INVALID_HID == (did = create_dataset(fid, "unregistered", H5T_NATIVE_INT, &fill, 1)))
+        goto error;
+    if (write_and_verify(did, H5T_NATIVE_INT, data) < 0)
+        goto error;
+    if (0 != seen.n_calls)
+        PROGRAM_ERROR("callback was called after it was unregistered");
+
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+
+    printf("PASSED\n");
+
+    return 0;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Dclose(did);
+    } H5E_END_TRY;
+
+    return -1;
+} /* end test_unregister() */
+
+
+int
+main(void)
+{
+    const H5Z_class2_t *cls = (const H5Z_class2_t *)H5PLget_plugin_info();
+    hid_t fapl_id = H5I_INVALID_HID;
+    hid_t fid = H5I_INVALID_HID;
+    int *int_data = NULL;
+    float *float_data = NULL;
+    int n_failed = 0;
+
+    /* Use the filter in this program rather than one found on the plugin path */
+    if (H5Zregister(cls) < 0)
+        HDF5_ERROR;
+    filter_id = cls->id;
+
+    /* An in-memory file that is never written out */
+    if (H5I_INVALID_HID == (fapl_id = H5Pcreate(H5P_FILE_ACCESS)))
+        HDF5_ERROR;
+    if (H5Pset_fapl_core(fapl_id, CORE_INCREMENT, 0) < 0)
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (fid = H5Fcreate(TEST_FILE_NAME, H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)))
+        HDF5_ERROR;
+
+    if (NULL == (int_data = (int *)malloc(DSET_ELEMS * sizeof(int))))
+        PROGRAM_ERROR("memory allocation for int data failed");
+    if (NULL == (float_data = (float *)malloc(DSET_ELEMS * sizeof(float))))
+        PROGRAM_ERROR("memory allocation for float data failed");
+    make_int_data(int_data);
+    if (make_float_data(float_data) < 0)
+        goto error;
+
+    if (test_int_stats(fid, int_data) < 0)
+        n_failed++;
+    if (test_float_stats(fid, float_data) < 0)
+        n_failed++;
+    if (test_chunk_headers(fid, int_data) < 0)
+        n_failed++;
+    if (test_default_dataset(fid, int_data) < 0)
+        n_failed++;
+    if (test_unregister(fid, int_data) < 0)
+        n_failed++;
+
+    free(int_data);
+    free(float_data);
+    if (H5Fclose(fid) < 0)
+        HDF5_ERROR;
+    if (H5Pclose(fapl_id) < 0)
+        HDF5_ERROR;
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%d test(s) FAILED\n", n_failed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+
+error:
+    free(int_data);
+    free(float_data);
+    H5E_BEGIN_TRY {
+        H5Fclose(fid);
+        H5Pclose(fapl_id);
+    } H5E_END_TRY;
+
+    return EXIT_FAILURE;
+} /* end main() */
@@ -0,0 +1,566 @@
+/* shuffle_stress.c
+ *
+ * Concurrency stress test for the shuffle plugins.
+ *
+ * Runs N threads at once, each creating its own file and dataset, writing
+ * it one chunk per H5Dwrite() call, and reading it back one chunk per
+ * H5Dread() call. Every call is timed, so besides the aggregate throughput
+ * of all the threads together the program reports the latency
+ * distribution (median, p99, p99.9, max) of a single chunk's write and
+ * read. Comparing one thread against many shows how the plugins, and their
+ * OpenMP teams nested inside the application's threads, hold up under
+ * contention.
+ *
+ * The HDF5 library holds a global lock in thread-safe builds, so calls
+ * from different threads never run the filters at the same time; what
+ * this measures is how a service built that way behaves, not the
+ * kernels' raw parallel speed (see shuffle_bench for that). A library
+ * that isn't thread-safe is run the same way, with this program taking a
+ * lock of its own around each call.
+ *
+ *
+ * Copyright (C) 2019 Dana Robinson <dana.e.robinson@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hdf5.h>
+
+/* Names */
+#define TEST_FILE_NAME  "%s/shuffle_stress_%d_thread_%d.h5"
+#define FNAME_MAX       255
+#define DSET_NAME       "filtered data"
+
+/* Defaults */
+#define DEFAULT_THREADS         4
+#define DEFAULT_CHUNKS          64
+#define DEFAULT_CHUNK_ELEMS     (256 * 1024)
+#define MIB                     ((double)1024 * 1024)
+
+/* Core driver growth increment */
+#define CORE_INCREMENT          (64 * 1024 * 1024)
+
+/* Some error macros */
+#define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
+#define HDF5_ERROR              do {PRINT_ERROR_MSG; goto error;} while (0)
+#define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
+
+/* Serializes HDF5 calls when the library isn't thread-safe */
+static int serialize_hdf5 = 0;
+static pthread_mutex_t hdf5_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* held tracks whether the caller has the lock, for its error path */
+#define HDF5_LOCK(held)         do {if (serialize_hdf5) pthread_mutex_lock(&hdf5_mutex); (held) = 1;} while (0)
+#define HDF5_UNLOCK(held)       do {if (serialize_hdf5) pthread_mutex_unlock(&hdf5_mutex); (held) = 0;} while (0)
+
+/* What every thread does */
+typedef struct stress_config_t {
+    int filter_number;
+    int gzip_level;
+    int use_core;               /* Core driver instead of files in dir */
+    const char *dir;
+    int n_chunks;               /* Per thread */
+    hsize_t chunk_elems;
+    pthread_barrier_t start;    /* Lines the threads up */
+} stress_config_t;
+
+/* One thread's results */
+typedef struct stress_thread_t {
+    pthread_t thread;
+    int index;
+    stress_config_t *config;
+    double *write_latency;      /* Seconds per chunk */
+    double *read_latency;
+    double started;
+    double finished;
+    int failed;
+} stress_thread_t;
+
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+} /* end now() */
+
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+} /* end compare_doubles() */
+
+
+/* Nearest-rank percentile of sorted samples */
+static double
+percentile(const double *sorted, size_t n, double p)
+{
+    size_t rank = (size_t)(p / 100.0 * (double)n + 0.999999);
+
+    if (rank < 1)
+        rank = 1;
+    if (rank > n)
+        rank = n;
+
+    return sorted[rank - 1];
+} /* end percentile() */
+
+
+static hid_t
+create_dcpl(const stress_config_t *config)
+{
+    hid_t dcpl_id   = H5I_INVALID_HID;
+
+    if (H5I_INVALID_HID == (dcpl_id = H5Pcreate(H5P_DATASET_CREATE)))
+        HDF5_ERROR;
+    if (H5Pset_chunk(dcpl_id, 1, &config->chunk_elems) < 0)
+        HDF5_ERROR;
+
+    if (1 == config->filter_number) {
+        if (H5Pset_shuffle(dcpl_id) < 0)
+            HDF5_ERROR;
+    }
+    else if (config->filter_number != 0) {
+        if (H5Pset_filter(dcpl_id, config->filter_number, H5Z_FLAG_MANDATORY, 0, NULL) < 0)
+            HDF5_ERROR;
+    }
+    if (config->gzip_level != 0)
+        if (H5Pset_deflate(dcpl_id, config->gzip_level) < 0)
+            HDF5_ERROR;
+
+    return dcpl_id;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Pclose(dcpl_id);
+    } H5E_END_TRY;
+
+    return H5I_INVALID_HID;
+} /* end create_dcpl() */
+
+
+/* The body of each thread. Every chunk goes through the filters in its
+ * own call: the chunk cache is turned off so a write can't be deferred to
+ * a later call (or the close).
+ */
+static void *
+stress_thread(void *arg)
+{
+    stress_thread_t *t = (stress_thread_t *)arg;
+    const stress_config_t *config = t->config;
+    char filename[FNAME_MAX];
+    hid_t fapl_id   = H5I_INVALID_HID;
+    hid_t dcpl_id   = H5I_INVALID_HID;
+    hid_t dapl_id   = H5I_INVALID_HID;
+    hid_t fid       = H5I_INVALID_HID;
+    hid_t sid       = H5I_INVALID_HID;
+    hid_t msid      = H5I_INVALID_HID;
+    hid_t did       = H5I_INVALID_HID;
+    hsize_t dset_dims = config->chunk_elems * (hsize_t)config->n_chunks;
+    int *buf        = NULL;
+    int locked      = 0;        /* Holding hdf5_mutex (or would be) */
+    int at_start    = 0;        /* Got past the barrier */
+    hsize_t j;
+    int c;
+
+    snprintf(filename, sizeof(filename), TEST_FILE_NAME, config->dir, config->filter_number, t->index);
+
+    if (NULL == (buf = (int *)malloc(config->chunk_elems * sizeof(int))))
+        PROGRAM_ERROR("memory allocation for buf failed");
+
+    /* Set everything up before the start line */
+    HDF5_LOCK(locked);
+    if (H5I_INVALID_HID == (fapl_id = H5Pcreate(H5P_FILE_ACCESS)))
+        HDF5_ERROR;
+    if (config->use_core && H5Pset_fapl_core(fapl_id, CORE_INCREMENT, 0) < 0)
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (dcpl_id = create_dcpl(config)))
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (dapl_id = H5Pcreate(H5P_DATASET_ACCESS)))
+        HDF5_ERROR;
+    if (H5Pset_chunk_cache(dapl_id, 0, 0, H5D_CHUNK_CACHE_W0_DEFAULT) < 0)
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (sid = H5Screate_simple(1, &dset_dims, NULL)))
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (msid = H5Screate_simple(1, &config->chunk_elems, NULL)))
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (fid = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id)))
+        HDF5_ERROR;
+    if (H5I_INVALID_HID == (did = H5Dcreate(fid, DSET_NAME, H5T_STD_I32LE, sid, H5P_DEFAULT, dcpl_id, dapl_id)))
+        HDF5_ERROR;
+    HDF5_UNLOCK(locked);
+
+    pthread_barrier_wait(&t->config->start);
+    at_start = 1;
+    t->started = now();
+
+    /* Write */
+    for (c = 0; c < config->n_chunks; c++) {
+        hsize_t start = (hsize_t)c * config->chunk_elems;
+        double t0;
+        herr_t status;
+
+        for (j = 0; j < config->chunk_elems; j++)
+            buf[j] = (int)(start + j) + t->index;
+
+        t0 = now();
+        HDF5_LOCK(locked);
+        if ((status = H5Sselect_hyperslab(sid, H5S_SELECT_SET, &start, NULL, &config->chunk_elems, NULL)) >= 0)
+            status = H5Dwrite(did, H5T_NATIVE_INT, msid, sid, H5P_DEFAULT, buf);
+        HDF5_UNLOCK(locked);
+        t->write_latency[c] = now() - t0;
+        if (status < 0)
+            HDF5_ERROR;
+    }
+
+    /* Read it back */
+    for (c = 0; c < config->n_chunks; c++) {
+        hsize_t start = (hsize_t)c * config->chunk_elems;
+        double t0;
+        herr_t status;
+
+        t0 = now();
+        HDF5_LOCK(locked);
+        if ((status = H5Sselect_hyperslab(sid, H5S_SELECT_SET, &start, NULL, &config->chunk_elems, NULL)) >= 0)
+            status = H5Dread(did, H5T_NATIVE_INT, msid, sid, H5P_DEFAULT, buf);
+        HDF5_UNLOCK(locked);
+        t->read_latency[c] = now() - t0;
+        if (status < 0)
+            HDF5_ERROR;
+
+        for (j = 0; j < config->chunk_elems; j++)
+            if (buf[j] != (int)(start + j) + t->index)
+                PROGRAM_ERROR("invalid data read from dataset");
+    }
+
+    t->finished = now();
+
+    /* Close everything */
+    HDF5_LOCK(locked);
+    if (H5Dclose(did) < 0)
+        HDF5_ERROR;
+    if (H5Fclose(fid) < 0)
+        HDF5_ERROR;
+    if (H5Sclose(sid) < 0)
+        HDF5_ERROR;
+    if (H5Sclose(msid) < 0)
+        HDF5_ERROR;
+    if (H5Pclose(dapl_id) < 0)
+        HDF5_ERROR;
+    if (H5Pclose(dcpl_id) < 0)
+        HDF5_ERROR;
+    if (H5Pclose(fapl_id) < 0)
+        HDF5_ERROR;
+    HDF5_UNLOCK(locked);
+
+    if (!config->use_core)
+        remove(filename);
+    free(buf);
+
+    return NULL;
+
+error:
+    /* Error case clean up, under the lock like everything else */
+    if (!locked)
+        HDF5_LOCK(locked);
+    H5E_BEGIN_TRY {
+        H5Dclose(did);
+        H5Fclose(fid);
+        H5Sclose(sid);
+        H5Sclose(msid);
+        H5Pclose(dapl_id);
+        H5Pclose(dcpl_id);
+        H5Pclose(fapl_id);
+    } H5E_END_TRY;
+    HDF5_UNLOCK(locked);
+
+    /* The others are waiting for everyone at the start line, this one
+     * included; run_filter() sees the failure after they're done
+     */
+    if (!at_start)
+        pthread_barrier_wait(&t->config->start);
+
+    free(buf);
+    t->failed = 1;
+    t->finished = now();
+
+    return NULL;
+} /* end stress_thread() */
+
+
+/* Pools every thread's samples for one direction and prints them */
+static int
+report_latency(const char *op, const stress_thread_t *threads, int n_threads, int n_chunks, int decode)
+{
+    size_t n = (size_t)n_threads * (size_t)n_chunks;
+    double *all = NULL;
+    int i;
+
+    if (NULL == (all = (double *)malloc(n * sizeof(double))))
+        return -1;
+    for (i = 0; i < n_threads; i++)
+        memcpy(all + (size_t)i * (size_t)n_chunks,
+                decode ? threads[i].read_latency : threads[i].write_latency,
+                (size_t)n_chunks * sizeof(double));
+    qsort(all, n, sizeof(double), compare_doubles);
+
+    printf("  %-5s latency ms: median %8.3f  p99 %8.3f  p99.9 %8.3f  max %8.3f\n", op,
+            1.0e3 * percentile(all, n, 50.0), 1.0e3 * percentile(all, n, 99.0),
+            1.0e3 * percentile(all, n, 99.9), 1.0e3 * all[n - 1]);
+
+    free(all);
+
+    return 0;
+} /* end report_latency() */
+
+
+/* Runs one filter with every thread at once */
+static int
+run_filter(stress_config_t *config, int n_threads)
+{
+    stress_thread_t *threads = NULL;
+    double wall_start = 0.0;
+    double wall_end = 0.0;
+    double total_mib;
+    int n_started = 0;
+    int i;
+
+    if (NULL == (threads = (stress_thread_t *)calloc((size_t)n_threads, sizeof(stress_thread_t))))
+        PROGRAM_ERROR("memory allocation for threads failed");
+    for (i = 0; i < n_threads; i++) {
+        threads[i].index = i;
+        threads[i].config = config;
+        threads[i].write_latency = (double *)calloc((size_t)config->n_chunks, sizeof(double));
+        threads[i].read_latency = (double *)calloc((size_t)config->n_chunks, sizeof(double));
+        if (NULL == threads[i].write_latency || NULL == threads[i].read_latency)
+            PROGRAM_ERROR("memory allocation for latencies failed");
+    }
+
+    /* Sized for everyone: a thread that fails during setup still waits on
+     * it from its error path, and failures are checked after the joins.
+     */
+    if (pthread_barrier_init(&config->start, NULL, (unsigned)n_threads) != 0)
+        PROGRAM_ERROR("unable to create barrier");
+    for (i = 0; i < n_threads; i++) {
+        if (pthread_create(&threads[i].thread, NULL, stress_thread, &threads[i]) != 0)
+            break;
+        n_started++;
+    }
+    if (n_started < n_threads) {
+        /* Nobody will ever get past the barrier; this can't be undone */
+        fprintf(stderr, "unable to start thread %d\n", n_started);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n_threads; i++)
+        pthread_join(threads[i].thread, NULL);
+    pthread_barrier_destroy(&config->start);
+
+    for (i = 0; i < n_threads; i++) {
+        if (threads[i].failed)
+            PROGRAM_ERROR("a thread failed");
+        if (0 == i || threads[i].started < wall_start)
+            wall_start = threads[i].started;
+        if (threads[i].finished > wall_end)
+            wall_end = threads[i].finished;
+    }
+
+    /* Each byte is written once and read once */
+    total_mib = 2.0 * (double)n_threads * (double)config->n_chunks
+            * (double)config->chunk_elems * sizeof(int) / MIB;
+
+    if (0 == config->filter_number)
+        printf("NO SHUFFLE");
+    else if (1 == config->filter_number)
+        printf("NATIVE SHUFFLE");
+    else
+        printf("SHUFFLE FILTER %d", config->filter_number);
+    if (config->gzip_level)
+        printf(" - GZIP LEVEL %d", config->gzip_level);
+    printf(": %d threads, %.3f s, %.1f MiB/s aggregate\n", n_threads, wall_end - wall_start,
+            total_mib / (wall_end - wall_start));
+
+    if (report_latency("write", threads, n_threads, config->n_chunks, 0) < 0)
+        PROGRAM_ERROR("unable to summarize write latencies");
+    if (report_latency("read", threads, n_threads, config->n_chunks, 1) < 0)
+        PROGRAM_ERROR("unable to summarize read latencies");
+
+    for (i = 0; i < n_threads; i++) {
+        free(threads[i].write_latency);
+        free(threads[i].read_latency);
+    }
+    free(threads);
+
+    return 0;
+
+error:
+    if (threads)
+        for (i = 0; i < n_threads; i++) {
+            free(threads[i].write_latency);
+            free(threads[i].read_latency);
+        }
+    free(threads);
+
+    return -1;
+} /* end run_filter() */
+
+
+void
+usage(FILE *stream)
+{
+    fprintf(stream, "Usage: shuffle_stress [-t threads] [-n chunks] [-c chunk elements] [-z gzip level] [-b backend] [-d dir] [filter # ...]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-t threads:\n");
+    fprintf(stream, "   Writer/reader threads, each with its own file (default %d)\n", DEFAULT_THREADS);
+    fprintf(stream, "\n");
+    fprintf(stream, "-n chunks:\n");
+    fprintf(stream, "   Chunks each thread writes and reads (default %d)\n", DEFAULT_CHUNKS);
+    fprintf(stream, "\n");
+    fprintf(stream, "-c chunk elements:\n");
+    fprintf(stream, "   32-bit integers per chunk (default %d)\n", DEFAULT_CHUNK_ELEMS);
+    fprintf(stream, "\n");
+    fprintf(stream, "-z gzip level:\n");
+    fprintf(stream, "   Use gzip after the shuffle (default 0, off)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-b backend:\n");
+    fprintf(stream, "   core = HDF5 core driver, in memory only (default)\n");
+    fprintf(stream, "   sec2 = Files in the -d directory, removed at the end\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "-d dir:\n");
+    fprintf(stream, "   Directory for sec2 files (default .)\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "filter #: 0 (none), 1 (native shuffle), 315-319 (default: all of them)\n");
+    fprintf(stream, "\n");
+} /* end usage() */
+
+int
+main(int argc, char *argv[])
+{
+    static const int default_filters[] = {0, 1, 315, 316, 317, 318, 319};
+    stress_config_t config;
+    int n_threads = DEFAULT_THREADS;
+    hbool_t threadsafe = 0;
+    const char *omp_threads;
+    int opt;
+    int i;
+
+    memset(&config, 0, sizeof(config));
+    config.use_core = 1;
+    config.dir = ".";
+    config.n_chunks = DEFAULT_CHUNKS;
+    config.chunk_elems = DEFAULT_CHUNK_ELEMS;
+
+    /* Parse command line */
+    while ((opt = getopt(argc, argv, "t:n:c:z:b:d:h")) != -1) {
+        switch (opt) {
+            case 't':
+                n_threads = atoi(optarg);
+                break;
+            case 'n':
+                config.n_chunks = atoi(optarg);
+                break;
+            case 'c':
+                config.chunk_elems = (hsize_t)strtoull(optarg, NULL, 10);
+                break;
+            case 'z':
+                config.gzip_level = atoi(optarg);
+                break;
+            case 'b':
+                if (0 == strcasecmp(optarg, "core"))
+                    config.use_core = 1;
+                else if (0 == strcasecmp(optarg, "sec2"))
+                    config.use_core = 0;
+                else {
+                    usage(stderr);
+                    PROGRAM_ERROR("unknown backend");
+                }
+                break;
+            case 'd':
+                config.dir = optarg;
+                break;
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                PROGRAM_ERROR("unknown option");
+        }
+    }
+    if (n_threads < 1 || config.n_chunks < 1 || config.chunk_elems < 1
+            || config.gzip_level < 0 || config.gzip_level > 9) {
+        usage(stderr);
+        PROGRAM_ERROR("invalid parameter");
+    }
+
+    if (H5is_library_threadsafe(&threadsafe) < 0)
+        HDF5_ERROR;
+    serialize_hdf5 = !threadsafe;
+
+    omp_threads = getenv("OMP_NUM_THREADS");
+    printf("%d threads x %d chunks of %.2f MiB, %s, %s HDF5, OMP_NUM_THREADS=%s\n\n",
+            n_threads, config.n_chunks, (double)config.chunk_elems * sizeof(int) / MIB,
+            config.use_core ? "core driver" : config.dir,
+            threadsafe ? "thread-safe" : "non-thread-safe (calls serialized here)",
+            omp_threads ? omp_threads : "unset");
+
+    if (optind < argc) {
+        for (i = optind; i < argc; i++) {
+            config.filter_number = atoi(argv[i]);
+            if (config.filter_number != 0 && config.filter_number != 1
+                    && (config.filter_number < 315 || config.filter_number > 319))
+                PROGRAM_ERROR("invalid filter number");
+            if (run_filter(&config, n_threads) < 0)
+                PROGRAM_ERROR("stress run failed");
+        }
+    }
+    else {
+        for (i = 0; i < (int)(sizeof(default_filters) / sizeof(default_filters[0])); i++) {
+            config.filter_number = default_filters[i];
+            if (run_filter(&config, n_threads) < 0)
+                PROGRAM_ERROR("stress run failed");
+        }
+    }
+
+    return EXIT_SUCCESS;
+
+error:
+    return EXIT_FAILURE;
+} /* end main */
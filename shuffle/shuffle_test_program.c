@@ -34,16 +34,21 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <dlfcn.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <hdf5.h>
 
 #include "shuffle.h"
 
 /* Names */
-#define TEST_FILE_NAME  "shuffle_filter_%d_gzip_level_%d.h5"
+#define TEST_FILE_NAME  "%s/shuffle_filter_%d_gzip_level_%d.h5"
 #define FNAME_MAX       255
 #define DSET_NAME       "filtered data"
 
@@ -57,11 +62,220 @@
 /* I/O size */
 #define ELEMS_PER_IO    CHUNK_DIMS
 
+/* Storage backends */
+typedef enum backend_t {
+    BACKEND_SEC2,                   /* Plain POSIX I/O (HDF5's default) */
+    BACKEND_CORE,                   /* HDF5 core driver, never touches storage */
+    BACKEND_DIRECT,                 /* O_DIRECT, bypassing the page cache */
+    BACKEND_TMPFS                   /* POSIX I/O to a memory-backed file system */
+} backend_t;
+
+#define TMPFS_DIR           "/dev/shm"
+#define CORE_INCREMENT      (64 * 1024 * 1024)
+#define DIRECT_ALIGNMENT    4096
+#define DIRECT_CBUF_SIZE    (16 * 1024 * 1024)
+
 /* Some error macros */
 #define PRINT_ERROR_MSG         do {fprintf(stderr, "***ERROR*** at line %d...\n", __LINE__);} while (0)
 #define HDF5_ERROR              do {PRINT_ERROR_MSG; goto error;} while (0)
 #define PROGRAM_ERROR(s)        do {PRINT_ERROR_MSG; fprintf(stderr, ": %s\n", (s)); goto error;} while (0)
 
+/* Where the file goes */
+static backend_t backend = BACKEND_SEC2;
+static int sync_writes = 0;
+static hid_t core_fid = H5I_INVALID_HID;    /* Held open between the phases */
+
+/* Timing the plugin's filter function */
+static H5Z_class2_t timed_class;
+static H5Z_func_t plugin_filter = NULL;
+static double filter_seconds = 0.0;
+
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+} /* end now() */
+
+
+/* Calls the plugin's filter function and adds up the time spent in it */
+static size_t
+timed_filter(unsigned int flags, size_t cd_nelmts, const unsigned int cd_values[],
+        size_t nbytes, size_t *buf_size, void **buf)
+{
+    double start = now();
+    size_t ret;
+
+    ret = plugin_filter(flags, cd_nelmts, cd_values, nbytes, buf_size, buf);
+    filter_seconds += now() - start;
+
+    return ret;
+} /* end timed_filter() */
+
+/* Loads the plugin for one of this project's filters from the plugin path
+ * ourselves and registers a copy of its filter class with the filter
+ * function wrapped in a timer. HDF5 uses a registered filter before it goes
+ * looking for plugins.
+ */
+static int
+install_timed_filter(int filter_number)
+{
+    const char *library;
+    unsigned n_paths = 0;
+    unsigned i;
+
+    switch (filter_number) {
+        case 315:   library = "libshuffle.so";              break;
+        case 316:   library = "libshuffle_noduff.so";       break;
+        case 317:   library = "libshuffle_omp.so";          break;
+        case 318:   library = "libshuffle_noduff_omp.so";   break;
+        case 319:   library = "libshuffle_blocked.so";      break;
+        default:    return -1;
+    }
+
+    if (H5PLsize(&n_paths) < 0)
+        HDF5_ERROR;
+
+    for (i = 0; i < n_paths; i++) {
+        char dir[FNAME_MAX];
+        char path[2 * FNAME_MAX];
+        const void *(*get_plugin_info)(void);
+        void *handle;
+
+        if (H5PLget(i, dir, sizeof(dir)) < 0)
+            HDF5_ERROR;
+        snprintf(path, sizeof(path), "%s/%s", dir, library);
+        if (NULL == (handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)))
+            continue;
+
+        /* The plugin stays loaded for the life of the program */
+        *(void **)&get_plugin_info = dlsym(handle, "H5PLget_plugin_info");
+        if (NULL == get_plugin_info)
+            PROGRAM_ERROR("plugin has no H5PLget_plugin_info()");
+        memcpy(&timed_class, get_plugin_info(), sizeof(timed_class));
+        plugin_filter = timed_class.filter;
+        timed_class.filter = timed_filter;
+
+        if (H5Zregister(&timed_class) < 0)
+            HDF5_ERROR;
+
+        return 0;
+    }
+
+    PROGRAM_ERROR("plugin not found in the plugin path");
+
+error:
+    return -1;
+} /* end install_timed_filter() */
+
+
+/* Opens (or creates, with H5F_ACC_TRUNC) the test file on the chosen
+ * backend. A core file only lives as long as it is open, so it is held
+ * open from creation to the end of the program and handed out again here.
+ */
+static hid_t
+open_test_file(const char *filename, unsigned flags)
+{
+    hid_t fapl_id   = H5I_INVALID_HID;
+    hid_t fid       = H5I_INVALID_HID;
+
+    if (BACKEND_CORE == backend && H5I_INVALID_HID != core_fid) {
+        if (H5Iinc_ref(core_fid) < 0)
+            HDF5_ERROR;
+        return core_fid;
+    }
+
+    if (H5I_INVALID_HID == (fapl_id = H5Pcreate(H5P_FILE_ACCESS)))
+        HDF5_ERROR;
+    switch (backend) {
+        case BACKEND_CORE:
+            if (H5Pset_fapl_core(fapl_id, CORE_INCREMENT, 0) < 0)
+                HDF5_ERROR;
+            break;
+        case BACKEND_DIRECT:
+#ifdef H5_HAVE_DIRECT
+            if (H5Pset_fapl_direct(fapl_id, DIRECT_ALIGNMENT, DIRECT_ALIGNMENT, DIRECT_CBUF_SIZE) < 0)
+                HDF5_ERROR;
+            break;
+#else
+            PROGRAM_ERROR("HDF5 was built without the direct VFD");
+#endif
+        case BACKEND_SEC2:
+        case BACKEND_TMPFS:
+        default:
+            if (H5Pset_fapl_sec2(fapl_id) < 0)
+                HDF5_ERROR;
+            break;
+    }
+
+    if (flags & H5F_ACC_TRUNC)
+        fid = H5Fcreate(filename, flags, H5P_DEFAULT, fapl_id);
+    else
+        fid = H5Fopen(filename, flags, fapl_id);
+    if (H5I_INVALID_HID == fid)
+        HDF5_ERROR;
+
+    if (BACKEND_CORE == backend) {
+        if (H5Iinc_ref(fid) < 0)
+            HDF5_ERROR;
+        core_fid = fid;
+    }
+
+    if (H5Pclose(fapl_id) < 0)
+        HDF5_ERROR;
+
+    return fid;
+
+error:
+    H5E_BEGIN_TRY {
+        H5Pclose(fapl_id);
+        H5Fclose(fid);
+    } H5E_END_TRY;
+
+    return H5I_INVALID_HID;
+} /* end open_test_file() */
+
+/* Makes sure the written data are on the device, so the storage time
+ * doesn't stop at the page cache
+ */
+static int
+sync_test_file(const char *filename)
+{
+    int fd;
+
+    if (!sync_writes || BACKEND_CORE == backend)
+        return 0;
+
+    if ((fd = open(filename, O_RDONLY)) < 0)
+        PROGRAM_ERROR("unable to open the file to sync it");
+    if (fsync(fd) < 0) {
+        close(fd);
+        PROGRAM_ERROR("fsync failed");
+    }
+    close(fd);
+
+    return 0;
+
+error:
+    return -1;
+} /* end sync_test_file() */
+
+static void
+report(const char *phase, double seconds, int filter_timed)
+{
+    double mib = (double)DSET_DIMS * sizeof(int) / (1024.0 * 1024.0);
+
+    printf("%-5s %8.3f s (%8.1f MiB/s)", phase, seconds, mib / seconds);
+    if (filter_timed)
+        printf("  filter %8.3f s  storage + HDF5 %8.3f s\n", filter_seconds, seconds - filter_seconds);
+    else
+        printf("  (built-in filter, not timed separately)\n");
+} /* end report() */
+
 
 int
 create_file(const char *filename, int filter_number, int gzip_level)
@@ -74,7 +288,7 @@ create_file(const char *filename, int filter_number, int gzip_level)
     hsize_t chunk_dims  = CHUNK_DIMS;
 
     /* Create the test file */
-    if (H5I_INVALID_HID == (fid = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)))
+    if (H5I_INVALID_HID == (fid = open_test_file(filename, H5F_ACC_TRUNC)))
         HDF5_ERROR;
 
     /* Create a simple dataspace to describe the dataset's size */
@@ -166,7 +380,7 @@ write_to_file(const char *filename)
     int i;
 
     /* Open the test file */
-    if (H5I_INVALID_HID == (fid = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT)))
+    if (H5I_INVALID_HID == (fid = open_test_file(filename, H5F_ACC_RDWR)))
         HDF5_ERROR;
 
     /* Open the dataset */
@@ -217,6 +431,9 @@ write_to_file(const char *filename)
         HDF5_ERROR;
     free(buf);
 
+    if (sync_test_file(filename) < 0)
+        PROGRAM_ERROR("Unable to sync file");
+
     return 0;
 
 error:
@@ -246,7 +463,7 @@ read_from_file(const char *filename)
     int i;
 
     /* Open the test file (read-only) */
-    if (H5I_INVALID_HID == (fid = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT)))
+    if (H5I_INVALID_HID == (fid = open_test_file(filename, H5F_ACC_RDONLY)))
         HDF5_ERROR;
 
     /* Open the dataset */
@@ -321,19 +538,32 @@ error:
 void
 usage(FILE *stream)
 {
-    fprintf(stream, "Usage: shuffle_test_program <shuffle filter #> <gzip level>\n");
+    fprintf(stream, "Usage: shuffle_test_program [-b backend] [-d dir] [-s] <shuffle filter #> <gzip level>\n");
     fprintf(stream, "\n");
     fprintf(stream, "   Both arguments are mandatory\n");
     fprintf(stream, "\n");
+    fprintf(stream, "-b <backend>:\n");
+    fprintf(stream, "   sec2 = Plain POSIX I/O, HDF5's default (default)\n");
+    fprintf(stream, "   core = HDF5 core driver, in memory only\n");
+    fprintf(stream, "   direct = O_DIRECT, bypassing the page cache (needs HDF5 built with it)\n");
+    fprintf(stream, "   tmpfs = POSIX I/O in " TMPFS_DIR " (removed at the end)\n");
+    fprintf(stream, "-d <dir>:\n");
+    fprintf(stream, "   Directory for the file (default ., or " TMPFS_DIR " for tmpfs)\n");
+    fprintf(stream, "-s:\n");
+    fprintf(stream, "   fsync the file after writing and count it as storage time\n");
+    fprintf(stream, "\n");
     fprintf(stream, "<shuffle filter #>:\n");
     fprintf(stream, "   0 = No shuffle filter\n");
     fprintf(stream, "   1 = Library shuffle filter\n");
-    fprintf(stream, "   315-8 = Shuffle filters built in this project\n");
+    fprintf(stream, "   315-9 = Shuffle filters built in this project\n");
     fprintf(stream, "\n");
     fprintf(stream, "<gzip level>:\n");
     fprintf(stream, "   0 = Don't follow shuffle with gzip\n");
     fprintf(stream, "   1-9 = Use gzip after the shuffle with compression level n\n");
     fprintf(stream, "\n");
+    fprintf(stream, "Write and read times are split into the time spent in this project's\n");
+    fprintf(stream, "filter function and the rest (HDF5, gzip if any, and the storage).\n");
+    fprintf(stream, "\n");
 } /* end usage() */
 
 int
@@ -342,19 +572,61 @@ main(int argc, char *argv[])
     int filter_number = 0;
     int filter_ok = 0;
     int gzip_level = 0;
+    int filter_timed = 0;
+    const char *dir = NULL;
     char *filename = NULL;
+    double start;
+    int opt;
 
     /* Parse command line (crudely) */
-    if (argc != 3) {
+    while ((opt = getopt(argc, argv, "b:d:sh")) != -1) {
+        switch (opt) {
+            case 'b':
+                if (0 == strcasecmp(optarg, "sec2"))
+                    backend = BACKEND_SEC2;
+                else if (0 == strcasecmp(optarg, "core"))
+                    backend = BACKEND_CORE;
+                else if (0 == strcasecmp(optarg, "direct"))
+                    backend = BACKEND_DIRECT;
+                else if (0 == strcasecmp(optarg, "tmpfs"))
+                    backend = BACKEND_TMPFS;
+                else {
+                    usage(stderr);
+                    PROGRAM_ERROR("unknown backend");
+                }
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            case 's':
+                sync_writes = 1;
+                break;
+            case 'h':
+                usage(stdout);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr);
+                PROGRAM_ERROR("unknown option");
+        }
+    }
+#ifndef H5_HAVE_DIRECT
+    if (BACKEND_DIRECT == backend)
+        PROGRAM_ERROR("HDF5 was built without the direct VFD");
+#endif
+    if (NULL == dir)
+        dir = BACKEND_TMPFS == backend ? TMPFS_DIR : ".";
+
+    if (argc - optind != 2) {
         usage(stderr);
         PROGRAM_ERROR("Incorrect number of parameters");
     }
+    argv += optind - 1;
 
     filter_number = atoi(argv[1]);
-    filter_ok = filter_number == 0 || filter_number == 1 || (filter_number >= 315 && filter_number <= 318);
+    filter_ok = filter_number == 0 || filter_number == 1 || (filter_number >= 315 && filter_number <= 319);
     if (!filter_ok) {
         usage(stderr);
-        PROGRAM_ERROR("Filters must be between 315 and 318 (inclusive). See shuffle.h for IDs.");
+        PROGRAM_ERROR("Filters must be between 315 and 319 (inclusive). See shuffle.h for IDs.");
     }
 
     gzip_level = atoi(argv[2]);
@@ -366,18 +638,39 @@ main(int argc, char *argv[])
     /* Compose the test file name */
     if (NULL == (filename = (char *)calloc(FNAME_MAX, sizeof(char))))
         PROGRAM_ERROR("Unable to allocate memory for filename");
-    if (snprintf(filename, FNAME_MAX, TEST_FILE_NAME, filter_number, gzip_level) < 0)
+    if (snprintf(filename, FNAME_MAX, TEST_FILE_NAME, dir, filter_number, gzip_level) < 0)
         PROGRAM_ERROR("Unable to compose filename");
 
+    /* Time our own filters separately */
+    if (filter_number >= 315) {
+        if (install_timed_filter(filter_number) < 0)
+            PROGRAM_ERROR("Unable to load the filter plugin");
+        filter_timed = 1;
+    }
+    else
+        filter_timed = 0 == filter_number;
+
     /* Create file, write to it, and read the data back */
     if (create_file(filename, filter_number, gzip_level) < 0)
         PROGRAM_ERROR("Unable to create file");
 
+    filter_seconds = 0.0;
+    start = now();
     if (write_to_file(filename) < 0)
         PROGRAM_ERROR("Unable to write to file");
+    report("write", now() - start, filter_timed);
 
+    filter_seconds = 0.0;
+    start = now();
     if (read_from_file(filename) < 0)
         PROGRAM_ERROR("Unable to read from file");
+    report("read", now() - start, filter_timed);
+
+    /* Let go of the core file and don't leave a big file in memory */
+    if (H5I_INVALID_HID != core_fid && H5Fclose(core_fid) < 0)
+        HDF5_ERROR;
+    if (BACKEND_TMPFS == backend)
+        remove(filename);
 
     free(filename);
 